@@ -0,0 +1,13 @@
+#version 450
+
+layout (location = 0) in vec3 inColor;
+layout (location = 1) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+layout (set = 2, binding = 0) uniform sampler2D colorTexture;
+
+void main()
+{
+    outFragColor = vec4(inColor * texture(colorTexture, inUV).rgb, 1.0f);
+}
\ No newline at end of file
@@ -1,5 +1,9 @@
 #version 450
 
+layout (constant_id = 0) const bool VERTEX_COLOR = false;
+
+layout (location = 0) out vec3 outColor;
+
 void main()
 {
     const vec3 positions[3] = vec3[3](
@@ -8,5 +12,12 @@ void main()
         vec3(-1.0f, 1.0f, 0.0f)
     );
 
+    const vec3 colors[3] = vec3[3](
+        vec3(1.0f, 0.0f, 0.0f),
+        vec3(0.0f, 1.0f, 0.0f),
+        vec3(0.0f, 0.0f, 1.0f)
+    );
+
     gl_Position = vec4(positions[gl_VertexIndex], 1.0f);
+    outColor = VERTEX_COLOR ? colors[gl_VertexIndex] : vec3(1.0f);
 }
\ No newline at end of file
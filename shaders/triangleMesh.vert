@@ -1,19 +1,70 @@
 #version 450
 
+layout (constant_id = 0) const bool VERTEX_COLOR = true;
+layout (constant_id = 1) const bool NORMAL_DEBUG = false;
+layout (constant_id = 2) const bool INSTANCING = false;
+layout (constant_id = 3) const bool OBJECT_BUFFER = false;
+// Quantized vertex formats store the normal octahedral-encoded in xy.
+layout (constant_id = 4) const bool OCT_NORMAL = false;
+
 layout (location = 0) in vec3 inPosition;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec3 inColor;
+layout (location = 3) in vec2 inUV;
 
 layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 outUV;
+
+struct ObjectData
+{
+    mat4 model;
+    vec4 sphere;
+    uvec4 draw;
+    uvec4 slots;
+};
+
+layout (std430, set = 0, binding = 0) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+} objectBuffer;
+
+// Both live in the frame allocator and are selected with dynamic offsets.
+layout (set = 1, binding = 0) uniform CameraBuffer
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+} camera;
+
+layout (std430, set = 1, binding = 1) readonly buffer InstanceBuffer
+{
+    mat4 models[];
+} instanceBuffer;
 
-layout (push_constant) uniform constants
+vec3 decodeOctahedral(vec2 encoded)
 {
-    vec4 data;
-    mat4 renderMatrix;
-} PushConstants;
+    vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float t = max(-normal.z, 0.0f);
+    normal.xy += mix(vec2(t), vec2(-t), greaterThanEqual(normal.xy, vec2(0.0f)));
+    return normalize(normal);
+}
 
 void main()
 {
-    gl_Position = PushConstants.renderMatrix * vec4(inPosition, 1.0f);
-    outColor = inColor;
+    // With OBJECT_BUFFER firstInstance selects the object; with INSTANCING
+    // each instance has a matrix written this frame.
+    mat4 model = mat4(1.0f);
+    if (OBJECT_BUFFER)
+        model = objectBuffer.objects[gl_InstanceIndex].model;
+    else if (INSTANCING)
+        model = instanceBuffer.models[gl_InstanceIndex];
+
+    gl_Position = camera.viewProjection * model * vec4(inPosition, 1.0f);
+
+    if (NORMAL_DEBUG)
+        outColor = (OCT_NORMAL ? decodeOctahedral(inNormal.xy) : inNormal) * 0.5f + 0.5f;
+    else
+        outColor = VERTEX_COLOR ? inColor : vec3(1.0f);
+
+    outUV = inUV;
 }
\ No newline at end of file
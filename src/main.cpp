@@ -1,12 +1,147 @@
 #include <vk_engine.h>
+#include <vk_obj_parser.h>
+#include <vk_offset_allocator.h>
+#include <vk_scene.h>
+#include <vk_culling.h>
+#include <vk_vertex_format.h>
+#include <vk_mesh_optimizer.h>
+#include <vk_mesh_lod.h>
+#include <vk_meshlet.h>
+#include <vk_parallel.h>
 
-int main()
+#include <iostream>
+#include <string>
+
+int main(int argc, char *argv[])
 {
 	VulkanEngine engine;
+	int recordingBenchmarkFrames = 0;
+	int deletionBenchmarkBuffers = 0;
+	int renderGraphBenchmarkCompiles = 0;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--headless")
+			engine.headless = true;
+		else if (arg == "--frames" && i + 1 < argc)
+			engine.headlessFrameCount = std::stoi(argv[++i]);
+		else if (arg == "--dump-png" && i + 1 < argc)
+		{
+			engine.dumpFormat = FrameDumpFormat::Png;
+			engine.dumpDirectory = argv[++i];
+		}
+		else if (arg == "--dump-raw" && i + 1 < argc)
+		{
+			engine.dumpFormat = FrameDumpFormat::Raw;
+			engine.dumpDirectory = argv[++i];
+		}
+		else if (arg == "--mode" && i + 1 < argc)
+			engine.selectedShader = std::stoi(argv[++i]) % SHADER_COUNT;
+		else if (arg == "--scene-grid" && i + 1 < argc)
+			engine.sceneGridSize = std::stoi(argv[++i]);
+		else if (arg == "--record-threads" && i + 1 < argc)
+			engine.recordThreadCount = std::stoul(argv[++i]);
+		else if (arg == "--profile-csv" && i + 1 < argc)
+			engine.profileCsvPath = argv[++i];
+		else if (arg == "--graph-stats")
+			engine.printGraphStats = true;
+		else if (arg == "--bench-recording" && i + 1 < argc)
+			recordingBenchmarkFrames = std::stoi(argv[++i]);
+		else if (arg == "--bench-deletion" && i + 1 < argc)
+			deletionBenchmarkBuffers = std::stoi(argv[++i]);
+		else if (arg == "--bench-render-graph" && i + 1 < argc)
+			renderGraphBenchmarkCompiles = std::stoi(argv[++i]);
+		else if (arg == "--host-visible-meshes")
+			engine.hostVisibleMeshes = true;
+		else if (arg == "--uncompressed-textures")
+			engine.compressTextures = false;
+		else if (arg == "--vertex-format" && i + 1 < argc)
+		{
+			if (!vkVertex::parse(argv[++i], engine.vertexFormat))
+			{
+				std::cout << "Unknown vertex format " << argv[i] << "; expected float32, half or unorm16" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--lod-threshold" && i + 1 < argc)
+			engine.lodPixelThreshold = std::stof(argv[++i]);
+		else if (arg == "--no-cluster-culling")
+			engine.clusterCulling = false;
+		else if (arg == "--present-mode" && i + 1 < argc)
+		{
+			if (!vkPresent::parse(argv[++i], engine.presentMode))
+			{
+				std::cout << "Unknown present mode " << argv[i] << "; expected fifo, fifo-relaxed, mailbox or immediate" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--max-queued-frames" && i + 1 < argc)
+			engine.maxQueuedFrames = std::stoul(argv[++i]);
+		else if (arg == "--bench-meshlets" && i + 1 < argc)
+		{
+			vkMeshlet::runBenchmark(std::stoul(argv[++i]));
+			return 0;
+		}
+		else if (arg == "--bench-lod" && i + 1 < argc)
+		{
+			vkMeshLod::runBenchmark(std::stoul(argv[++i]));
+			return 0;
+		}
+		else if (arg == "--bench-vertex-formats")
+		{
+			const char *paths[] = {"../assets/monkey_smooth.obj", "../assets/monkey_flat.obj"};
+			vkVertex::runReport(paths, sizeof(paths) / sizeof(paths[0]));
+			return 0;
+		}
+		else if (arg == "--bench-allocator" && i + 1 < argc)
+		{
+			OffsetAllocator::runBenchmark(std::stoul(argv[++i]));
+			return 0;
+		}
+		else if (arg == "--bench-scene" && i + 1 < argc)
+		{
+			RenderScene::runBenchmark(std::stoul(argv[++i]));
+			return 0;
+		}
+		else if (arg == "--bench-jobs" && i + 1 < argc)
+		{
+			vkParallel::runBenchmark(std::stoul(argv[++i]));
+			return 0;
+		}
+		else if (arg == "--bench-culling" && i + 1 < argc)
+		{
+			vkCull::runBenchmark(std::stoul(argv[++i]));
+			return 0;
+		}
+		else if (arg == "--bench-mesh-opt" && i + 1 < argc)
+		{
+			vkMeshOpt::runBenchmark(std::stoul(argv[++i]));
+			return 0;
+		}
+		else if (arg == "--bench-obj" && i + 1 < argc)
+		{
+			vkObj::runBenchmark(std::stoul(argv[++i]));
+			return 0;
+		}
+		else
+		{
+			std::cout << "Usage: vkPlayground [--headless] [--frames N] [--dump-png DIR | --dump-raw DIR] [--mode N] [--scene-grid N] [--record-threads N] [--bench-recording FRAMES] [--bench-deletion BUFFERS] [--bench-render-graph COMPILES] [--profile-csv FILE] [--graph-stats] [--host-visible-meshes] [--uncompressed-textures] [--vertex-format float32|half|unorm16] [--lod-threshold PIXELS] [--no-cluster-culling] [--present-mode fifo|fifo-relaxed|mailbox|immediate] [--max-queued-frames N] [--bench-vertex-formats] [--bench-obj MB] [--bench-mesh-opt COPIES] [--bench-lod OBJECTS] [--bench-meshlets OBJECTS] [--bench-allocator OPS] [--bench-scene OBJECTS] [--bench-culling OBJECTS] [--bench-jobs JOBS]" << std::endl;
+			return 1;
+		}
+	}
 
 	engine.init();	
 	
-	engine.run();	
+	if (recordingBenchmarkFrames > 0)
+		engine.runRecordingBenchmark(recordingBenchmarkFrames);
+	else if (deletionBenchmarkBuffers > 0)
+		engine.runDeletionBenchmark(deletionBenchmarkBuffers);
+	else if (renderGraphBenchmarkCompiles > 0)
+		engine.runRenderGraphBenchmark(renderGraphBenchmarkCompiles);
+	else
+		engine.run();	
 
 	engine.cleanup();	
 
@@ -0,0 +1,293 @@
+#include <vk_culling.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "glm/gtx/transform.hpp"
+
+#include "vk_parallel.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VKP_CULL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VKP_CULL_SSE2
+#endif
+
+namespace
+{
+    // Below this many spheres per job, splitting the work costs more than it saves.
+    constexpr size_t PARALLEL_CHUNK_SIZE = 64 * 1024;
+
+    // Each chunk compacts into its own slice of visible through
+    // runChunks(chunkCount, cullChunk), then the slices are packed together
+    // in order.
+    template <typename RunChunks>
+    void cullChunks(const SphereBounds &bounds, const glm::vec4 planes[6], std::vector<uint32_t> &visible, RunChunks &&runChunks)
+    {
+        const size_t count = bounds.size();
+        visible.resize(count);
+
+        const size_t chunkCount = (count + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+        std::vector<size_t> chunkVisible(chunkCount);
+        runChunks(chunkCount, [&](size_t chunk)
+                  {
+                      const size_t begin = chunk * PARALLEL_CHUNK_SIZE;
+                      const size_t end = std::min(count, begin + PARALLEL_CHUNK_SIZE);
+                      chunkVisible[chunk] = vkCull::cullSimd(bounds, planes, begin, end, visible.data() + begin); });
+
+        size_t total = chunkCount > 0 ? chunkVisible[0] : 0;
+        for (size_t chunk = 1; chunk < chunkCount; ++chunk)
+        {
+            std::memmove(visible.data() + total, visible.data() + chunk * PARALLEL_CHUNK_SIZE, chunkVisible[chunk] * sizeof(uint32_t));
+            total += chunkVisible[chunk];
+        }
+        visible.resize(total);
+    }
+}
+
+void SphereBounds::push(const glm::vec4 &sphere)
+{
+    centerX.push_back(sphere.x);
+    centerY.push_back(sphere.y);
+    centerZ.push_back(sphere.z);
+    radius.push_back(sphere.w);
+}
+
+void SphereBounds::set(size_t index, const glm::vec4 &sphere)
+{
+    centerX[index] = sphere.x;
+    centerY[index] = sphere.y;
+    centerZ[index] = sphere.z;
+    radius[index] = sphere.w;
+}
+
+glm::vec4 SphereBounds::get(size_t index) const
+{
+    return {centerX[index], centerY[index], centerZ[index], radius[index]};
+}
+
+namespace vkCull
+{
+    void extractFrustumPlanes(const glm::mat4 &m, glm::vec4 planes[6])
+    {
+        const glm::vec4 row0 = {m[0][0], m[1][0], m[2][0], m[3][0]};
+        const glm::vec4 row1 = {m[0][1], m[1][1], m[2][1], m[3][1]};
+        const glm::vec4 row2 = {m[0][2], m[1][2], m[2][2], m[3][2]};
+        const glm::vec4 row3 = {m[0][3], m[1][3], m[2][3], m[3][3]};
+
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+
+        for (int i = 0; i < 6; ++i)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    glm::vec4 transformSphere(const glm::vec4 &sphere, const glm::mat4 &transform)
+    {
+        const glm::vec3 center = transform * glm::vec4(glm::vec3(sphere), 1.0f);
+        const float scale = std::max({glm::length(glm::vec3(transform[0])),
+                                      glm::length(glm::vec3(transform[1])),
+                                      glm::length(glm::vec3(transform[2]))});
+        return glm::vec4(center, sphere.w * scale);
+    }
+
+    // The SIMD kernels evaluate the plane distance in the same order, so both
+    // paths agree bit for bit (FMA contraction stays off; see VKP_ENABLE_AVX2).
+    size_t cullScalar(const SphereBounds &bounds, const glm::vec4 planes[6], size_t begin, size_t end, uint32_t *visible)
+    {
+        size_t count = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const float x = bounds.centerX[i];
+            const float y = bounds.centerY[i];
+            const float z = bounds.centerZ[i];
+            const float negativeRadius = -bounds.radius[i];
+
+            bool inside = true;
+            for (int p = 0; p < 6; ++p)
+            {
+                const float distance = ((planes[p].x * x + planes[p].y * y) + planes[p].z * z) + planes[p].w;
+                inside &= distance >= negativeRadius;
+            }
+
+            visible[count] = (uint32_t)i;
+            count += inside;
+        }
+        return count;
+    }
+
+    size_t cullSimd(const SphereBounds &bounds, const glm::vec4 planes[6], size_t begin, size_t end, uint32_t *visible)
+    {
+        size_t count = 0;
+        size_t i = begin;
+
+#if defined(VKP_CULL_AVX2) || defined(VKP_CULL_SSE2)
+        const float *centerX = bounds.centerX.data();
+        const float *centerY = bounds.centerY.data();
+        const float *centerZ = bounds.centerZ.data();
+        const float *radius = bounds.radius.data();
+#endif
+
+#if defined(VKP_CULL_AVX2)
+        __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; ++p)
+        {
+            planeX[p] = _mm256_set1_ps(planes[p].x);
+            planeY[p] = _mm256_set1_ps(planes[p].y);
+            planeZ[p] = _mm256_set1_ps(planes[p].z);
+            planeW[p] = _mm256_set1_ps(planes[p].w);
+        }
+
+        const __m256 zero = _mm256_setzero_ps();
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256 x = _mm256_loadu_ps(centerX + i);
+            const __m256 y = _mm256_loadu_ps(centerY + i);
+            const __m256 z = _mm256_loadu_ps(centerZ + i);
+            const __m256 negativeRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(radius + i));
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                __m256 distance = _mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(planeZ[p], z));
+                distance = _mm256_add_ps(distance, planeW[p]);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+            }
+
+            const uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+            for (uint32_t lane = 0; lane < 8; ++lane)
+            {
+                visible[count] = (uint32_t)(i + lane);
+                count += (mask >> lane) & 1;
+            }
+        }
+#elif defined(VKP_CULL_SSE2)
+        __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; ++p)
+        {
+            planeX[p] = _mm_set1_ps(planes[p].x);
+            planeY[p] = _mm_set1_ps(planes[p].y);
+            planeZ[p] = _mm_set1_ps(planes[p].z);
+            planeW[p] = _mm_set1_ps(planes[p].w);
+        }
+
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= end; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(centerX + i);
+            const __m128 y = _mm_loadu_ps(centerY + i);
+            const __m128 z = _mm_loadu_ps(centerZ + i);
+            const __m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(radius + i));
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                __m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y));
+                distance = _mm_add_ps(distance, _mm_mul_ps(planeZ[p], z));
+                distance = _mm_add_ps(distance, planeW[p]);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+
+            const uint32_t mask = (uint32_t)_mm_movemask_ps(inside);
+            for (uint32_t lane = 0; lane < 4; ++lane)
+            {
+                visible[count] = (uint32_t)(i + lane);
+                count += (mask >> lane) & 1;
+            }
+        }
+#endif
+
+        return count + cullScalar(bounds, planes, i, end, visible + count);
+    }
+
+    const char *simdName()
+    {
+#if defined(VKP_CULL_AVX2)
+        return "AVX2";
+#elif defined(VKP_CULL_SSE2)
+        return "SSE2";
+#else
+        return "scalar";
+#endif
+    }
+
+    void cull(const SphereBounds &bounds, const glm::mat4 &viewProjection, std::vector<uint32_t> &visible, JobSystem &jobs)
+    {
+        glm::vec4 planes[6];
+        extractFrustumPlanes(viewProjection, planes);
+
+        cullChunks(bounds, planes, visible, [&](size_t chunkCount, const auto &cullChunk)
+                   { jobs.parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+                                      {
+                                          for (size_t chunk = begin; chunk < end; ++chunk)
+                                              cullChunk(chunk); }); });
+    }
+
+    void runBenchmark(size_t objectCount)
+    {
+        constexpr int ITERATIONS = 20;
+
+        SphereBounds bounds;
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+        std::uniform_real_distribution<float> radius(0.5f, 4.0f);
+        for (size_t i = 0; i < objectCount; ++i)
+            bounds.push({position(rng), position(rng), position(rng), radius(rng)});
+
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 450.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(glm::radians(70.0f), 1700.f / 900.0f, 0.1f, 1000.0f);
+        projection[1][1] *= -1;
+        const glm::mat4 viewProjection = projection * view;
+
+        glm::vec4 planes[6];
+        extractFrustumPlanes(viewProjection, planes);
+
+        std::vector<uint32_t> reference(objectCount);
+        std::vector<uint32_t> simd(objectCount);
+        std::vector<uint32_t> jobParallel;
+
+        JobSystem jobs;
+        jobs.init();
+
+        auto time = [&](auto &&function)
+        {
+            function();
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < ITERATIONS; ++i)
+                function();
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count() / ITERATIONS;
+        };
+
+        size_t referenceCount = 0;
+        size_t simdCount = 0;
+        const double scalarMs = time([&]()
+                                     { referenceCount = cullScalar(bounds, planes, 0, objectCount, reference.data()); });
+        const double simdMs = time([&]()
+                                   { simdCount = cullSimd(bounds, planes, 0, objectCount, simd.data()); });
+        const double jobsMs = time([&]()
+                                   { cull(bounds, viewProjection, jobParallel, jobs); });
+
+        reference.resize(referenceCount);
+        simd.resize(simdCount);
+        const bool simdMatches = simd == reference;
+        const bool jobsMatch = jobParallel == reference;
+
+        std::cout << "Frustum culling benchmark: " << objectCount << " spheres, " << referenceCount << " visible" << std::endl;
+        std::cout << "  scalar:          " << scalarMs << " ms" << std::endl;
+        std::cout << "  " << simdName() << " 1 thread:   " << simdMs << " ms (" << scalarMs / simdMs << "x), "
+                  << (simdMatches ? "matches" : "DIFFERS FROM") << " scalar" << std::endl;
+        std::cout << "  " << simdName() << " " << jobs.getThreadCount() << " job worker(s): " << jobsMs << " ms (" << scalarMs / jobsMs << "x), "
+                  << (jobsMatch ? "matches" : "DIFFERS FROM") << " scalar" << std::endl;
+    }
+}
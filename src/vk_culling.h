@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+class JobSystem;
+
+// World-space bounding spheres stored as parallel arrays, so the culling
+// kernel loads 4 or 8 of each component with a single instruction.
+struct SphereBounds
+{
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+
+    size_t size() const { return radius.size(); }
+    void push(const glm::vec4 &sphere);
+    void set(size_t index, const glm::vec4 &sphere);
+    glm::vec4 get(size_t index) const;
+};
+
+namespace vkCull
+{
+    // Gribb-Hartmann plane extraction; planes point inwards and are normalized
+    // so a sphere test can compare the signed distance against the radius.
+    void extractFrustumPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6]);
+
+    glm::vec4 transformSphere(const glm::vec4 &sphere, const glm::mat4 &transform);
+
+    // Both write the indices of the spheres in [begin, end) that touch the
+    // frustum to visible, in ascending order, and return how many there are.
+    size_t cullScalar(const SphereBounds &bounds, const glm::vec4 planes[6], size_t begin, size_t end, uint32_t *visible);
+    size_t cullSimd(const SphereBounds &bounds, const glm::vec4 planes[6], size_t begin, size_t end, uint32_t *visible);
+
+    // "AVX2", "SSE2" or "scalar", depending on the instruction set compiled in.
+    const char *simdName();
+
+    // Compacted list of visible sphere indices; large inputs are split into
+    // jobs on jobs.
+    void cull(const SphereBounds &bounds, const glm::mat4 &viewProjection, std::vector<uint32_t> &visible, JobSystem &jobs);
+
+    void runBenchmark(size_t objectCount);
+}
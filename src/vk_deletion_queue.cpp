@@ -0,0 +1,172 @@
+#include <vk_deletion_queue.h>
+
+#include <cstring>
+#include <utility>
+
+namespace
+{
+    template <typename Handle>
+    uint64_t handleBits(Handle handle)
+    {
+        static_assert(sizeof(Handle) <= sizeof(uint64_t), "Handles must fit a record");
+        uint64_t bits = 0;
+        std::memcpy(&bits, &handle, sizeof(handle));
+        return bits;
+    }
+
+    template <typename Handle>
+    Handle fromBits(uint64_t bits)
+    {
+        Handle handle;
+        std::memcpy(&handle, &bits, sizeof(handle));
+        return handle;
+    }
+}
+
+void DeletionQueue::init(VkDevice device, VmaAllocator allocator)
+{
+    this->device = device;
+    this->allocator = allocator;
+}
+
+void DeletionQueue::beginFrame(uint64_t frame)
+{
+    currentFrame = frame;
+}
+
+void DeletionQueue::retire(uint64_t completedFrame)
+{
+    size_t retired = 0;
+    while (retired < buckets.size() && buckets[retired].frame <= completedFrame)
+        destroyBucket(buckets[retired++]);
+
+    if (retired > 0)
+        buckets.erase(buckets.begin(), buckets.begin() + retired);
+}
+
+void DeletionQueue::flush()
+{
+    for (size_t i = buckets.size(); i > 0; --i)
+        destroyBucket(buckets[i - 1]);
+    buckets.clear();
+}
+
+size_t DeletionQueue::size() const
+{
+    size_t count = 0;
+    for (const Bucket &bucket : buckets)
+        count += bucket.records.size();
+    return count;
+}
+
+void DeletionQueue::push(VkBuffer buffer, VmaAllocation allocation) { pushRecord(DeletionType::Buffer, handleBits(buffer), allocation); }
+void DeletionQueue::push(VkImage image, VmaAllocation allocation) { pushRecord(DeletionType::Image, handleBits(image), allocation); }
+void DeletionQueue::push(VkImageView imageView) { pushRecord(DeletionType::ImageView, handleBits(imageView), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkSampler sampler) { pushRecord(DeletionType::Sampler, handleBits(sampler), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkFramebuffer framebuffer) { pushRecord(DeletionType::Framebuffer, handleBits(framebuffer), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkRenderPass renderPass) { pushRecord(DeletionType::RenderPass, handleBits(renderPass), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkCommandPool commandPool) { pushRecord(DeletionType::CommandPool, handleBits(commandPool), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkFence fence) { pushRecord(DeletionType::Fence, handleBits(fence), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkSemaphore semaphore) { pushRecord(DeletionType::Semaphore, handleBits(semaphore), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkPipeline pipeline) { pushRecord(DeletionType::Pipeline, handleBits(pipeline), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkPipelineLayout pipelineLayout) { pushRecord(DeletionType::PipelineLayout, handleBits(pipelineLayout), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkPipelineCache pipelineCache) { pushRecord(DeletionType::PipelineCache, handleBits(pipelineCache), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkDescriptorPool descriptorPool) { pushRecord(DeletionType::DescriptorPool, handleBits(descriptorPool), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkDescriptorSetLayout descriptorSetLayout) { pushRecord(DeletionType::DescriptorSetLayout, handleBits(descriptorSetLayout), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkShaderModule shaderModule) { pushRecord(DeletionType::ShaderModule, handleBits(shaderModule), VK_NULL_HANDLE); }
+void DeletionQueue::push(VkSwapchainKHR swapchain) { pushRecord(DeletionType::Swapchain, handleBits(swapchain), VK_NULL_HANDLE); }
+void DeletionQueue::push(VmaAllocation allocation) { pushRecord(DeletionType::Allocation, 0, allocation); }
+
+void DeletionQueue::pushRecord(DeletionType type, uint64_t handle, VmaAllocation allocation)
+{
+    if (buckets.empty() || buckets.back().frame != currentFrame)
+    {
+        if (buckets.size() == buckets.capacity())
+            ++growthCount;
+
+        if (spare.empty())
+        {
+            buckets.push_back({currentFrame, {}});
+        }
+        else
+        {
+            buckets.push_back(std::move(spare.back()));
+            spare.pop_back();
+            buckets.back().frame = currentFrame;
+        }
+    }
+
+    std::vector<DeletionRecord> &records = buckets.back().records;
+    if (records.size() == records.capacity())
+        ++growthCount;
+    records.push_back({type, handle, allocation});
+}
+
+void DeletionQueue::destroyBucket(Bucket &bucket)
+{
+    for (size_t i = bucket.records.size(); i > 0; --i)
+        destroy(bucket.records[i - 1]);
+    bucket.records.clear();
+
+    if (spare.size() == spare.capacity())
+        ++growthCount;
+    spare.push_back(std::move(bucket));
+}
+
+void DeletionQueue::destroy(const DeletionRecord &record)
+{
+    switch (record.type)
+    {
+    case DeletionType::Buffer:
+        vmaDestroyBuffer(allocator, fromBits<VkBuffer>(record.handle), record.allocation);
+        break;
+    case DeletionType::Image:
+        vmaDestroyImage(allocator, fromBits<VkImage>(record.handle), record.allocation);
+        break;
+    case DeletionType::ImageView:
+        vkDestroyImageView(device, fromBits<VkImageView>(record.handle), nullptr);
+        break;
+    case DeletionType::Sampler:
+        vkDestroySampler(device, fromBits<VkSampler>(record.handle), nullptr);
+        break;
+    case DeletionType::Framebuffer:
+        vkDestroyFramebuffer(device, fromBits<VkFramebuffer>(record.handle), nullptr);
+        break;
+    case DeletionType::RenderPass:
+        vkDestroyRenderPass(device, fromBits<VkRenderPass>(record.handle), nullptr);
+        break;
+    case DeletionType::CommandPool:
+        vkDestroyCommandPool(device, fromBits<VkCommandPool>(record.handle), nullptr);
+        break;
+    case DeletionType::Fence:
+        vkDestroyFence(device, fromBits<VkFence>(record.handle), nullptr);
+        break;
+    case DeletionType::Semaphore:
+        vkDestroySemaphore(device, fromBits<VkSemaphore>(record.handle), nullptr);
+        break;
+    case DeletionType::Pipeline:
+        vkDestroyPipeline(device, fromBits<VkPipeline>(record.handle), nullptr);
+        break;
+    case DeletionType::PipelineLayout:
+        vkDestroyPipelineLayout(device, fromBits<VkPipelineLayout>(record.handle), nullptr);
+        break;
+    case DeletionType::PipelineCache:
+        vkDestroyPipelineCache(device, fromBits<VkPipelineCache>(record.handle), nullptr);
+        break;
+    case DeletionType::DescriptorPool:
+        vkDestroyDescriptorPool(device, fromBits<VkDescriptorPool>(record.handle), nullptr);
+        break;
+    case DeletionType::DescriptorSetLayout:
+        vkDestroyDescriptorSetLayout(device, fromBits<VkDescriptorSetLayout>(record.handle), nullptr);
+        break;
+    case DeletionType::ShaderModule:
+        vkDestroyShaderModule(device, fromBits<VkShaderModule>(record.handle), nullptr);
+        break;
+    case DeletionType::Swapchain:
+        vkDestroySwapchainKHR(device, fromBits<VkSwapchainKHR>(record.handle), nullptr);
+        break;
+    case DeletionType::Allocation:
+        vmaFreeMemory(allocator, record.allocation);
+        break;
+    }
+}
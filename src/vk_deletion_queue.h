@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vk_types.h"
+
+enum class DeletionType : uint8_t
+{
+    Buffer,
+    Image,
+    ImageView,
+    Sampler,
+    Framebuffer,
+    RenderPass,
+    CommandPool,
+    Fence,
+    Semaphore,
+    Pipeline,
+    PipelineLayout,
+    PipelineCache,
+    DescriptorPool,
+    DescriptorSetLayout,
+    ShaderModule,
+    Swapchain,
+    // Memory with no buffer or image of its own, e.g. shared by aliased images.
+    Allocation,
+};
+
+struct DeletionRecord
+{
+    DeletionType type;
+    // The handle's bits; every handle type destroyed here is non-dispatchable.
+    uint64_t handle;
+    // Freed with the buffer or image, or the record itself for Allocation;
+    // null for everything else.
+    VmaAllocation allocation;
+};
+
+// Deferred destruction of Vulkan handles as plain records, without a closure
+// per handle. Handles are grouped into buckets by the frame that pushed them;
+// retire() destroys the buckets of every frame the GPU has finished, so
+// transient resources go as soon as they can instead of at shutdown. Buckets
+// and their record arrays are recycled, so once the queue has seen its
+// busiest frame, pushing and retiring never allocate.
+class DeletionQueue
+{
+    public:
+        void init(VkDevice device, VmaAllocator allocator);
+
+        // Tags everything pushed from now on with frame, which must not
+        // decrease. A queue that never begins a frame keeps everything in
+        // frame 0 until flush().
+        void beginFrame(uint64_t frame);
+        // Destroys everything pushed during completedFrame or before, newest
+        // first.
+        void retire(uint64_t completedFrame);
+        // Destroys everything, newest first.
+        void flush();
+
+        void push(VkBuffer buffer, VmaAllocation allocation);
+        void push(VkImage image, VmaAllocation allocation);
+        void push(VkImageView imageView);
+        void push(VkSampler sampler);
+        void push(VkFramebuffer framebuffer);
+        void push(VkRenderPass renderPass);
+        void push(VkCommandPool commandPool);
+        void push(VkFence fence);
+        void push(VkSemaphore semaphore);
+        void push(VkPipeline pipeline);
+        void push(VkPipelineLayout pipelineLayout);
+        void push(VkPipelineCache pipelineCache);
+        void push(VkDescriptorPool descriptorPool);
+        void push(VkDescriptorSetLayout descriptorSetLayout);
+        void push(VkShaderModule shaderModule);
+        void push(VkSwapchainKHR swapchain);
+        void push(VmaAllocation allocation);
+
+        // Handles waiting for their frame to finish.
+        size_t size() const;
+        // Times a bucket or record array had to grow; stops rising once the
+        // queue has warmed up.
+        uint64_t getGrowthCount() const { return growthCount; }
+
+    private:
+        struct Bucket
+        {
+            uint64_t frame;
+            std::vector<DeletionRecord> records;
+        };
+
+        void pushRecord(DeletionType type, uint64_t handle, VmaAllocation allocation);
+        void destroy(const DeletionRecord &record);
+        void destroyBucket(Bucket &bucket);
+
+        VkDevice device{VK_NULL_HANDLE};
+        VmaAllocator allocator{VK_NULL_HANDLE};
+
+        // Oldest frame first; retired buckets move to spare with their capacity.
+        std::vector<Bucket> buckets;
+        std::vector<Bucket> spare;
+        uint64_t currentFrame{0};
+        uint64_t growthCount{0};
+};
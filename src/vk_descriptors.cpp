@@ -0,0 +1,364 @@
+#include <vk_descriptors.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace
+{
+    constexpr uint32_t SETS_PER_POOL = 64;
+
+    // Descriptors of each type per set, on average, when sizing a new pool.
+    const std::pair<VkDescriptorType, float> POOL_RATIOS[] = {
+        {VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0.5f},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f}};
+
+    bool isBufferType(VkDescriptorType type)
+    {
+        return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+               type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    }
+
+    void writeSet(VkDevice device, VkDescriptorSet set, const std::vector<DescriptorResource> &resources)
+    {
+        std::vector<VkWriteDescriptorSet> writes;
+        writes.reserve(resources.size());
+        for (const DescriptorResource &resource : resources)
+        {
+            const bool buffer = isBufferType(resource.type);
+            writes.push_back({
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .pNext = nullptr,
+                .dstSet = set,
+                .dstBinding = resource.binding,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = resource.type,
+                .pImageInfo = buffer ? nullptr : &resource.imageInfo,
+                .pBufferInfo = buffer ? &resource.bufferInfo : nullptr,
+                .pTexelBufferView = nullptr});
+        }
+        vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+    }
+
+    template <typename T>
+    void hashCombine(size_t &seed, const T &value)
+    {
+        seed ^= std::hash<T>()(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+    }
+}
+
+void DescriptorAllocator::init(VkDevice device)
+{
+    this->device = device;
+}
+
+void DescriptorAllocator::cleanup()
+{
+    for (VkDescriptorPool pool : freePools)
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    for (VkDescriptorPool pool : usedPools)
+        vkDestroyDescriptorPool(device, pool, nullptr);
+
+    freePools.clear();
+    usedPools.clear();
+    currentPool = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool DescriptorAllocator::grabPool()
+{
+    if (!freePools.empty())
+    {
+        VkDescriptorPool pool = freePools.back();
+        freePools.pop_back();
+        return pool;
+    }
+
+    std::vector<VkDescriptorPoolSize> sizes;
+    for (const auto &[type, ratio] : POOL_RATIOS)
+        sizes.push_back({type, (uint32_t)(ratio * SETS_PER_POOL)});
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .maxSets = SETS_PER_POOL,
+        .poolSizeCount = (uint32_t)sizes.size(),
+        .pPoolSizes = sizes.data()};
+
+    VkDescriptorPool pool;
+    VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool));
+    ++stats.poolsCreated;
+    return pool;
+}
+
+bool DescriptorAllocator::allocate(VkDescriptorSetLayout layout, VkDescriptorSet *set)
+{
+    if (currentPool == VK_NULL_HANDLE)
+    {
+        currentPool = grabPool();
+        usedPools.push_back(currentPool);
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .descriptorPool = currentPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout};
+
+    VkResult result = vkAllocateDescriptorSets(device, &allocInfo, set);
+    if (result == VK_ERROR_FRAGMENTED_POOL || result == VK_ERROR_OUT_OF_POOL_MEMORY)
+    {
+        // The pool is full; retry once in a fresh one.
+        currentPool = grabPool();
+        usedPools.push_back(currentPool);
+
+        allocInfo.descriptorPool = currentPool;
+        result = vkAllocateDescriptorSets(device, &allocInfo, set);
+    }
+
+    if (result != VK_SUCCESS)
+        return false;
+
+    ++stats.setsAllocated;
+    return true;
+}
+
+void DescriptorAllocator::reset()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (VkDescriptorPool pool : usedPools)
+    {
+        vkResetDescriptorPool(device, pool, 0);
+        freePools.push_back(pool);
+    }
+    usedPools.clear();
+    currentPool = VK_NULL_HANDLE;
+
+    auto end = std::chrono::high_resolution_clock::now();
+    stats.resetMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+    ++stats.poolResets;
+}
+
+bool DescriptorLayoutCache::LayoutKey::operator==(const LayoutKey &other) const
+{
+    if (flags != other.flags || bindings.size() != other.bindings.size())
+        return false;
+
+    for (size_t i = 0; i < bindings.size(); ++i)
+    {
+        const VkDescriptorSetLayoutBinding &a = bindings[i];
+        const VkDescriptorSetLayoutBinding &b = other.bindings[i];
+        if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount ||
+            a.stageFlags != b.stageFlags || a.pImmutableSamplers != b.pImmutableSamplers)
+            return false;
+    }
+    return true;
+}
+
+size_t DescriptorLayoutCache::LayoutKeyHash::operator()(const LayoutKey &key) const
+{
+    size_t seed = key.flags;
+    for (const VkDescriptorSetLayoutBinding &binding : key.bindings)
+    {
+        hashCombine(seed, binding.binding);
+        hashCombine(seed, (uint32_t)binding.descriptorType);
+        hashCombine(seed, binding.descriptorCount);
+        hashCombine(seed, binding.stageFlags);
+    }
+    return seed;
+}
+
+void DescriptorLayoutCache::init(VkDevice device)
+{
+    this->device = device;
+}
+
+void DescriptorLayoutCache::cleanup()
+{
+    for (auto &[key, layout] : layouts)
+        vkDestroyDescriptorSetLayout(device, layout, nullptr);
+    layouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::create(const VkDescriptorSetLayoutCreateInfo &info)
+{
+    LayoutKey key = {
+        .flags = info.flags,
+        .bindings = std::vector<VkDescriptorSetLayoutBinding>(info.pBindings, info.pBindings + info.bindingCount)};
+    std::sort(key.bindings.begin(), key.bindings.end(), [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b)
+              { return a.binding < b.binding; });
+
+    auto cached = layouts.find(key);
+    if (cached != layouts.end())
+    {
+        ++stats.hits;
+        return cached->second;
+    }
+
+    VkDescriptorSetLayout layout;
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &info, nullptr, &layout));
+    layouts.emplace(std::move(key), layout);
+    ++stats.misses;
+    return layout;
+}
+
+bool DescriptorSetCache::SetKey::operator==(const SetKey &other) const
+{
+    if (layout != other.layout || resources.size() != other.resources.size())
+        return false;
+
+    for (size_t i = 0; i < resources.size(); ++i)
+    {
+        const DescriptorResource &a = resources[i];
+        const DescriptorResource &b = other.resources[i];
+        if (a.binding != b.binding || a.type != b.type ||
+            a.bufferInfo.buffer != b.bufferInfo.buffer || a.bufferInfo.offset != b.bufferInfo.offset || a.bufferInfo.range != b.bufferInfo.range ||
+            a.imageInfo.sampler != b.imageInfo.sampler || a.imageInfo.imageView != b.imageInfo.imageView || a.imageInfo.imageLayout != b.imageInfo.imageLayout)
+            return false;
+    }
+    return true;
+}
+
+size_t DescriptorSetCache::SetKeyHash::operator()(const SetKey &key) const
+{
+    size_t seed = std::hash<VkDescriptorSetLayout>()(key.layout);
+    for (const DescriptorResource &resource : key.resources)
+    {
+        hashCombine(seed, resource.binding);
+        hashCombine(seed, (uint32_t)resource.type);
+        if (isBufferType(resource.type))
+        {
+            hashCombine(seed, resource.bufferInfo.buffer);
+            hashCombine(seed, resource.bufferInfo.offset);
+            hashCombine(seed, resource.bufferInfo.range);
+        }
+        else
+        {
+            hashCombine(seed, resource.imageInfo.sampler);
+            hashCombine(seed, resource.imageInfo.imageView);
+            hashCombine(seed, (uint32_t)resource.imageInfo.imageLayout);
+        }
+    }
+    return seed;
+}
+
+void DescriptorSetCache::init(VkDevice device, DescriptorAllocator *allocator)
+{
+    this->device = device;
+    this->allocator = allocator;
+}
+
+void DescriptorSetCache::cleanup()
+{
+    // The sets themselves go away with the allocator's pools.
+    sets.clear();
+}
+
+VkDescriptorSet DescriptorSetCache::get(VkDescriptorSetLayout layout, const std::vector<DescriptorResource> &resources)
+{
+    SetKey key = {
+        .layout = layout,
+        .resources = resources};
+
+    auto cached = sets.find(key);
+    if (cached != sets.end())
+    {
+        ++stats.hits;
+        return cached->second;
+    }
+
+    VkDescriptorSet set;
+    if (!allocator->allocate(layout, &set))
+        return VK_NULL_HANDLE;
+
+    writeSet(device, set, resources);
+
+    sets.emplace(std::move(key), set);
+    ++stats.misses;
+    return set;
+}
+
+DescriptorBuilder::DescriptorBuilder(DescriptorLayoutCache &layoutCache, DescriptorSetCache &setCache)
+    : layoutCache(layoutCache), setCache(setCache)
+{
+}
+
+DescriptorBuilder &DescriptorBuilder::addBinding(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stageFlags)
+{
+    bindings.push_back({
+        .binding = binding,
+        .descriptorType = type,
+        .descriptorCount = 1,
+        .stageFlags = stageFlags,
+        .pImmutableSamplers = nullptr});
+    return *this;
+}
+
+DescriptorBuilder &DescriptorBuilder::bindBuffer(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stageFlags,
+                                                 VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+    addBinding(binding, type, stageFlags);
+    resources.push_back({
+        .binding = binding,
+        .type = type,
+        .bufferInfo = {buffer, offset, range},
+        .imageInfo = {}});
+    return *this;
+}
+
+DescriptorBuilder &DescriptorBuilder::bindImage(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stageFlags,
+                                                VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout)
+{
+    addBinding(binding, type, stageFlags);
+    resources.push_back({
+        .binding = binding,
+        .type = type,
+        .bufferInfo = {},
+        .imageInfo = {sampler, imageView, imageLayout}});
+    return *this;
+}
+
+VkDescriptorSetLayout DescriptorBuilder::buildLayout()
+{
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .bindingCount = (uint32_t)bindings.size(),
+        .pBindings = bindings.data()};
+    return layoutCache.create(layoutInfo);
+}
+
+bool DescriptorBuilder::build(VkDescriptorSet &set, VkDescriptorSetLayout &layout)
+{
+    layout = buildLayout();
+
+    std::sort(resources.begin(), resources.end(), [](const DescriptorResource &a, const DescriptorResource &b)
+              { return a.binding < b.binding; });
+    set = setCache.get(layout, resources);
+    return set != VK_NULL_HANDLE;
+}
+
+bool DescriptorBuilder::build(VkDescriptorSet &set)
+{
+    VkDescriptorSetLayout layout;
+    return build(set, layout);
+}
+
+bool DescriptorBuilder::build(DescriptorAllocator &allocator, VkDescriptorSet &set)
+{
+    if (!allocator.allocate(buildLayout(), &set))
+        return false;
+
+    writeSet(allocator.getDevice(), set, resources);
+    return true;
+}
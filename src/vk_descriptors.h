@@ -0,0 +1,154 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "vk_types.h"
+
+struct DescriptorStats
+{
+    uint32_t setsAllocated{0};
+    uint32_t poolsCreated{0};
+    uint32_t poolResets{0};
+    double resetMilliseconds{0.0};
+};
+
+struct DescriptorCacheStats
+{
+    uint32_t hits{0};
+    uint32_t misses{0};
+};
+
+// Hands out descriptor sets from a list of pools, creating another pool when
+// the current one runs out. Sets are never freed one by one; reset() recycles
+// every pool at once.
+class DescriptorAllocator
+{
+    public:
+        void init(VkDevice device);
+        void cleanup();
+
+        bool allocate(VkDescriptorSetLayout layout, VkDescriptorSet *set);
+        void reset();
+
+        VkDevice getDevice() const { return device; }
+        const DescriptorStats &getStats() const { return stats; }
+
+    private:
+        VkDescriptorPool grabPool();
+
+        VkDevice device;
+        VkDescriptorPool currentPool{VK_NULL_HANDLE};
+        std::vector<VkDescriptorPool> usedPools;
+        std::vector<VkDescriptorPool> freePools;
+
+        DescriptorStats stats;
+};
+
+// Returns the same VkDescriptorSetLayout for every create info with the same
+// bindings, so layouts can be requested wherever they are needed.
+class DescriptorLayoutCache
+{
+    public:
+        void init(VkDevice device);
+        void cleanup();
+
+        VkDescriptorSetLayout create(const VkDescriptorSetLayoutCreateInfo &info);
+
+        const DescriptorCacheStats &getStats() const { return stats; }
+
+    private:
+        struct LayoutKey
+        {
+            VkDescriptorSetLayoutCreateFlags flags;
+            // Sorted by binding number.
+            std::vector<VkDescriptorSetLayoutBinding> bindings;
+
+            bool operator==(const LayoutKey &other) const;
+        };
+
+        struct LayoutKeyHash
+        {
+            size_t operator()(const LayoutKey &key) const;
+        };
+
+        VkDevice device;
+        std::unordered_map<LayoutKey, VkDescriptorSetLayout, LayoutKeyHash> layouts;
+
+        DescriptorCacheStats stats;
+};
+
+// One resource bound to a set: buffer info for buffer types, image info for
+// image and sampler types.
+struct DescriptorResource
+{
+    uint32_t binding;
+    VkDescriptorType type;
+    VkDescriptorBufferInfo bufferInfo;
+    VkDescriptorImageInfo imageInfo;
+};
+
+// Descriptor sets keyed by their layout and bound resources. A set is written
+// once, the first time a combination is requested, and returned as is after
+// that. Sets come from a long-lived allocator that is never reset.
+class DescriptorSetCache
+{
+    public:
+        void init(VkDevice device, DescriptorAllocator *allocator);
+        void cleanup();
+
+        // resources must be sorted by binding.
+        VkDescriptorSet get(VkDescriptorSetLayout layout, const std::vector<DescriptorResource> &resources);
+
+        const DescriptorCacheStats &getStats() const { return stats; }
+
+    private:
+        struct SetKey
+        {
+            VkDescriptorSetLayout layout;
+            std::vector<DescriptorResource> resources;
+
+            bool operator==(const SetKey &other) const;
+        };
+
+        struct SetKeyHash
+        {
+            size_t operator()(const SetKey &key) const;
+        };
+
+        VkDevice device;
+        DescriptorAllocator *allocator;
+        std::unordered_map<SetKey, VkDescriptorSet, SetKeyHash> sets;
+
+        DescriptorCacheStats stats;
+};
+
+// Collects bindings and resources, then gets the layout from the layout cache
+// and the set from the set cache, or writes a new one from a short-lived
+// allocator.
+class DescriptorBuilder
+{
+    public:
+        DescriptorBuilder(DescriptorLayoutCache &layoutCache, DescriptorSetCache &setCache);
+
+        // Declares a binding without a resource, for building a layout only.
+        DescriptorBuilder &addBinding(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stageFlags);
+        DescriptorBuilder &bindBuffer(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stageFlags,
+                                      VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+        DescriptorBuilder &bindImage(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stageFlags,
+                                     VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout);
+
+        VkDescriptorSetLayout buildLayout();
+        bool build(VkDescriptorSet &set, VkDescriptorSetLayout &layout);
+        bool build(VkDescriptorSet &set);
+        // Bypasses the set cache: the set is written every call and lives
+        // until allocator is reset.
+        bool build(DescriptorAllocator &allocator, VkDescriptorSet &set);
+
+    private:
+        DescriptorLayoutCache &layoutCache;
+        DescriptorSetCache &setCache;
+
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<DescriptorResource> resources;
+};
@@ -3,6 +3,11 @@
 
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <iterator>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
@@ -14,44 +19,72 @@
 
 #include "glm/gtx/transform.hpp"
 
+#include "imgui.h"
+#include "imgui_impl_sdl.h"
+#include "imgui_impl_vulkan.h"
+
 #include <vk_types.h>
 #include <vk_initializers.h>
 
-#define VK_CHECK(x)                                        \
-    do                                                     \
-    {                                                      \
-        VkResult err = x;                                  \
-        if (err)                                           \
-        {                                                  \
-            std::cout << "Vk error: " << err << std::endl; \
-            exit(EXIT_FAILURE);                            \
-        }                                                  \
-                                                           \
-    } while (0);
+namespace
+{
+    // Instances per side of the instanced grid mode.
+    constexpr uint32_t GRID_COLUMNS = 5;
+    constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+    // The scene modes are recorded into secondary command buffers by the
+    // recording threads; everything else is drawn inline.
+    bool usesSecondaryContents(int shader)
+    {
+        return shader == 2 || shader == 3;
+    }
+}
 
 void VulkanEngine::init()
 {
-    SDL_Init(SDL_INIT_VIDEO);
+    if (!headless)
+    {
+        SDL_Init(SDL_INIT_VIDEO);
 
-    SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+        SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
 
-    window = SDL_CreateWindow(
-        "Vulkan Playground",
-        SDL_WINDOWPOS_UNDEFINED,
-        SDL_WINDOWPOS_UNDEFINED,
-        windowExtent.width,
-        windowExtent.height,
-        window_flags);
+        window = SDL_CreateWindow(
+            "Vulkan Playground",
+            SDL_WINDOWPOS_UNDEFINED,
+            SDL_WINDOWPOS_UNDEFINED,
+            windowExtent.width,
+            windowExtent.height,
+            window_flags);
+    }
 
     initVulkan();
-    initSwapchain();
+
+    if (headless)
+    {
+        initOffscreenTargets();
+    }
+    else
+    {
+        framePacer.init(device, waitForPresent, FRAME_OVERLAP);
+        framePacer.setMaxQueuedFrames(maxQueuedFrames);
+        initSwapchain();
+    }
+
+    jobs.init(recordThreadCount);
+
     initCommands();
-    initDefaultRenderpass();
-    initFramebuffers();
+    initFrameGraph();
     initSyncStructures();
+    initDescriptors();
+    initProfiler();
     initPipelines();
 
+    if (!headless)
+        initImgui();
+
     loadMeshes();
+    loadTextures();
+    initScene();
     isInitialized = true;
 }
 
@@ -59,33 +92,133 @@ void VulkanEngine::cleanup()
 {
     if (isInitialized)
     {
-        vkWaitForFences(device, 1, &renderFence, true, 1000000000);
+        vkDeviceWaitIdle(device);
+
+        jobs.cleanup();
+        printDescriptorStats();
+
+        if (headless)
+        {
+            for (FrameData &frame : frames)
+                readbackFrame(frame);
+        }
+
+        // Subsystems own their handles, so they go first and in reverse
+        // order of initialization; the queues then destroy the engine's own
+        // handles newest first.
+        gpuScene.cleanup();
+        geometryBuffer.cleanup();
+
+        pipelineVariants.cleanup();
+        shaderCache.cleanup();
+        if (!vkPipelineCache::write(device, pipelineCache, pipelineCachePath))
+            std::cout << "Failed to write pipeline cache: " << pipelineCachePath << std::endl;
+
+        if (!headless)
+        {
+            ImGui_ImplVulkan_Shutdown();
+            ImGui_ImplSDL2_Shutdown();
+            ImGui::DestroyContext();
+        }
 
+        profiler.cleanup();
+
+        frameAllocator.cleanup();
+        for (FrameData &frame : frames)
+            frame.descriptorAllocator.cleanup();
+        descriptorSetCache.cleanup();
+        descriptorAllocator.cleanup();
+        descriptorLayoutCache.cleanup();
+
+        frameGraph.cleanup();
+        uploadContext.cleanup();
+
+        if (!headless)
+            framePacer.cleanup();
+
+        retireSwapchain(frameDeletionQueue);
+        frameDeletionQueue.flush();
         mainDeletionQueue.flush();
 
         vmaDestroyAllocator(allocator);
 
         vkb::destroy_debug_utils_messenger(instance, debugMessenger);
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        if (!headless)
+            vkDestroySurfaceKHR(instance, surface, nullptr);
 
         vkDestroyDevice(device, nullptr);
         vkDestroyInstance(instance, nullptr);
 
-        SDL_DestroyWindow(window);
+        if (!headless)
+            SDL_DestroyWindow(window);
     }
 }
 
+FrameData &VulkanEngine::getCurrentFrame()
+{
+    return frames[frameNumber % FRAME_OVERLAP];
+}
+
 void VulkanEngine::draw()
 {
-    VK_CHECK(vkWaitForFences(device, 1, &renderFence, true, 10E9));
-    VK_CHECK(vkResetFences(device, 1, &renderFence));
+    FrameData &frame = getCurrentFrame();
+
+    VK_CHECK(vkWaitForFences(device, 1, &frame.renderFence, true, 10E9));
+
+    // This slot's fence covered frame frameNumber - FRAME_OVERLAP, so
+    // everything retired up to that frame is no longer in use.
+    if (frameNumber >= (int)FRAME_OVERLAP)
+        frameDeletionQueue.retire(frameNumber - FRAME_OVERLAP);
+    frameDeletionQueue.beginFrame(frameNumber);
+
+    // Rebuilt after beginFrame, so what the old graph retires waits for
+    // every frame that could still be using it.
+    if (frameGraphDirty || frameGraphIndirect != (selectedShader == 5))
+    {
+        buildFrameGraph();
+        if (printGraphStats)
+            frameGraph.printStats("Frame graph");
+    }
 
     uint32_t swapchainImageIndex;
-    VK_CHECK(vkAcquireNextImageKHR(device, swapchain, 10E9, presentSemaphore, nullptr, &swapchainImageIndex));
+    if (headless)
+    {
+        readbackFrame(frame);
+        swapchainImageIndex = frameNumber % FRAME_OVERLAP;
+    }
+    else
+    {
+        const VkResult acquireResult = vkAcquireNextImageKHR(device, swapchain, 10E9, frame.presentSemaphore, nullptr, &swapchainImageIndex);
+
+        // Nothing was acquired and the fence is still signaled, so the frame
+        // is simply retried on the new swapchain.
+        if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            swapchainDirty = true;
+            return;
+        }
 
-    VK_CHECK(vkResetCommandBuffer(commandBuffer, 0));
+        // A suboptimal image is still usable; it is rebuilt after this frame.
+        if (acquireResult == VK_SUBOPTIMAL_KHR)
+            swapchainDirty = true;
+        else
+            VK_CHECK(acquireResult);
+    }
+
+    VK_CHECK(vkResetFences(device, 1, &frame.renderFence));
+    frame.descriptorAllocator.reset();
+    if (!frameSetBuilder().build(frame.descriptorAllocator, frameSet))
+        std::cout << "Failed to allocate the frame descriptor set" << std::endl;
+
+    auto cpuStart = std::chrono::high_resolution_clock::now();
+    const uint32_t frameIndex = frameNumber % FRAME_OVERLAP;
+    frameAllocator.beginFrame(frameIndex);
+    frameDraws = 0;
+    frameTriangles = 0;
 
-    VkCommandBuffer cmd = commandBuffer;
+    VK_CHECK(vkResetCommandBuffer(frame.mainCommandBuffer, 0));
+
+    VkCommandBuffer cmd = frame.mainCommandBuffer;
     VkCommandBufferBeginInfo cmdBeginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .pNext = nullptr,
@@ -94,107 +227,381 @@ void VulkanEngine::draw()
 
     VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
-    VkClearValue clearValue{
-        .color = {0.0f, 0.0f, abs(sin(frameNumber / 120.f))}};
+    profiler.beginFrame(cmd, frameIndex, frameNumber);
+    const uint32_t frameZone = profiler.beginZone(cmd, "Frame");
 
-    VkRenderPassBeginInfo rpInfo = {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .pNext = nullptr,
-        .renderPass = renderPass,
-        .framebuffer = framebuffers[swapchainImageIndex],
-        .renderArea{.offset{.x = 0, .y = 0}, .extent = windowExtent},
-        .clearValueCount = 1,
-        .pClearValues = &clearValue};
-
-    vkCmdBeginRenderPass(cmd, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    if (selectedShader == 0)
+    if (!headless)
     {
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, trianglePipeline);
-        vkCmdDraw(cmd, 3, 1, 0, 0);
-    }
-    else if (selectedShader == 1)
-    {   
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, coloredTrianglePipeline);
-        vkCmdDraw(cmd, 3, 1, 0, 0);
+        ImGui_ImplVulkan_NewFrame();
+        ImGui_ImplSDL2_NewFrame(window);
+        ImGui::NewFrame();
+        if (showOverlay)
+        {
+            profiler.drawOverlay();
+            framePacer.drawOverlay(activePresentMode);
+        }
+        ImGui::Render();
     }
-    else if (selectedShader == 2)
+
+    const float angle = glm::radians(frameNumber * 0.2f);
+    glm::vec3 sceneCamPos = {std::sin(angle) * 30.0f, 12.0f, std::cos(angle) * 30.0f};
+    glm::mat4 sceneView = glm::lookAt(sceneCamPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 sceneProjection = glm::perspective(glm::radians(70.0f), (float)windowExtent.width / windowExtent.height, 0.1f, 200.0f);
+    sceneProjection[1][1] *= -1;
+    glm::mat4 sceneViewProjection = sceneProjection * sceneView;
+
+    // The instanced grid has a fixed camera of its own and rotates each
+    // instance individually through the frame allocator.
+    GpuCameraData cameraData = {
+        .view = sceneView,
+        .projection = sceneProjection,
+        .viewProjection = sceneViewProjection};
+
+    if (selectedShader == 4)
     {
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+        cameraData.view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -12.0f));
+        cameraData.viewProjection = cameraData.projection * cameraData.view;
 
-        VkDeviceSize offset = 0;
-        vkCmdBindVertexBuffers(cmd, 0, 1, &monkeyMesh.vertexBuffer.buffer, &offset);
+        FrameAllocation<glm::mat4> instances = frameAllocator.allocate<glm::mat4>(GRID_COLUMNS * GRID_COLUMNS);
+        if (instances.data)
+        {
+            const glm::mat4 dequantize = monkeyMesh.getDequantizeTransform();
+            for (uint32_t i = 0; i < GRID_COLUMNS * GRID_COLUMNS; ++i)
+            {
+                const glm::vec2 cell = glm::vec2(i % GRID_COLUMNS, i / GRID_COLUMNS) - 0.5f * (GRID_COLUMNS - 1);
+                instances.data[i] = glm::translate(glm::mat4(1.0f), glm::vec3(cell.x * 2.5f, 0.0f, cell.y * 2.5f)) *
+                                    glm::rotate(glm::mat4(1.0f), glm::radians(frameNumber * 0.4f + i * 15.0f), glm::vec3(0, 1, 0)) * dequantize;
+            }
+            frameSetOffsets[1] = instances.offset;
+        }
+    }
 
-        glm::vec3 camPos = {0.0f, 0.0f, -2.0f};
-        glm::mat4 view = glm::translate(glm::mat4(1.0f), camPos);
-        glm::mat4 projection = glm::perspective(glm::radians(70.0f), 1700.f / 900.0f, 0.1f, 200.0f);
-        projection[1][1] *= -1;
-        glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(frameNumber * 0.4f), glm::vec3(0, 1, 0));
-        glm::mat4 meshMatrix = projection * view * model;
+    FrameAllocation<GpuCameraData> camera = frameAllocator.allocate<GpuCameraData>();
+    if (camera.data)
+    {
+        *camera.data = cameraData;
+        frameSetOffsets[0] = camera.offset;
+    }
 
-        MeshPushConstants constants = {
-            .renderMatrix = meshMatrix};
+    frameViewProjection = sceneViewProjection;
+    frameCameraPosition = sceneCamPos;
 
-        vkCmdPushConstants(cmd, meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
-        vkCmdDraw(cmd, monkeyMesh.vertices.size(), 1, 0, 0);
-    }
+    VkClearValue clearValue{
+        .color = {0.0f, 0.0f, abs(sin(frameNumber / 120.f))}};
+    frameGraph.setClearValue(backbuffer, clearValue);
+    frameGraph.setSubpassContents(mainPass, usesSecondaryContents(selectedShader) ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdEndRenderPass(cmd);
+    // Dynamic state set outside the render pass, since secondary contents
+    // leave no room for it inside.
+    setViewport(cmd);
+    frameGraph.execute(cmd, swapchainImageIndex, frameIndex);
 
+    profiler.endZone(cmd, frameZone);
     VK_CHECK(vkEndCommandBuffer(cmd));
 
+    frameAllocator.endFrame();
+
+    auto cpuEnd = std::chrono::high_resolution_clock::now();
+    profiler.endFrame(frameIndex, std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count(), frameDraws, frameTriangles);
+
+    if (headless)
+    {
+        VkSubmitInfo submit = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = nullptr,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmd};
+
+        VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, frame.renderFence));
+
+        ++frameNumber;
+        return;
+    }
+
     VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
     VkSubmitInfo submit = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .pNext = nullptr,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &presentSemaphore,
+        .pWaitSemaphores = &frame.presentSemaphore,
         .pWaitDstStageMask = &waitStage,
         .commandBufferCount = 1,
         .pCommandBuffers = &cmd,
         .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &renderSemaphore};
+        .pSignalSemaphores = &frame.renderSemaphore};
 
-    VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, renderFence));
+    VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, frame.renderFence));
+
+    const uint64_t presentId = framePacer.markPresent(frame.renderFence);
+    VkPresentIdKHR presentIdInfo = {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+        .pNext = nullptr,
+        .swapchainCount = 1,
+        .pPresentIds = &presentId};
 
     VkPresentInfoKHR presentInfo = {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-        .pNext = nullptr,
+        .pNext = presentId != 0 ? &presentIdInfo : nullptr,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &renderSemaphore,
+        .pWaitSemaphores = &frame.renderSemaphore,
         .swapchainCount = 1,
         .pSwapchains = &swapchain,
         .pImageIndices = &swapchainImageIndex};
 
-    VK_CHECK(vkQueuePresentKHR(graphicsQueue, &presentInfo));
+    const VkResult presentResult = vkQueuePresentKHR(graphicsQueue, &presentInfo);
+    if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+        swapchainDirty = true;
+    else
+        VK_CHECK(presentResult);
 
     ++frameNumber;
 }
 
 void VulkanEngine::run()
 {
+    if (headless)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (int i = 0; i < headlessFrameCount; ++i)
+            draw();
+
+        vkDeviceWaitIdle(device);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << "Rendered " << headlessFrameCount << " headless frames in " << seconds << " s ("
+                  << headlessFrameCount / seconds << " fps)" << std::endl;
+        return;
+    }
+
     SDL_Event e;
     bool bQuit = false;
 
     while (!bQuit)
     {
+        // Input is sampled only once the queue is under its cap, so the
+        // frame it drives is presented as soon after it as the cap allows.
+        framePacer.waitForQueue();
+
         while (SDL_PollEvent(&e) != 0)
         {
+            ImGui_ImplSDL2_ProcessEvent(&e);
+
             if (e.type == SDL_QUIT)
                 bQuit = true;
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                swapchainDirty = true;
             else if (e.type == SDL_KEYDOWN)
             {
                 if (e.key.keysym.sym == SDLK_SPACE)
-                    ++selectedShader;
-                    if(selectedShader > 2)
-                        selectedShader = 0;
+                    selectedShader = (selectedShader + 1) % SHADER_COUNT;
+                else if (e.key.keysym.sym == SDLK_F1)
+                    showOverlay = !showOverlay;
+                else if (e.key.keysym.sym == SDLK_F2)
+                {
+                    presentMode = vkPresent::next(presentMode);
+                    swapchainDirty = true;
+                }
+                else if (e.key.keysym.sym == SDLK_F3)
+                    framePacer.setMaxQueuedFrames(framePacer.getMaxQueuedFrames() > 0 ? 0 : 1);
             }
         }
+        framePacer.markInput();
+
+        // A minimized window has nothing to present to; sleep until the next
+        // event instead of spinning.
+        if (SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED)
+        {
+            SDL_WaitEvent(nullptr);
+            continue;
+        }
+
+        if (swapchainDirty)
+            recreateSwapchain();
         draw();
     }
 }
 
+void VulkanEngine::runRecordingBenchmark(int frameCount)
+{
+    VK_CHECK(vkDeviceWaitIdle(device));
+
+    // Every object, unculled, so the draw count is the whole scene.
+    std::vector<uint32_t> allObjects(scene.getObjectCount());
+    std::iota(allObjects.begin(), allObjects.end(), 0);
+
+    scene.buildDrawList(allObjects, {0.0f, 12.0f, 30.0f}, 200.0f);
+
+    std::cout << "Recording benchmark: " << scene.drawItems.size() << " draws, " << frameCount << " frames per thread count" << std::endl;
+
+    FrameData &frame = frames[0];
+    double singleThreadMs = 0.0;
+    for (uint32_t threadCount = 1;; threadCount = std::min(threadCount * 2, jobs.getThreadCount()))
+    {
+        const VkFramebuffer framebuffer = frameGraph.getFramebuffer(mainPass, 0);
+        recordDrawList(frame, framebuffer, threadCount);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        uint32_t secondaryCount = 0;
+        for (int i = 0; i < frameCount; ++i)
+            secondaryCount = recordDrawList(frame, framebuffer, threadCount);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        const double ms = std::chrono::duration<double, std::milli>(end - start).count() / frameCount;
+        if (threadCount == 1)
+            singleThreadMs = ms;
+
+        std::cout << "  " << threadCount << " thread(s), " << secondaryCount << " secondary buffer(s): " << ms << " ms/frame ("
+                  << singleThreadMs / ms << "x)" << std::endl;
+
+        if (threadCount == jobs.getThreadCount())
+            break;
+    }
+}
+
+void VulkanEngine::runDeletionBenchmark(int buffersPerFrame)
+{
+    constexpr int FRAME_COUNT = 1000;
+    // By then every bucket and record array has reached its steady-state size.
+    constexpr int WARMUP_FRAMES = FRAME_OVERLAP + 2;
+
+    VK_CHECK(vkDeviceWaitIdle(device));
+
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = nullptr,
+        .size = 256,
+        .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT};
+
+    VmaAllocationCreateInfo allocInfo = {
+        .usage = VMA_MEMORY_USAGE_CPU_TO_GPU};
+
+    std::cout << "Deletion benchmark: " << buffersPerFrame << " transient buffers per frame, " << FRAME_COUNT << " frames" << std::endl;
+
+    double pushMs = 0.0;
+    double retireMs = 0.0;
+    uint64_t warmGrowthCount = 0;
+    size_t peakPending = 0;
+    std::vector<AllocatedBuffer> buffers(buffersPerFrame);
+
+    for (int i = 0; i < FRAME_COUNT; ++i)
+    {
+        FrameData &frame = getCurrentFrame();
+        VK_CHECK(vkWaitForFences(device, 1, &frame.renderFence, true, 10E9));
+        VK_CHECK(vkResetFences(device, 1, &frame.renderFence));
+
+        auto retireStart = std::chrono::high_resolution_clock::now();
+        if (frameNumber >= (int)FRAME_OVERLAP)
+            frameDeletionQueue.retire(frameNumber - FRAME_OVERLAP);
+        frameDeletionQueue.beginFrame(frameNumber);
+        auto retireEnd = std::chrono::high_resolution_clock::now();
+
+        if (i == WARMUP_FRAMES)
+            warmGrowthCount = frameDeletionQueue.getGrowthCount();
+
+        for (AllocatedBuffer &buffer : buffers)
+            VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, nullptr));
+
+        auto pushStart = std::chrono::high_resolution_clock::now();
+        for (const AllocatedBuffer &buffer : buffers)
+            frameDeletionQueue.push(buffer.buffer, buffer.allocation);
+        auto pushEnd = std::chrono::high_resolution_clock::now();
+
+        peakPending = std::max(peakPending, frameDeletionQueue.size());
+
+        // Stands in for the frame's work: the fence signals once everything
+        // submitted before it has finished.
+        VK_CHECK(vkQueueSubmit(graphicsQueue, 0, nullptr, frame.renderFence));
+        ++frameNumber;
+
+        if (i >= WARMUP_FRAMES)
+        {
+            retireMs += std::chrono::duration<double, std::milli>(retireEnd - retireStart).count();
+            pushMs += std::chrono::duration<double, std::milli>(pushEnd - pushStart).count();
+        }
+    }
+
+    VK_CHECK(vkDeviceWaitIdle(device));
+
+    const double handles = double(FRAME_COUNT - WARMUP_FRAMES) * buffersPerFrame;
+    std::cout << "  push: " << pushMs * 1e6 / handles << " ns/handle, retire: " << retireMs * 1e6 / handles << " ns/handle (including vmaDestroyBuffer)" << std::endl;
+    std::cout << "  " << peakPending << " handles pending at most, " << frameDeletionQueue.getGrowthCount() - warmGrowthCount
+              << " queue allocations after warm-up (" << warmGrowthCount << " during)" << std::endl;
+}
+
+void VulkanEngine::runRenderGraphBenchmark(int compileCount)
+{
+    VK_CHECK(vkDeviceWaitIdle(device));
+
+    // Nothing is ever executed, so what the graph retires can be destroyed
+    // right after.
+    DeletionQueue retired;
+    retired.init(device, allocator);
+
+    RenderGraph graph;
+    graph.init(device, physicalDevice, allocator, &retired, nullptr);
+
+    std::cout << "Render graph benchmark: " << compileCount << " compiles at " << windowExtent.width << "x" << windowExtent.height << std::endl;
+
+    double compileMs = 0.0;
+    for (int i = 0; i < compileCount; ++i)
+    {
+        graph.reset();
+
+        // A deferred frame: the G-buffer and lighting share a render pass,
+        // bloom runs in compute, and the debug view feeds no output and is
+        // culled.
+        const RenderResource back = graph.importImage("Backbuffer", swapchainImageFormat, windowExtent, swapchainImages, swapchainImageViews,
+                                                      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        graph.markOutput(back, headless ? ResourceUsage::TransferSrc : ResourceUsage::Present);
+        const RenderResource albedo = graph.createImage("Albedo", VK_FORMAT_R8G8B8A8_UNORM, windowExtent);
+        const RenderResource normals = graph.createImage("Normals", VK_FORMAT_A2B10G10R10_UNORM_PACK32, windowExtent);
+        const RenderResource depth = graph.createImage("Depth", DEPTH_FORMAT, windowExtent);
+        const RenderResource hdr = graph.createImage("HDR", VK_FORMAT_R16G16B16A16_SFLOAT, windowExtent);
+        const RenderResource bloom = graph.createImage("Bloom", VK_FORMAT_R16G16B16A16_SFLOAT, windowExtent);
+        const RenderResource blur = graph.createImage("Blur", VK_FORMAT_R16G16B16A16_SFLOAT, windowExtent);
+        const RenderResource debug = graph.createImage("Debug", VK_FORMAT_R8G8B8A8_UNORM, windowExtent);
+
+        graph.addPass("GBuffer", PassType::Graphics)
+            .writeColor(albedo, AttachmentLoad::Clear)
+            .writeColor(normals, AttachmentLoad::Clear)
+            .writeDepth(depth, AttachmentLoad::Clear);
+        graph.addPass("Lighting", PassType::Graphics)
+            .read(albedo, ResourceUsage::InputAttachment)
+            .read(normals, ResourceUsage::InputAttachment)
+            .read(depth, ResourceUsage::InputAttachment)
+            .writeColor(hdr, AttachmentLoad::DontCare);
+        graph.addPass("Bloom", PassType::Compute)
+            .read(hdr, ResourceUsage::SampledCompute)
+            .write(bloom, ResourceUsage::StorageWrite);
+        graph.addPass("Blur", PassType::Compute)
+            .read(bloom, ResourceUsage::SampledCompute)
+            .write(blur, ResourceUsage::StorageWrite);
+        graph.addPass("Tonemap", PassType::Graphics)
+            .read(hdr, ResourceUsage::SampledFragment)
+            .read(blur, ResourceUsage::SampledFragment)
+            .writeColor(back, AttachmentLoad::DontCare);
+        graph.addPass("Debug view", PassType::Graphics)
+            .read(normals, ResourceUsage::SampledFragment)
+            .writeColor(debug, AttachmentLoad::Clear);
+
+        if (!graph.compile())
+        {
+            std::cout << "  Failed to compile the graph" << std::endl;
+            break;
+        }
+        compileMs += graph.getStats().compileMilliseconds;
+    }
+
+    graph.printStats("  Deferred graph");
+    std::cout << "  " << compileMs / std::max(compileCount, 1) << " ms per compile" << std::endl;
+
+    graph.cleanup();
+    retired.flush();
+}
+
 void VulkanEngine::initVulkan()
 {
     vkb::InstanceBuilder builder;
@@ -202,6 +609,7 @@ void VulkanEngine::initVulkan()
     auto inst_ret = builder.set_app_name("Vulkan Playground")
                         .request_validation_layers(true)
                         .require_api_version(1, 1, 0)
+                        .set_headless(headless)
                         .use_default_debug_messenger()
                         .build();
 
@@ -209,41 +617,129 @@ void VulkanEngine::initVulkan()
     instance = vkb_instance.instance;
     debugMessenger = vkb_instance.debug_messenger;
 
-    SDL_Vulkan_CreateSurface(window, instance, &surface);
-
     vkb::PhysicalDeviceSelector selector{vkb_instance};
-    vkb::PhysicalDevice pd = selector
-                                 .set_minimum_version(1, 1)
+    selector.set_minimum_version(1, 1);
+    selector.set_required_features({
+        .multiDrawIndirect = VK_TRUE,
+        .drawIndirectFirstInstance = VK_TRUE});
+    selector.add_desired_extension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
 
-                                 .set_surface(surface)
-                                 .select()
-                                 .value();
+    if (headless)
+    {
+        selector.require_present(false);
+    }
+    else
+    {
+        selector.add_desired_extension(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        selector.add_desired_extension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        SDL_Vulkan_CreateSurface(window, instance, &surface);
+        selector.set_surface(surface);
+    }
+
+    vkb::PhysicalDevice pd = selector.select().value();
+    std::cout << "Using device: " << pd.properties.deviceName << std::endl;
+
+    // Enabled on top of the required features when present; without it
+    // textures stay uncompressed.
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(pd.physical_device, &supportedFeatures);
+    pd.features.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    compressTextures = compressTextures && supportedFeatures.textureCompressionBC;
+
+    physicalDevice = pd.physical_device;
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+    bool hasDrawIndirectCount = false;
+    uint32_t presentWaitExtensions = 0;
+    for (const VkExtensionProperties &extension : extensions)
+    {
+        if (std::strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+            hasDrawIndirectCount = true;
+        else if (std::strcmp(extension.extensionName, VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0 ||
+                 std::strcmp(extension.extensionName, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0)
+            ++presentWaitExtensions;
+    }
+
+    // Present wait needs both extensions and their features; without it
+    // latency is estimated from the render fences.
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+        .pNext = nullptr};
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+        .pNext = &presentWaitFeatures};
+
+    bool hasPresentWait = false;
+    if (!headless && presentWaitExtensions == 2)
+    {
+        VkPhysicalDeviceFeatures2 features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &presentIdFeatures};
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+        hasPresentWait = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+    }
 
     vkb::DeviceBuilder deviceBuilder{pd};
+    if (hasPresentWait)
+    {
+        presentIdFeatures.pNext = nullptr;
+        deviceBuilder.add_pNext(&presentIdFeatures);
+        deviceBuilder.add_pNext(&presentWaitFeatures);
+    }
     vkb::Device vkbDevice = deviceBuilder.build().value();
 
     device = vkbDevice.device;
-    physicalDevice = pd.physical_device;
+
+    if (hasDrawIndirectCount)
+        drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+    if (hasPresentWait)
+        waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
 
     graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
     graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+    auto dedicatedTransferQueue = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer);
+    if (dedicatedTransferQueue)
+    {
+        transferQueue = dedicatedTransferQueue.value();
+        transferQueueFamily = vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+    }
+    else
+    {
+        transferQueue = graphicsQueue;
+        transferQueueFamily = graphicsQueueFamily;
+    }
+
     VmaAllocatorCreateInfo allocatorInfo = {
         .physicalDevice = physicalDevice,
         .device = device,
         .instance = instance};
 
     vmaCreateAllocator(&allocatorInfo, &allocator);
+
+    mainDeletionQueue.init(device, allocator);
+    frameDeletionQueue.init(device, allocator);
+
+    uploadContext.init(device, allocator, transferQueueFamily, transferQueue, 32 * 1024 * 1024);
 }
 
-void VulkanEngine::initSwapchain()
+void VulkanEngine::initSwapchain(VkSwapchainKHR oldSwapchain)
 {
+    activePresentMode = vkPresent::select(physicalDevice, surface, presentMode);
+    if (activePresentMode != presentMode)
+        std::cout << "Present mode " << vkPresent::name(presentMode) << " is unsupported, using " << vkPresent::name(activePresentMode) << std::endl;
+
     vkb::SwapchainBuilder swapchainBuilder{physicalDevice, device, surface};
 
     vkb::Swapchain vkbSwapchain = swapchainBuilder
                                       .use_default_format_selection()
-                                      .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+                                      .set_desired_present_mode(activePresentMode)
                                       .set_desired_extent(windowExtent.width, windowExtent.height)
+                                      .set_old_swapchain(oldSwapchain)
                                       .build()
                                       .value();
 
@@ -251,265 +747,526 @@ void VulkanEngine::initSwapchain()
     swapchainImages = vkbSwapchain.get_images().value();
     swapchainImageViews = vkbSwapchain.get_image_views().value();
     swapchainImageFormat = vkbSwapchain.image_format;
+    // The surface has the final say, e.g. on high-DPI displays.
+    windowExtent = vkbSwapchain.extent;
 
-    mainDeletionQueue.pushFunction([=]()
-                                   { vkDestroySwapchainKHR(device, swapchain, nullptr); });
+    framePacer.setSwapchain(swapchain);
 }
 
-void VulkanEngine::initCommands()
+void VulkanEngine::recreateSwapchain()
 {
-    VkCommandPoolCreateInfo commandPoolInfo = vkInit::commandPoolCreateInfo(graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-
-    VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &commandPool));
-
-    VkCommandBufferAllocateInfo cmdAllocInfo = vkInit::commandBufferAllocateInfo(commandPool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-    VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &commandBuffer));
+    int width = 0;
+    int height = 0;
+    SDL_Vulkan_GetDrawableSize(window, &width, &height);
+    if (width == 0 || height == 0)
+        return;
+
+    // Frames in flight may still render to the old images, so they go
+    // through the frame deletion queue instead of waiting for the device to
+    // idle. The old swapchain stays alive long enough to be passed on.
+    retireSwapchain(frameDeletionQueue);
+
+    windowExtent = {(uint32_t)width, (uint32_t)height};
+    initSwapchain(swapchain);
+    buildFrameGraph();
+    updateLodProjection();
+
+    swapchainDirty = false;
+}
 
-    mainDeletionQueue.pushFunction([=]()
-                                   { vkDestroyCommandPool(device, commandPool, nullptr); });
+void VulkanEngine::retireSwapchain(DeletionQueue &queue)
+{
+    // Pushed in creation order, so views are destroyed before the swapchain
+    // owning their images. The frame graph retires the framebuffers using
+    // them when it's rebuilt.
+    if (swapchain != VK_NULL_HANDLE)
+        queue.push(swapchain);
+    for (VkImageView imageView : swapchainImageViews)
+        queue.push(imageView);
 }
 
-void VulkanEngine::initDefaultRenderpass()
+void VulkanEngine::initOffscreenTargets()
 {
-    VkAttachmentDescription colorAttachment = {
+    swapchainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = nullptr,
+        .imageType = VK_IMAGE_TYPE_2D,
         .format = swapchainImageFormat,
+        .extent = {windowExtent.width, windowExtent.height, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
         .samples = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
-
-    VkAttachmentReference colorAttachmentReference = {
-        .attachment = 0,
-        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
-
-    VkSubpassDescription subpass = {
-        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .colorAttachmentCount = 1,
-        .pColorAttachments = &colorAttachmentReference};
-
-    VkRenderPassCreateInfo renderPassInfo = {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-        .attachmentCount = 1,
-        .pAttachments = &colorAttachment,
-        .subpassCount = 1,
-        .pSubpasses = &subpass};
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
 
-    VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass))
+    VmaAllocationCreateInfo imageAllocInfo = {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY};
 
-    mainDeletionQueue.pushFunction([=]()
-                                   { vkDestroyRenderPass(device, renderPass, nullptr); });
-}
+    offscreenImages.resize(FRAME_OVERLAP);
+    swapchainImages.resize(FRAME_OVERLAP);
+    swapchainImageViews.resize(FRAME_OVERLAP);
 
-void VulkanEngine::initFramebuffers()
-{
-    VkFramebufferCreateInfo fbInfo = {
-        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+    for (int i = 0; i < FRAME_OVERLAP; ++i)
+    {
+        VK_CHECK(vmaCreateImage(allocator, &imageInfo, &imageAllocInfo, &offscreenImages[i].image, &offscreenImages[i].allocation, nullptr));
+        swapchainImages[i] = offscreenImages[i].image;
+
+        VkImageViewCreateInfo viewInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext = nullptr,
+            .image = swapchainImages[i],
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = swapchainImageFormat,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1}};
+
+        VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &swapchainImageViews[i]));
+
+        mainDeletionQueue.push(offscreenImages[i].image, offscreenImages[i].allocation);
+    }
+
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .pNext = nullptr,
-        .renderPass = renderPass,
-        .attachmentCount = 1,
-        .width = windowExtent.width,
-        .height = windowExtent.height,
-        .layers = 1};
+        .size = (VkDeviceSize)windowExtent.width * windowExtent.height * 4,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT};
 
-    const uint32_t swapchainImageCount = swapchainImages.size();
-    framebuffers.resize(swapchainImageCount);
+    VmaAllocationCreateInfo bufferAllocInfo = {
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .usage = VMA_MEMORY_USAGE_GPU_TO_CPU};
 
-    for (int i = 0; i < swapchainImageCount; ++i)
+    for (FrameData &frame : frames)
     {
-        fbInfo.pAttachments = &swapchainImageViews[i];
-        VK_CHECK(vkCreateFramebuffer(device, &fbInfo, nullptr, &framebuffers[i]));
+        VmaAllocationInfo allocationInfo;
+        VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &bufferAllocInfo, &frame.readbackBuffer.buffer, &frame.readbackBuffer.allocation, &allocationInfo));
+        frame.readbackData = allocationInfo.pMappedData;
 
-        mainDeletionQueue.pushFunction([=]()
-                                       { vkDestroyFramebuffer(device, framebuffers[i], nullptr);
-                                         vkDestroyImageView(device, swapchainImageViews[i], nullptr); });
+        mainDeletionQueue.push(frame.readbackBuffer.buffer, frame.readbackBuffer.allocation);
     }
 }
 
-void VulkanEngine::initSyncStructures()
+void VulkanEngine::readbackFrame(FrameData &frame)
 {
-    VkFenceCreateInfo fenceCreateInfo = vkInit::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+    if (frame.readbackFrameNumber < 0)
+        return;
 
-    VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &renderFence));
+    int readbackFrameNumber = frame.readbackFrameNumber;
+    frame.readbackFrameNumber = -1;
 
-    mainDeletionQueue.pushFunction([=]()
-                                   { vkDestroyFence(device, renderFence, nullptr); });
+    if (dumpFormat == FrameDumpFormat::None)
+        return;
 
-    VkSemaphoreCreateInfo semaphoreCreateInfo = vkInit::semaphoreCreateInfo();
+    vmaInvalidateAllocation(allocator, frame.readbackBuffer.allocation, 0, VK_WHOLE_SIZE);
 
-    VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &presentSemaphore));
-    VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &renderSemaphore));
+    std::string path = dumpDirectory + "/frame_" + std::to_string(readbackFrameNumber);
+    const uint8_t *pixels = (const uint8_t *)frame.readbackData;
 
-    mainDeletionQueue.pushFunction([=]()
-                                   { vkDestroySemaphore(device, presentSemaphore, nullptr);
-                                     vkDestroySemaphore(device, renderSemaphore, nullptr); });
+    if (dumpFormat == FrameDumpFormat::Png)
+        vkDump::writePng(path + ".png", windowExtent.width, windowExtent.height, pixels);
+    else
+        vkDump::writeRaw(path + ".rgba", windowExtent.width, windowExtent.height, pixels);
 }
 
-bool VulkanEngine::loadShaderModule(std::string filepath, VkShaderModule *outShaderModule)
+void VulkanEngine::initCommands()
 {
-    std::ifstream file(filepath, std::ios::ate | std::ios::binary);
-    if (!file.is_open())
+    VkCommandPoolCreateInfo commandPoolInfo = vkInit::commandPoolCreateInfo(graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+    for (FrameData &frame : frames)
     {
-        std::cout << "Can't open file: " << filepath << std::endl;
-        return false;
-    }
+        VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &frame.commandPool));
 
-    size_t fileSize = (size_t)file.tellg();
+        VkCommandBufferAllocateInfo cmdAllocInfo = vkInit::commandBufferAllocateInfo(frame.commandPool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
-    std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
+        VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &frame.mainCommandBuffer));
 
-    file.seekg(0);
-    file.read((char *)buffer.data(), fileSize);
-    file.close();
+        VkCommandBufferAllocateInfo overlayAllocInfo = vkInit::commandBufferAllocateInfo(frame.commandPool, 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        VK_CHECK(vkAllocateCommandBuffers(device, &overlayAllocInfo, &frame.overlayCommandBuffer));
 
-    VkShaderModuleCreateInfo createInfo = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .pNext = nullptr,
-        .codeSize = buffer.size() * sizeof(uint32_t),
-        .pCode = buffer.data()};
+        mainDeletionQueue.push(frame.commandPool);
 
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
-    {
-        return false;
+        VkCommandPoolCreateInfo recordPoolInfo = vkInit::commandPoolCreateInfo(graphicsQueueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+        frame.recordPools.resize(jobs.getThreadCount());
+        frame.recordCommandBuffers.resize(jobs.getThreadCount());
+        for (size_t i = 0; i < frame.recordPools.size(); ++i)
+        {
+            VK_CHECK(vkCreateCommandPool(device, &recordPoolInfo, nullptr, &frame.recordPools[i]));
+
+            VkCommandBufferAllocateInfo secondaryAllocInfo = vkInit::commandBufferAllocateInfo(frame.recordPools[i], 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+            VK_CHECK(vkAllocateCommandBuffers(device, &secondaryAllocInfo, &frame.recordCommandBuffers[i]));
+
+            mainDeletionQueue.push(frame.recordPools[i]);
+        }
     }
-    *outShaderModule = shaderModule;
-    return true;
 }
 
-void VulkanEngine::initPipelines()
+void VulkanEngine::initFrameGraph()
+{
+    frameGraph.init(device, physicalDevice, allocator, &frameDeletionQueue, &profiler);
+    buildFrameGraph();
+}
+
+void VulkanEngine::buildFrameGraph()
 {
-    VkShaderModule triangleFragShader;
-    if (!loadShaderModule("../shaders/triangle.frag.spv", &triangleFragShader))
+    frameGraph.reset();
+
+    // Rendering waits for the acquire semaphore at color output, so that's
+    // where the swapchain image becomes usable.
+    backbuffer = frameGraph.importImage("Backbuffer", swapchainImageFormat, windowExtent, swapchainImages, swapchainImageViews,
+                                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    const RenderResource depth = frameGraph.createImage("Depth", DEPTH_FORMAT, windowExtent);
+    VkClearValue depthClear{
+        .depthStencil = {1.0f, 0}};
+    frameGraph.setClearValue(depth, depthClear);
+
+    // Declared whenever the GPU scene exists and culled unless the main pass
+    // draws from it.
+    const std::vector<VkBuffer> commandBuffers = gpuScene.getCommandBuffers();
+    frameGraphIndirect = selectedShader == 5 && !commandBuffers.empty();
+    RenderResource drawCommands = 0;
+    RenderResource drawCounts = 0;
+    if (!commandBuffers.empty())
     {
-        std::cout << "Error building triangle fragment shader module" << std::endl;
+        drawCommands = frameGraph.importBuffer("Draw commands", commandBuffers);
+        drawCounts = frameGraph.importBuffer("Draw counts", gpuScene.getCountBuffers());
+        frameGraph.addPass("Cull", PassType::Compute)
+            .write(drawCommands, ResourceUsage::StorageWrite)
+            .write(drawCounts, ResourceUsage::StorageWrite)
+            .execute([this](VkCommandBuffer cmd, const RenderPassContext &context)
+                     { gpuScene.cull(cmd, context.frameIndex, frameViewProjection, frameCameraPosition, scene.lodSettings); });
     }
-    else
+
+    PassBuilder main = frameGraph.addPass("Main pass", PassType::Graphics);
+    main.writeColor(backbuffer, AttachmentLoad::Clear)
+        .writeDepth(depth, AttachmentLoad::Clear)
+        .execute([this](VkCommandBuffer cmd, const RenderPassContext &context)
+                 { drawMainPass(cmd, context); });
+    if (frameGraphIndirect)
     {
-        std::cout << "Triangle fragment shader successfully loaded" << std::endl;
+        main.read(drawCommands, ResourceUsage::IndirectRead)
+            .read(drawCounts, ResourceUsage::IndirectRead);
     }
+    mainPass = main.getPass();
 
-    VkShaderModule triangleVertShader;
-    if (!loadShaderModule("../shaders/triangle.vert.spv", &triangleVertShader))
+    if (headless)
     {
-        std::cout << "Error building triangle vertex shader module" << std::endl;
+        std::vector<VkBuffer> readbackBuffers;
+        for (FrameData &frame : frames)
+            readbackBuffers.push_back(frame.readbackBuffer.buffer);
+
+        const RenderResource readback = frameGraph.importBuffer("Readback", readbackBuffers);
+        frameGraph.markOutput(readback, ResourceUsage::HostRead);
+        frameGraph.addPass("Readback", PassType::Transfer)
+            .read(backbuffer, ResourceUsage::TransferSrc)
+            .write(readback, ResourceUsage::TransferDst)
+            .execute([this](VkCommandBuffer cmd, const RenderPassContext &context)
+                     {
+                         VkBufferImageCopy copyRegion = {
+                             .bufferOffset = 0,
+                             .bufferRowLength = 0,
+                             .bufferImageHeight = 0,
+                             .imageSubresource = {
+                                 .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                 .mipLevel = 0,
+                                 .baseArrayLayer = 0,
+                                 .layerCount = 1},
+                             .imageOffset = {0, 0, 0},
+                             .imageExtent = {windowExtent.width, windowExtent.height, 1}};
+
+                         FrameData &frame = frames[context.frameIndex];
+                         vkCmdCopyImageToBuffer(cmd, swapchainImages[context.imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame.readbackBuffer.buffer, 1, &copyRegion);
+                         frame.readbackFrameNumber = frameNumber; });
     }
     else
     {
-        std::cout << "Triangle vertex shader successfully loaded" << std::endl;
+        frameGraph.markOutput(backbuffer, ResourceUsage::Present);
     }
 
-    VkShaderModule coloredTriangleFragShader;
-    if (!loadShaderModule("../shaders/coloredTriangle.frag.spv", &coloredTriangleFragShader))
+    if (!frameGraph.compile())
+        std::cout << "Failed to compile the frame graph" << std::endl;
+
+    renderPass = frameGraph.getRenderPass(mainPass);
+    frameGraphDirty = false;
+}
+
+void VulkanEngine::drawMainPass(VkCommandBuffer cmd, const RenderPassContext &context)
+{
+    if (selectedShader < 2)
     {
-        std::cout << "Error building colored triangle fragment shader module" << std::endl;
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineVariants.get(pipelineKeyForShader(selectedShader)));
+        vkCmdDraw(cmd, 3, 1, 0, 0);
+        frameDraws = 1;
+        frameTriangles = 1;
     }
-    else
+    else if (selectedShader == 5)
     {
-        std::cout << "Colored Triangle fragment shader successfully loaded" << std::endl;
+        // The surviving draws are only known on the GPU; these are the counts
+        // of the last cull read back, FRAME_OVERLAP frames old.
+        gpuScene.drawIndirect(cmd, context.frameIndex, scene);
+        frameDraws = gpuScene.getLastStats().drawnClusters;
+        frameTriangles = gpuScene.getLastStats().drawnTriangles;
     }
-
-    VkShaderModule coloredTriangleVertShader;
-    if (!loadShaderModule("../shaders/coloredTriangle.vert.spv", &coloredTriangleVertShader))
+    else if (selectedShader < 4)
     {
-        std::cout << "Error building colored triangle vertex shader module" << std::endl;
+        drawObjects(cmd, context.framebuffer, frameViewProjection, frameCameraPosition, selectedShader == 3 ? (int)normalDebugMaterial : -1);
     }
     else
     {
-        std::cout << "Colored Triangle vertex shader successfully loaded" << std::endl;
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineVariants.get(pipelineKeyForShader(selectedShader)));
+        bindMeshSets(cmd, meshPipelineLayout);
+        geometryBuffer.bind(cmd);
+
+        const MeshLod lod = monkeyMesh.getLod(0);
+        vkCmdDrawIndexed(cmd, lod.indexCount, GRID_COLUMNS * GRID_COLUMNS, monkeyMesh.firstIndex + lod.firstIndex, monkeyMesh.firstVertex, 0);
+        frameDraws = 1;
+        frameTriangles = (uint64_t)lod.indexCount / 3 * GRID_COLUMNS * GRID_COLUMNS;
     }
 
-    VkShaderModule meshTriangleFragShader;
-    if (!loadShaderModule("../shaders/triangleMesh.frag.spv", &meshTriangleFragShader))
-    {
-        std::cout << "Error building mesh triangle fragment shader module" << std::endl;
-    }
-    else
+    if (!headless)
+        drawOverlay(cmd, context.framebuffer, usesSecondaryContents(selectedShader));
+}
+
+void VulkanEngine::initSyncStructures()
+{
+    VkFenceCreateInfo fenceCreateInfo = vkInit::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+    VkSemaphoreCreateInfo semaphoreCreateInfo = vkInit::semaphoreCreateInfo();
+
+    for (FrameData &frame : frames)
     {
-        std::cout << "Mesh Triangle fragment shader successfully loaded" << std::endl;
+        VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &frame.renderFence));
+
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frame.presentSemaphore));
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frame.renderSemaphore));
+
+        mainDeletionQueue.push(frame.renderFence);
+        mainDeletionQueue.push(frame.presentSemaphore);
+        mainDeletionQueue.push(frame.renderSemaphore);
     }
+}
+
+void VulkanEngine::initDescriptors()
+{
+    descriptorLayoutCache.init(device);
+    descriptorAllocator.init(device);
+    descriptorSetCache.init(device, &descriptorAllocator);
+
+    for (FrameData &frame : frames)
+        frame.descriptorAllocator.init(device);
+
+    objectSetLayout = DescriptorBuilder(descriptorLayoutCache, descriptorSetCache)
+                          .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+                          .buildLayout();
 
-    VkShaderModule meshTriangleVertShader;
-    if (!loadShaderModule("../shaders/triangleMesh.vert.spv", &meshTriangleVertShader))
+    // The descriptors always point at the start of the ring with a fixed
+    // range; each frame only changes the dynamic offsets.
+    const VkDeviceSize instanceRange = MAX_FRAME_INSTANCES * sizeof(glm::mat4);
+    frameAllocator.init(allocator, physicalDevice, frameAllocatorSize, std::max<VkDeviceSize>(instanceRange, sizeof(GpuCameraData)), FRAME_OVERLAP);
+
+    frameSetLayout = frameSetBuilder().buildLayout();
+}
+
+DescriptorBuilder VulkanEngine::frameSetBuilder()
+{
+    const VkDeviceSize instanceRange = MAX_FRAME_INSTANCES * sizeof(glm::mat4);
+    return DescriptorBuilder(descriptorLayoutCache, descriptorSetCache)
+        .bindBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, frameAllocator.getBuffer(), 0, sizeof(GpuCameraData))
+        .bindBuffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, frameAllocator.getBuffer(), 0, instanceRange);
+}
+
+void VulkanEngine::printDescriptorStats() const
+{
+    DescriptorStats frameStats;
+    for (const FrameData &frame : frames)
     {
-        std::cout << "Error building mesh triangle vertex shader module" << std::endl;
+        const DescriptorStats &stats = frame.descriptorAllocator.getStats();
+        frameStats.setsAllocated += stats.setsAllocated;
+        frameStats.poolsCreated += stats.poolsCreated;
+        frameStats.poolResets += stats.poolResets;
+        frameStats.resetMilliseconds += stats.resetMilliseconds;
     }
-    else
+
+    const DescriptorStats &persistent = descriptorAllocator.getStats();
+    const DescriptorCacheStats &layouts = descriptorLayoutCache.getStats();
+    const DescriptorCacheStats &sets = descriptorSetCache.getStats();
+    const double resetMicroseconds = frameStats.poolResets ? frameStats.resetMilliseconds * 1000.0 / frameStats.poolResets : 0.0;
+
+    std::cout << "Descriptors: " << persistent.setsAllocated << " cached sets in " << persistent.poolsCreated << " pools, "
+              << frameStats.setsAllocated << " per-frame sets in " << frameStats.poolsCreated << " pools, "
+              << frameStats.poolResets << " pool resets averaging " << resetMicroseconds << " us" << std::endl;
+    std::cout << "Descriptor caches: layouts " << layouts.hits << " hits / " << layouts.misses << " misses, sets "
+              << sets.hits << " hits / " << sets.misses << " misses" << std::endl;
+}
+
+void VulkanEngine::initProfiler()
+{
+    profiler.init(device, physicalDevice, graphicsQueueFamily, FRAME_OVERLAP, profileCsvPath);
+}
+
+void VulkanEngine::initImgui()
+{
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16}};
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = 16,
+        .poolSizeCount = 1,
+        .pPoolSizes = poolSizes};
+    VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &imguiPool));
+
+    ImGui::CreateContext();
+    ImGui_ImplSDL2_InitForVulkan(window);
+
+    ImGui_ImplVulkan_InitInfo initInfo = {
+        .Instance = instance,
+        .PhysicalDevice = physicalDevice,
+        .Device = device,
+        .QueueFamily = graphicsQueueFamily,
+        .Queue = graphicsQueue,
+        .PipelineCache = pipelineCache,
+        .DescriptorPool = imguiPool,
+        .MinImageCount = 2,
+        // ImGui's vertex and index buffers are reused per frame in flight.
+        .ImageCount = std::max<uint32_t>((uint32_t)swapchainImages.size(), FRAME_OVERLAP),
+        .MSAASamples = VK_SAMPLE_COUNT_1_BIT,
+        .Allocator = nullptr,
+        .CheckVkResultFn = nullptr};
+    ImGui_ImplVulkan_Init(&initInfo, renderPass);
+
+    // Font upload needs layout transitions, so it goes through the graphics
+    // queue rather than the upload context.
+    VkCommandBuffer cmd = frames[0].mainCommandBuffer;
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = nullptr};
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+    ImGui_ImplVulkan_CreateFontsTexture(cmd);
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    VkSubmitInfo submit = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmd};
+    VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, VK_NULL_HANDLE));
+    VK_CHECK(vkQueueWaitIdle(graphicsQueue));
+    ImGui_ImplVulkan_DestroyFontUploadObjects();
+
+    mainDeletionQueue.push(imguiPool);
+}
+
+// Records the ImGui draw data built at the start of the frame. Passes whose
+// contents are secondary buffers can't take inline draws, so the overlay gets
+// a secondary buffer of its own there.
+void VulkanEngine::drawOverlay(VkCommandBuffer cmd, VkFramebuffer framebuffer, bool secondaryContents)
+{
+    if (!secondaryContents)
     {
-        std::cout << "Mesh Triangle vertex shader successfully loaded" << std::endl;
+        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+        return;
     }
 
+    VkCommandBuffer overlayCmd = getCurrentFrame().overlayCommandBuffer;
+    VK_CHECK(vkResetCommandBuffer(overlayCmd, 0));
+
+    const VkCommandBufferInheritanceInfo inheritanceInfo = vkInit::commandBufferInheritanceInfo(renderPass, 0, framebuffer);
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritanceInfo};
+    VK_CHECK(vkBeginCommandBuffer(overlayCmd, &beginInfo));
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), overlayCmd);
+    VK_CHECK(vkEndCommandBuffer(overlayCmd));
+
+    vkCmdExecuteCommands(cmd, 1, &overlayCmd);
+}
+
+void VulkanEngine::initPipelines()
+{
+    bool warmCache = false;
+    pipelineCache = vkPipelineCache::load(device, physicalDevice, pipelineCachePath, &warmCache);
+    mainDeletionQueue.push(pipelineCache);
+
+    shaderCache.init(device);
+    pipelineVariants.init(device, pipelineCache);
+
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkInit::pipelineLayoutCreateInfo();
     VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &graphicsPipelineLayout));
 
     VkPipelineLayoutCreateInfo meshPipelineLayoutInfo = vkInit::pipelineLayoutCreateInfo();
-    VkPushConstantRange pushConstant = {
-        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-        .offset = 0,
-        .size = sizeof(MeshPushConstants)};
+    VkDescriptorSetLayout meshSetLayouts[] = {objectSetLayout, frameSetLayout};
 
-    meshPipelineLayoutInfo.pPushConstantRanges = &pushConstant;
-    meshPipelineLayoutInfo.pushConstantRangeCount = 1;
+    meshPipelineLayoutInfo.pSetLayouts = meshSetLayouts;
+    meshPipelineLayoutInfo.setLayoutCount = 2;
     VK_CHECK(vkCreatePipelineLayout(device, &meshPipelineLayoutInfo, nullptr, &meshPipelineLayout));
 
-    PipelineBuilder pipelineBuilder;
-    pipelineBuilder.shaderStages.push_back(vkInit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, triangleVertShader));
-    pipelineBuilder.shaderStages.push_back(vkInit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, triangleFragShader));
-    pipelineBuilder.vertexInputInfo = vkInit::vertexInputStateCreateInfo();
-    pipelineBuilder.inputAssembly = vkInit::inputAssemblyCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-    pipelineBuilder.viewport = {
-        .x = 0.0f,
-        .y = 0.0f,
-        .width = (float)windowExtent.width,
-        .height = (float)windowExtent.height,
-        .minDepth = 0.0f,
-        .maxDepth = 1.0f};
+    textureSetLayout = DescriptorBuilder(descriptorLayoutCache, descriptorSetCache)
+                           .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+                           .buildLayout();
 
-    pipelineBuilder.scissor = {
-        .offset = {0, 0},
-        .extent = windowExtent};
+    VkPipelineLayoutCreateInfo texturedPipelineLayoutInfo = vkInit::pipelineLayoutCreateInfo();
+    VkDescriptorSetLayout texturedSetLayouts[] = {objectSetLayout, frameSetLayout, textureSetLayout};
 
-    pipelineBuilder.rasterizer = vkInit::rasterizationStateCreateInfo(VK_POLYGON_MODE_FILL);
-    pipelineBuilder.multisampling = vkInit::multisampleStateCreateInfo();
-    pipelineBuilder.colorBlendAttachment = vkInit::colorBlendAttachmentState();
-    pipelineBuilder.pipelineLayout = graphicsPipelineLayout;
-    trianglePipeline = pipelineBuilder.buildPipeline(device, renderPass);
+    texturedPipelineLayoutInfo.pSetLayouts = texturedSetLayouts;
+    texturedPipelineLayoutInfo.setLayoutCount = 3;
+    VK_CHECK(vkCreatePipelineLayout(device, &texturedPipelineLayoutInfo, nullptr, &texturedPipelineLayout));
 
-    pipelineBuilder.shaderStages.clear();
-    pipelineBuilder.shaderStages.push_back(vkInit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, coloredTriangleVertShader));
-    pipelineBuilder.shaderStages.push_back(vkInit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, coloredTriangleFragShader));
-    coloredTrianglePipeline = pipelineBuilder.buildPipeline(device, renderPass);
+    // Build every variant up front so draw() never compiles mid-frame.
+    auto start = std::chrono::high_resolution_clock::now();
 
-    VertexInputDescription vertexDescription = Vertex::getVertexDescription();
-    pipelineBuilder.vertexInputInfo.pVertexAttributeDescriptions = vertexDescription.attributes.data();
-    pipelineBuilder.vertexInputInfo.vertexAttributeDescriptionCount = vertexDescription.attributes.size();
-
-    pipelineBuilder.vertexInputInfo.pVertexBindingDescriptions = vertexDescription.bindings.data();
-    pipelineBuilder.vertexInputInfo.vertexBindingDescriptionCount = vertexDescription.bindings.size();
+    for (int shader = 0; shader < SHADER_COUNT; ++shader)
+    {
+        if (pipelineVariants.get(pipelineKeyForShader(shader)) == VK_NULL_HANDLE)
+            std::cout << "Failed to build pipeline variant " << shader << std::endl;
+    }
 
-    pipelineBuilder.shaderStages.clear();
-    pipelineBuilder.shaderStages.push_back(vkInit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, meshTriangleVertShader));
-    pipelineBuilder.shaderStages.push_back(vkInit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, meshTriangleFragShader));
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << pipelineVariants.size() << " pipelines created in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms ("
+              << (warmCache ? "warm" : "cold") << " cache)" << std::endl;
 
-    pipelineBuilder.pipelineLayout = meshPipelineLayout;
-    meshPipeline = pipelineBuilder.buildPipeline(device, renderPass);
+    mainDeletionQueue.push(graphicsPipelineLayout);
+    mainDeletionQueue.push(meshPipelineLayout);
+    mainDeletionQueue.push(texturedPipelineLayout);
+}
 
-    vkDestroyShaderModule(device, coloredTriangleVertShader, nullptr);
-    vkDestroyShaderModule(device, coloredTriangleFragShader, nullptr);
-    vkDestroyShaderModule(device, triangleVertShader, nullptr);
-    vkDestroyShaderModule(device, triangleFragShader, nullptr);
-    vkDestroyShaderModule(device, meshTriangleVertShader, nullptr);
-    vkDestroyShaderModule(device, meshTriangleFragShader, nullptr);
+PipelineKey VulkanEngine::pipelineKeyForShader(int shader)
+{
+    if (shader < 2)
+    {
+        return {
+            .vertexShader = shaderCache.get("../shaders/triangle.vert.spv"),
+            .fragmentShader = shaderCache.get("../shaders/triangle.frag.spv"),
+            .features = shader == 1 ? (uint32_t)SHADER_FEATURE_VERTEX_COLOR : 0u,
+            .layout = graphicsPipelineLayout,
+            .renderPass = renderPass};
+    }
 
-    mainDeletionQueue.pushFunction([=]()
-                                   { vkDestroyPipeline(device, meshPipeline, nullptr);
-                                     vkDestroyPipeline(device, coloredTrianglePipeline, nullptr);
-                                     vkDestroyPipeline(device, trianglePipeline, nullptr);
-                                     vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr);
-                                     vkDestroyPipelineLayout(device, graphicsPipelineLayout, nullptr); });
+    const uint32_t meshFeatures[] = {
+        SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_OBJECT_BUFFER,
+        SHADER_FEATURE_NORMAL_DEBUG | SHADER_FEATURE_OBJECT_BUFFER,
+        SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_INSTANCING,
+        SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_OBJECT_BUFFER};
+
+    return {
+        .vertexShader = shaderCache.get("../shaders/triangleMesh.vert.spv"),
+        .fragmentShader = shaderCache.get("../shaders/triangle.frag.spv"),
+        .features = meshFeatures[shader - 2],
+        .layout = meshPipelineLayout,
+        .renderPass = renderPass,
+        .meshVertexInput = true,
+        .vertexFormat = vertexFormat};
 }
 
 void VulkanEngine::loadMeshes()
@@ -524,43 +1281,381 @@ void VulkanEngine::loadMeshes()
     triangleMesh.vertices[1].color = {0.0f, 1.0f, 0.0f};
     triangleMesh.vertices[2].color = {0.0f, 1.0f, 0.0f};
 
-    monkeyMesh.loadObj("../assets/monkey_smooth.obj");
+    triangleMesh.indices = {0, 1, 2};
+
+    triangleMesh.computeBounds();
+
+    geometryBuffer.init(this, vertexFormat, 256 * 1024, 1024 * 1024);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Parsing and optimizing a mesh that isn't cached yet is independent
+    // per mesh, so OBJ files load in parallel, each parsed as jobs itself.
+    const std::pair<Mesh *, const char *> objMeshes[] = {
+        {&monkeyMesh, "../assets/monkey_smooth.obj"}};
+    jobs.parallelFor(std::size(objMeshes), 1, [&](size_t begin, size_t end)
+                     {
+                         for (size_t i = begin; i < end; ++i)
+                             objMeshes[i].first->loadObj(objMeshes[i].second, jobs); });
 
-    uploadMesh(triangleMesh);
-    uploadMesh(monkeyMesh);
+    geometryBuffer.addMesh(triangleMesh);
+    geometryBuffer.addMesh(monkeyMesh);
+
+    uploadContext.flush();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Meshes loaded and uploaded in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+    const UploadStats &uploadStats = uploadContext.getStats();
+    if (uploadStats.submissions > 0)
+        std::cout << "Staged " << uploadStats.bytesUploaded / 1024.0 << " KB in " << uploadStats.submissions << " submission(s) at "
+                  << uploadStats.bytesUploaded / (1024.0 * 1024.0) / uploadStats.seconds << " MB/s" << std::endl;
+}
+
+void VulkanEngine::loadTextures()
+{
+    const std::vector<std::string> texturePaths = {
+        "../assets/lost_empire-RGBA.png",
+        "../assets/lost_empire-RGB.png",
+        "../assets/lost_empire-Alpha.png"};
+    const char *formatNames[] = {"RGBA8", "BC1", "BC3"};
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<TextureData> textureData = vkTexture::loadAll(texturePaths, compressTextures, jobs);
+
+    auto loaded = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < textureData.size(); ++i)
+    {
+        const TextureData &data = textureData[i];
+        if (data.mips.empty())
+            continue;
+
+        Texture texture = {
+            .format = vkTexture::vkFormat(data.format),
+            .mipLevels = (uint32_t)data.mips.size()};
+        texture.image = createImage(texture.format, {data.width, data.height, 1}, texture.mipLevels,
+                                    VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+        std::vector<ImageUploadLevel> levels;
+        for (const TextureMip &mip : data.mips)
+            levels.push_back({mip.width, mip.height, data.getData() + mip.offset});
+
+        if (!uploadContext.uploadImage(texture.image.image, vkTexture::blockSize(data.format), vkTexture::blockBytes(data.format), levels))
+        {
+            vmaDestroyImage(allocator, texture.image.image, texture.image.allocation);
+            continue;
+        }
+
+        VkImageViewCreateInfo viewInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext = nullptr,
+            .image = texture.image.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = texture.format,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = texture.mipLevels,
+                .baseArrayLayer = 0,
+                .layerCount = 1}};
+        VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &texture.imageView));
+
+        textures.push_back(texture);
+
+        std::cout << texturePaths[i] << ": " << data.width << "x" << data.height << " " << formatNames[(int)data.format] << ", "
+                  << texture.mipLevels << " mips, " << data.getSize() / (1024.0 * 1024.0) << " MB";
+        if (data.stats.fromCache)
+            std::cout << " from cache" << std::endl;
+        else
+            std::cout << ", decode " << data.stats.decodeMilliseconds << " ms, mips " << data.stats.mipMilliseconds
+                      << " ms, encode " << data.stats.compressMilliseconds << " ms" << std::endl;
+    }
+
+    uploadContext.flush();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << textures.size() << " textures loaded in " << std::chrono::duration<double, std::milli>(loaded - start).count()
+              << " ms and uploaded in " << std::chrono::duration<double, std::milli>(end - loaded).count() << " ms" << std::endl;
+
+    VkSamplerCreateInfo samplerInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .pNext = nullptr,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .maxLod = VK_LOD_CLAMP_NONE};
+    VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler));
+
+    for (const Texture &texture : textures)
+    {
+        mainDeletionQueue.push(texture.image.image, texture.image.allocation);
+        mainDeletionQueue.push(texture.imageView);
+    }
+    mainDeletionQueue.push(textureSampler);
+}
+
+void VulkanEngine::initScene()
+{
+    const uint32_t monkey = scene.addMesh(&monkeyMesh);
+    const uint32_t triangle = scene.addMesh(&triangleMesh);
+
+    const uint32_t defaultMaterial = scene.addMaterial({
+        .pipeline = pipelineVariants.get(pipelineKeyForShader(2)),
+        .pipelineLayout = meshPipelineLayout});
+    normalDebugMaterial = scene.addMaterial({
+        .pipeline = pipelineVariants.get(pipelineKeyForShader(3)),
+        .pipelineLayout = meshPipelineLayout});
+
+    uint32_t texturedMaterial = defaultMaterial;
+    if (!textures.empty())
+    {
+        PipelineKey texturedKey = pipelineKeyForShader(2);
+        texturedKey.fragmentShader = shaderCache.get("../shaders/textured.frag.spv");
+        texturedKey.features = SHADER_FEATURE_OBJECT_BUFFER;
+        texturedKey.layout = texturedPipelineLayout;
+
+        VkDescriptorSet textureSet;
+        DescriptorBuilder(descriptorLayoutCache, descriptorSetCache)
+            .bindImage(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, textures[0].imageView, textureSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+            .build(textureSet);
+
+        texturedMaterial = scene.addMaterial({
+            .pipeline = pipelineVariants.get(texturedKey),
+            .pipelineLayout = texturedPipelineLayout,
+            .descriptorSet = textureSet});
+    }
+
+    const int halfGrid = sceneGridSize / 2;
+    for (int x = -halfGrid; x < sceneGridSize - halfGrid; ++x)
+    {
+        for (int z = -halfGrid; z < sceneGridSize - halfGrid; ++z)
+        {
+            glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x * 3.0f, 0.0f, z * 3.0f));
+            if ((x + z) % 3 == 0)
+                scene.addObject(triangle, defaultMaterial, transform);
+            else
+                scene.addObject(monkey, (x + z) & 1 ? normalDebugMaterial : (x - z) % 4 == 0 ? texturedMaterial : defaultMaterial, transform);
+        }
+    }
+
+    updateLodProjection();
+    scene.lodSettings.pixelThreshold = lodPixelThreshold;
+
+    gpuScene.init(this, scene, clusterCulling);
+    // Its buffers exist now, so the cull pass can be declared.
+    frameGraphDirty = true;
+}
+
+void VulkanEngine::updateLodProjection()
+{
+    // Matches the 70 degree projection in draw().
+    scene.lodSettings.projectionScale = lodPixelThreshold > 0.0f ? windowExtent.height / (2.0f * std::tan(glm::radians(70.0f) * 0.5f)) : 0.0f;
+}
+
+void VulkanEngine::drawObjects(VkCommandBuffer cmd, VkFramebuffer framebuffer, const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition, int materialOverride)
+{
+    vkCull::cull(scene.objectBounds, viewProjection, visibleObjects, jobs);
+    scene.buildDrawList(visibleObjects, cameraPosition, 200.0f, materialOverride);
+
+    for (const DrawItem &item : scene.drawItems)
+        frameTriangles += scene.meshes[vkDrawKey::mesh(item.key)]->getLod(item.lod).indexCount / 3;
+    frameDraws += (uint32_t)scene.drawItems.size();
+
+    FrameData &frame = getCurrentFrame();
+    const uint32_t secondaryCount = recordDrawList(frame, framebuffer, jobs.getThreadCount());
+    vkCmdExecuteCommands(cmd, secondaryCount, frame.recordCommandBuffers.data());
+}
+
+// Splits scene.drawItems into contiguous ranges, one per secondary command
+// buffer, and records them in parallel. Returns how many buffers were used.
+uint32_t VulkanEngine::recordDrawList(FrameData &frame, VkFramebuffer framebuffer, uint32_t recorderCount)
+{
+    // Below this, a thread spends longer starting a buffer than recording it.
+    constexpr size_t MIN_DRAWS_PER_RECORDER = 256;
+
+    const size_t drawCount = scene.drawItems.size();
+    const size_t secondaryCount = std::clamp<size_t>((drawCount + MIN_DRAWS_PER_RECORDER - 1) / MIN_DRAWS_PER_RECORDER,
+                                                     1, std::min<size_t>(recorderCount, frame.recordPools.size()));
+    const size_t drawsPerSecondary = (drawCount + secondaryCount - 1) / secondaryCount;
+
+    const VkCommandBufferInheritanceInfo inheritanceInfo = vkInit::commandBufferInheritanceInfo(renderPass, 0, framebuffer);
+
+    auto recordSecondary = [&](size_t i)
+    {
+        VK_CHECK(vkResetCommandPool(device, frame.recordPools[i], 0));
+
+        VkCommandBuffer secondary = frame.recordCommandBuffers[i];
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+            .pInheritanceInfo = &inheritanceInfo};
+        VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo));
+
+        const size_t first = std::min(drawCount, i * drawsPerSecondary);
+        const size_t last = std::min(drawCount, first + drawsPerSecondary);
+        recordDrawRange(secondary, first, last - first);
+
+        VK_CHECK(vkEndCommandBuffer(secondary));
+    };
+
+    // Each buffer has a pool of its own, so whichever worker ends up with it
+    // records without locking.
+    jobs.parallelFor(secondaryCount, 1, [&](size_t begin, size_t end)
+                     {
+                         for (size_t i = begin; i < end; ++i)
+                             recordSecondary(i); });
+
+    return (uint32_t)secondaryCount;
+}
+
+// Secondary buffers start with no state bound, so each range rebinds what its
+// first draw needs.
+void VulkanEngine::recordDrawRange(VkCommandBuffer cmd, size_t first, size_t count)
+{
+    setViewport(cmd);
+
+    uint32_t lastPipeline = UINT32_MAX;
+    VkDescriptorSet lastDescriptorSet = VK_NULL_HANDLE;
+    bool geometryBound = false;
+
+    for (size_t i = first; i < first + count; ++i)
+    {
+        const DrawItem &item = scene.drawItems[i];
+        const Material &material = scene.materials[vkDrawKey::material(item.key)];
+
+        if (vkDrawKey::pipeline(item.key) != lastPipeline)
+        {
+            lastPipeline = vkDrawKey::pipeline(item.key);
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
+        }
+
+        // Transforms come from the object buffer through firstInstance and the
+        // camera from the frame set, so nothing is pushed per draw.
+        if (!geometryBound)
+        {
+            geometryBuffer.bind(cmd);
+            bindMeshSets(cmd, material.pipelineLayout);
+            geometryBound = true;
+        }
+
+        if (material.descriptorSet != VK_NULL_HANDLE && material.descriptorSet != lastDescriptorSet)
+        {
+            lastDescriptorSet = material.descriptorSet;
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipelineLayout, 2, 1, &material.descriptorSet, 0, nullptr);
+        }
+
+        const Mesh &mesh = *scene.meshes[vkDrawKey::mesh(item.key)];
+        const MeshLod lod = mesh.getLod(item.lod);
+        vkCmdDrawIndexed(cmd, lod.indexCount, 1, mesh.firstIndex + lod.firstIndex, mesh.firstVertex, item.object);
+    }
+}
+
+void VulkanEngine::setViewport(VkCommandBuffer cmd)
+{
+    const VkViewport viewport = {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = (float)windowExtent.width,
+        .height = (float)windowExtent.height,
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f};
+
+    const VkRect2D scissor = {
+        .offset = {0, 0},
+        .extent = windowExtent};
+
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+}
+
+void VulkanEngine::bindMeshSets(VkCommandBuffer cmd, VkPipelineLayout layout)
+{
+    VkDescriptorSet sets[] = {gpuScene.objectSet, frameSet};
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 2, sets, 2, frameSetOffsets);
+}
+
+AllocatedBuffer VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage)
+{
+    AllocatedBuffer newBuffer;
+    VK_CHECK(createBuffer(allocSize, usage, memoryUsage, newBuffer));
+
+    return newBuffer;
 }
 
-void VulkanEngine::uploadMesh(Mesh &mesh)
+VkResult VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, AllocatedBuffer &buffer)
 {
+    const uint32_t queueFamilies[] = {graphicsQueueFamily, transferQueueFamily};
+    const bool concurrent = graphicsQueueFamily != transferQueueFamily && memoryUsage == VMA_MEMORY_USAGE_GPU_ONLY;
+
     VkBufferCreateInfo bufferInfo = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .pNext = nullptr,
-        .size = mesh.vertices.size() * sizeof(Vertex),
-        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT};
+        .size = allocSize,
+        .usage = usage,
+        .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = concurrent ? 2u : 0u,
+        .pQueueFamilyIndices = concurrent ? queueFamilies : nullptr};
 
     VmaAllocationCreateInfo vmaAllocInfo = {
-        .usage = VMA_MEMORY_USAGE_CPU_TO_GPU};
+        .usage = memoryUsage};
+
+    return vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &buffer.buffer, &buffer.allocation, nullptr);
+}
+
+AllocatedImage VulkanEngine::createImage(VkFormat format, VkExtent3D extent, uint32_t mipLevels, VkImageUsageFlags usage)
+{
+    const uint32_t queueFamilies[] = {graphicsQueueFamily, transferQueueFamily};
+    const bool concurrent = graphicsQueueFamily != transferQueueFamily;
 
-    VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &mesh.vertexBuffer.buffer, &mesh.vertexBuffer.allocation, nullptr))
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = nullptr,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = extent,
+        .mipLevels = mipLevels,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage,
+        .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = concurrent ? 2u : 0u,
+        .pQueueFamilyIndices = concurrent ? queueFamilies : nullptr,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+    VmaAllocationCreateInfo vmaAllocInfo = {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY};
 
-    mainDeletionQueue.pushFunction([=]()
-                                   { vmaDestroyBuffer(allocator, mesh.vertexBuffer.buffer, mesh.vertexBuffer.allocation); });
+    AllocatedImage newImage;
+    VK_CHECK(vmaCreateImage(allocator, &imageInfo, &vmaAllocInfo, &newImage.image, &newImage.allocation, nullptr));
 
-    void *data;
-    vmaMapMemory(allocator, mesh.vertexBuffer.allocation, &data);
-    std::memcpy(data, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
-    vmaUnmapMemory(allocator, mesh.vertexBuffer.allocation);
+    return newImage;
 }
 
 VkPipeline PipelineBuilder::buildPipeline(VkDevice device, VkRenderPass pass)
 {
+    // Viewport and scissor are set when recording, so a resize doesn't need
+    // new pipelines.
     VkPipelineViewportStateCreateInfo viewportState = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
         .pNext = nullptr,
         .viewportCount = 1,
-        .pViewports = &viewport,
+        .pViewports = nullptr,
         .scissorCount = 1,
-        .pScissors = &scissor};
+        .pScissors = nullptr};
+
+    const VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .pNext = nullptr,
+        .dynamicStateCount = 2,
+        .pDynamicStates = dynamicStates};
 
     VkPipelineColorBlendStateCreateInfo colorBlending = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
@@ -580,14 +1675,16 @@ VkPipeline PipelineBuilder::buildPipeline(VkDevice device, VkRenderPass pass)
         .pViewportState = &viewportState,
         .pRasterizationState = &rasterizer,
         .pMultisampleState = &multisampling,
+        .pDepthStencilState = &depthStencil,
         .pColorBlendState = &colorBlending,
+        .pDynamicState = &dynamicState,
         .layout = pipelineLayout,
         .renderPass = pass,
         .subpass = 0,
         .basePipelineHandle = VK_NULL_HANDLE};
 
     VkPipeline newPipeline;
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS)
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS)
     {
         std::cout << "Failed to create graphics pipeline" << std::endl;
         return VK_NULL_HANDLE;
@@ -10,28 +10,65 @@
 
 #include "vk_types.h"
 #include "vk_mesh.h"
+#include "vk_frame_dump.h"
+#include "vk_upload.h"
+#include "vk_geometry_buffer.h"
+#include "vk_pipeline_cache.h"
+#include "vk_shader_variants.h"
+#include "vk_scene.h"
+#include "vk_gpu_scene.h"
+#include "vk_parallel.h"
+#include "vk_profiler.h"
+#include "vk_frame_allocator.h"
+#include "vk_descriptors.h"
+#include "vk_texture.h"
+#include "vk_deletion_queue.h"
+#include "vk_frame_pacing.h"
+#include "vk_render_graph.h"
 
-struct MeshPushConstants {
-    glm::vec4 data;
-    glm::mat4 renderMatrix;
+// Variants cycled with space: white and vertex-colored triangle, the scene with
+// its own materials, the scene with debug normals, the instanced mesh grid, and
+// the scene culled and drawn indirectly on the GPU.
+constexpr int SHADER_COUNT = 6;
+
+// Mirrors CameraBuffer in triangleMesh.vert (std140).
+struct GpuCameraData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
 };
 
-struct DeletionQueue
+// Instance matrices one draw can read from the frame allocator.
+constexpr uint32_t MAX_FRAME_INSTANCES = 1024;
+
+#ifndef VKP_FRAME_OVERLAP
+#define VKP_FRAME_OVERLAP 2
+#endif
+
+constexpr unsigned int FRAME_OVERLAP = VKP_FRAME_OVERLAP;
+
+struct FrameData
 {
-    std::deque<std::function<void()>> deletors;
+    VkSemaphore presentSemaphore;
+    VkSemaphore renderSemaphore;
+    VkFence renderFence;
+
+    VkCommandPool commandPool;
+    VkCommandBuffer mainCommandBuffer;
+    // The ImGui overlay, for passes whose contents are secondary buffers.
+    VkCommandBuffer overlayCommandBuffer;
 
-    void pushFunction(std::function<void()> && function)
-    {
-        deletors.push_back(function);
-    }
+    // One pool per job system thread, each with a single secondary buffer, so
+    // recording jobs never share a pool and a pool can be reset as a whole.
+    std::vector<VkCommandPool> recordPools;
+    std::vector<VkCommandBuffer> recordCommandBuffers;
 
-    void flush()
-    {
-        for (auto deletor : deletors)
-            deletor();
+    // Sets that live for one frame; reset once the frame's fence signals.
+    DescriptorAllocator descriptorAllocator;
 
-        deletors.clear();
-    }
+    AllocatedBuffer readbackBuffer;
+    void *readbackData;
+    int readbackFrameNumber{-1};
 };
 
 class VulkanEngine {
@@ -42,41 +79,135 @@ class VulkanEngine {
         VkExtent2D windowExtent{ 1700 , 900 };
         struct SDL_Window* window{ nullptr };
 
+        bool headless{false};
+        int headlessFrameCount{300};
+        FrameDumpFormat dumpFormat{FrameDumpFormat::None};
+        std::string dumpDirectory{"."};
+        bool hostVisibleMeshes{false};
+        int sceneGridSize{11};
+        // Job system threads, the main thread included, which cull, record
+        // the scene draw list and load meshes; 0 uses every hardware thread.
+        unsigned int recordThreadCount{0};
+        // Per-zone GPU timings are streamed here when set.
+        std::string profileCsvPath;
+        // Reports the frame graph's passes, barriers and memory each time
+        // it's rebuilt.
+        bool printGraphStats{false};
+        bool showOverlay{true};
+        // BC1/BC3 when the device supports them, RGBA8 otherwise.
+        bool compressTextures{true};
+        // Layout of the geometry buffer's vertices.
+        VertexFormat vertexFormat{VertexFormat::Float32};
+        // Largest projected LOD error in pixels; 0 always draws LOD 0.
+        float lodPixelThreshold{1.0f};
+        // Cull and draw meshlets individually in the GPU-driven mode instead
+        // of whole objects.
+        bool clusterCulling{true};
+        // Requested present mode; FIFO is used where it's unsupported.
+        VkPresentModeKHR presentMode{VK_PRESENT_MODE_FIFO_KHR};
+        // Presented frames allowed to be queued when input is sampled; 0
+        // leaves it to the frames in flight.
+        uint32_t maxQueuedFrames{0};
+
         VkInstance instance;
         VkDebugUtilsMessengerEXT debugMessenger;
         VkPhysicalDevice physicalDevice;
         VkDevice device;
         VkSurfaceKHR surface;
 
-        VkSwapchainKHR swapchain;
+        VkSwapchainKHR swapchain{VK_NULL_HANDLE};
         VkFormat swapchainImageFormat;
+        VkPresentModeKHR activePresentMode{VK_PRESENT_MODE_FIFO_KHR};
+        // Set on resize and out-of-date or suboptimal presents; the swapchain
+        // is rebuilt before the next frame.
+        bool swapchainDirty{false};
         std::vector<VkImage> swapchainImages;
         std::vector<VkImageView> swapchainImageViews;
+        std::vector<AllocatedImage> offscreenImages;
 
         VkQueue graphicsQueue;
         uint32_t graphicsQueueFamily;
 
-        VkCommandPool commandPool;
-        VkCommandBuffer commandBuffer;
+        VkQueue transferQueue;
+        uint32_t transferQueueFamily;
+        UploadContext uploadContext;
+
+        // Null when VK_KHR_draw_indirect_count is unavailable.
+        PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount{nullptr};
+        // Null unless VK_KHR_present_id and VK_KHR_present_wait are enabled.
+        PFN_vkWaitForPresentKHR waitForPresent{nullptr};
+        FramePacer framePacer;
+
+        DescriptorLayoutCache descriptorLayoutCache;
+        // Backs descriptorSetCache; never reset.
+        DescriptorAllocator descriptorAllocator;
+        DescriptorSetCache descriptorSetCache;
+
+        VkDescriptorSetLayout objectSetLayout;
+        // Set 1 of mesh pipelines: camera and instance data in the frame
+        // allocator, selected per frame with dynamic offsets. The set is
+        // written each frame from that frame's descriptor allocator.
+        VkDescriptorSetLayout frameSetLayout;
+        VkDescriptorSet frameSet;
+        uint32_t frameSetOffsets[2]{0, 0};
+
+        VkDeviceSize frameAllocatorSize{4 * 1024 * 1024};
+        FrameAllocator frameAllocator;
+
+        FrameData frames[FRAME_OVERLAP];
 
+        // Culling, the main pass and, headless, the readback. Rebuilt when the
+        // swapchain or the mode changes; the graph culls what the mode doesn't
+        // draw.
+        RenderGraph frameGraph;
+        uint32_t mainPass{0};
+        RenderResource backbuffer{0};
+        // The main pass's; unchanged across rebuilds while its attachments
+        // are, so pipelines built against it stay valid.
         VkRenderPass renderPass;
-        std::vector<VkFramebuffer> framebuffers;
+        bool frameGraphDirty{false};
+        // Whether the last build read the GPU-driven draws.
+        bool frameGraphIndirect{false};
+        // The scene camera of the frame being recorded, for pass callbacks.
+        glm::mat4 frameViewProjection{1.0f};
+        glm::vec3 frameCameraPosition{0.0f};
 
-        VkSemaphore renderSemaphore;
-        VkSemaphore presentSemaphore;
-        VkFence renderFence;
+        std::string pipelineCachePath{"vkPlayground.pipelinecache"};
+        VkPipelineCache pipelineCache{VK_NULL_HANDLE};
+
+        ShaderCache shaderCache;
+        PipelineVariants pipelineVariants;
+
+        std::vector<Texture> textures;
+        VkSampler textureSampler;
 
-        VkPipeline trianglePipeline;
-        VkPipeline coloredTrianglePipeline;
-        
-        VkPipeline meshPipeline;
         Mesh triangleMesh;
         Mesh monkeyMesh;
+        GeometryBuffer geometryBuffer;
+
+        RenderScene scene;
+        GpuScene gpuScene;
+        std::vector<uint32_t> visibleObjects;
+        JobSystem jobs;
+
+        GpuProfiler profiler;
+        VkDescriptorPool imguiPool;
+        // Draw calls and triangles recorded this frame, for the profiler.
+        uint32_t frameDraws{0};
+        uint64_t frameTriangles{0};
+        uint32_t normalDebugMaterial{0};
 
         VkPipelineLayout graphicsPipelineLayout;
         VkPipelineLayout meshPipelineLayout;
+        // Mesh sets plus a material texture at set 2.
+        VkDescriptorSetLayout textureSetLayout;
+        VkPipelineLayout texturedPipelineLayout;
 
+        // Handles that live until shutdown.
         DeletionQueue mainDeletionQueue;
+        // Handles retired while rendering, destroyed once the frame that
+        // retired them has finished on the GPU.
+        DeletionQueue frameDeletionQueue;
 
         VmaAllocator allocator;
 
@@ -88,18 +219,59 @@ class VulkanEngine {
 
         void run();
 
+        // Times recording the whole scene into secondary command buffers for
+        // 1, 2, 4, ... recording threads.
+        void runRecordingBenchmark(int frameCount);
+        // Creates and retires buffersPerFrame transient buffers per frame
+        // through frameDeletionQueue and times pushing and retiring them.
+        void runDeletionBenchmark(int buffersPerFrame);
+        // Compiles a deferred-style graph of attachments compileCount times
+        // and reports its barriers, subpasses and aliased memory.
+        void runRenderGraphBenchmark(int compileCount);
+
+        FrameData &getCurrentFrame();
+
+        AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
+        // Returns the allocation's result instead of exiting when it fails.
+        VkResult createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, AllocatedBuffer &buffer);
+        AllocatedImage createImage(VkFormat format, VkExtent3D extent, uint32_t mipLevels, VkImageUsageFlags usage);
+
+        // Binds the object set and this frame's frame set for mesh pipelines.
+        void bindMeshSets(VkCommandBuffer cmd, VkPipelineLayout layout);
+
     private:
         void initVulkan();
-        void initSwapchain();
+        void initSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+        void recreateSwapchain();
+        // Hands the swapchain and its views to queue.
+        void retireSwapchain(DeletionQueue &queue);
+        void initOffscreenTargets();
         void initCommands();
-        void initDefaultRenderpass();
-        void initFramebuffers();
+        void initFrameGraph();
+        // Declares and compiles the frame for the current mode and swapchain.
+        void buildFrameGraph();
+        void drawMainPass(VkCommandBuffer cmd, const RenderPassContext &context);
         void initSyncStructures();
-        bool loadShaderModule(std::string filepath, VkShaderModule *outShaderModule);
+        void initDescriptors();
+        DescriptorBuilder frameSetBuilder();
+        void printDescriptorStats() const;
+        void initProfiler();
+        void initImgui();
+        void drawOverlay(VkCommandBuffer cmd, VkFramebuffer framebuffer, bool secondaryContents);
+        void readbackFrame(FrameData &frame);
         void initPipelines();
+        // Viewport and scissor are dynamic so pipelines survive a resize.
+        void setViewport(VkCommandBuffer cmd);
+        void updateLodProjection();
+        PipelineKey pipelineKeyForShader(int shader);
 
         void loadMeshes();
-        void uploadMesh(Mesh &mesh);
+        void loadTextures();
+        void initScene();
+        void drawObjects(VkCommandBuffer cmd, VkFramebuffer framebuffer, const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition, int materialOverride);
+        uint32_t recordDrawList(FrameData &frame, VkFramebuffer framebuffer, uint32_t recorderCount);
+        void recordDrawRange(VkCommandBuffer cmd, size_t first, size_t count);
+
 };
 
 class PipelineBuilder
@@ -110,12 +282,11 @@ class PipelineBuilder
         VkPipelineInputAssemblyStateCreateInfo inputAssembly;
         VkPipelineRasterizationStateCreateInfo rasterizer;
         VkPipelineLayout pipelineLayout;
+        VkPipelineCache pipelineCache{VK_NULL_HANDLE};
         
         VkPipelineColorBlendAttachmentState colorBlendAttachment;
         VkPipelineMultisampleStateCreateInfo multisampling;
-
-        VkViewport viewport;
-        VkRect2D scissor;
+        VkPipelineDepthStencilStateCreateInfo depthStencil;
 
         VkPipeline buildPipeline(VkDevice device, VkRenderPass pass);
 };
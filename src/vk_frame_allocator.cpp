@@ -0,0 +1,97 @@
+#include <vk_frame_allocator.h>
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+void FrameAllocator::init(VmaAllocator allocator, VkPhysicalDevice physicalDevice, VkDeviceSize capacity, VkDeviceSize maxRange, uint32_t frameCount)
+{
+    this->allocator = allocator;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // Both limits are powers of two, so the larger one satisfies both.
+    alignment = std::max<VkDeviceSize>({16, properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment});
+    this->capacity = alignUp(capacity, alignment);
+
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = nullptr,
+        .size = this->capacity + maxRange,
+        .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+
+    VmaAllocationCreateInfo vmaAllocInfo = {
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .usage = VMA_MEMORY_USAGE_CPU_TO_GPU};
+
+    VmaAllocationInfo allocationInfo;
+    VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &buffer.buffer, &buffer.allocation, &allocationInfo));
+    mappedData = (uint8_t *)allocationInfo.pMappedData;
+
+    frameEnds.assign(frameCount, 0);
+}
+
+void FrameAllocator::cleanup()
+{
+    vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+}
+
+void FrameAllocator::beginFrame(uint32_t frameIndex)
+{
+    // Frames retire in order, so once this slot's previous frame is done
+    // everything up to its end is free.
+    currentFrame = frameIndex;
+    tail = std::max(tail, frameEnds[frameIndex]);
+    frameStart = head;
+}
+
+void FrameAllocator::endFrame()
+{
+    frameEnds[currentFrame] = head;
+
+    if (head == frameStart)
+        return;
+
+    const VkDeviceSize begin = frameStart % capacity;
+    const VkDeviceSize end = begin + (head - frameStart);
+    if (end <= capacity)
+    {
+        vmaFlushAllocation(allocator, buffer.allocation, begin, end - begin);
+    }
+    else
+    {
+        vmaFlushAllocation(allocator, buffer.allocation, begin, capacity - begin);
+        vmaFlushAllocation(allocator, buffer.allocation, 0, end - capacity);
+    }
+}
+
+void *FrameAllocator::allocateBytes(VkDeviceSize size, uint32_t &offset)
+{
+    VkDeviceSize position = alignUp(head, alignment);
+
+    // Allocations never straddle the end of the buffer; skip to the start.
+    if (position % capacity + size > capacity)
+        position = alignUp(position, capacity);
+
+    if (position + size - tail > capacity)
+    {
+        if (!reportedFull)
+        {
+            std::cout << "Frame allocator out of space: " << capacity << " bytes shared by frames in flight" << std::endl;
+            reportedFull = true;
+        }
+        return nullptr;
+    }
+
+    head = position + size;
+    offset = (uint32_t)(position % capacity);
+    return mappedData + offset;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vk_types.h"
+
+template <typename T>
+struct FrameAllocation
+{
+    // Null when the ring is out of space.
+    T *data{nullptr};
+    // Byte offset into the ring buffer, for use as a dynamic offset.
+    uint32_t offset{0};
+};
+
+// Linear ring over one persistently mapped buffer for data rewritten every
+// frame: camera constants, per-instance matrices and the like. Allocation is
+// a pointer bump. Space used by a frame is reclaimed when its slot begins
+// again, which happens after that slot's fence has been waited on, so the GPU
+// is never reading what the CPU overwrites.
+class FrameAllocator
+{
+    public:
+        // maxRange is the largest descriptor range bound at an offset into the
+        // ring; the buffer is padded by that much so fixed-range dynamic
+        // descriptors stay valid at any offset.
+        void init(VmaAllocator allocator, VkPhysicalDevice physicalDevice, VkDeviceSize capacity, VkDeviceSize maxRange, uint32_t frameCount);
+        void cleanup();
+
+        void beginFrame(uint32_t frameIndex);
+        // Flushes the frame's writes, for memory that isn't host-coherent.
+        void endFrame();
+
+        template <typename T>
+        FrameAllocation<T> allocate(size_t count = 1)
+        {
+            static_assert(alignof(T) <= 16, "FrameAllocator aligns to at least 16 bytes");
+
+            FrameAllocation<T> allocation;
+            void *data = allocateBytes(sizeof(T) * count, allocation.offset);
+            allocation.data = (T *)data;
+            return allocation;
+        }
+
+        VkBuffer getBuffer() const { return buffer.buffer; }
+        VkDeviceSize getFrameBytes() const { return head - frameStart; }
+
+    private:
+        void *allocateBytes(VkDeviceSize size, uint32_t &offset);
+
+        VmaAllocator allocator;
+        AllocatedBuffer buffer;
+        uint8_t *mappedData{nullptr};
+
+        VkDeviceSize capacity{0};
+        VkDeviceSize alignment{16};
+
+        // Positions grow without wrapping; the buffer offset is position % capacity.
+        VkDeviceSize head{0};
+        VkDeviceSize tail{0};
+        VkDeviceSize frameStart{0};
+        std::vector<VkDeviceSize> frameEnds;
+        uint32_t currentFrame{0};
+
+        bool reportedFull{false};
+};
@@ -0,0 +1,126 @@
+#include <vk_frame_dump.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+    {
+        static uint32_t table[256] = {};
+        if (table[1] == 0)
+        {
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+        }
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void pushBigEndian(std::vector<uint8_t> &out, uint32_t value)
+    {
+        out.push_back(value >> 24);
+        out.push_back(value >> 16);
+        out.push_back(value >> 8);
+        out.push_back(value);
+    }
+
+    void writeChunk(std::ofstream &file, const char type[4], const std::vector<uint8_t> &payload)
+    {
+        std::vector<uint8_t> chunk;
+        chunk.reserve(payload.size() + 12);
+        pushBigEndian(chunk, (uint32_t)payload.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), payload.begin(), payload.end());
+        pushBigEndian(chunk, crc32(chunk.data() + 4, payload.size() + 4));
+
+        file.write((const char *)chunk.data(), chunk.size());
+    }
+}
+
+namespace vkDump
+{
+    bool writeRaw(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cout << "Can't open file: " << path << std::endl;
+            return false;
+        }
+
+        file.write((const char *)rgba, (size_t)width * height * 4);
+        return file.good();
+    }
+
+    bool writePng(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cout << "Can't open file: " << path << std::endl;
+            return false;
+        }
+
+        const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        file.write((const char *)signature, sizeof(signature));
+
+        std::vector<uint8_t> header;
+        pushBigEndian(header, width);
+        pushBigEndian(header, height);
+        header.insert(header.end(), {8, 6, 0, 0, 0});
+        writeChunk(file, "IHDR", header);
+
+        // Scanlines use filter type 0 and are stored uncompressed: dumps are
+        // written from the render loop, so encoding speed matters more than size.
+        const size_t rowSize = (size_t)width * 4 + 1;
+        std::vector<uint8_t> scanlines(rowSize * height);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            scanlines[y * rowSize] = 0;
+            std::copy(rgba + (size_t)y * width * 4, rgba + (size_t)(y + 1) * width * 4, scanlines.begin() + y * rowSize + 1);
+        }
+
+        std::vector<uint8_t> idat = {0x78, 0x01};
+        idat.reserve(scanlines.size() + scanlines.size() / 65535 * 5 + 16);
+
+        uint32_t adlerA = 1;
+        uint32_t adlerB = 0;
+        size_t offset = 0;
+        do
+        {
+            const size_t blockSize = std::min<size_t>(65535, scanlines.size() - offset);
+            const bool last = offset + blockSize == scanlines.size();
+
+            idat.push_back(last ? 1 : 0);
+            idat.push_back(blockSize & 0xFF);
+            idat.push_back(blockSize >> 8);
+            idat.push_back(~blockSize & 0xFF);
+            idat.push_back((~blockSize >> 8) & 0xFF);
+            idat.insert(idat.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+
+            for (size_t i = offset; i < offset + blockSize; ++i)
+            {
+                adlerA = (adlerA + scanlines[i]) % 65521;
+                adlerB = (adlerB + adlerA) % 65521;
+            }
+            offset += blockSize;
+        } while (offset < scanlines.size());
+
+        pushBigEndian(idat, (adlerB << 16) | adlerA);
+        writeChunk(file, "IDAT", idat);
+        writeChunk(file, "IEND", {});
+
+        return file.good();
+    }
+}
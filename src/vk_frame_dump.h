@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum class FrameDumpFormat
+{
+    None,
+    Raw,
+    Png
+};
+
+namespace vkDump
+{
+    // Pixels are tightly packed RGBA8 rows, top row first.
+    bool writeRaw(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba);
+    bool writePng(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba);
+}
@@ -0,0 +1,196 @@
+#include <vk_frame_pacing.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "imgui.h"
+
+namespace
+{
+    constexpr size_t HISTORY_SIZE = 240;
+    // Present ids stay valid after their fence is reused, so more frames can
+    // be pending than are in flight; this only bounds the bookkeeping.
+    constexpr size_t MAX_PENDING_PRESENTS = 8;
+    constexpr uint64_t WAIT_TIMEOUT = 1000000000;
+
+    const struct
+    {
+        VkPresentModeKHR mode;
+        const char *name;
+    } presentModes[] = {
+        {VK_PRESENT_MODE_FIFO_KHR, "fifo"},
+        {VK_PRESENT_MODE_FIFO_RELAXED_KHR, "fifo-relaxed"},
+        {VK_PRESENT_MODE_MAILBOX_KHR, "mailbox"},
+        {VK_PRESENT_MODE_IMMEDIATE_KHR, "immediate"},
+    };
+    constexpr size_t PRESENT_MODE_COUNT = sizeof(presentModes) / sizeof(presentModes[0]);
+}
+
+const char *vkPresent::name(VkPresentModeKHR mode)
+{
+    for (const auto &entry : presentModes)
+    {
+        if (entry.mode == mode)
+            return entry.name;
+    }
+    return "unknown";
+}
+
+bool vkPresent::parse(const char *name, VkPresentModeKHR &mode)
+{
+    for (const auto &entry : presentModes)
+    {
+        if (std::strcmp(entry.name, name) == 0)
+        {
+            mode = entry.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+VkPresentModeKHR vkPresent::next(VkPresentModeKHR mode)
+{
+    for (size_t i = 0; i < PRESENT_MODE_COUNT; ++i)
+    {
+        if (presentModes[i].mode == mode)
+            return presentModes[(i + 1) % PRESENT_MODE_COUNT].mode;
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+VkPresentModeKHR vkPresent::select(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkPresentModeKHR desired)
+{
+    uint32_t modeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &modeCount, nullptr);
+    std::vector<VkPresentModeKHR> modes(modeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &modeCount, modes.data());
+
+    if (std::find(modes.begin(), modes.end(), desired) != modes.end())
+        return desired;
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void FramePacer::init(VkDevice device, PFN_vkWaitForPresentKHR waitForPresent, uint32_t frameOverlap)
+{
+    this->device = device;
+    this->waitForPresent = waitForPresent;
+    this->frameOverlap = std::max(frameOverlap, 1u);
+    inputTime = Clock::now();
+}
+
+void FramePacer::cleanup()
+{
+    if (stats.frames == 0)
+        return;
+
+    std::cout << "Input-to-present latency over " << stats.frames << " frames ("
+              << (measuresPresent() ? "present wait" : "estimated to GPU completion") << "): "
+              << stats.totalMilliseconds / stats.frames << " ms average, " << stats.maxMilliseconds << " ms max, "
+              << stats.dropped << " dropped" << std::endl;
+}
+
+void FramePacer::setSwapchain(VkSwapchainKHR swapchain)
+{
+    this->swapchain = swapchain;
+
+    if (measuresPresent())
+    {
+        stats.dropped += pending.size();
+        pending.clear();
+    }
+}
+
+void FramePacer::waitForQueue()
+{
+    // Without present wait, a frame is collected through its fence, which is
+    // reset when its slot comes around again; frameOverlap pending frames is
+    // as far as draw() gets without waiting on that fence anyway.
+    const size_t inFlight = measuresPresent() ? MAX_PENDING_PRESENTS : frameOverlap;
+    const size_t limit = maxQueuedFrames > 0 ? std::min<size_t>(maxQueuedFrames, inFlight) : inFlight;
+
+    while (pending.size() >= limit)
+        collectOldest(WAIT_TIMEOUT);
+
+    while (!pending.empty() && collectOldest(0))
+        ;
+}
+
+void FramePacer::markInput()
+{
+    inputTime = Clock::now();
+}
+
+uint64_t FramePacer::markPresent(VkFence fence)
+{
+    const uint64_t presentId = measuresPresent() ? nextPresentId++ : 0;
+    pending.push_back({presentId, fence, inputTime});
+    return presentId;
+}
+
+bool FramePacer::collectOldest(uint64_t timeout)
+{
+    const PendingFrame &frame = pending.front();
+
+    const VkResult result = measuresPresent() ? waitForPresent(device, swapchain, frame.presentId, timeout)
+                                              : vkWaitForFences(device, 1, &frame.fence, VK_TRUE, timeout);
+
+    if (result == VK_TIMEOUT && timeout == 0)
+        return false;
+
+    // A blocking wait that times out, or a present that was never shown
+    // because the swapchain went out of date, has nothing to measure.
+    if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+        record(frame.inputTime);
+    else
+        ++stats.dropped;
+
+    pending.pop_front();
+    return true;
+}
+
+void FramePacer::record(Clock::time_point frameInputTime)
+{
+    const double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - frameInputTime).count();
+
+    ++stats.frames;
+    stats.totalMilliseconds += milliseconds;
+    stats.maxMilliseconds = std::max(stats.maxMilliseconds, milliseconds);
+    stats.lastMilliseconds = milliseconds;
+
+    history.push_back((float)milliseconds);
+    if (history.size() > HISTORY_SIZE)
+        history.pop_front();
+}
+
+void FramePacer::drawOverlay(VkPresentModeKHR presentMode) const
+{
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 420.0f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.7f);
+    if (!ImGui::Begin("Latency", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("Present mode: %s (F2)", vkPresent::name(presentMode));
+    if (maxQueuedFrames > 0)
+        ImGui::Text("Queued frames: at most %u (F3)", maxQueuedFrames);
+    else
+        ImGui::TextUnformatted("Queued frames: uncapped (F3)");
+    ImGui::TextUnformatted(measuresPresent() ? "Measured with present wait" : "Estimated to GPU completion");
+
+    if (!history.empty())
+    {
+        std::vector<float> values(history.begin(), history.end());
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%.2f ms (avg %.2f)", stats.lastMilliseconds, stats.totalMilliseconds / stats.frames);
+        ImGui::PlotLines("Latency ms", values.data(), (int)values.size(), 0, overlay, 0.0f, FLT_MAX, ImVec2(260.0f, 40.0f));
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+#include "vk_types.h"
+
+namespace vkPresent
+{
+    // fifo, fifo-relaxed, mailbox or immediate.
+    const char *name(VkPresentModeKHR mode);
+    bool parse(const char *name, VkPresentModeKHR &mode);
+
+    // The mode cycled to at runtime after mode, in the order above.
+    VkPresentModeKHR next(VkPresentModeKHR mode);
+
+    // desired if the surface supports it, FIFO otherwise; FIFO is always
+    // available.
+    VkPresentModeKHR select(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkPresentModeKHR desired);
+}
+
+struct LatencyStats
+{
+    uint64_t frames{0};
+    // Frames whose present was lost to swapchain recreation or timed out.
+    uint64_t dropped{0};
+    double totalMilliseconds{0.0};
+    double maxMilliseconds{0.0};
+    double lastMilliseconds{0.0};
+};
+
+// Caps how many presented frames may still be queued when input is sampled
+// and measures input-to-present latency. With VK_KHR_present_wait a frame is
+// done when it reaches the display; without it, when its rendering fence
+// signals, which leaves out the time spent queued for scanout.
+//
+// Frames that aren't waited on are polled once per frame, so unless the cap
+// makes the pacer block on them their latency is an upper bound, up to one
+// frame late.
+class FramePacer
+{
+    public:
+        // waitForPresent is null unless VK_KHR_present_id and
+        // VK_KHR_present_wait are enabled. frameOverlap is the number of
+        // frames the renderer keeps in flight.
+        void init(VkDevice device, PFN_vkWaitForPresentKHR waitForPresent, uint32_t frameOverlap);
+        // Prints the latency collected so far.
+        void cleanup();
+
+        // Frames presented to the previous swapchain can no longer be
+        // waited on and are dropped.
+        void setSwapchain(VkSwapchainKHR swapchain);
+
+        // 0 lets the CPU run as far ahead as the frames in flight allow; 1
+        // waits for the previous frame before sampling input.
+        void setMaxQueuedFrames(uint32_t count) { maxQueuedFrames = count; }
+        uint32_t getMaxQueuedFrames() const { return maxQueuedFrames; }
+
+        // Blocks until no more than the cap of frames are queued, collecting
+        // the latency of finished frames. Call right before sampling input.
+        void waitForQueue();
+        // Input for the next frame has just been sampled.
+        void markInput();
+        // Call just before presenting; fence signals when the frame's
+        // rendering finishes and must stay unreset until waitForQueue has
+        // seen it, which the engine's frame overlap guarantees. Returns the
+        // id to chain through VkPresentIdKHR, or 0 without present wait.
+        uint64_t markPresent(VkFence fence);
+
+        bool measuresPresent() const { return waitForPresent != nullptr; }
+        const LatencyStats &getStats() const { return stats; }
+
+        // ImGui window with the present mode, queue cap and a rolling latency
+        // graph. Call between ImGui::NewFrame and ImGui::Render.
+        void drawOverlay(VkPresentModeKHR presentMode) const;
+
+    private:
+        using Clock = std::chrono::high_resolution_clock;
+
+        struct PendingFrame
+        {
+            uint64_t presentId;
+            VkFence fence;
+            Clock::time_point inputTime;
+        };
+
+        // Waits up to timeout nanoseconds for the oldest pending frame and
+        // records it if it finished. Returns false if it's still pending.
+        bool collectOldest(uint64_t timeout);
+        void record(Clock::time_point inputTime);
+
+        VkDevice device{VK_NULL_HANDLE};
+        PFN_vkWaitForPresentKHR waitForPresent{nullptr};
+        VkSwapchainKHR swapchain{VK_NULL_HANDLE};
+        uint32_t frameOverlap{1};
+        uint32_t maxQueuedFrames{0};
+
+        std::deque<PendingFrame> pending;
+        Clock::time_point inputTime;
+        uint64_t nextPresentId{1};
+
+        LatencyStats stats;
+        std::deque<float> history;
+};
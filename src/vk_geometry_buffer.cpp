@@ -0,0 +1,237 @@
+#include <vk_geometry_buffer.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "vk_engine.h"
+
+void GeometryBuffer::init(VulkanEngine *engine, VertexFormat vertexFormat, uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    this->engine = engine;
+    this->vertexFormat = vertexFormat;
+    vertexStride = vkVertex::stride(vertexFormat);
+
+    vertexAllocator.reset(vertexCapacity);
+    indexAllocator.reset(indexCapacity);
+
+    if (!createBuffers(vertexCapacity, indexCapacity))
+    {
+        std::cout << "Failed to allocate the geometry buffer" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void GeometryBuffer::cleanup()
+{
+    retire(vertexBuffer, indexBuffer);
+}
+
+bool GeometryBuffer::createBuffers(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    const VmaMemoryUsage memoryUsage = engine->hostVisibleMeshes ? VMA_MEMORY_USAGE_CPU_TO_GPU : VMA_MEMORY_USAGE_GPU_ONLY;
+    const VkBufferUsageFlags transferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    AllocatedBuffer newVertexBuffer;
+    AllocatedBuffer newIndexBuffer;
+    if (engine->createBuffer((size_t)vertexCapacity * vertexStride, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | transferUsage, memoryUsage, newVertexBuffer) != VK_SUCCESS)
+        return false;
+    if (engine->createBuffer((size_t)indexCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | transferUsage, memoryUsage, newIndexBuffer) != VK_SUCCESS)
+    {
+        vmaDestroyBuffer(engine->allocator, newVertexBuffer.buffer, newVertexBuffer.allocation);
+        return false;
+    }
+
+    vertexBuffer = newVertexBuffer;
+    indexBuffer = newIndexBuffer;
+
+    if (engine->hostVisibleMeshes)
+    {
+        vmaMapMemory(engine->allocator, vertexBuffer.allocation, (void **)&mappedVertices);
+        vmaMapMemory(engine->allocator, indexBuffer.allocation, (void **)&mappedIndices);
+    }
+
+    return true;
+}
+
+void GeometryBuffer::retire(AllocatedBuffer oldVertexBuffer, AllocatedBuffer oldIndexBuffer)
+{
+    if (engine->hostVisibleMeshes)
+    {
+        vmaUnmapMemory(engine->allocator, oldVertexBuffer.allocation);
+        vmaUnmapMemory(engine->allocator, oldIndexBuffer.allocation);
+    }
+
+    // Frames in flight may still draw from them.
+    engine->frameDeletionQueue.push(oldVertexBuffer.buffer, oldVertexBuffer.allocation);
+    engine->frameDeletionQueue.push(oldIndexBuffer.buffer, oldIndexBuffer.allocation);
+}
+
+bool GeometryBuffer::grow(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    const uint32_t oldVertexCapacity = (uint32_t)vertexAllocator.getCapacity();
+    const uint32_t oldIndexCapacity = (uint32_t)indexAllocator.getCapacity();
+
+    AllocatedBuffer oldVertexBuffer = vertexBuffer;
+    AllocatedBuffer oldIndexBuffer = indexBuffer;
+
+    engine->uploadContext.flush();
+    if (!createBuffers(vertexCapacity, indexCapacity))
+    {
+        std::cout << "Failed to grow the geometry buffer to " << vertexCapacity << " vertices and " << indexCapacity << " indices" << std::endl;
+        return false;
+    }
+
+    engine->uploadContext.copyBuffer(oldVertexBuffer.buffer, vertexBuffer.buffer, {0, 0, (VkDeviceSize)oldVertexCapacity * vertexStride});
+    engine->uploadContext.copyBuffer(oldIndexBuffer.buffer, indexBuffer.buffer, {0, 0, (VkDeviceSize)oldIndexCapacity * sizeof(uint32_t)});
+    engine->uploadContext.flush();
+
+    retire(oldVertexBuffer, oldIndexBuffer);
+
+    vertexAllocator.grow(vertexCapacity);
+    indexAllocator.grow(indexCapacity);
+
+    std::cout << "Geometry buffer grown to " << vertexCapacity << " vertices and " << indexCapacity << " indices" << std::endl;
+    return true;
+}
+
+bool GeometryBuffer::addMesh(Mesh &mesh)
+{
+    const uint32_t vertexCount = (uint32_t)mesh.getVertexCount();
+    const uint32_t indexCount = (uint32_t)mesh.getIndexCount();
+
+    // Nothing to draw, e.g. a mesh that failed to load; the allocators have
+    // no zero-sized ranges, so record empty ones instead of growing.
+    if (vertexCount == 0 || indexCount == 0)
+    {
+        mesh.firstVertex = 0;
+        mesh.vertexCount = 0;
+        mesh.firstIndex = 0;
+        mesh.indexCount = 0;
+        return true;
+    }
+
+    uint64_t firstVertex = vertexAllocator.allocate(vertexCount);
+    uint64_t firstIndex = indexAllocator.allocate(indexCount);
+
+    if (firstVertex == OffsetAllocator::INVALID_OFFSET || firstIndex == OffsetAllocator::INVALID_OFFSET)
+    {
+        if (firstVertex != OffsetAllocator::INVALID_OFFSET)
+            vertexAllocator.free(firstVertex);
+        if (firstIndex != OffsetAllocator::INVALID_OFFSET)
+            indexAllocator.free(firstIndex);
+
+        const uint64_t vertexCapacity = std::max(vertexAllocator.getCapacity() * 2, vertexAllocator.getCapacity() + vertexCount);
+        const uint64_t indexCapacity = std::max(indexAllocator.getCapacity() * 2, indexAllocator.getCapacity() + indexCount);
+        if (vertexCapacity > UINT32_MAX || indexCapacity > UINT32_MAX)
+        {
+            std::cout << "Geometry buffer is full" << std::endl;
+            return false;
+        }
+
+        if (!grow((uint32_t)vertexCapacity, (uint32_t)indexCapacity))
+            return false;
+
+        firstVertex = vertexAllocator.allocate(vertexCount);
+        firstIndex = indexAllocator.allocate(indexCount);
+        if (firstVertex == OffsetAllocator::INVALID_OFFSET || firstIndex == OffsetAllocator::INVALID_OFFSET)
+        {
+            if (firstVertex != OffsetAllocator::INVALID_OFFSET)
+                vertexAllocator.free(firstVertex);
+            if (firstIndex != OffsetAllocator::INVALID_OFFSET)
+                indexAllocator.free(firstIndex);
+
+            std::cout << "Geometry buffer allocation failed after growing" << std::endl;
+            return false;
+        }
+    }
+
+    mesh.firstVertex = (uint32_t)firstVertex;
+    mesh.vertexCount = vertexCount;
+    mesh.firstIndex = (uint32_t)firstIndex;
+    mesh.indexCount = indexCount;
+
+    vkVertex::dequantization(vertexFormat, mesh.boundsMin, mesh.boundsMax, mesh.positionScale, mesh.positionOffset);
+
+    if (engine->hostVisibleMeshes)
+    {
+        vkVertex::encode(vertexFormat, mesh.getVertexData(), vertexCount, mesh.positionScale, mesh.positionOffset, mappedVertices + firstVertex * vertexStride);
+        std::memcpy(mappedIndices + firstIndex, mesh.getIndexData(), (size_t)indexCount * sizeof(uint32_t));
+
+        vmaFlushAllocation(engine->allocator, vertexBuffer.allocation, firstVertex * vertexStride, (VkDeviceSize)vertexCount * vertexStride);
+        vmaFlushAllocation(engine->allocator, indexBuffer.allocation, firstIndex * sizeof(uint32_t), (VkDeviceSize)indexCount * sizeof(uint32_t));
+    }
+    else
+    {
+        if (vertexFormat == VertexFormat::Float32)
+        {
+            engine->uploadContext.uploadBuffer(vertexBuffer.buffer, firstVertex * vertexStride, mesh.getVertexData(), (VkDeviceSize)vertexCount * vertexStride);
+        }
+        else
+        {
+            // Staging pieces can split a vertex, so encode the whole mesh first.
+            std::vector<uint8_t> encodedVertices((size_t)vertexCount * vertexStride);
+            vkVertex::encode(vertexFormat, mesh.getVertexData(), vertexCount, mesh.positionScale, mesh.positionOffset, encodedVertices.data());
+            engine->uploadContext.uploadBuffer(vertexBuffer.buffer, firstVertex * vertexStride, encodedVertices.data(), (VkDeviceSize)encodedVertices.size());
+        }
+        engine->uploadContext.uploadBuffer(indexBuffer.buffer, firstIndex * sizeof(uint32_t), mesh.getIndexData(), (VkDeviceSize)indexCount * sizeof(uint32_t));
+    }
+
+    return true;
+}
+
+void GeometryBuffer::removeMesh(Mesh &mesh)
+{
+    if (mesh.vertexCount > 0)
+        vertexAllocator.free(mesh.firstVertex);
+    if (mesh.indexCount > 0)
+        indexAllocator.free(mesh.firstIndex);
+
+    mesh.vertexCount = 0;
+    mesh.indexCount = 0;
+}
+
+bool GeometryBuffer::defragment(const std::vector<Mesh *> &meshes)
+{
+    AllocatedBuffer oldVertexBuffer = vertexBuffer;
+    AllocatedBuffer oldIndexBuffer = indexBuffer;
+
+    engine->uploadContext.flush();
+    if (!createBuffers((uint32_t)vertexAllocator.getCapacity(), (uint32_t)indexAllocator.getCapacity()))
+    {
+        std::cout << "Failed to allocate buffers to defragment the geometry buffer into" << std::endl;
+        return false;
+    }
+
+    vertexAllocator.reset(vertexAllocator.getCapacity());
+    indexAllocator.reset(indexAllocator.getCapacity());
+
+    for (Mesh *mesh : meshes)
+    {
+        if (mesh->vertexCount == 0)
+            continue;
+
+        const uint32_t firstVertex = (uint32_t)vertexAllocator.allocate(mesh->vertexCount);
+        const uint32_t firstIndex = (uint32_t)indexAllocator.allocate(mesh->indexCount);
+
+        engine->uploadContext.copyBuffer(oldVertexBuffer.buffer, vertexBuffer.buffer,
+                                         {(VkDeviceSize)mesh->firstVertex * vertexStride, (VkDeviceSize)firstVertex * vertexStride, (VkDeviceSize)mesh->vertexCount * vertexStride});
+        engine->uploadContext.copyBuffer(oldIndexBuffer.buffer, indexBuffer.buffer,
+                                         {(VkDeviceSize)mesh->firstIndex * sizeof(uint32_t), (VkDeviceSize)firstIndex * sizeof(uint32_t), (VkDeviceSize)mesh->indexCount * sizeof(uint32_t)});
+
+        mesh->firstVertex = firstVertex;
+        mesh->firstIndex = firstIndex;
+    }
+
+    engine->uploadContext.flush();
+
+    retire(oldVertexBuffer, oldIndexBuffer);
+    return true;
+}
+
+void GeometryBuffer::bind(VkCommandBuffer cmd) const
+{
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer.buffer, &offset);
+    vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_mesh.h"
+#include "vk_vertex_format.h"
+#include "vk_offset_allocator.h"
+
+class VulkanEngine;
+
+// One vertex buffer and one 32-bit index buffer shared by every mesh. Meshes
+// only record their ranges, so a whole scene draws after a single bind().
+class GeometryBuffer
+{
+    public:
+        AllocatedBuffer vertexBuffer;
+        AllocatedBuffer indexBuffer;
+
+        // Vertices are encoded to vertexFormat as meshes are added.
+        void init(VulkanEngine *engine, VertexFormat vertexFormat, uint32_t vertexCapacity, uint32_t indexCapacity);
+        void cleanup();
+
+        // Also sets the mesh's dequantization scale and offset.
+        bool addMesh(Mesh &mesh);
+        // The mesh's ranges are reused immediately, so only remove meshes the
+        // GPU has finished reading (e.g. from a frame deletion queue).
+        void removeMesh(Mesh &mesh);
+        // Packs the given meshes to the front of new buffers and retires the old
+        // ones through the engine's frame deletion queue. Returns false and
+        // leaves everything as it was when the new buffers can't be allocated.
+        bool defragment(const std::vector<Mesh *> &meshes);
+
+        void bind(VkCommandBuffer cmd) const;
+
+        VertexFormat getVertexFormat() const { return vertexFormat; }
+
+    private:
+        // Replaces the buffers only when both allocations succeed.
+        bool createBuffers(uint32_t vertexCapacity, uint32_t indexCapacity);
+        bool grow(uint32_t vertexCapacity, uint32_t indexCapacity);
+        void retire(AllocatedBuffer oldVertexBuffer, AllocatedBuffer oldIndexBuffer);
+
+        VulkanEngine *engine{nullptr};
+
+        VertexFormat vertexFormat{VertexFormat::Float32};
+        uint32_t vertexStride{sizeof(Vertex)};
+
+        OffsetAllocator vertexAllocator;
+        OffsetAllocator indexAllocator;
+
+        uint8_t *mappedVertices{nullptr};
+        uint32_t *mappedIndices{nullptr};
+};
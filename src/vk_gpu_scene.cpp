@@ -0,0 +1,342 @@
+#include <vk_gpu_scene.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+#include "vk_engine.h"
+#include "vk_initializers.h"
+
+namespace
+{
+    // Bits of CullPushConstants::flags.
+    constexpr uint32_t CULL_COMPACT = 1 << 0;
+    constexpr uint32_t CULL_CLUSTERS = 1 << 1;
+
+    struct CullPushConstants
+    {
+        glm::vec4 frustumPlanes[6];
+        uint32_t objectCount;
+        uint32_t flags;
+        float lodThreshold;
+        float lodHysteresis;
+        // xyz camera position, w LodSettings::projectionScale.
+        glm::vec4 camera;
+    };
+
+    static_assert(sizeof(CullPushConstants) <= 128, "Push constants must fit the guaranteed minimum");
+
+    // Takes a mesh-space meshlet to the geometry buffer's vertex space.
+    GpuMeshletData toGpuMeshlet(const Mesh &mesh, const Meshlet &meshlet)
+    {
+        const glm::vec3 scale = mesh.positionScale;
+        const glm::vec3 offset = mesh.positionOffset;
+        const float meshRadius = mesh.boundingSphere.w > 0.0f ? mesh.boundingSphere.w : 1.0f;
+
+        return {
+            .sphere = glm::vec4((glm::vec3(meshlet.sphere) - offset) / scale, meshlet.sphere.w / meshRadius),
+            .cone = glm::vec4((meshlet.coneApex - offset) / scale, meshlet.coneCutoff),
+            .coneAxis = glm::vec4(meshlet.coneAxis / scale, 0.0f),
+            .firstIndex = mesh.firstIndex + meshlet.firstIndex,
+            .indexCount = meshlet.triangleCount * 3,
+            .padding = {0, 0}};
+    }
+}
+
+void GpuScene::init(VulkanEngine *engine, const RenderScene &scene, bool clusterCulling)
+{
+    this->engine = engine;
+    this->clusterCulling = clusterCulling;
+    objectCount = (uint32_t)scene.getObjectCount();
+
+    // Every mesh's LODs, LOD 0 first, and their meshlets. A LOD without
+    // meshlets gets one covering all of it that is never culled on its own.
+    std::vector<GpuLodData> lods;
+    std::vector<GpuMeshletData> meshlets;
+    std::vector<uint32_t> meshFirstLods(scene.meshes.size());
+    std::vector<uint32_t> meshCommandCounts(scene.meshes.size(), 1);
+    for (size_t m = 0; m < scene.meshes.size(); ++m)
+    {
+        const Mesh &mesh = *scene.meshes[m];
+        meshFirstLods[m] = (uint32_t)lods.size();
+        for (uint32_t level = 0; level < mesh.getLodCount(); ++level)
+        {
+            const MeshLod lod = mesh.getLod(level);
+            const uint32_t firstMeshlet = (uint32_t)meshlets.size();
+            for (uint32_t i = 0; i < lod.meshletCount; ++i)
+                meshlets.push_back(toGpuMeshlet(mesh, mesh.meshlets[lod.firstMeshlet + i]));
+
+            if (lod.meshletCount == 0)
+            {
+                const Meshlet whole = {
+                    .firstIndex = lod.firstIndex,
+                    .triangleCount = lod.indexCount / 3,
+                    .vertexCount = (uint32_t)mesh.getVertexCount(),
+                    .sphere = mesh.boundingSphere,
+                    .coneApex = glm::vec3(mesh.boundingSphere),
+                    .coneAxis = glm::vec3(0.0f, 0.0f, 1.0f),
+                    .coneCutoff = 2.0f};
+                meshlets.push_back(toGpuMeshlet(mesh, whole));
+            }
+
+            lods.push_back({
+                .firstIndex = mesh.firstIndex + lod.firstIndex,
+                .indexCount = lod.indexCount,
+                .error = mesh.boundingSphere.w > 0.0f ? lod.error / mesh.boundingSphere.w : 0.0f,
+                .firstMeshlet = firstMeshlet,
+                .meshletCount = (uint32_t)meshlets.size() - firstMeshlet,
+                .padding = {0, 0, 0}});
+
+            if (clusterCulling)
+                meshCommandCounts[m] = std::max(meshCommandCounts[m], lods.back().meshletCount);
+        }
+    }
+
+    // One batch per material, with its commands in a contiguous range. Each
+    // object owns as many commands as its mesh's LODs have meshlets at most.
+    std::vector<uint32_t> order(objectCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                     { return scene.objectMaterials[a] < scene.objectMaterials[b]; });
+
+    std::vector<GpuObjectData> objects(objectCount);
+    commandCount = 0;
+    for (uint32_t object : order)
+    {
+        const uint32_t material = scene.objectMaterials[object];
+        const uint32_t meshIndex = scene.objectMeshes[object];
+        const Mesh &mesh = *scene.meshes[meshIndex];
+
+        const uint32_t slot = commandCount;
+        commandCount += meshCommandCounts[meshIndex];
+
+        if (batches.empty() || batches.back().material != material)
+            batches.push_back({.material = material, .firstCommand = slot, .commandCount = 0});
+        batches.back().commandCount += meshCommandCounts[meshIndex];
+
+        objects[object] = {
+            .model = scene.objectTransforms[object] * mesh.getDequantizeTransform(),
+            .sphere = scene.objectBounds.get(object),
+            .firstIndex = mesh.firstIndex + mesh.getLod(0).firstIndex,
+            .indexCount = mesh.getLod(0).indexCount,
+            .vertexOffset = (int32_t)mesh.firstVertex,
+            .batch = (uint32_t)batches.size() - 1,
+            .batchFirstCommand = batches.back().firstCommand,
+            .commandSlot = slot,
+            .firstLod = meshFirstLods[meshIndex],
+            .lodCount = mesh.getLodCount()};
+    }
+
+    const size_t objectBufferSize = std::max<size_t>(objects.size(), 1) * sizeof(GpuObjectData);
+    objectBuffer = engine->createBuffer(objectBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    const size_t lodStateSize = std::max<size_t>(objects.size(), 1) * sizeof(uint32_t);
+    lodBuffer = engine->createBuffer(std::max<size_t>(lods.size(), 1) * sizeof(GpuLodData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    meshletBuffer = engine->createBuffer(std::max<size_t>(meshlets.size(), 1) * sizeof(GpuMeshletData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    lodStateBuffer = engine->createBuffer(lodStateSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+    if (!objects.empty())
+    {
+        engine->uploadContext.uploadBuffer(objectBuffer.buffer, 0, objects.data(), objects.size() * sizeof(GpuObjectData));
+        engine->uploadContext.uploadBuffer(lodBuffer.buffer, 0, lods.data(), lods.size() * sizeof(GpuLodData));
+        engine->uploadContext.uploadBuffer(meshletBuffer.buffer, 0, meshlets.data(), meshlets.size() * sizeof(GpuMeshletData));
+        engine->uploadContext.uploadBuffer(lodStateBuffer.buffer, 0, lodStateSize, [](void *dst, VkDeviceSize, VkDeviceSize size)
+                                           { std::memset(dst, 0, size); });
+        engine->uploadContext.flush();
+    }
+
+    DescriptorBuilder(engine->descriptorLayoutCache, engine->descriptorSetCache)
+        .bindBuffer(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, objectBuffer.buffer, 0, VK_WHOLE_SIZE)
+        .build(objectSet);
+
+    initCullPipeline();
+
+    frames.resize(FRAME_OVERLAP);
+    for (FrameResources &frame : frames)
+    {
+        frame.commandBuffer = engine->createBuffer(std::max<size_t>(commandCount, 1) * sizeof(VkDrawIndexedIndirectCommand),
+                                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                   VMA_MEMORY_USAGE_GPU_ONLY);
+        frame.countBuffer = engine->createBuffer(std::max<size_t>(batches.size(), 1) * sizeof(uint32_t),
+                                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                 VMA_MEMORY_USAGE_GPU_ONLY);
+
+        VkBufferCreateInfo statsInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext = nullptr,
+            .size = sizeof(GpuCullStats),
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+        VmaAllocationCreateInfo statsAllocInfo = {
+            .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage = VMA_MEMORY_USAGE_GPU_TO_CPU};
+        VmaAllocationInfo allocationInfo;
+        VK_CHECK(vmaCreateBuffer(engine->allocator, &statsInfo, &statsAllocInfo, &frame.statsBuffer.buffer, &frame.statsBuffer.allocation, &allocationInfo));
+        frame.mappedStats = (GpuCullStats *)allocationInfo.pMappedData;
+        frame.statsPending = false;
+
+        DescriptorBuilder(engine->descriptorLayoutCache, engine->descriptorSetCache)
+            .bindBuffer(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, frame.commandBuffer.buffer, 0, VK_WHOLE_SIZE)
+            .bindBuffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, frame.countBuffer.buffer, 0, VK_WHOLE_SIZE)
+            .bindBuffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, lodBuffer.buffer, 0, VK_WHOLE_SIZE)
+            .bindBuffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, lodStateBuffer.buffer, 0, VK_WHOLE_SIZE)
+            .bindBuffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, meshletBuffer.buffer, 0, VK_WHOLE_SIZE)
+            .bindBuffer(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, frame.statsBuffer.buffer, 0, VK_WHOLE_SIZE)
+            .build(frame.cullSet);
+    }
+
+    std::cout << "GPU scene: " << objectCount << " objects in " << batches.size() << " batches, " << commandCount << " commands, "
+              << meshlets.size() << " meshlets" << (clusterCulling ? " culled individually, " : " drawn whole, ")
+              << (engine->drawIndexedIndirectCount ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirect fallback") << std::endl;
+}
+
+void GpuScene::initCullPipeline()
+{
+    cullSetLayout = DescriptorBuilder(engine->descriptorLayoutCache, engine->descriptorSetCache)
+                        .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .buildLayout();
+
+    VkDescriptorSetLayout setLayouts[] = {engine->objectSetLayout, cullSetLayout};
+    VkPushConstantRange pushConstant = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(CullPushConstants)};
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkInit::pipelineLayoutCreateInfo();
+    pipelineLayoutInfo.setLayoutCount = 2;
+    pipelineLayoutInfo.pSetLayouts = setLayouts;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+    VK_CHECK(vkCreatePipelineLayout(engine->device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout));
+
+    VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = nullptr,
+        .stage = vkInit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, engine->shaderCache.get("../shaders/cull.comp.spv")),
+        .layout = cullPipelineLayout};
+    VK_CHECK(vkCreateComputePipelines(engine->device, engine->pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline));
+}
+
+void GpuScene::cleanup()
+{
+    if (statsFrames > 0)
+    {
+        const uint64_t visibleSum = drawnTriangleSum + frustumCulledSum + backfaceCulledSum;
+        std::cout << "GPU culling over " << statsFrames << " frames: " << drawnTriangleSum / statsFrames << " triangles drawn per frame, "
+                  << objectCulledSum / statsFrames << " culled with their object, " << frustumCulledSum / statsFrames << " by cluster frustum and "
+                  << backfaceCulledSum / statsFrames << " by cluster cone (" << 100.0 * (frustumCulledSum + backfaceCulledSum) / std::max<uint64_t>(visibleSum, 1)
+                  << "% of visible objects' triangles)" << std::endl;
+    }
+
+    for (FrameResources &frame : frames)
+    {
+        vmaDestroyBuffer(engine->allocator, frame.commandBuffer.buffer, frame.commandBuffer.allocation);
+        vmaDestroyBuffer(engine->allocator, frame.countBuffer.buffer, frame.countBuffer.allocation);
+        vmaDestroyBuffer(engine->allocator, frame.statsBuffer.buffer, frame.statsBuffer.allocation);
+    }
+    frames.clear();
+
+    vmaDestroyBuffer(engine->allocator, objectBuffer.buffer, objectBuffer.allocation);
+    vmaDestroyBuffer(engine->allocator, lodBuffer.buffer, lodBuffer.allocation);
+    vmaDestroyBuffer(engine->allocator, meshletBuffer.buffer, meshletBuffer.allocation);
+    vmaDestroyBuffer(engine->allocator, lodStateBuffer.buffer, lodStateBuffer.allocation);
+
+    vkDestroyPipeline(engine->device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(engine->device, cullPipelineLayout, nullptr);
+}
+
+void GpuScene::cull(VkCommandBuffer cmd, uint32_t frameIndex, const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition, const LodSettings &lodSettings)
+{
+    FrameResources &frame = frames[frameIndex];
+    const bool compact = engine->drawIndexedIndirectCount != nullptr;
+
+    // The frame's fence has signalled, so its last cull's counters are final.
+    if (frame.statsPending)
+    {
+        vmaInvalidateAllocation(engine->allocator, frame.statsBuffer.allocation, 0, VK_WHOLE_SIZE);
+        lastStats = *frame.mappedStats;
+        ++statsFrames;
+        drawnTriangleSum += lastStats.drawnTriangles;
+        objectCulledSum += lastStats.objectCulledTriangles;
+        frustumCulledSum += lastStats.frustumCulledTriangles;
+        backfaceCulledSum += lastStats.backfaceCulledTriangles;
+    }
+    frame.statsPending = true;
+
+    vkCmdFillBuffer(cmd, frame.countBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    vkCmdFillBuffer(cmd, frame.statsBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    // Without a count every command is drawn, so culled ones must be empty.
+    if (!compact)
+        vkCmdFillBuffer(cmd, frame.commandBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+
+    // The LOD state was last written by the previous frame's cull.
+    VkBufferMemoryBarrier clearBarriers[] = {
+        vkInit::bufferMemoryBarrier(frame.countBuffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT),
+        vkInit::bufferMemoryBarrier(frame.statsBuffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT),
+        vkInit::bufferMemoryBarrier(lodStateBuffer.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT),
+        vkInit::bufferMemoryBarrier(frame.commandBuffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT)};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         compact ? 3 : 4, clearBarriers, 0, nullptr);
+
+    CullPushConstants constants;
+    vkCull::extractFrustumPlanes(viewProjection, constants.frustumPlanes);
+    constants.objectCount = objectCount;
+    constants.flags = (compact ? CULL_COMPACT : 0) | (clusterCulling ? CULL_CLUSTERS : 0);
+    constants.lodThreshold = lodSettings.pixelThreshold;
+    constants.lodHysteresis = lodSettings.hysteresis;
+    constants.camera = glm::vec4(cameraPosition, lodSettings.projectionScale);
+
+    VkDescriptorSet sets[] = {objectSet, frame.cullSet};
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 2, sets, 0, nullptr);
+    vkCmdPushConstants(cmd, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &constants);
+    vkCmdDispatch(cmd, (objectCount + 63) / 64, 1, 1);
+
+    VkBufferMemoryBarrier statsBarrier = vkInit::bufferMemoryBarrier(frame.statsBuffer.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &statsBarrier, 0, nullptr);
+}
+
+std::vector<VkBuffer> GpuScene::getCommandBuffers() const
+{
+    std::vector<VkBuffer> buffers;
+    for (const FrameResources &frame : frames)
+        buffers.push_back(frame.commandBuffer.buffer);
+    return buffers;
+}
+
+std::vector<VkBuffer> GpuScene::getCountBuffers() const
+{
+    std::vector<VkBuffer> buffers;
+    for (const FrameResources &frame : frames)
+        buffers.push_back(frame.countBuffer.buffer);
+    return buffers;
+}
+
+void GpuScene::drawIndirect(VkCommandBuffer cmd, uint32_t frameIndex, const RenderScene &scene)
+{
+    FrameResources &frame = frames[frameIndex];
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+    engine->geometryBuffer.bind(cmd);
+
+    for (uint32_t i = 0; i < batches.size(); ++i)
+    {
+        const Batch &batch = batches[i];
+        const Material &material = scene.materials[batch.material];
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
+        if (i == 0)
+            engine->bindMeshSets(cmd, material.pipelineLayout);
+        if (material.descriptorSet != VK_NULL_HANDLE)
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipelineLayout, 2, 1, &material.descriptorSet, 0, nullptr);
+
+        if (engine->drawIndexedIndirectCount)
+            engine->drawIndexedIndirectCount(cmd, frame.commandBuffer.buffer, batch.firstCommand * stride,
+                                             frame.countBuffer.buffer, i * sizeof(uint32_t), batch.commandCount, stride);
+        else
+            vkCmdDrawIndexedIndirect(cmd, frame.commandBuffer.buffer, batch.firstCommand * stride, batch.commandCount, stride);
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "vk_types.h"
+#include "vk_scene.h"
+
+class VulkanEngine;
+
+// Mirrors ObjectData in triangleMesh.vert and cull.comp (std430). firstIndex
+// and indexCount are LOD 0's.
+struct GpuObjectData
+{
+    glm::mat4 model;
+    // World-space bounding sphere: xyz center, w radius.
+    glm::vec4 sphere;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    uint32_t batch;
+    uint32_t batchFirstCommand;
+    uint32_t commandSlot;
+    // The mesh's range in the LOD buffer.
+    uint32_t firstLod;
+    uint32_t lodCount;
+};
+
+static_assert(sizeof(GpuObjectData) == 112, "GpuObjectData must match the std430 layout in the shaders");
+
+// Mirrors LodData in cull.comp (std430).
+struct GpuLodData
+{
+    // Absolute in the geometry buffer.
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Relative to the mesh's bounding sphere radius, so the shader scales it
+    // by the object's world-space radius.
+    float error;
+    // The LOD's range in the meshlet buffer; never empty.
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    uint32_t padding[3];
+};
+
+static_assert(sizeof(GpuLodData) == 32, "GpuLodData must match the std430 layout in cull.comp");
+
+// Mirrors MeshletData in cull.comp (std430). Points are in the geometry
+// buffer's vertex space, so the object's model matrix takes them to world
+// space whatever the vertex format.
+struct GpuMeshletData
+{
+    // xyz center, w radius relative to the mesh's bounding sphere radius.
+    glm::vec4 sphere;
+    // xyz cone apex, w cutoff; above 1 for meshlets that can't be cone culled.
+    glm::vec4 cone;
+    // xyz cone axis, scaled so the model matrix's linear part maps it to the
+    // world-space axis; normalized in the shader.
+    glm::vec4 coneAxis;
+    // Absolute in the geometry buffer.
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t padding[2];
+};
+
+static_assert(sizeof(GpuMeshletData) == 64, "GpuMeshletData must match the std430 layout in cull.comp");
+
+// Mirrors CullStats in cull.comp. Triangle counts are at each object's
+// selected LOD; objects outside the frustum count at their last one.
+struct GpuCullStats
+{
+    uint32_t drawnClusters;
+    uint32_t drawnTriangles;
+    uint32_t objectCulledTriangles;
+    uint32_t frustumCulledTriangles;
+    uint32_t backfaceCulledTriangles;
+};
+
+// GPU copy of a RenderScene's objects. Mesh shaders read transforms from the
+// object buffer by instance index, and cull() builds the indirect draws for
+// drawIndirect() with a compute frustum cull and LOD selection. With cluster
+// culling each visible object's LOD is split into meshlets, and every meshlet
+// that passes its own frustum and backface cone tests gets a draw.
+class GpuScene
+{
+    public:
+        VkDescriptorSet objectSet{VK_NULL_HANDLE};
+
+        void init(VulkanEngine *engine, const RenderScene &scene, bool clusterCulling);
+        void cleanup();
+
+        // Must be recorded outside of a render pass. The caller makes the
+        // draws visible to drawIndirect(); the frame graph derives that
+        // barrier from the buffers below.
+        void cull(VkCommandBuffer cmd, uint32_t frameIndex, const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition, const LodSettings &lodSettings);
+        void drawIndirect(VkCommandBuffer cmd, uint32_t frameIndex, const RenderScene &scene);
+
+        // Counters of the last cull whose frame has finished, FRAME_OVERLAP
+        // frames behind the one being recorded.
+        const GpuCullStats &getLastStats() const { return lastStats; }
+
+        // What cull() writes and drawIndirect() reads, one buffer per frame in
+        // flight; empty before init().
+        std::vector<VkBuffer> getCommandBuffers() const;
+        std::vector<VkBuffer> getCountBuffers() const;
+
+    private:
+        struct Batch
+        {
+            uint32_t material;
+            uint32_t firstCommand;
+            uint32_t commandCount;
+        };
+
+        struct FrameResources
+        {
+            AllocatedBuffer commandBuffer;
+            AllocatedBuffer countBuffer;
+            AllocatedBuffer statsBuffer;
+            GpuCullStats *mappedStats;
+            bool statsPending;
+            VkDescriptorSet cullSet;
+        };
+
+        void initCullPipeline();
+
+        VulkanEngine *engine{nullptr};
+
+        uint32_t objectCount{0};
+        // Indirect commands: one per object, or per meshlet of each object's
+        // LOD with the most meshlets when cluster culling.
+        uint32_t commandCount{0};
+        bool clusterCulling{true};
+        AllocatedBuffer objectBuffer;
+        AllocatedBuffer lodBuffer;
+        AllocatedBuffer meshletBuffer;
+        // Each object's last LOD, kept across frames for hysteresis.
+        AllocatedBuffer lodStateBuffer;
+        std::vector<Batch> batches;
+        std::vector<FrameResources> frames;
+
+        GpuCullStats lastStats{};
+        // Sums over every cull read back, reported by cleanup().
+        uint64_t statsFrames{0};
+        uint64_t drawnTriangleSum{0};
+        uint64_t objectCulledSum{0};
+        uint64_t frustumCulledSum{0};
+        uint64_t backfaceCulledSum{0};
+
+        VkDescriptorSetLayout cullSetLayout;
+        VkPipelineLayout cullPipelineLayout;
+        VkPipeline cullPipeline;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile
+{
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        bool open(const std::string &path);
+        void close();
+
+        const uint8_t *data() const { return mappedData; }
+        size_t size() const { return mappedSize; }
+
+    private:
+        const uint8_t *mappedData{nullptr};
+        size_t mappedSize{0};
+
+#ifdef _WIN32
+        void *fileHandle{nullptr};
+        void *mappingHandle{nullptr};
+#endif
+};
@@ -1,8 +1,105 @@
 #include <vk_mesh.h>
 
 #include <iostream>
+#include <cstring>
+#include <chrono>
+#include <unordered_map>
 
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#ifdef VKP_VALIDATE_OBJ_PARSER
 #include "tiny_obj_loader.h"
+#endif
+
+#include "vk_mapped_file.h"
+#include "vk_mesh_cache.h"
+#include "vk_mesh_optimizer.h"
+#include "vk_mesh_lod.h"
+#include "vk_meshlet.h"
+#include "vk_obj_parser.h"
+
+namespace
+{
+    struct VertexHash
+    {
+        size_t operator()(const Vertex &vertex) const
+        {
+            const float values[8] = {
+                vertex.position.x, vertex.position.y, vertex.position.z,
+                vertex.normal.x, vertex.normal.y, vertex.normal.z,
+                vertex.uv.x, vertex.uv.y};
+
+            size_t hash = 14695981039346656037ull;
+            for (float value : values)
+            {
+                // Equality is float ==, under which -0 and +0 match, so they
+                // must hash alike.
+                if (value == 0.0f)
+                    value = 0.0f;
+
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                hash = (hash ^ bits) * 1099511628211ull;
+            }
+            return hash;
+        }
+    };
+
+#ifdef VKP_VALIDATE_OBJ_PARSER
+    bool matchesTinyObj(const std::string &filename, const ObjData &obj)
+    {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warn;
+        std::string err;
+
+        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str(), nullptr))
+        {
+            std::cerr << filename << ": tinyobj failed: " << err << std::endl;
+            return false;
+        }
+
+        auto sameFloats = [](const std::vector<float> &a, const std::vector<float> &b)
+        {
+            if (a.size() != b.size())
+                return false;
+            for (size_t i = 0; i < a.size(); ++i)
+                if (std::fabs(a[i] - b[i]) > 1e-6f * std::max(1.0f, std::fabs(a[i])))
+                    return false;
+            return true;
+        };
+
+        bool matches = sameFloats(attrib.vertices, obj.positions) &&
+                       sameFloats(attrib.normals, obj.normals) &&
+                       sameFloats(attrib.texcoords, obj.texcoords);
+
+        size_t corner = 0;
+        for (const tinyobj::shape_t &shape : shapes)
+        {
+            for (const tinyobj::index_t &idx : shape.mesh.indices)
+            {
+                matches = matches && corner < obj.indices.size() &&
+                          obj.indices[corner].position == idx.vertex_index &&
+                          obj.indices[corner].texcoord == idx.texcoord_index &&
+                          obj.indices[corner].normal == idx.normal_index;
+                ++corner;
+            }
+        }
+        matches = matches && corner == obj.indices.size();
+
+        if (!matches)
+            std::cerr << filename << ": OBJ parser output does not match tinyobj" << std::endl;
+        return matches;
+    }
+#endif
+}
 
 VertexInputDescription Vertex::getVertexDescription()
 {
@@ -33,64 +130,158 @@ VertexInputDescription Vertex::getVertexDescription()
         .format = VK_FORMAT_R32G32B32_SFLOAT,
         .offset = offsetof(Vertex, color)};
 
+    VkVertexInputAttributeDescription uvAttribute = {
+        .location = 3,
+        .binding = 0,
+        .format = VK_FORMAT_R32G32_SFLOAT,
+        .offset = offsetof(Vertex, uv)};
+
     description.attributes.push_back(positionAttribute);
     description.attributes.push_back(normalAttribute);
     description.attributes.push_back(colorAttribute);
+    description.attributes.push_back(uvAttribute);
 
     return description;
 }
 
-bool Mesh::loadObj(std::string filename)
+glm::mat4 Mesh::getDequantizeTransform() const
 {
-    tinyobj::attrib_t attrib;
+    glm::mat4 transform = glm::scale(glm::mat4(1.0f), positionScale);
+    transform[3] = glm::vec4(positionOffset, 1.0f);
+    return transform;
+}
+
+void Mesh::computeBounds()
+{
+    const Vertex *data = getVertexData();
+    const size_t count = getVertexCount();
+
+    if (count == 0)
+    {
+        boundsMin = boundsMax = glm::vec3(0.0f);
+        boundingSphere = glm::vec4(0.0f);
+        return;
+    }
 
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
+    boundsMin = boundsMax = data[0].position;
+    for (size_t i = 1; i < count; ++i)
+    {
+        boundsMin = glm::min(boundsMin, data[i].position);
+        boundsMax = glm::max(boundsMax, data[i].position);
+    }
 
-    std::string warn;
-    std::string err;
+    const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const glm::vec3 offset = data[i].position - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    boundingSphere = glm::vec4(center, std::sqrt(radiusSquared));
+}
 
-    tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str(), nullptr);
+bool Mesh::loadObj(std::string filename, JobSystem &jobs)
+{
+    auto start = std::chrono::high_resolution_clock::now();
 
-    if(!warn.empty())
+    if (vkMeshCache::load(filename, *this))
     {
-        std::cout << "WARN: " << warn << std::endl;
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << filename << ": mapped " << cachedVertexCount << " vertices and " << cachedIndexCount
+                  << " indices from mesh cache in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+        return true;
     }
-    if(!err.empty())
+
+    if (!parseObj(filename, jobs))
+        return false;
+
+    const MeshOptimizeStats optimizeStats = vkMeshOpt::optimize(*this);
+    std::cout << filename << ": ACMR " << optimizeStats.before.acmr << " -> " << optimizeStats.after.acmr
+              << ", ATVR " << optimizeStats.before.atvr << " -> " << optimizeStats.after.atvr
+              << " after optimizing in " << optimizeStats.milliseconds << " ms" << std::endl;
+
+    computeBounds();
+    vkMeshLod::generateLods(*this);
+
+    const MeshletStats meshletStats = vkMeshlet::buildMeshlets(*this);
+    std::cout << filename << ": " << meshletStats.meshletCount << " meshlets with " << meshletStats.averageVertices << " vertices and "
+              << meshletStats.averageTriangles << " triangles on average, " << 100.0 * meshletStats.coneFraction << "% cone-cullable, built in "
+              << meshletStats.milliseconds << " ms" << std::endl;
+
+    if (!vkMeshCache::write(filename, *this))
+        std::cout << "Failed to write mesh cache for " << filename << std::endl;
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << filename << ": parsed OBJ in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+    return true;
+}
+
+bool Mesh::parseObj(const std::string &filename, JobSystem &jobs)
+{
+    cacheFile.reset();
+    vertices.clear();
+    indices.clear();
+    lods.clear();
+    meshlets.clear();
+
+    ObjData obj;
+    std::string error;
+
+    auto parseStart = std::chrono::high_resolution_clock::now();
+    if (!vkObj::parseFile(filename, obj, error, jobs))
     {
-        std::cerr << err << std::endl;
+        std::cerr << filename << ": " << error << std::endl;
         return false;
     }
+    auto parseEnd = std::chrono::high_resolution_clock::now();
 
-    for (size_t s = 0; s < shapes.size(); ++s)
-    {
-        size_t indexOffset = 0;
-        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); ++f)
-        {
-            int fv = 3;
+    double parseSeconds = std::chrono::duration<double>(parseEnd - parseStart).count();
+    std::cout << filename << ": parsed at " << std::filesystem::file_size(filename) / (1024.0 * 1024.0) / parseSeconds << " MB/s" << std::endl;
 
-            for (size_t v = 0; v < fv; ++v)
-            {
-                tinyobj::index_t idx = shapes[s].mesh.indices[indexOffset + v];
+#ifdef VKP_VALIDATE_OBJ_PARSER
+    if (!matchesTinyObj(filename, obj))
+        return false;
+#endif
 
-                tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-                tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-                tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
+    const size_t cornerCount = obj.indices.size();
 
-                tinyobj::real_t nx = attrib.normals[3 * idx.vertex_index + 0];
-                tinyobj::real_t ny = attrib.normals[3 * idx.vertex_index + 1];
-                tinyobj::real_t nz = attrib.normals[3 * idx.vertex_index + 2];
+    std::unordered_map<Vertex, uint32_t, VertexHash> uniqueVertices;
+    uniqueVertices.reserve(cornerCount);
+    vertices.reserve(cornerCount);
+    indices.reserve(cornerCount);
 
-                Vertex newVertex = {
-                    .position = {vx, vy, vz},
-                    .normal = {nx, ny, nz},
-                    .color = newVertex.normal};
+    for (const ObjIndex &idx : obj.indices)
+    {
+        const float *position = &obj.positions[3 * idx.position];
 
-                vertices.push_back(newVertex);
-            }
-            indexOffset += fv;
+        glm::vec3 normal = {0.0f, 0.0f, 0.0f};
+        if (idx.normal >= 0)
+            normal = {obj.normals[3 * idx.normal + 0], obj.normals[3 * idx.normal + 1], obj.normals[3 * idx.normal + 2]};
+
+        glm::vec2 uv = {0.0f, 0.0f};
+        if (idx.texcoord >= 0)
+        {
+            uv.x = obj.texcoords[2 * idx.texcoord + 0];
+            uv.y = 1.0f - obj.texcoords[2 * idx.texcoord + 1];
         }
+
+        Vertex newVertex = {
+            .position = {position[0], position[1], position[2]},
+            .normal = normal,
+            .color = normal,
+            .uv = uv};
+
+        auto [it, inserted] = uniqueVertices.try_emplace(newVertex, (uint32_t)vertices.size());
+        if (inserted)
+            vertices.push_back(newVertex);
+
+        indices.push_back(it->second);
     }
 
+    std::cout << filename << ": " << cornerCount << " vertices before dedup, "
+              << vertices.size() << " vertices and " << indices.size() << " indices after" << std::endl;
+
+    computeBounds();
     return true;
 }
\ No newline at end of file
@@ -2,11 +2,18 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
 
 #include "vk_types.h"
 
+class JobSystem;
+class MappedFile;
+
 struct VertexInputDescription
 {
     std::vector<VkVertexInputBindingDescription> bindings;
@@ -19,13 +26,95 @@ struct Vertex {
     glm::vec3 position;
     glm::vec3 normal;
     glm::vec3 color;
+    glm::vec2 uv;
 
     static VertexInputDescription getVertexDescription();
+
+    bool operator==(const Vertex &other) const
+    {
+        return position == other.position && normal == other.normal && uv == other.uv;
+    }
+};
+
+// A level of detail: a range of the mesh's indices and the largest
+// mesh-space distance its surface strays from the full-detail one, split
+// into the meshlets [firstMeshlet, firstMeshlet + meshletCount).
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+};
+
+// A cluster of at most vkMeshlet::MAX_VERTICES vertices and
+// vkMeshlet::MAX_TRIANGLES triangles, contiguous in the mesh's indices, with
+// mesh-space bounds for culling it on its own.
+struct Meshlet
+{
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+    // xyz center, w radius.
+    glm::vec4 sphere;
+    // Every triangle faces away from a camera at p when
+    // dot(normalize(coneApex - p), coneAxis) >= coneCutoff; a cutoff above 1
+    // means the triangles face too many ways for that to ever hold.
+    glm::vec3 coneApex;
+    glm::vec3 coneAxis;
+    float coneCutoff;
 };
 
 struct Mesh {
     std::vector<Vertex> vertices;
-    AllocatedBuffer vertexBuffer;
+    // Every LOD's indices back to back, LOD 0 first; all of them index the
+    // same vertices.
+    std::vector<uint32_t> indices;
+    // Empty until LODs are generated, in which case getLod(0) covers all indices.
+    std::vector<MeshLod> lods;
+    // Every LOD's meshlets, LOD 0 first; empty until they are built.
+    std::vector<Meshlet> meshlets;
+
+    // Ranges in the engine's GeometryBuffer, in elements.
+    uint32_t firstVertex{0};
+    uint32_t vertexCount{0};
+    uint32_t firstIndex{0};
+    uint32_t indexCount{0};
+
+    glm::vec3 boundsMin{0.0f};
+    glm::vec3 boundsMax{0.0f};
+    // Centered on the AABB: xyz center, w radius.
+    glm::vec4 boundingSphere{0.0f};
+
+    // Maps quantized vertex positions back to mesh space; identity for
+    // Float32 geometry. Set by the GeometryBuffer when the mesh is added.
+    glm::vec3 positionScale{1.0f};
+    glm::vec3 positionOffset{0.0f};
+
+    // Set instead of vertices/indices when the mesh was mapped from its binary cache.
+    std::shared_ptr<MappedFile> cacheFile;
+    const Vertex *cachedVertices{nullptr};
+    const uint32_t *cachedIndices{nullptr};
+    uint32_t cachedVertexCount{0};
+    uint32_t cachedIndexCount{0};
+
+    const Vertex *getVertexData() const { return cacheFile ? cachedVertices : vertices.data(); }
+    size_t getVertexCount() const { return cacheFile ? cachedVertexCount : vertices.size(); }
+    const uint32_t *getIndexData() const { return cacheFile ? cachedIndices : indices.data(); }
+    size_t getIndexCount() const { return cacheFile ? cachedIndexCount : indices.size(); }
+
+    uint32_t getLodCount() const { return lods.empty() ? 1 : (uint32_t)lods.size(); }
+    MeshLod getLod(uint32_t level) const { return lods.empty() ? MeshLod{0, (uint32_t)getIndexCount(), 0.0f, 0, 0} : lods[level]; }
+
+    glm::mat4 getDequantizeTransform() const;
 
-    bool loadObj(std::string filename);
+    void computeBounds();
+    // Maps the mesh cache when it is current; otherwise parses the OBJ,
+    // optimizes it for the vertex cache and overdraw, generates its LODs,
+    // splits them into meshlets and writes the cache. The OBJ is parsed as
+    // jobs on jobs.
+    bool loadObj(std::string filename, JobSystem &jobs);
+    // Parses and deduplicates an OBJ without touching the cache.
+    bool parseObj(const std::string &filename, JobSystem &jobs);
 };
\ No newline at end of file
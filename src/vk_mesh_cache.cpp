@@ -0,0 +1,184 @@
+#include <vk_mesh_cache.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "vk_mapped_file.h"
+
+namespace
+{
+    constexpr char MESH_CACHE_MAGIC[4] = {'V', 'K', 'P', 'M'};
+    constexpr uint32_t MESH_CACHE_VERSION = 6;
+
+    struct MeshCacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t pathHash;
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        uint32_t vertexStride;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        float boundsMin[3];
+        float boundsMax[3];
+        float boundingSphere[4];
+        // MeshLod entries after the index blob; 0 for a mesh without LODs.
+        uint32_t lodCount;
+        // Meshlet entries after the LODs.
+        uint32_t meshletCount;
+    };
+
+    static_assert(sizeof(MeshCacheHeader) % alignof(Vertex) == 0, "Vertex blob must stay aligned after the header");
+
+    uint64_t hashPath(const std::string &path)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : path)
+            hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+        return hash;
+    }
+
+    bool sourceKey(const std::string &sourcePath, MeshCacheHeader &header)
+    {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(sourcePath, ec);
+        if (ec)
+            return false;
+
+        auto mtime = std::filesystem::last_write_time(sourcePath, ec);
+        if (ec)
+            return false;
+
+        std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.pathHash = hashPath(std::filesystem::absolute(sourcePath).lexically_normal().string());
+        header.sourceSize = size;
+        header.sourceMtime = (int64_t)mtime.time_since_epoch().count();
+        header.vertexStride = sizeof(Vertex);
+        return true;
+    }
+}
+
+namespace vkMeshCache
+{
+    std::string cachePath(const std::string &sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    bool load(const std::string &sourcePath, Mesh &mesh)
+    {
+        MeshCacheHeader expected = {};
+        if (!sourceKey(sourcePath, expected))
+            return false;
+
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(cachePath(sourcePath)) || file->size() < sizeof(MeshCacheHeader))
+            return false;
+
+        MeshCacheHeader header;
+        std::memcpy(&header, file->data(), sizeof(header));
+
+        if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+            header.version != expected.version ||
+            header.pathHash != expected.pathHash ||
+            header.sourceSize != expected.sourceSize ||
+            header.sourceMtime != expected.sourceMtime ||
+            header.vertexStride != expected.vertexStride)
+            return false;
+
+        const size_t vertexBytes = (size_t)header.vertexCount * sizeof(Vertex);
+        const size_t indexBytes = (size_t)header.indexCount * sizeof(uint32_t);
+        const size_t lodBytes = (size_t)header.lodCount * sizeof(MeshLod);
+        const size_t meshletBytes = (size_t)header.meshletCount * sizeof(Meshlet);
+        if (file->size() != sizeof(MeshCacheHeader) + vertexBytes + indexBytes + lodBytes + meshletBytes)
+            return false;
+
+        // A corrupt index would have the GPU read past the vertex buffer;
+        // rejecting the cache makes the caller rebuild it from the OBJ.
+        const uint32_t *indices = (const uint32_t *)(file->data() + sizeof(MeshCacheHeader) + vertexBytes);
+        for (uint32_t i = 0; i < header.indexCount; ++i)
+        {
+            if (indices[i] >= header.vertexCount)
+            {
+                std::cout << cachePath(sourcePath) << ": index " << i << " is out of range, rebuilding the cache" << std::endl;
+                return false;
+            }
+        }
+
+        const MeshLod *lods = (const MeshLod *)(file->data() + sizeof(MeshCacheHeader) + vertexBytes + indexBytes);
+        for (uint32_t i = 0; i < header.lodCount; ++i)
+        {
+            if ((uint64_t)lods[i].firstIndex + lods[i].indexCount > header.indexCount ||
+                (uint64_t)lods[i].firstMeshlet + lods[i].meshletCount > header.meshletCount)
+                return false;
+        }
+
+        const Meshlet *meshlets = (const Meshlet *)(file->data() + sizeof(MeshCacheHeader) + vertexBytes + indexBytes + lodBytes);
+        for (uint32_t i = 0; i < header.meshletCount; ++i)
+        {
+            if ((uint64_t)meshlets[i].firstIndex + meshlets[i].triangleCount * 3ull > header.indexCount)
+                return false;
+        }
+
+        mesh.vertices.clear();
+        mesh.indices.clear();
+        mesh.cachedVertices = (const Vertex *)(file->data() + sizeof(MeshCacheHeader));
+        mesh.cachedIndices = indices;
+        mesh.cachedVertexCount = header.vertexCount;
+        mesh.cachedIndexCount = header.indexCount;
+        mesh.boundsMin = {header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]};
+        mesh.boundsMax = {header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]};
+        mesh.boundingSphere = {header.boundingSphere[0], header.boundingSphere[1], header.boundingSphere[2], header.boundingSphere[3]};
+        mesh.lods.assign(lods, lods + header.lodCount);
+        mesh.meshlets.assign(meshlets, meshlets + header.meshletCount);
+        mesh.cacheFile = file;
+        return true;
+    }
+
+    bool write(const std::string &sourcePath, const Mesh &mesh)
+    {
+        MeshCacheHeader header = {};
+        if (!sourceKey(sourcePath, header))
+            return false;
+
+        header.vertexCount = (uint32_t)mesh.getVertexCount();
+        header.indexCount = (uint32_t)mesh.getIndexCount();
+        for (int i = 0; i < 3; ++i)
+        {
+            header.boundsMin[i] = mesh.boundsMin[i];
+            header.boundsMax[i] = mesh.boundsMax[i];
+        }
+        for (int i = 0; i < 4; ++i)
+            header.boundingSphere[i] = mesh.boundingSphere[i];
+        header.lodCount = (uint32_t)mesh.lods.size();
+        header.meshletCount = (uint32_t)mesh.meshlets.size();
+
+        const std::string path = cachePath(sourcePath);
+        const std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+            {
+                std::cout << "Can't open file: " << tempPath << std::endl;
+                return false;
+            }
+
+            file.write((const char *)&header, sizeof(header));
+            file.write((const char *)mesh.getVertexData(), mesh.getVertexCount() * sizeof(Vertex));
+            file.write((const char *)mesh.getIndexData(), mesh.getIndexCount() * sizeof(uint32_t));
+            file.write((const char *)mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+            file.write((const char *)mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+            if (!file.good())
+                return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tempPath, path, ec);
+        return !ec;
+    }
+}
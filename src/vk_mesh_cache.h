@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+#include "vk_mesh.h"
+
+namespace vkMeshCache
+{
+    std::string cachePath(const std::string &sourcePath);
+
+    // Maps a cache written for the current size and mtime of sourcePath and
+    // points the mesh at its vertex and index blobs.
+    bool load(const std::string &sourcePath, Mesh &mesh);
+    bool write(const std::string &sourcePath, const Mesh &mesh);
+}
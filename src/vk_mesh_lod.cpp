@@ -0,0 +1,551 @@
+#include <vk_mesh_lod.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+
+#include <glm/geometric.hpp>
+#include "glm/gtx/transform.hpp"
+
+#include "vk_culling.h"
+#include "vk_mesh_optimizer.h"
+#include "vk_parallel.h"
+#include "vk_scene.h"
+
+namespace
+{
+    constexpr uint32_t INVALID_VERTEX = UINT32_MAX;
+
+    // Border planes weigh this much more than the area-weighted face planes,
+    // which keeps open edges (e.g. the monkey's eyes) from shrinking.
+    constexpr double BORDER_WEIGHT = 10.0;
+    // Scales the normal change of a collapse, 0 to 2, by the squared edge
+    // length so it adds to the cost in the same units as the quadrics.
+    constexpr double NORMAL_WEIGHT = 0.5;
+    // Share of the cheapest candidates each pass may collapse before the
+    // costs are re-evaluated.
+    constexpr size_t PASS_FRACTION = 4;
+    constexpr size_t MIN_LOD_TRIANGLES = 16;
+
+    uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+}
+
+void MeshSimplifier::Quadric::addPlane(const glm::dvec3 &normal, double distance, double planeWeight)
+{
+    a00 += planeWeight * normal.x * normal.x;
+    a01 += planeWeight * normal.x * normal.y;
+    a02 += planeWeight * normal.x * normal.z;
+    a03 += planeWeight * normal.x * distance;
+    a11 += planeWeight * normal.y * normal.y;
+    a12 += planeWeight * normal.y * normal.z;
+    a13 += planeWeight * normal.y * distance;
+    a22 += planeWeight * normal.z * normal.z;
+    a23 += planeWeight * normal.z * distance;
+    a33 += planeWeight * distance * distance;
+    weight += planeWeight;
+}
+
+void MeshSimplifier::Quadric::add(const Quadric &other)
+{
+    a00 += other.a00;
+    a01 += other.a01;
+    a02 += other.a02;
+    a03 += other.a03;
+    a11 += other.a11;
+    a12 += other.a12;
+    a13 += other.a13;
+    a22 += other.a22;
+    a23 += other.a23;
+    a33 += other.a33;
+    weight += other.weight;
+}
+
+double MeshSimplifier::Quadric::evaluate(const glm::vec3 &point) const
+{
+    const double x = point.x, y = point.y, z = point.z;
+    const double error = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x +
+                         a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y +
+                         a22 * z * z + 2.0 * a23 * z + a33;
+    // Normalized to a squared distance.
+    return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+}
+
+MeshSimplifier::MeshSimplifier(const Vertex *vertices, size_t vertexCount, const uint32_t *indices, size_t indexCount)
+    : vertices(vertices), vertexCount(vertexCount), indices(indices, indices + indexCount - indexCount % 3)
+{
+    std::vector<uint32_t> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+              {
+                  const glm::vec3 &pa = vertices[a].position;
+                  const glm::vec3 &pb = vertices[b].position;
+                  return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z; });
+
+    vertexPositions.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        if (i == 0 || vertices[order[i]].position != vertices[order[i - 1]].position)
+            positions.push_back(vertices[order[i]].position);
+        vertexPositions[order[i]] = (uint32_t)positions.size() - 1;
+    }
+
+    quadrics.assign(positions.size(), Quadric{});
+    borderPositions.assign(positions.size(), false);
+    neighbourMarks.assign(positions.size(), 0);
+
+    std::unordered_map<uint64_t, uint32_t> edgeCounts;
+    for (size_t t = 0; t < this->indices.size(); t += 3)
+    {
+        const uint32_t p[3] = {vertexPositions[this->indices[t]], vertexPositions[this->indices[t + 1]], vertexPositions[this->indices[t + 2]]};
+        const glm::dvec3 p0 = positions[p[0]], p1 = positions[p[1]], p2 = positions[p[2]];
+
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const double doubleArea = glm::length(normal);
+        if (doubleArea > 0.0)
+        {
+            normal /= doubleArea;
+            for (uint32_t position : p)
+                quadrics[position].addPlane(normal, -glm::dot(normal, p0), doubleArea * 0.5);
+        }
+
+        for (int e = 0; e < 3; ++e)
+            ++edgeCounts[edgeKey(p[e], p[(e + 1) % 3])];
+    }
+
+    // Edges with a single triangle get a plane through them, perpendicular
+    // to that triangle, so collapses don't pull the border inwards.
+    for (size_t t = 0; t < this->indices.size(); t += 3)
+    {
+        const uint32_t p[3] = {vertexPositions[this->indices[t]], vertexPositions[this->indices[t + 1]], vertexPositions[this->indices[t + 2]]};
+        const glm::dvec3 corners[3] = {positions[p[0]], positions[p[1]], positions[p[2]]};
+        const glm::dvec3 faceNormal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+
+        for (int e = 0; e < 3; ++e)
+        {
+            if (edgeCounts[edgeKey(p[e], p[(e + 1) % 3])] != 1)
+                continue;
+
+            borderPositions[p[e]] = true;
+            borderPositions[p[(e + 1) % 3]] = true;
+
+            const glm::dvec3 edge = corners[(e + 1) % 3] - corners[e];
+            glm::dvec3 normal = glm::cross(edge, faceNormal);
+            const double length = glm::length(normal);
+            if (length == 0.0)
+                continue;
+
+            normal /= length;
+            const double planeWeight = glm::dot(edge, edge) * BORDER_WEIGHT;
+            quadrics[p[e]].addPlane(normal, -glm::dot(normal, corners[e]), planeWeight);
+            quadrics[p[(e + 1) % 3]].addPlane(normal, -glm::dot(normal, corners[e]), planeWeight);
+        }
+    }
+}
+
+float MeshSimplifier::getError() const
+{
+    return (float)std::sqrt(maxCost);
+}
+
+void MeshSimplifier::buildAdjacency()
+{
+    adjacencyOffsets.assign(positions.size() + 1, 0);
+    for (uint32_t index : indices)
+        ++adjacencyOffsets[vertexPositions[index] + 1];
+    std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+
+    adjacency.resize(indices.size());
+    std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[cursor[vertexPositions[indices[i]]]++] = (uint32_t)(i / 3);
+}
+
+// Fills wedgeScratch with the vertex at `to` each vertex at `from` turns into
+// and returns whether the collapse keeps the mesh and its seams intact.
+bool MeshSimplifier::evaluateCollapse(uint32_t from, uint32_t to, bool borderEdge, double &cost)
+{
+    if (borderPositions[from] && !borderEdge)
+        return false;
+
+    wedgeScratch.clear();
+    const uint32_t stamp = ++markStamp;
+
+    for (uint32_t a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; ++a)
+    {
+        const uint32_t *triangle = &indices[adjacency[a] * 3];
+
+        uint32_t fromVertex = INVALID_VERTEX;
+        uint32_t toVertex = INVALID_VERTEX;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            const uint32_t position = vertexPositions[triangle[corner]];
+            if (position == from)
+                fromVertex = triangle[corner];
+            else if (position == to)
+                toVertex = triangle[corner];
+            else
+                neighbourMarks[position] = stamp;
+        }
+        wedgeScratch.push_back({fromVertex, toVertex});
+
+        // Triangles that keep their area after the collapse must not flip.
+        if (toVertex == INVALID_VERTEX)
+        {
+            glm::vec3 before[3], after[3];
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                before[corner] = positions[vertexPositions[triangle[corner]]];
+                after[corner] = vertexPositions[triangle[corner]] == from ? positions[to] : before[corner];
+            }
+
+            const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+                return false;
+        }
+    }
+
+    // Link condition: the endpoints may only share the neighbours opposite the
+    // edge, or the collapse would fold the surface onto itself.
+    uint32_t sharedNeighbours = 0;
+    for (uint32_t a = adjacencyOffsets[to]; a < adjacencyOffsets[to + 1]; ++a)
+    {
+        const uint32_t *triangle = &indices[adjacency[a] * 3];
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            const uint32_t position = vertexPositions[triangle[corner]];
+            if (position != from && position != to && neighbourMarks[position] == stamp)
+            {
+                neighbourMarks[position] = 0;
+                ++sharedNeighbours;
+            }
+        }
+    }
+    if (sharedNeighbours > (borderEdge ? 1u : 2u))
+        return false;
+
+    // Every vertex at `from` must reach exactly one vertex at `to`, and
+    // distinct vertices distinct ones, so seams collapse along themselves.
+    std::sort(wedgeScratch.begin(), wedgeScratch.end());
+    size_t pairCount = 0;
+    for (size_t i = 0; i < wedgeScratch.size();)
+    {
+        const uint32_t fromVertex = wedgeScratch[i].first;
+        const uint32_t toVertex = wedgeScratch[i].second;
+        if (toVertex == INVALID_VERTEX)
+            return false;
+
+        size_t j = i;
+        while (j < wedgeScratch.size() && wedgeScratch[j].first == fromVertex)
+        {
+            if (wedgeScratch[j].second != toVertex && wedgeScratch[j].second != INVALID_VERTEX)
+                return false;
+            ++j;
+        }
+
+        wedgeScratch[pairCount++] = {fromVertex, toVertex};
+        i = j;
+    }
+    wedgeScratch.resize(pairCount);
+
+    if (pairCount > 1)
+    {
+        for (size_t i = 0; i < pairCount; ++i)
+        {
+            for (size_t j = i + 1; j < pairCount; ++j)
+            {
+                if (wedgeScratch[i].second == wedgeScratch[j].second)
+                    return false;
+            }
+        }
+    }
+
+    const glm::vec3 edge = positions[to] - positions[from];
+    double normalChange = 0.0;
+    for (const auto &[fromVertex, toVertex] : wedgeScratch)
+    {
+        const glm::vec3 &a = vertices[fromVertex].normal;
+        const glm::vec3 &b = vertices[toVertex].normal;
+        const float lengths = glm::length(a) * glm::length(b);
+        if (lengths > 0.0f)
+            normalChange = std::max(normalChange, 1.0 - glm::dot(a, b) / lengths);
+    }
+
+    cost = quadrics[from].evaluate(positions[to]) + NORMAL_WEIGHT * normalChange * glm::dot(edge, edge);
+    return true;
+}
+
+bool MeshSimplifier::simplify(size_t targetIndexCount)
+{
+    struct Candidate
+    {
+        uint32_t from;
+        uint32_t to;
+        bool borderEdge;
+        double cost;
+    };
+
+    std::vector<Candidate> candidates;
+    std::unordered_map<uint64_t, uint32_t> edgeCounts;
+    std::vector<uint32_t> passLocks(positions.size(), 0);
+    uint32_t pass = 0;
+
+    while (indices.size() > targetIndexCount)
+    {
+        ++pass;
+        buildAdjacency();
+
+        edgeCounts.clear();
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            for (int e = 0; e < 3; ++e)
+                ++edgeCounts[edgeKey(vertexPositions[indices[t + e]], vertexPositions[indices[t + (e + 1) % 3]])];
+        }
+
+        candidates.clear();
+        for (const auto &[key, count] : edgeCounts)
+        {
+            const uint32_t a = (uint32_t)(key >> 32);
+            const uint32_t b = (uint32_t)key;
+            const bool borderEdge = count == 1;
+
+            double costAB = 0.0, costBA = 0.0;
+            const bool validAB = evaluateCollapse(a, b, borderEdge, costAB);
+            const bool validBA = evaluateCollapse(b, a, borderEdge, costBA);
+            if (validAB && (!validBA || costAB <= costBA))
+                candidates.push_back({a, b, borderEdge, costAB});
+            else if (validBA)
+                candidates.push_back({b, a, borderEdge, costBA});
+        }
+
+        if (candidates.empty())
+            return false;
+
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+                  { return a.cost < b.cost; });
+        candidates.erase(candidates.begin() + std::max<size_t>(1, candidates.size() / PASS_FRACTION), candidates.end());
+
+        vertexRemap.resize(vertexCount);
+        std::iota(vertexRemap.begin(), vertexRemap.end(), 0);
+
+        size_t triangleCount = indices.size() / 3;
+        const size_t targetTriangles = targetIndexCount / 3;
+        size_t collapses = 0;
+
+        for (const Candidate &candidate : candidates)
+        {
+            if (triangleCount <= targetTriangles)
+                break;
+            if (passLocks[candidate.from] == pass || passLocks[candidate.to] == pass)
+                continue;
+
+            // The neighbourhood is untouched this pass, so this repeats the
+            // evaluation above and refills wedgeScratch.
+            double cost;
+            if (!evaluateCollapse(candidate.from, candidate.to, candidate.borderEdge, cost))
+                continue;
+
+            for (const auto &[fromVertex, toVertex] : wedgeScratch)
+                vertexRemap[fromVertex] = toVertex;
+
+            for (uint32_t a = adjacencyOffsets[candidate.from]; a < adjacencyOffsets[candidate.from + 1]; ++a)
+            {
+                const uint32_t *triangle = &indices[adjacency[a] * 3];
+                bool hasTo = false;
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    const uint32_t position = vertexPositions[triangle[corner]];
+                    passLocks[position] = pass;
+                    hasTo = hasTo || position == candidate.to;
+                }
+                triangleCount -= hasTo;
+            }
+
+            quadrics[candidate.to].add(quadrics[candidate.from]);
+            maxCost = std::max(maxCost, candidate.cost);
+            ++collapses;
+        }
+
+        if (collapses == 0)
+            return false;
+
+        size_t written = 0;
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            const uint32_t a = vertexRemap[indices[t]];
+            const uint32_t b = vertexRemap[indices[t + 1]];
+            const uint32_t c = vertexRemap[indices[t + 2]];
+            const uint32_t pa = vertexPositions[a], pb = vertexPositions[b], pc = vertexPositions[c];
+            if (pa == pb || pb == pc || pa == pc)
+                continue;
+
+            indices[written++] = a;
+            indices[written++] = b;
+            indices[written++] = c;
+        }
+        indices.resize(written);
+    }
+
+    return true;
+}
+
+namespace vkMeshLod
+{
+    void generateLods(Mesh &mesh)
+    {
+        if (mesh.cacheFile || !mesh.lods.empty() || mesh.indices.size() < 3)
+            return;
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        const size_t fullIndexCount = mesh.indices.size();
+        mesh.lods.push_back({0, (uint32_t)fullIndexCount, 0.0f, 0, 0});
+
+        MeshSimplifier simplifier(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), fullIndexCount);
+        std::vector<uint32_t> clusters;
+        size_t previousIndexCount = fullIndexCount;
+
+        for (uint32_t level = 1; level < MAX_LODS; ++level)
+        {
+            const size_t targetIndexCount = previousIndexCount / 6 * 3;
+            if (targetIndexCount < MIN_LOD_TRIANGLES * 3)
+                break;
+
+            simplifier.simplify(targetIndexCount);
+
+            // Not worth a level if the seams and borders kept most triangles.
+            std::vector<uint32_t> lodIndices = simplifier.getIndices();
+            if (lodIndices.size() > previousIndexCount * 3 / 4)
+                break;
+
+            vkMeshOpt::optimizeVertexCache(lodIndices.data(), lodIndices.size(), mesh.vertices.size(), vkMeshOpt::CACHE_SIZE, clusters);
+
+            mesh.lods.push_back({(uint32_t)mesh.indices.size(), (uint32_t)lodIndices.size(), simplifier.getError(), 0, 0});
+            mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.end());
+            previousIndexCount = lodIndices.size();
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Generated " << mesh.lods.size() - 1 << " LODs in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms:";
+        for (const MeshLod &lod : mesh.lods)
+            std::cout << " " << lod.indexCount / 3 << " (" << lod.error << ")";
+        std::cout << std::endl;
+    }
+
+    uint32_t select(const Mesh &mesh, float worldRadius, float distance, uint32_t current, const LodSettings &settings)
+    {
+        const uint32_t lodCount = mesh.getLodCount();
+        if (lodCount == 1 || settings.projectionScale <= 0.0f || mesh.boundingSphere.w <= 0.0f)
+            return 0;
+
+        // Errors are in mesh space; the sphere radii give the object's scale.
+        const float pixelsPerError = worldRadius / mesh.boundingSphere.w * settings.projectionScale / std::max(distance, 1e-3f);
+
+        uint32_t level = 0;
+        while (level + 1 < lodCount && mesh.lods[level + 1].error * pixelsPerError <= settings.pixelThreshold)
+            ++level;
+
+        current = std::min(current, lodCount - 1);
+        const float coarsenThreshold = settings.pixelThreshold * (1.0f - settings.hysteresis);
+        while (level > current && mesh.lods[level].error * pixelsPerError > coarsenThreshold)
+            --level;
+
+        return level;
+    }
+
+    void runBenchmark(size_t objectCount)
+    {
+        constexpr int FRAME_COUNT = 300;
+
+        JobSystem jobs;
+        jobs.init();
+
+        Mesh monkey;
+        if (!monkey.loadObj("../assets/monkey_smooth.obj", jobs))
+            return;
+
+        std::vector<double> lodAcmr(monkey.getLodCount());
+        for (uint32_t level = 0; level < monkey.getLodCount(); ++level)
+        {
+            const MeshLod lod = monkey.getLod(level);
+            lodAcmr[level] = vkMeshOpt::analyzeVertexCache(monkey.getIndexData() + lod.firstIndex, lod.indexCount, monkey.getVertexCount()).acmr;
+            std::cout << "  LOD " << level << ": " << lod.indexCount / 3 << " triangles, error " << lod.error << ", ACMR " << lodAcmr[level] << std::endl;
+        }
+
+        RenderScene scene;
+        const uint32_t mesh = scene.addMesh(&monkey);
+        // Fake handle: the benchmark never touches the device.
+        const uint32_t material = scene.addMaterial({.pipeline = (VkPipeline)(uintptr_t)1});
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> across(-60.0f, 60.0f);
+        std::uniform_real_distribution<float> depth(-400.0f, 0.0f);
+        for (size_t i = 0; i < objectCount; ++i)
+            scene.addObject(mesh, material, glm::translate(glm::mat4(1.0f), glm::vec3(across(rng), across(rng) * 0.25f, depth(rng))));
+
+        const float fovY = glm::radians(70.0f);
+        glm::mat4 projection = glm::perspective(fovY, 1700.0f / 900.0f, 0.1f, 500.0f);
+        projection[1][1] *= -1;
+
+        std::vector<uint32_t> visible;
+        auto run = [&](float hysteresis, std::vector<uint64_t> *histogram)
+        {
+            scene.lodSettings = {
+                .projectionScale = 900.0f / (2.0f * std::tan(fovY * 0.5f)),
+                .pixelThreshold = 1.0f,
+                .hysteresis = hysteresis};
+            std::fill(scene.objectLods.begin(), scene.objectLods.end(), 0);
+
+            uint64_t fullTriangles = 0, triangles = 0, switches = 0;
+            double fullInvocations = 0.0, invocations = 0.0;
+            std::vector<uint32_t> previousLods = scene.objectLods;
+
+            for (int frame = 0; frame < FRAME_COUNT; ++frame)
+            {
+                // A slow dolly with a little shake, which is what makes
+                // objects near a switching distance pop without hysteresis.
+                const glm::vec3 cameraPosition(0.0f, 2.0f, 20.0f - 60.0f * (1.0f - std::cos(frame * 0.02f)) + 0.3f * std::sin(frame * 1.7f));
+                const glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+                vkCull::cull(scene.objectBounds, projection * view, visible, jobs);
+                scene.buildDrawList(visible, cameraPosition, 500.0f);
+
+                for (const DrawItem &item : scene.drawItems)
+                {
+                    const uint32_t lodTriangles = monkey.getLod(item.lod).indexCount / 3;
+                    fullTriangles += monkey.getLod(0).indexCount / 3;
+                    triangles += lodTriangles;
+                    fullInvocations += lodAcmr[0] * (monkey.getLod(0).indexCount / 3);
+                    invocations += lodAcmr[item.lod] * lodTriangles;
+                    if (histogram)
+                        ++(*histogram)[item.lod];
+                    if (frame > 0 && previousLods[item.object] != item.lod)
+                        ++switches;
+                }
+                previousLods = scene.objectLods;
+            }
+
+            std::cout << "  hysteresis " << hysteresis << ": " << triangles / FRAME_COUNT << " triangles/frame vs " << fullTriangles / FRAME_COUNT
+                      << " at LOD 0 (" << 100.0 * triangles / std::max<uint64_t>(fullTriangles, 1) << "%), "
+                      << invocations / FRAME_COUNT << " vertex shader invocations/frame vs " << fullInvocations / FRAME_COUNT
+                      << ", " << (double)switches / FRAME_COUNT << " LOD switches/frame" << std::endl;
+        };
+
+        std::vector<uint64_t> histogram(monkey.getLodCount(), 0);
+        std::cout << "LOD benchmark: " << objectCount << " monkeys up to 400 units deep, " << FRAME_COUNT << " frames" << std::endl;
+        run(0.0f, nullptr);
+        run(0.25f, &histogram);
+
+        std::cout << "  draws per LOD:";
+        for (uint64_t count : histogram)
+            std::cout << " " << count / FRAME_COUNT;
+        std::cout << std::endl;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "vk_mesh.h"
+
+struct LodSettings
+{
+    // Viewport height over 2 tan(fovY / 2), which turns an error at a distance
+    // into pixels. 0 always selects LOD 0.
+    float projectionScale{0.0f};
+    // Largest projected error, in pixels, a LOD may have to be selected.
+    float pixelThreshold{1.0f};
+    // Fraction of the threshold a coarser LOD must stay under before it
+    // replaces the current one, so objects near a switching distance don't
+    // flicker between two levels.
+    float hysteresis{0.25f};
+};
+
+// Quadric error metric simplification by half-edge collapses (Garland and
+// Heckbert 1997). Vertices never move, so every LOD can index the original
+// vertex data. Vertices sharing a position but differing in normal or UV
+// collapse together along their seam or not at all, and the normal change
+// of a collapse is added to its cost.
+class MeshSimplifier
+{
+    public:
+        MeshSimplifier(const Vertex *vertices, size_t vertexCount, const uint32_t *indices, size_t indexCount);
+
+        // Collapses edges until at most targetIndexCount indices remain.
+        // Returns false when no collapse was possible before the target.
+        bool simplify(size_t targetIndexCount);
+
+        const std::vector<uint32_t> &getIndices() const { return indices; }
+        // Mesh-space distance bound of the result from the input.
+        float getError() const;
+
+    private:
+        struct Quadric
+        {
+            double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+            double weight;
+
+            void addPlane(const glm::dvec3 &normal, double distance, double planeWeight);
+            void add(const Quadric &other);
+            double evaluate(const glm::vec3 &point) const;
+        };
+
+        bool evaluateCollapse(uint32_t from, uint32_t to, bool borderEdge, double &cost);
+        void buildAdjacency();
+        uint32_t countTriangles(uint32_t position) const { return adjacencyOffsets[position + 1] - adjacencyOffsets[position]; }
+
+        const Vertex *vertices;
+        size_t vertexCount;
+        std::vector<uint32_t> indices;
+
+        // Vertices are grouped by exact position; topology and quadrics live
+        // on positions, attributes on vertices.
+        std::vector<uint32_t> vertexPositions;
+        std::vector<glm::vec3> positions;
+        std::vector<Quadric> quadrics;
+        std::vector<bool> borderPositions;
+
+        // Triangles around each position, rebuilt every pass.
+        std::vector<uint32_t> adjacencyOffsets;
+        std::vector<uint32_t> adjacency;
+
+        std::vector<uint32_t> vertexRemap;
+        std::vector<std::pair<uint32_t, uint32_t>> wedgeScratch;
+        std::vector<uint32_t> neighbourMarks;
+        uint32_t markStamp{0};
+
+        double maxCost{0.0};
+};
+
+namespace vkMeshLod
+{
+    // Coarsest level generateLods produces is MAX_LODS - 1.
+    constexpr uint32_t MAX_LODS = 5;
+
+    // Appends up to MAX_LODS - 1 coarser index lists to the mesh's indices,
+    // each about half the triangles of the one before, and fills mesh.lods.
+    // Stops early once simplification stalls.
+    void generateLods(Mesh &mesh);
+
+    // Coarsest level whose error projects under the threshold. Moving to a
+    // coarser level than current also needs the hysteresis margin.
+    uint32_t select(const Mesh &mesh, float worldRadius, float distance, uint32_t current, const LodSettings &settings);
+
+    void runBenchmark(size_t objectCount);
+}
@@ -0,0 +1,405 @@
+#include <vk_mesh_optimizer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+
+#include <glm/geometric.hpp>
+
+#include "vk_parallel.h"
+
+namespace
+{
+    // FIFO cache simulation: a vertex is cached while fewer than cacheSize
+    // misses happened since it was loaded.
+    class FifoCache
+    {
+        public:
+            FifoCache(size_t vertexCount, uint32_t cacheSize)
+                : loadTime(vertexCount, 0), size(cacheSize), time(cacheSize + 1)
+            {
+            }
+
+            // Returns true on a miss.
+            bool access(uint32_t vertex)
+            {
+                if (time - loadTime[vertex] <= size)
+                    return false;
+                loadTime[vertex] = time++;
+                return true;
+            }
+
+            uint32_t accessTriangle(const uint32_t *triangle)
+            {
+                return access(triangle[0]) + access(triangle[1]) + access(triangle[2]);
+            }
+
+            // Evicts everything without touching the per-vertex state.
+            void flush() { time += size + 1; }
+
+        private:
+            std::vector<uint64_t> loadTime;
+            uint64_t size;
+            uint64_t time;
+    };
+
+    // Triangles using each vertex, in compressed rows.
+    struct Adjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+
+        Adjacency(const uint32_t *indices, size_t indexCount, size_t vertexCount)
+            : offsets(vertexCount + 1, 0), triangles(indexCount)
+        {
+            for (size_t i = 0; i < indexCount; ++i)
+                ++offsets[indices[i] + 1];
+            std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+            std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indexCount; ++i)
+                triangles[cursor[indices[i]]++] = (uint32_t)(i / 3);
+        }
+    };
+}
+
+namespace vkMeshOpt
+{
+    VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+    {
+        VertexCacheStats stats;
+        if (indexCount < 3 || vertexCount == 0)
+            return stats;
+
+        FifoCache cache(vertexCount, cacheSize);
+        std::vector<bool> referenced(vertexCount, false);
+        size_t misses = 0;
+        size_t referencedCount = 0;
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            misses += cache.access(indices[i]);
+            if (!referenced[indices[i]])
+            {
+                referenced[indices[i]] = true;
+                ++referencedCount;
+            }
+        }
+
+        stats.acmr = (double)misses / (indexCount / 3);
+        stats.atvr = (double)misses / referencedCount;
+        return stats;
+    }
+
+    void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize, std::vector<uint32_t> &clusters)
+    {
+        const size_t triangleCount = indexCount / 3;
+        clusters.clear();
+        if (triangleCount == 0)
+            return;
+
+        const Adjacency adjacency(indices, indexCount, vertexCount);
+
+        std::vector<uint32_t> liveTriangles(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+            liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+        // Same timestamps as FifoCache, kept inline so scores can read them.
+        std::vector<uint64_t> cacheTime(vertexCount, 0);
+        uint64_t time = cacheSize + 1;
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnds;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> order;
+        order.reserve(triangleCount);
+
+        size_t cursor = 0;
+        int64_t fanVertex = 0;
+        clusters.push_back(0);
+
+        while (fanVertex >= 0)
+        {
+            candidates.clear();
+
+            for (uint32_t a = adjacency.offsets[fanVertex]; a < adjacency.offsets[fanVertex + 1]; ++a)
+            {
+                const uint32_t triangle = adjacency.triangles[a];
+                if (emitted[triangle])
+                    continue;
+
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    const uint32_t v = indices[triangle * 3 + corner];
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    --liveTriangles[v];
+                    if (time - cacheTime[v] > cacheSize)
+                        cacheTime[v] = time++;
+                }
+
+                emitted[triangle] = true;
+                order.push_back(triangle);
+            }
+
+            // Prefer the candidate whose remaining triangles still fit in the
+            // cache and that entered it longest ago.
+            int64_t best = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t v : candidates)
+            {
+                if (liveTriangles[v] == 0)
+                    continue;
+
+                int64_t priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                    priority = (int64_t)(time - cacheTime[v]);
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    best = v;
+                }
+            }
+
+            if (best < 0)
+            {
+                while (!deadEnds.empty() && best < 0)
+                {
+                    const uint32_t v = deadEnds.back();
+                    deadEnds.pop_back();
+                    if (liveTriangles[v] > 0)
+                        best = v;
+                }
+                while (best < 0 && cursor < vertexCount)
+                {
+                    if (liveTriangles[cursor] > 0)
+                        best = (int64_t)cursor;
+                    ++cursor;
+                }
+
+                if (best >= 0 && clusters.back() != order.size())
+                    clusters.push_back((uint32_t)order.size());
+            }
+
+            fanVertex = best;
+        }
+
+        std::vector<uint32_t> reordered(indexCount);
+        for (size_t t = 0; t < order.size(); ++t)
+            std::copy_n(indices + order[t] * 3, 3, reordered.begin() + t * 3);
+        std::copy(reordered.begin(), reordered.end(), indices);
+    }
+
+    void optimizeOverdraw(uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount, std::vector<uint32_t> &clusters,
+                          uint32_t cacheSize, float threshold)
+    {
+        const size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0 || clusters.empty())
+            return;
+
+        // Soft boundaries: cut a cluster wherever the run so far already
+        // reuses the cache about as well as the whole cluster does.
+        std::vector<uint32_t> softClusters;
+        FifoCache cache(vertexCount, cacheSize);
+        for (size_t c = 0; c < clusters.size(); ++c)
+        {
+            const uint32_t begin = clusters[c];
+            const uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : (uint32_t)triangleCount;
+
+            cache.flush();
+            uint32_t clusterMisses = 0;
+            for (uint32_t t = begin; t < end; ++t)
+                clusterMisses += cache.accessTriangle(indices + t * 3);
+            const float clusterAcmr = (float)clusterMisses / (end - begin);
+
+            cache.flush();
+            softClusters.push_back(begin);
+            uint32_t runBegin = begin;
+            uint32_t runMisses = 0;
+            for (uint32_t t = begin; t + 1 < end; ++t)
+            {
+                runMisses += cache.accessTriangle(indices + t * 3);
+                if ((float)runMisses / (t + 1 - runBegin) <= threshold * clusterAcmr)
+                {
+                    runBegin = t + 1;
+                    runMisses = 0;
+                    softClusters.push_back(runBegin);
+                    cache.flush();
+                }
+            }
+        }
+        clusters.swap(softClusters);
+
+        // Area-weighted centroid and normal of every cluster.
+        const size_t clusterCount = clusters.size();
+        std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+        std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+
+        for (size_t c = 0; c < clusterCount; ++c)
+        {
+            const uint32_t begin = clusters[c];
+            const uint32_t end = c + 1 < clusterCount ? clusters[c + 1] : (uint32_t)triangleCount;
+
+            float clusterArea = 0.0f;
+            for (uint32_t t = begin; t < end; ++t)
+            {
+                const glm::vec3 &p0 = vertices[indices[t * 3 + 0]].position;
+                const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].position;
+                const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].position;
+
+                const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                const float area = glm::length(normal);
+                centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+                normals[c] += normal;
+                clusterArea += area;
+            }
+
+            meshCentroid += centroids[c];
+            meshArea += clusterArea;
+            if (clusterArea > 0.0f)
+                centroids[c] /= clusterArea;
+        }
+
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        std::vector<float> sortKeys(clusterCount);
+        for (size_t c = 0; c < clusterCount; ++c)
+        {
+            const float length = glm::length(normals[c]);
+            sortKeys[c] = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+        }
+
+        std::vector<uint32_t> order(clusterCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                         { return sortKeys[a] > sortKeys[b]; });
+
+        std::vector<uint32_t> reordered;
+        reordered.reserve(indexCount);
+        std::vector<uint32_t> sortedClusters;
+        sortedClusters.reserve(clusterCount);
+        for (uint32_t c : order)
+        {
+            const uint32_t begin = clusters[c];
+            const uint32_t end = c + 1 < clusterCount ? clusters[c + 1] : (uint32_t)triangleCount;
+
+            sortedClusters.push_back((uint32_t)(reordered.size() / 3));
+            reordered.insert(reordered.end(), indices + begin * 3, indices + end * 3);
+        }
+
+        std::copy(reordered.begin(), reordered.end(), indices);
+        clusters.swap(sortedClusters);
+    }
+
+    void optimizeVertexFetch(std::vector<Vertex> &vertices, uint32_t *indices, size_t indexCount)
+    {
+        constexpr uint32_t UNUSED = UINT32_MAX;
+
+        std::vector<uint32_t> remap(vertices.size(), UNUSED);
+        std::vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            uint32_t &target = remap[indices[i]];
+            if (target == UNUSED)
+            {
+                target = (uint32_t)reordered.size();
+                reordered.push_back(vertices[indices[i]]);
+            }
+            indices[i] = target;
+        }
+
+        vertices.swap(reordered);
+    }
+
+    MeshOptimizeStats optimize(Mesh &mesh)
+    {
+        MeshOptimizeStats stats;
+        if (mesh.cacheFile || !mesh.lods.empty() || mesh.indices.size() < 3)
+            return stats;
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        stats.before = analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+        std::vector<uint32_t> clusters;
+        optimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), CACHE_SIZE, clusters);
+        // Meshoptimizer's default: clusters may be 5% worse for the cache.
+        optimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size(), clusters, CACHE_SIZE, 1.05f);
+        optimizeVertexFetch(mesh.vertices, mesh.indices.data(), mesh.indices.size());
+
+        stats.after = analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+        stats.clusterCount = (uint32_t)clusters.size();
+
+        auto end = std::chrono::high_resolution_clock::now();
+        stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        return stats;
+    }
+
+    std::vector<MeshOptimizeStats> optimizeAll(const std::vector<Mesh *> &meshes, JobSystem &jobs)
+    {
+        std::vector<MeshOptimizeStats> stats(meshes.size());
+        jobs.parallelFor(meshes.size(), 1, [&](size_t begin, size_t end)
+                         {
+                             for (size_t i = begin; i < end; ++i)
+                                 stats[i] = optimize(*meshes[i]); });
+        return stats;
+    }
+
+    void runBenchmark(size_t copies)
+    {
+        const char *paths[] = {"../assets/monkey_smooth.obj", "../assets/monkey_flat.obj"};
+
+        JobSystem jobs;
+        jobs.init();
+
+        std::vector<Mesh> sources;
+        for (const char *path : paths)
+        {
+            Mesh mesh;
+            if (!mesh.parseObj(path, jobs))
+                return;
+
+            Mesh optimized = mesh;
+            const MeshOptimizeStats stats = optimize(optimized);
+            std::cout << path << ": " << mesh.indices.size() / 3 << " triangles, ACMR " << stats.before.acmr << " -> " << stats.after.acmr
+                      << ", ATVR " << stats.before.atvr << " -> " << stats.after.atvr << ", " << stats.clusterCount << " clusters, "
+                      << stats.milliseconds << " ms" << std::endl;
+
+            sources.push_back(std::move(mesh));
+        }
+
+        copies = std::max<size_t>(copies, 1);
+        auto time = [&](JobSystem &workers)
+        {
+            std::vector<Mesh> meshes;
+            meshes.reserve(copies * sources.size());
+            for (size_t i = 0; i < copies; ++i)
+                meshes.insert(meshes.end(), sources.begin(), sources.end());
+
+            std::vector<Mesh *> pointers;
+            for (Mesh &mesh : meshes)
+                pointers.push_back(&mesh);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            optimizeAll(pointers, workers);
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count();
+        };
+
+        JobSystem serialJobs;
+        serialJobs.init(1);
+
+        const double serialMs = time(serialJobs);
+        const double parallelMs = time(jobs);
+        std::cout << "Optimized " << copies * sources.size() << " meshes in " << serialMs << " ms on 1 job worker, "
+                  << parallelMs << " ms on " << jobs.getThreadCount() << " job workers (" << serialMs / parallelMs << "x)" << std::endl;
+
+        serialJobs.cleanup();
+        jobs.cleanup();
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vk_mesh.h"
+
+// Post-transform cache efficiency of an index buffer, measured against a
+// simulated FIFO cache.
+struct VertexCacheStats
+{
+    // Average cache miss ratio: vertex shader invocations per triangle, 0.5 at
+    // best for large regular meshes and 3 at worst.
+    double acmr{0.0};
+    // Average transformed vertex ratio: invocations per vertex, 1 at best.
+    double atvr{0.0};
+};
+
+struct MeshOptimizeStats
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+    // Triangle clusters the overdraw pass sorted.
+    uint32_t clusterCount{0};
+    double milliseconds{0.0};
+};
+
+namespace vkMeshOpt
+{
+    // Entries in the simulated FIFO, a typical size for desktop GPUs.
+    constexpr uint32_t CACHE_SIZE = 16;
+
+    VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+    // Tipsify (Sander et al. 2007): reorders triangles so each vertex is
+    // reused while it is still in a cache of cacheSize entries. Writes the
+    // start of every cluster the walk had to leave through a dead end to
+    // clusters.
+    void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize, std::vector<uint32_t> &clusters);
+
+    // Splits clusters further while that keeps the ACMR within threshold of
+    // the cluster's own, then sorts them so outward-facing ones are drawn
+    // first and hide what is behind them.
+    void optimizeOverdraw(uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount, std::vector<uint32_t> &clusters,
+                          uint32_t cacheSize, float threshold);
+
+    // Renumbers vertices in the order the indices first reference them so
+    // fetches walk the vertex buffer forwards. Unreferenced vertices are
+    // dropped.
+    void optimizeVertexFetch(std::vector<Vertex> &vertices, uint32_t *indices, size_t indexCount);
+
+    // Runs the three passes above on a mesh that owns its vertices and indices
+    // and has no LODs yet.
+    MeshOptimizeStats optimize(Mesh &mesh);
+
+    // Optimizes each mesh as its own job on jobs.
+    std::vector<MeshOptimizeStats> optimizeAll(const std::vector<Mesh *> &meshes, JobSystem &jobs);
+
+    void runBenchmark(size_t copies);
+}
@@ -0,0 +1,448 @@
+#include <vk_meshlet.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+#include <glm/geometric.hpp>
+#include "glm/gtx/transform.hpp"
+
+#include "vk_culling.h"
+#include "vk_mesh_optimizer.h"
+#include "vk_parallel.h"
+
+namespace
+{
+    constexpr uint32_t INVALID_TRIANGLE = UINT32_MAX;
+
+    // Cost of a candidate triangle on top of the vertices it adds: how far its
+    // normal turns from the meshlet's, 0 to 2, and its distance from the
+    // meshlet's center in expected meshlet radii.
+    constexpr float CONE_WEIGHT = 0.5f;
+    constexpr float DISTANCE_WEIGHT = 0.5f;
+    // Below this the cone is wider than about 84 degrees, culls almost
+    // nothing and puts the apex far behind the meshlet.
+    constexpr float MIN_CONE_DOT = 0.1f;
+
+    // Center within the sphere's radius of every plane.
+    bool sphereVisible(const glm::vec4 planes[6], const glm::vec3 &center, float radius)
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+}
+
+namespace vkMeshlet
+{
+    void build(const Vertex *vertices, size_t vertexCount, uint32_t *indices, size_t indexCount, std::vector<Meshlet> &meshlets)
+    {
+        const size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return;
+
+        // Triangles around each vertex.
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+            ++offsets[indices[i] + 1];
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+            adjacency[cursor[indices[i]]++] = (uint32_t)(i / 3);
+
+        std::vector<glm::vec3> normals(triangleCount);
+        std::vector<glm::vec3> centroids(triangleCount);
+        double totalArea = 0.0;
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            const glm::vec3 &p0 = vertices[indices[t * 3]].position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].position;
+
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float doubleArea = glm::length(normal);
+            normals[t] = doubleArea > 0.0f ? normal / doubleArea : glm::vec3(0.0f);
+            centroids[t] = (p0 + p1 + p2) / 3.0f;
+            totalArea += doubleArea * 0.5;
+        }
+
+        // Radius of a disc made of MAX_TRIANGLES average triangles.
+        float expectedRadius = (float)std::sqrt(totalArea / triangleCount * MAX_TRIANGLES / glm::pi<double>());
+        if (!(expectedRadius > 0.0f))
+            expectedRadius = 1.0f;
+
+        std::vector<bool> emitted(triangleCount, false);
+        // Meshlet that last used each vertex and last listed each triangle as
+        // a candidate, plus one.
+        std::vector<uint32_t> vertexStamps(vertexCount, 0);
+        std::vector<uint32_t> candidateStamps(triangleCount, 0);
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> output;
+        output.reserve(triangleCount * 3);
+
+        const size_t firstMeshlet = meshlets.size();
+        size_t seed = 0;
+        uint32_t stamp = 0;
+
+        auto extraVertices = [&](uint32_t triangle)
+        {
+            return (uint32_t)(vertexStamps[indices[triangle * 3]] != stamp) +
+                   (uint32_t)(vertexStamps[indices[triangle * 3 + 1]] != stamp) +
+                   (uint32_t)(vertexStamps[indices[triangle * 3 + 2]] != stamp);
+        };
+
+        while (true)
+        {
+            while (seed < triangleCount && emitted[seed])
+                ++seed;
+            if (seed == triangleCount)
+                break;
+
+            ++stamp;
+            Meshlet meshlet = {};
+            meshlet.firstIndex = (uint32_t)output.size();
+
+            glm::vec3 normalSum(0.0f);
+            glm::vec3 centroidSum(0.0f);
+            candidates.clear();
+
+            uint32_t next = (uint32_t)seed;
+            while (next != INVALID_TRIANGLE)
+            {
+                emitted[next] = true;
+                ++meshlet.triangleCount;
+                normalSum += normals[next];
+                centroidSum += centroids[next];
+
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    const uint32_t vertex = indices[next * 3 + corner];
+                    output.push_back(vertex);
+                    if (vertexStamps[vertex] == stamp)
+                        continue;
+
+                    vertexStamps[vertex] = stamp;
+                    ++meshlet.vertexCount;
+                    for (uint32_t a = offsets[vertex]; a < offsets[vertex + 1]; ++a)
+                    {
+                        const uint32_t triangle = adjacency[a];
+                        if (!emitted[triangle] && candidateStamps[triangle] != stamp)
+                        {
+                            candidateStamps[triangle] = stamp;
+                            candidates.push_back(triangle);
+                        }
+                    }
+                }
+
+                if (meshlet.triangleCount == MAX_TRIANGLES)
+                    break;
+
+                const float normalLength = glm::length(normalSum);
+                const glm::vec3 axis = normalLength > 0.0f ? normalSum / normalLength : glm::vec3(0.0f);
+                const glm::vec3 center = centroidSum / (float)meshlet.triangleCount;
+
+                next = INVALID_TRIANGLE;
+                float bestCost = FLT_MAX;
+                size_t kept = 0;
+                for (uint32_t triangle : candidates)
+                {
+                    if (emitted[triangle])
+                        continue;
+                    candidates[kept++] = triangle;
+
+                    const uint32_t extra = extraVertices(triangle);
+                    if (meshlet.vertexCount + extra > MAX_VERTICES)
+                        continue;
+
+                    const float cost = (float)extra + CONE_WEIGHT * (1.0f - glm::dot(normals[triangle], axis)) +
+                                       DISTANCE_WEIGHT * glm::length(centroids[triangle] - center) / expectedRadius;
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        next = triangle;
+                    }
+                }
+                candidates.resize(kept);
+
+                // Nothing left that touches the meshlet, e.g. the last of an
+                // eye: carry on with the next triangle in order if it's close.
+                if (next == INVALID_TRIANGLE)
+                {
+                    while (seed < triangleCount && emitted[seed])
+                        ++seed;
+                    if (seed < triangleCount && meshlet.vertexCount + extraVertices((uint32_t)seed) <= MAX_VERTICES &&
+                        glm::length(centroids[seed] - center) <= expectedRadius)
+                        next = (uint32_t)seed;
+                }
+            }
+
+            meshlets.push_back(meshlet);
+        }
+
+        std::copy(output.begin(), output.end(), indices);
+        for (size_t m = firstMeshlet; m < meshlets.size(); ++m)
+            computeBounds(vertices, indices, meshlets[m]);
+    }
+
+    MeshletStats buildMeshlets(Mesh &mesh)
+    {
+        MeshletStats stats;
+        if (mesh.cacheFile || mesh.lods.empty() || !mesh.meshlets.empty())
+            return stats;
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        uint64_t vertexSum = 0, triangleSum = 0, coneCount = 0;
+        for (MeshLod &lod : mesh.lods)
+        {
+            lod.firstMeshlet = (uint32_t)mesh.meshlets.size();
+            build(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data() + lod.firstIndex, lod.indexCount, mesh.meshlets);
+            lod.meshletCount = (uint32_t)mesh.meshlets.size() - lod.firstMeshlet;
+
+            for (uint32_t m = lod.firstMeshlet; m < lod.firstMeshlet + lod.meshletCount; ++m)
+            {
+                Meshlet &meshlet = mesh.meshlets[m];
+                meshlet.firstIndex += lod.firstIndex;
+                vertexSum += meshlet.vertexCount;
+                triangleSum += meshlet.triangleCount;
+                coneCount += meshlet.coneCutoff <= 1.0f;
+            }
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+
+        stats.meshletCount = (uint32_t)mesh.meshlets.size();
+        if (stats.meshletCount > 0)
+        {
+            stats.averageVertices = (double)vertexSum / stats.meshletCount;
+            stats.averageTriangles = (double)triangleSum / stats.meshletCount;
+            stats.coneFraction = (double)coneCount / stats.meshletCount;
+        }
+        stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        return stats;
+    }
+
+    void computeBounds(const Vertex *vertices, const uint32_t *indices, Meshlet &meshlet)
+    {
+        const uint32_t *triangles = indices + meshlet.firstIndex;
+        const uint32_t indexCount = meshlet.triangleCount * 3;
+
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        for (uint32_t i = 0; i < indexCount; ++i)
+        {
+            boundsMin = glm::min(boundsMin, vertices[triangles[i]].position);
+            boundsMax = glm::max(boundsMax, vertices[triangles[i]].position);
+        }
+
+        const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        float radius = 0.0f;
+        for (uint32_t i = 0; i < indexCount; ++i)
+            radius = std::max(radius, glm::length(vertices[triangles[i]].position - center));
+        meshlet.sphere = glm::vec4(center, radius);
+
+        glm::vec3 normalSum(0.0f);
+        for (uint32_t i = 0; i < indexCount; i += 3)
+        {
+            const glm::vec3 &p0 = vertices[triangles[i]].position;
+            const glm::vec3 normal = glm::cross(vertices[triangles[i + 1]].position - p0, vertices[triangles[i + 2]].position - p0);
+            const float length = glm::length(normal);
+            if (length > 0.0f)
+                normalSum += normal / length;
+        }
+
+        meshlet.coneApex = center;
+        meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.coneCutoff = 2.0f;
+
+        const float axisLength = glm::length(normalSum);
+        if (axisLength <= 0.0f)
+            return;
+        const glm::vec3 axis = normalSum / axisLength;
+
+        float minDot = 1.0f;
+        for (uint32_t i = 0; i < indexCount; i += 3)
+        {
+            const glm::vec3 &p0 = vertices[triangles[i]].position;
+            const glm::vec3 normal = glm::cross(vertices[triangles[i + 1]].position - p0, vertices[triangles[i + 2]].position - p0);
+            const float length = glm::length(normal);
+            if (length > 0.0f)
+                minDot = std::min(minDot, glm::dot(normal / length, axis));
+        }
+
+        if (minDot <= MIN_CONE_DOT)
+            return;
+
+        // Moves the apex back along the axis until it is behind every
+        // triangle's plane.
+        float maxT = 0.0f;
+        for (uint32_t i = 0; i < indexCount; i += 3)
+        {
+            const glm::vec3 &p0 = vertices[triangles[i]].position;
+            const glm::vec3 normal = glm::cross(vertices[triangles[i + 1]].position - p0, vertices[triangles[i + 2]].position - p0);
+            const float length = glm::length(normal);
+            if (length <= 0.0f)
+                continue;
+
+            const glm::vec3 unitNormal = normal / length;
+            maxT = std::max(maxT, glm::dot(center - p0, unitNormal) / glm::dot(axis, unitNormal));
+        }
+
+        meshlet.coneApex = center - axis * maxT;
+        meshlet.coneAxis = axis;
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+
+    bool isBackfacing(const Meshlet &meshlet, const glm::vec3 &cameraPosition)
+    {
+        const glm::vec3 toApex = meshlet.coneApex - cameraPosition;
+        const float distance = glm::length(toApex);
+        return distance > 0.0f && glm::dot(toApex, meshlet.coneAxis) >= meshlet.coneCutoff * distance;
+    }
+
+    void runBenchmark(size_t objectCount)
+    {
+        constexpr int FRAME_COUNT = 300;
+
+        JobSystem jobs;
+        jobs.init();
+
+        Mesh monkey;
+        if (!monkey.loadObj("../assets/monkey_smooth.obj", jobs))
+            return;
+
+        const MeshLod lod = monkey.getLod(0);
+        if (lod.meshletCount == 0)
+        {
+            std::cout << "Meshlet benchmark: the mesh has no meshlets" << std::endl;
+            return;
+        }
+
+        // Clustering a freshly optimized copy shows what it costs the vertex cache.
+        Mesh optimized;
+        if (optimized.parseObj("../assets/monkey_smooth.obj", jobs))
+        {
+            vkMeshOpt::optimize(optimized);
+            std::vector<uint32_t> &indices = optimized.indices;
+            const double acmrBefore = vkMeshOpt::analyzeVertexCache(indices.data(), indices.size(), optimized.vertices.size()).acmr;
+
+            std::vector<Meshlet> meshlets;
+            auto start = std::chrono::high_resolution_clock::now();
+            build(optimized.vertices.data(), optimized.vertices.size(), indices.data(), indices.size(), meshlets);
+            auto end = std::chrono::high_resolution_clock::now();
+
+            uint32_t vertexSum = 0, coneCount = 0;
+            float coneCutoffSum = 0.0f;
+            for (const Meshlet &meshlet : meshlets)
+            {
+                vertexSum += meshlet.vertexCount;
+                if (meshlet.coneCutoff <= 1.0f)
+                {
+                    ++coneCount;
+                    coneCutoffSum += meshlet.coneCutoff;
+                }
+            }
+
+            std::cout << "Meshlet benchmark: " << indices.size() / 3 << " triangles in " << meshlets.size() << " meshlets, built in "
+                      << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+            std::cout << "  " << (double)indices.size() / 3 / meshlets.size() << " triangles and " << (double)vertexSum / meshlets.size()
+                      << " vertices per meshlet, " << coneCount << " with a cone (mean cutoff " << coneCutoffSum / std::max(coneCount, 1u)
+                      << "), ACMR " << acmrBefore << " -> " << vkMeshOpt::analyzeVertexCache(indices.data(), indices.size(), optimized.vertices.size()).acmr << std::endl;
+        }
+
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> position(-40.0f, 40.0f);
+        std::uniform_real_distribution<float> angle(0.0f, glm::two_pi<float>());
+
+        std::vector<glm::mat4> transforms;
+        std::vector<glm::mat4> inverseTransforms;
+        SphereBounds bounds;
+        for (size_t i = 0; i < objectCount; ++i)
+        {
+            const glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(position(rng), position(rng) * 0.25f, position(rng))) *
+                                        glm::rotate(glm::mat4(1.0f), angle(rng), glm::normalize(glm::vec3(position(rng), position(rng), position(rng)) + 1e-3f));
+            transforms.push_back(transform);
+            inverseTransforms.push_back(glm::inverse(transform));
+            bounds.push(vkCull::transformSphere(monkey.boundingSphere, transform));
+        }
+
+        glm::mat4 projection = glm::perspective(glm::radians(70.0f), 1700.0f / 900.0f, 0.1f, 200.0f);
+        projection[1][1] *= -1;
+
+        const uint64_t lodTriangles = lod.indexCount / 3;
+        uint64_t totalTriangles = 0, objectCulled = 0, frustumCulled = 0, backfaceCulled = 0, drawnClusters = 0;
+        // Front-facing triangles inside cone-culled meshlets; must stay 0.
+        uint64_t wronglyCulled = 0;
+        double milliseconds = 0.0;
+
+        std::vector<uint32_t> visible;
+        glm::vec4 planes[6];
+        for (int frame = 0; frame < FRAME_COUNT; ++frame)
+        {
+            const float orbit = frame * glm::two_pi<float>() / FRAME_COUNT;
+            const glm::vec3 cameraPosition(std::sin(orbit) * 50.0f, 15.0f, std::cos(orbit) * 50.0f);
+            const glm::mat4 viewProjection = projection * glm::lookAt(cameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            vkCull::extractFrustumPlanes(viewProjection, planes);
+
+            vkCull::cull(bounds, viewProjection, visible, jobs);
+            totalTriangles += lodTriangles * objectCount;
+            objectCulled += lodTriangles * (objectCount - visible.size());
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (uint32_t object : visible)
+            {
+                const glm::vec3 meshCamera = glm::vec3(inverseTransforms[object] * glm::vec4(cameraPosition, 1.0f));
+                for (uint32_t m = lod.firstMeshlet; m < lod.firstMeshlet + lod.meshletCount; ++m)
+                {
+                    const Meshlet &meshlet = monkey.meshlets[m];
+                    const glm::vec3 center = glm::vec3(transforms[object] * glm::vec4(glm::vec3(meshlet.sphere), 1.0f));
+                    if (!sphereVisible(planes, center, meshlet.sphere.w))
+                        frustumCulled += meshlet.triangleCount;
+                    else if (isBackfacing(meshlet, meshCamera))
+                        backfaceCulled += meshlet.triangleCount;
+                    else
+                        ++drawnClusters;
+                }
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            milliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+
+            // Checked outside the timing.
+            for (uint32_t object : visible)
+            {
+                const glm::vec3 meshCamera = glm::vec3(inverseTransforms[object] * glm::vec4(cameraPosition, 1.0f));
+                for (uint32_t m = lod.firstMeshlet; m < lod.firstMeshlet + lod.meshletCount; ++m)
+                {
+                    const Meshlet &meshlet = monkey.meshlets[m];
+                    if (!isBackfacing(meshlet, meshCamera))
+                        continue;
+
+                    const uint32_t *triangles = monkey.getIndexData() + meshlet.firstIndex;
+                    for (uint32_t i = 0; i < meshlet.triangleCount * 3; i += 3)
+                    {
+                        const glm::vec3 &p0 = monkey.getVertexData()[triangles[i]].position;
+                        const glm::vec3 normal = glm::cross(monkey.getVertexData()[triangles[i + 1]].position - p0, monkey.getVertexData()[triangles[i + 2]].position - p0);
+                        wronglyCulled += glm::dot(normal, meshCamera - p0) > 0.0f;
+                    }
+                }
+            }
+        }
+
+        const uint64_t drawnTriangles = totalTriangles - objectCulled - frustumCulled - backfaceCulled;
+        const uint64_t visibleTriangles = totalTriangles - objectCulled;
+        std::cout << "  " << objectCount << " monkeys, " << FRAME_COUNT << " orbiting frames: " << drawnTriangles / FRAME_COUNT << " of "
+                  << visibleTriangles / FRAME_COUNT << " triangles in visible objects drawn per frame ("
+                  << 100.0 * drawnTriangles / std::max<uint64_t>(visibleTriangles, 1) << "%) in " << drawnClusters / FRAME_COUNT << " clusters" << std::endl;
+        std::cout << "  culled per frame: " << objectCulled / FRAME_COUNT << " triangles by object, " << frustumCulled / FRAME_COUNT
+                  << " by cluster frustum, " << backfaceCulled / FRAME_COUNT << " by cluster cone; "
+                  << milliseconds / FRAME_COUNT << " ms/frame for cluster tests, " << wronglyCulled << " front-facing triangles culled" << std::endl;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "vk_mesh.h"
+
+struct MeshletStats
+{
+    uint32_t meshletCount{0};
+    double averageVertices{0.0};
+    double averageTriangles{0.0};
+    // Share of meshlets whose normal cone can cull them at all.
+    double coneFraction{0.0};
+    double milliseconds{0.0};
+};
+
+namespace vkMeshlet
+{
+    // The limits mesh shader hardware is tuned for, so the same clusters can
+    // feed a mesh shader path; small enough for a useful normal cone.
+    constexpr uint32_t MAX_VERTICES = 64;
+    constexpr uint32_t MAX_TRIANGLES = 124;
+
+    // Greedily grows meshlets from the triangles' current order, preferring
+    // neighbours that add no vertices, face the meshlet's way and stay close
+    // to it. Reorders indices in place so each meshlet is contiguous and
+    // appends the meshlets, with firstIndex relative to indices.
+    void build(const Vertex *vertices, size_t vertexCount, uint32_t *indices, size_t indexCount, std::vector<Meshlet> &meshlets);
+
+    // Splits every LOD of a mesh that owns its indices into meshlets and
+    // fills mesh.meshlets and each LOD's meshlet range.
+    MeshletStats buildMeshlets(Mesh &mesh);
+
+    // Bounding sphere from the meshlet's vertices and the normal cone of its
+    // triangles (meshoptimizer's bounds): the apex sits behind every
+    // triangle's plane, so the test holds from anywhere in space.
+    void computeBounds(const Vertex *vertices, const uint32_t *indices, Meshlet &meshlet);
+
+    // Mesh-space camera position; mirrors the test in cull.comp.
+    bool isBackfacing(const Meshlet &meshlet, const glm::vec3 &cameraPosition);
+
+    void runBenchmark(size_t objectCount);
+}
@@ -0,0 +1,656 @@
+#include <vk_obj_parser.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+#include "vk_mapped_file.h"
+#include "vk_parallel.h"
+
+namespace
+{
+    constexpr int32_t MISSING_INDEX = std::numeric_limits<int32_t>::min();
+    constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+    constexpr double POW10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    struct RawCorner
+    {
+        // position, texcoord, normal. Negative OBJ indices are stored relative
+        // to the first element of that attribute in the chunk, flagged in `relative`.
+        int32_t index[3];
+        uint8_t relative;
+    };
+
+    struct Chunk
+    {
+        const char *begin;
+        const char *end;
+
+        std::vector<float> positions;
+        std::vector<float> normals;
+        std::vector<float> texcoords;
+        std::vector<RawCorner> corners;
+        std::vector<uint32_t> faceSizes;
+
+        size_t positionOffset{0};
+        size_t normalOffset{0};
+        size_t texcoordOffset{0};
+
+        std::vector<ObjIndex> triangles;
+        size_t triangleOffset{0};
+
+        std::string error;
+    };
+
+    inline bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char *skipSpaces(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    // Accumulates up to 19 significant digits into an integer and applies the
+    // decimal exponent with a single exact multiply or divide when both fit in
+    // a double (Clinger's fast path), falling back to strtod otherwise.
+    const char *parseFloat(const char *p, const char *end, float &out)
+    {
+        const char *start = p;
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool anyDigit = false;
+
+        while (p < end && isDigit(*p))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                    ++digits;
+            }
+            else
+            {
+                ++exponent;
+            }
+            anyDigit = true;
+            ++p;
+        }
+
+        if (p < end && *p == '.')
+        {
+            ++p;
+            while (p < end && isDigit(*p))
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if (mantissa != 0)
+                        ++digits;
+                    --exponent;
+                }
+                anyDigit = true;
+                ++p;
+            }
+        }
+
+        if (!anyDigit)
+            return nullptr;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char *q = p + 1;
+            bool exponentNegative = false;
+            if (q < end && (*q == '-' || *q == '+'))
+            {
+                exponentNegative = *q == '-';
+                ++q;
+            }
+
+            if (q < end && isDigit(*q))
+            {
+                int value = 0;
+                while (q < end && isDigit(*q))
+                {
+                    if (value < 10000)
+                        value = value * 10 + (*q - '0');
+                    ++q;
+                }
+                exponent += exponentNegative ? -value : value;
+                p = q;
+            }
+        }
+
+        double value;
+        if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22)
+        {
+            value = exponent < 0 ? (double)mantissa / POW10[-exponent] : (double)mantissa * POW10[exponent];
+            if (negative)
+                value = -value;
+        }
+        else
+        {
+            value = std::strtod(std::string(start, p).c_str(), nullptr);
+        }
+
+        out = (float)value;
+        return p;
+    }
+
+    const char *parseInt(const char *p, const char *end, int32_t &out)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        if (p >= end || !isDigit(*p))
+            return nullptr;
+
+        int64_t value = 0;
+        while (p < end && isDigit(*p))
+        {
+            value = value * 10 + (*p - '0');
+            if (value > std::numeric_limits<int32_t>::max())
+                return nullptr;
+            ++p;
+        }
+
+        out = (int32_t)(negative ? -value : value);
+        return p;
+    }
+
+    void parseFloats(const char *p, const char *end, std::vector<float> &out, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            float value = 0.0f;
+            p = skipSpaces(p, end);
+            const char *next = parseFloat(p, end, value);
+            if (next)
+                p = next;
+            out.push_back(value);
+        }
+    }
+
+    bool parseFace(Chunk &chunk, const char *p, const char *end)
+    {
+        const size_t localCounts[3] = {
+            chunk.positions.size() / 3,
+            chunk.texcoords.size() / 2,
+            chunk.normals.size() / 3};
+
+        uint32_t cornerCount = 0;
+        while (true)
+        {
+            p = skipSpaces(p, end);
+            if (p >= end)
+                break;
+
+            RawCorner corner = {{MISSING_INDEX, MISSING_INDEX, MISSING_INDEX}, 0};
+            for (int attribute = 0; attribute < 3; ++attribute)
+            {
+                if (attribute > 0)
+                {
+                    if (p >= end || *p != '/')
+                        break;
+                    ++p;
+                    if (p < end && *p == '/')
+                        continue;
+                }
+
+                int32_t value;
+                p = parseInt(p, end, value);
+                if (!p || value == 0)
+                {
+                    chunk.error = "invalid face index";
+                    return false;
+                }
+
+                if (value > 0)
+                {
+                    corner.index[attribute] = value - 1;
+                }
+                else
+                {
+                    corner.index[attribute] = (int32_t)localCounts[attribute] + value;
+                    corner.relative |= 1 << attribute;
+                }
+            }
+
+            while (p < end && !isSpace(*p))
+                ++p;
+
+            chunk.corners.push_back(corner);
+            ++cornerCount;
+        }
+
+        if (cornerCount < 3)
+            chunk.corners.resize(chunk.corners.size() - cornerCount);
+        else
+            chunk.faceSizes.push_back(cornerCount);
+
+        return true;
+    }
+
+    void parseChunk(Chunk &chunk)
+    {
+        const char *p = chunk.begin;
+        const size_t estimatedLines = (chunk.end - chunk.begin) / 32;
+        chunk.positions.reserve(estimatedLines);
+        chunk.corners.reserve(estimatedLines);
+
+        while (p < chunk.end)
+        {
+            const char *lineEnd = (const char *)std::memchr(p, '\n', chunk.end - p);
+            if (!lineEnd)
+                lineEnd = chunk.end;
+
+            const char *line = skipSpaces(p, lineEnd);
+            const size_t length = lineEnd - line;
+
+            if (length >= 2 && line[0] == 'v' && isSpace(line[1]))
+                parseFloats(line + 2, lineEnd, chunk.positions, 3);
+            else if (length >= 3 && line[0] == 'v' && line[1] == 'n' && isSpace(line[2]))
+                parseFloats(line + 3, lineEnd, chunk.normals, 3);
+            else if (length >= 3 && line[0] == 'v' && line[1] == 't' && isSpace(line[2]))
+                parseFloats(line + 3, lineEnd, chunk.texcoords, 2);
+            else if (length >= 2 && line[0] == 'f' && isSpace(line[1]))
+            {
+                if (!parseFace(chunk, line + 2, lineEnd))
+                    return;
+            }
+
+            p = lineEnd + 1;
+        }
+    }
+
+    bool resolveIndex(int32_t &index, bool relative, size_t offset, size_t count)
+    {
+        if (index == MISSING_INDEX)
+        {
+            index = -1;
+            return true;
+        }
+
+        int64_t resolved = relative ? (int64_t)offset + index : index;
+        if (resolved < 0 || resolved >= (int64_t)count)
+            return false;
+
+        index = (int32_t)resolved;
+        return true;
+    }
+
+    bool pointInTriangle(const float *vx, const float *vy, float tx, float ty)
+    {
+        bool inside = false;
+        for (int i = 0, j = 2; i < 3; j = i++)
+        {
+            if (((vy[i] > ty) != (vy[j] > ty)) &&
+                (tx < (vx[j] - vx[i]) * (ty - vy[i]) / (vy[j] - vy[i]) + vx[i]))
+                inside = !inside;
+        }
+        return inside;
+    }
+
+    // Ear clipping in the polygon's dominant plane, mirroring tinyobj's
+    // triangulation so both loaders emit the same triangles.
+    void triangulateFace(const ObjIndex *face, size_t count, const std::vector<float> &v, std::vector<ObjIndex> &out)
+    {
+        size_t axes[2] = {1, 2};
+        for (size_t k = 0; k < count; ++k)
+        {
+            const float *p0 = &v[3 * face[k].position];
+            const float *p1 = &v[3 * face[(k + 1) % count].position];
+            const float *p2 = &v[3 * face[(k + 2) % count].position];
+
+            const float e0x = p1[0] - p0[0], e0y = p1[1] - p0[1], e0z = p1[2] - p0[2];
+            const float e1x = p2[0] - p1[0], e1y = p2[1] - p1[1], e1z = p2[2] - p1[2];
+            const float cx = std::fabs(e0y * e1z - e0z * e1y);
+            const float cy = std::fabs(e0z * e1x - e0x * e1z);
+            const float cz = std::fabs(e0x * e1y - e0y * e1x);
+
+            const float epsilon = std::numeric_limits<float>::epsilon();
+            if (cx > epsilon || cy > epsilon || cz > epsilon)
+            {
+                if (!(cx > cy && cx > cz))
+                {
+                    axes[0] = 0;
+                    if (cz > cx && cz > cy)
+                        axes[1] = 1;
+                }
+                break;
+            }
+        }
+
+        float area = 0.0f;
+        for (size_t k = 0; k < count; ++k)
+        {
+            const float *p0 = &v[3 * face[k].position];
+            const float *p1 = &v[3 * face[(k + 1) % count].position];
+            area += (p0[axes[0]] * p1[axes[1]] - p0[axes[1]] * p1[axes[0]]) * 0.5f;
+        }
+
+        std::vector<ObjIndex> remaining(face, face + count);
+        size_t guess = 0;
+        size_t remainingIterations = count;
+        size_t previousRemaining = count;
+
+        while (remaining.size() > 3 && remainingIterations > 0)
+        {
+            const size_t n = remaining.size();
+            if (guess >= n)
+                guess -= n;
+
+            if (previousRemaining != n)
+            {
+                previousRemaining = n;
+                remainingIterations = n;
+            }
+            else
+            {
+                --remainingIterations;
+            }
+
+            ObjIndex ind[3];
+            float vx[3];
+            float vy[3];
+            for (size_t k = 0; k < 3; ++k)
+            {
+                ind[k] = remaining[(guess + k) % n];
+                vx[k] = v[3 * ind[k].position + axes[0]];
+                vy[k] = v[3 * ind[k].position + axes[1]];
+            }
+
+            const float cross = (vx[1] - vx[0]) * (vy[2] - vy[1]) - (vy[1] - vy[0]) * (vx[2] - vx[1]);
+            if (cross * area < 0.0f)
+            {
+                ++guess;
+                continue;
+            }
+
+            bool overlap = false;
+            for (size_t other = 3; other < n; ++other)
+            {
+                const ObjIndex &corner = remaining[(guess + other) % n];
+                if (pointInTriangle(vx, vy, v[3 * corner.position + axes[0]], v[3 * corner.position + axes[1]]))
+                {
+                    overlap = true;
+                    break;
+                }
+            }
+
+            if (overlap)
+            {
+                ++guess;
+                continue;
+            }
+
+            out.insert(out.end(), ind, ind + 3);
+            remaining.erase(remaining.begin() + (guess + 1) % n);
+        }
+
+        if (remaining.size() == 3)
+            out.insert(out.end(), remaining.begin(), remaining.end());
+    }
+
+    void resolveChunk(Chunk &chunk, const std::vector<float> &positions, size_t normalCount, size_t texcoordCount)
+    {
+        const size_t positionCount = positions.size() / 3;
+        const size_t offsets[3] = {chunk.positionOffset, chunk.texcoordOffset, chunk.normalOffset};
+        const size_t counts[3] = {positionCount, texcoordCount, normalCount};
+
+        std::vector<ObjIndex> face;
+        chunk.triangles.reserve(chunk.corners.size());
+
+        size_t corner = 0;
+        for (uint32_t faceSize : chunk.faceSizes)
+        {
+            face.clear();
+            for (uint32_t i = 0; i < faceSize; ++i, ++corner)
+            {
+                RawCorner raw = chunk.corners[corner];
+                for (int attribute = 0; attribute < 3; ++attribute)
+                {
+                    if (!resolveIndex(raw.index[attribute], raw.relative & (1 << attribute), offsets[attribute], counts[attribute]) ||
+                        (attribute == 0 && raw.index[0] < 0))
+                    {
+                        chunk.error = "face index out of range";
+                        return;
+                    }
+                }
+                face.push_back({raw.index[0], raw.index[1], raw.index[2]});
+            }
+
+            if (faceSize == 3)
+                chunk.triangles.insert(chunk.triangles.end(), face.begin(), face.end());
+            else
+                triangulateFace(face.data(), face.size(), positions, chunk.triangles);
+        }
+
+        chunk.corners = {};
+        chunk.faceSizes = {};
+    }
+
+    bool firstError(const std::vector<Chunk> &chunks, std::string &error)
+    {
+        for (const Chunk &chunk : chunks)
+        {
+            if (!chunk.error.empty())
+            {
+                error = chunk.error;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Splits data into about chunkCount line-aligned chunks; runChunks(count,
+    // task) runs task(0) .. task(count - 1) and returns once all have run.
+    template <typename RunChunks>
+    bool parseChunks(const char *data, size_t size, ObjData &out, std::string &error, size_t chunkCount, RunChunks &&runChunks)
+    {
+        chunkCount = std::max<size_t>(1, std::min<size_t>(chunkCount, size / MIN_CHUNK_SIZE));
+        std::vector<Chunk> chunks(chunkCount);
+
+        const char *end = data + size;
+        const char *begin = data;
+        for (size_t i = 0; i < chunkCount; ++i)
+        {
+            const char *split = i + 1 == chunkCount ? end : data + size * (i + 1) / chunkCount;
+            split = std::max(split, begin);
+            if (split < end)
+            {
+                const char *newline = (const char *)std::memchr(split, '\n', end - split);
+                split = newline ? newline + 1 : end;
+            }
+
+            chunks[i].begin = begin;
+            chunks[i].end = split;
+            begin = split;
+        }
+
+        runChunks(chunks.size(), [&](size_t i)
+                  { parseChunk(chunks[i]); });
+
+        if (firstError(chunks, error))
+            return false;
+
+        size_t positionCount = 0;
+        size_t normalCount = 0;
+        size_t texcoordCount = 0;
+        for (Chunk &chunk : chunks)
+        {
+            chunk.positionOffset = positionCount;
+            chunk.normalOffset = normalCount;
+            chunk.texcoordOffset = texcoordCount;
+            positionCount += chunk.positions.size() / 3;
+            normalCount += chunk.normals.size() / 3;
+            texcoordCount += chunk.texcoords.size() / 2;
+        }
+
+        out.positions.resize(positionCount * 3);
+        out.normals.resize(normalCount * 3);
+        out.texcoords.resize(texcoordCount * 2);
+
+        runChunks(chunks.size(), [&](size_t i)
+                  {
+                      Chunk &chunk = chunks[i];
+                      std::copy(chunk.positions.begin(), chunk.positions.end(), out.positions.begin() + chunk.positionOffset * 3);
+                      std::copy(chunk.normals.begin(), chunk.normals.end(), out.normals.begin() + chunk.normalOffset * 3);
+                      std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), out.texcoords.begin() + chunk.texcoordOffset * 2);
+                      chunk.positions = {};
+                      chunk.normals = {};
+                      chunk.texcoords = {}; });
+
+        runChunks(chunks.size(), [&](size_t i)
+                  { resolveChunk(chunks[i], out.positions, normalCount, texcoordCount); });
+
+        if (firstError(chunks, error))
+            return false;
+
+        size_t indexCount = 0;
+        for (Chunk &chunk : chunks)
+        {
+            chunk.triangleOffset = indexCount;
+            indexCount += chunk.triangles.size();
+        }
+
+        out.indices.resize(indexCount);
+
+        runChunks(chunks.size(), [&](size_t i)
+                  {
+                      Chunk &chunk = chunks[i];
+                      std::copy(chunk.triangles.begin(), chunk.triangles.end(), out.indices.begin() + chunk.triangleOffset); });
+
+        return true;
+    }
+}
+
+namespace vkObj
+{
+    bool parse(const char *data, size_t size, ObjData &out, std::string &error, JobSystem &jobs)
+    {
+        return parseChunks(data, size, out, error, jobs.getThreadCount() * 4, [&](size_t count, const auto &task)
+                           { jobs.parallelFor(count, 1, [&](size_t begin, size_t end)
+                                              {
+                                                  for (size_t i = begin; i < end; ++i)
+                                                      task(i); }); });
+    }
+
+    bool parseFile(const std::string &path, ObjData &out, std::string &error, JobSystem &jobs)
+    {
+        MappedFile file;
+        if (!file.open(path))
+        {
+            error = "Can't open file: " + path;
+            return false;
+        }
+
+        return parse((const char *)file.data(), file.size(), out, error, jobs);
+    }
+
+    void runBenchmark(size_t megabytes)
+    {
+        std::string text;
+        text.reserve(megabytes * 1024 * 1024 + 4096);
+
+        const int gridSize = 256;
+        char line[256];
+        int baseVertex = 1;
+        while (text.size() < megabytes * 1024 * 1024)
+        {
+            for (int y = 0; y < gridSize; ++y)
+            {
+                for (int x = 0; x < gridSize; ++x)
+                {
+                    const float u = x / (float)(gridSize - 1);
+                    const float v = y / (float)(gridSize - 1);
+                    std::snprintf(line, sizeof(line), "v %f %f %f\nvn %f %f %f\nvt %f %f\n",
+                                  u * 10.0f, std::sin(u * 6.28f) * std::cos(v * 6.28f), v * 10.0f,
+                                  0.0f, 1.0f, 0.0f, u, v);
+                    text += line;
+                }
+            }
+
+            for (int y = 0; y + 1 < gridSize; ++y)
+            {
+                for (int x = 0; x + 1 < gridSize; ++x)
+                {
+                    const int a = baseVertex + y * gridSize + x;
+                    const int b = a + 1;
+                    const int c = a + gridSize + 1;
+                    const int d = a + gridSize;
+                    std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c, d, d, d);
+                    text += line;
+                }
+            }
+            baseVertex += gridSize * gridSize;
+        }
+
+        const double sizeMB = text.size() / (1024.0 * 1024.0);
+        std::cout << "OBJ parser benchmark: " << sizeMB << " MB synthetic OBJ" << std::endl;
+
+        std::vector<unsigned int> threadCounts = {1};
+        if (std::thread::hardware_concurrency() > 1)
+            threadCounts.push_back(std::thread::hardware_concurrency());
+
+        for (unsigned int threads : threadCounts)
+        {
+            JobSystem jobs;
+            jobs.init(threads);
+
+            double bestSeconds = std::numeric_limits<double>::max();
+            size_t triangleCount = 0;
+            for (int run = 0; run < 3; ++run)
+            {
+                ObjData data;
+                std::string error;
+
+                auto start = std::chrono::high_resolution_clock::now();
+                if (!parse(text.data(), text.size(), data, error, jobs))
+                {
+                    std::cout << "OBJ parser benchmark failed: " << error << std::endl;
+                    return;
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+
+                bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(end - start).count());
+                triangleCount = data.indices.size() / 3;
+            }
+
+            std::cout << "  " << jobs.getThreadCount() << " job worker(s): " << sizeMB / bestSeconds << " MB/s, "
+                      << triangleCount << " triangles" << std::endl;
+
+            jobs.cleanup();
+        }
+    }
+}
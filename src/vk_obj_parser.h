@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ObjIndex
+{
+    int32_t position;
+    int32_t texcoord;
+    int32_t normal;
+};
+
+// Flat attribute arrays plus triangulated corners, laid out like tinyobj's
+// attrib_t/index_t: indices are 0-based and -1 marks a missing texcoord or normal.
+struct ObjData
+{
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    std::vector<ObjIndex> indices;
+};
+
+class JobSystem;
+
+namespace vkObj
+{
+    // The file is split into chunks that are parsed as jobs on jobs.
+    bool parse(const char *data, size_t size, ObjData &out, std::string &error, JobSystem &jobs);
+    bool parseFile(const std::string &path, ObjData &out, std::string &error, JobSystem &jobs);
+
+    void runBenchmark(size_t megabytes);
+}
@@ -0,0 +1,157 @@
+#include <vk_offset_allocator.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+OffsetAllocator::OffsetAllocator(uint64_t capacity)
+{
+    reset(capacity);
+}
+
+void OffsetAllocator::reset(uint64_t capacity)
+{
+    this->capacity = capacity;
+    used = 0;
+    freeByOffset.clear();
+    freeBySize.clear();
+    allocations.clear();
+
+    if (capacity > 0)
+        insertFreeRange(0, capacity);
+}
+
+void OffsetAllocator::grow(uint64_t newCapacity)
+{
+    if (newCapacity <= capacity)
+        return;
+
+    const uint64_t oldCapacity = capacity;
+    capacity = newCapacity;
+    insertFreeRange(oldCapacity, newCapacity - oldCapacity);
+}
+
+uint64_t OffsetAllocator::allocate(uint64_t size)
+{
+    if (size == 0)
+        return INVALID_OFFSET;
+
+    auto best = freeBySize.lower_bound(size);
+    if (best == freeBySize.end())
+        return INVALID_OFFSET;
+
+    const uint64_t offset = best->second;
+    const uint64_t rangeSize = best->first;
+
+    freeBySize.erase(best);
+    freeByOffset.erase(offset);
+
+    if (rangeSize > size)
+    {
+        freeByOffset.emplace(offset + size, rangeSize - size);
+        freeBySize.emplace(rangeSize - size, offset + size);
+    }
+
+    allocations.emplace(offset, size);
+    used += size;
+    return offset;
+}
+
+void OffsetAllocator::free(uint64_t offset)
+{
+    auto allocation = allocations.find(offset);
+    if (allocation == allocations.end())
+        return;
+
+    used -= allocation->second;
+    insertFreeRange(offset, allocation->second);
+    allocations.erase(allocation);
+}
+
+uint64_t OffsetAllocator::getLargestFreeRange() const
+{
+    return freeBySize.empty() ? 0 : freeBySize.rbegin()->first;
+}
+
+void OffsetAllocator::insertFreeRange(uint64_t offset, uint64_t size)
+{
+    auto next = freeByOffset.lower_bound(offset);
+    if (next != freeByOffset.end() && offset + size == next->first)
+    {
+        size += next->second;
+        eraseFreeRange(next);
+    }
+
+    auto previous = freeByOffset.lower_bound(offset);
+    if (previous != freeByOffset.begin())
+    {
+        --previous;
+        if (previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            size += previous->second;
+            eraseFreeRange(previous);
+        }
+    }
+
+    freeByOffset.emplace(offset, size);
+    freeBySize.emplace(size, offset);
+}
+
+void OffsetAllocator::eraseFreeRange(std::map<uint64_t, uint64_t>::iterator range)
+{
+    auto sizeRange = freeBySize.equal_range(range->second);
+    for (auto it = sizeRange.first; it != sizeRange.second; ++it)
+    {
+        if (it->second == range->first)
+        {
+            freeBySize.erase(it);
+            break;
+        }
+    }
+    freeByOffset.erase(range);
+}
+
+void OffsetAllocator::runBenchmark(size_t operations)
+{
+    OffsetAllocator allocator(1ull << 32);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint64_t> sizeDistribution(64, 64 * 1024);
+
+    std::vector<uint64_t> live;
+    live.reserve(operations);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < operations; ++i)
+    {
+        // Keep roughly 4096 live ranges so frees and allocations interleave.
+        if (live.size() > 4096 || (!live.empty() && (rng() & 1)))
+        {
+            const size_t victim = rng() % live.size();
+            allocator.free(live[victim]);
+            live[victim] = live.back();
+            live.pop_back();
+        }
+        else
+        {
+            const uint64_t offset = allocator.allocate(sizeDistribution(rng));
+            if (offset != INVALID_OFFSET)
+                live.push_back(offset);
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    const double nanoseconds = std::chrono::duration<double, std::nano>(end - start).count();
+
+    std::cout << "Offset allocator benchmark: " << operations << " alloc/free operations, "
+              << nanoseconds / operations << " ns/op, " << live.size() << " live ranges, "
+              << allocator.getFreeRangeCount() << " free ranges, largest free range "
+              << allocator.getLargestFreeRange() << " of " << allocator.getCapacity() - allocator.getUsed() << " free" << std::endl;
+
+    for (uint64_t offset : live)
+        allocator.free(offset);
+
+    std::cout << "  after freeing everything: " << allocator.getFreeRangeCount() << " free range(s)" << std::endl;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+
+// Best-fit range allocator over [0, capacity). Free ranges are indexed by
+// offset for coalescing with their neighbours and by size for lookup.
+class OffsetAllocator
+{
+    public:
+        static constexpr uint64_t INVALID_OFFSET = UINT64_MAX;
+
+        explicit OffsetAllocator(uint64_t capacity = 0);
+
+        void reset(uint64_t capacity);
+        void grow(uint64_t newCapacity);
+
+        uint64_t allocate(uint64_t size);
+        void free(uint64_t offset);
+
+        uint64_t getCapacity() const { return capacity; }
+        uint64_t getUsed() const { return used; }
+        uint64_t getLargestFreeRange() const;
+        size_t getFreeRangeCount() const { return freeByOffset.size(); }
+
+        static void runBenchmark(size_t operations);
+
+    private:
+        void insertFreeRange(uint64_t offset, uint64_t size);
+        void eraseFreeRange(std::map<uint64_t, uint64_t>::iterator range);
+
+        uint64_t capacity{0};
+        uint64_t used{0};
+
+        std::map<uint64_t, uint64_t> freeByOffset;
+        std::multimap<uint64_t, uint64_t> freeBySize;
+        std::unordered_map<uint64_t, uint64_t> allocations;
+};
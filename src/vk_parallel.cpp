@@ -0,0 +1,445 @@
+#include <vk_parallel.h>
+
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iostream>
+
+namespace
+{
+    // Every worker takes jobs from one queue under one lock; the baseline
+    // JobSystem is benchmarked against.
+    class MutexQueuePool
+    {
+        public:
+            explicit MutexQueuePool(unsigned int threadCount)
+            {
+                for (unsigned int i = 1; i < threadCount; ++i)
+                    workers.emplace_back(&MutexQueuePool::workerLoop, this);
+            }
+
+            ~MutexQueuePool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                jobAvailable.notify_all();
+
+                for (std::thread &worker : workers)
+                    worker.join();
+            }
+
+            // The caller drains the queue alongside the workers. Jobs can't
+            // wait on jobs of their own: the caller waits for the whole queue.
+            void forEach(size_t taskCount, const std::function<void(size_t)> &task)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (size_t i = 0; i < taskCount; ++i)
+                    jobs.push_back([&task, i]()
+                                   { task(i); });
+                pendingJobs += taskCount;
+                jobAvailable.notify_all();
+
+                while (runOne(lock))
+                    ;
+
+                jobsFinished.wait(lock, [this]()
+                                  { return pendingJobs == 0; });
+            }
+
+        private:
+            void workerLoop()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (true)
+                {
+                    jobAvailable.wait(lock, [this]()
+                                      { return stopping || !jobs.empty(); });
+                    if (stopping)
+                        return;
+
+                    runOne(lock);
+                }
+            }
+
+            bool runOne(std::unique_lock<std::mutex> &lock)
+            {
+                if (jobs.empty())
+                    return false;
+
+                std::function<void()> job = std::move(jobs.front());
+                jobs.pop_front();
+
+                lock.unlock();
+                job();
+                lock.lock();
+
+                if (--pendingJobs == 0)
+                    jobsFinished.notify_all();
+                return true;
+            }
+
+            std::vector<std::thread> workers;
+            std::deque<std::function<void()>> jobs;
+            std::mutex mutex;
+            std::condition_variable jobAvailable;
+            std::condition_variable jobsFinished;
+            size_t pendingJobs{0};
+            bool stopping{false};
+    };
+
+    // Uneven per-item cost for the parallel-for benchmark: a few items are
+    // far more expensive than the rest, as with objects of very different
+    // triangle counts.
+    float simulateWork(size_t item)
+    {
+        const uint32_t iterations = item % 97 == 0 ? 4096 : 32 + (uint32_t)(item % 7) * 16;
+        float value = (float)item;
+        for (uint32_t i = 0; i < iterations; ++i)
+            value = std::sqrt(value + 1.0f) * 1.0001f;
+        return value;
+    }
+
+    // Fork/join over a binary tree: each job spawns its two children and
+    // waits for them.
+    void spawnTree(JobSystem &jobs, uint32_t depth, std::atomic<uint32_t> &leaves)
+    {
+        if (depth == 0)
+        {
+            leaves.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        JobCounter children;
+        jobs.run(children, [&jobs, depth, &leaves]()
+                 { spawnTree(jobs, depth - 1, leaves); });
+        jobs.run(children, [&jobs, depth, &leaves]()
+                 { spawnTree(jobs, depth - 1, leaves); });
+        jobs.wait(children);
+    }
+}
+
+namespace vkParallel
+{
+    void runBenchmark(size_t jobCount)
+    {
+        constexpr int ITERATIONS = 10;
+        // Jobs spawned before each wait, within a worker's pool and deque.
+        constexpr size_t BATCH_SIZE = 1024;
+
+        const unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+        jobCount = std::max<size_t>(jobCount, BATCH_SIZE);
+
+        JobSystem jobs;
+        jobs.init(threadCount);
+        MutexQueuePool pool(threadCount);
+
+        auto time = [&](auto &&function)
+        {
+            function();
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < ITERATIONS; ++i)
+                function();
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count() / ITERATIONS;
+        };
+
+        std::cout << "Job system benchmark: " << jobCount << " jobs, " << threadCount << " thread(s)" << std::endl;
+
+        // Spawn and join cost: empty jobs in batches.
+        std::atomic<size_t> executed{0};
+        const double queueSpawnMs = time([&]()
+                                         {
+                                             for (size_t first = 0; first < jobCount; first += BATCH_SIZE)
+                                                 pool.forEach(std::min(BATCH_SIZE, jobCount - first), [&](size_t)
+                                                              { executed.fetch_add(1, std::memory_order_relaxed); }); });
+        const double stealSpawnMs = time([&]()
+                                         {
+                                             for (size_t first = 0; first < jobCount; first += BATCH_SIZE)
+                                             {
+                                                 JobCounter counter;
+                                                 for (size_t i = first; i < std::min(jobCount, first + BATCH_SIZE); ++i)
+                                                     jobs.run(counter, [&executed]()
+                                                              { executed.fetch_add(1, std::memory_order_relaxed); });
+                                                 jobs.wait(counter);
+                                             } });
+        std::cout << "  empty jobs, mutex queue:   " << queueSpawnMs * 1e6 / jobCount << " ns/job" << std::endl;
+        std::cout << "  empty jobs, work stealing: " << stealSpawnMs * 1e6 / jobCount << " ns/job (" << queueSpawnMs / stealSpawnMs << "x)"
+                  << std::endl;
+
+        // Uneven items: one task per thread on the queue, as a static
+        // partition, against adaptive splitting.
+        std::vector<float> reference(jobCount);
+        std::vector<float> results(jobCount);
+        const double serialMs = time([&]()
+                                     {
+                                         for (size_t i = 0; i < jobCount; ++i)
+                                             reference[i] = simulateWork(i); });
+        const double queueForMs = time([&]()
+                                       {
+                                           const size_t perTask = (jobCount + threadCount - 1) / threadCount;
+                                           pool.forEach(threadCount, [&](size_t task)
+                                                        {
+                                                            const size_t end = std::min(jobCount, (task + 1) * perTask);
+                                                            for (size_t i = task * perTask; i < end; ++i)
+                                                                results[i] = simulateWork(i); }); });
+        const bool queueMatches = results == reference;
+        std::fill(results.begin(), results.end(), 0.0f);
+        const double stealForMs = time([&]()
+                                       { jobs.parallelFor(jobCount, 16, [&](size_t begin, size_t end)
+                                                          {
+                                                              for (size_t i = begin; i < end; ++i)
+                                                                  results[i] = simulateWork(i); }); });
+        const bool stealMatches = results == reference;
+
+        std::cout << "  uneven parallel for, serial:            " << serialMs << " ms" << std::endl;
+        std::cout << "  uneven parallel for, static partition:  " << queueForMs << " ms (" << serialMs / queueForMs << "x), "
+                  << (queueMatches ? "matches" : "DIFFERS FROM") << " serial" << std::endl;
+        std::cout << "  uneven parallel for, adaptive stealing: " << stealForMs << " ms (" << serialMs / stealForMs << "x), "
+                  << (stealMatches ? "matches" : "DIFFERS FROM") << " serial" << std::endl;
+
+        // Nested fork/join, which the single queue can't do: its callers
+        // wait for the whole queue, their own job included.
+        uint32_t depth = 0;
+        while ((size_t(2) << depth) <= jobCount)
+            ++depth;
+        std::atomic<uint32_t> leaves{0};
+        const double treeMs = time([&]()
+                                   { spawnTree(jobs, depth, leaves); });
+        const size_t treeJobs = (size_t(2) << depth) - 2;
+        std::cout << "  fork/join tree of depth " << depth << ": " << treeMs * 1e6 / treeJobs << " ns/job, "
+                  << (leaves.load() == (uint32_t)(ITERATIONS + 1) << depth ? "all" : "NOT ALL") << " leaves reached" << std::endl;
+
+        jobs.cleanup();
+    }
+}
+
+thread_local JobSystem *JobSystem::currentSystem = nullptr;
+thread_local uint32_t JobSystem::currentWorker = 0;
+
+JobSystem::~JobSystem()
+{
+    cleanup();
+}
+
+void JobSystem::init(unsigned int threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        std::unique_ptr<Worker> worker = std::make_unique<Worker>();
+        worker->pool = std::make_unique<Job[]>(JOB_POOL_SIZE);
+        worker->random = 0x9e3779b9u * (i + 1);
+        workers.push_back(std::move(worker));
+    }
+
+    previousSystem = currentSystem;
+    previousWorker = currentWorker;
+    currentSystem = this;
+    currentWorker = 0;
+
+    stopping = false;
+    for (unsigned int i = 1; i < threadCount; ++i)
+        threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::cleanup()
+{
+    if (workers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+
+    for (std::thread &thread : threads)
+        thread.join();
+    threads.clear();
+    workers.clear();
+
+    if (currentSystem == this)
+    {
+        currentSystem = previousSystem;
+        currentWorker = previousWorker;
+    }
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    const bool isWorker = currentSystem == this;
+    while (counter.pending.load(std::memory_order_acquire) != 0)
+    {
+        Job *job = isWorker ? findJob(currentWorker) : nullptr;
+        if (job != nullptr)
+            execute(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+JobSystem::Job *JobSystem::allocateJob()
+{
+    if (currentSystem != this)
+        return nullptr;
+
+    Worker &worker = *workers[currentWorker];
+    Job &job = worker.pool[worker.nextJob & (JOB_POOL_SIZE - 1)];
+    if (job.live.load(std::memory_order_acquire))
+        return nullptr;
+
+    ++worker.nextJob;
+    job.live.store(true, std::memory_order_relaxed);
+    return &job;
+}
+
+void JobSystem::submit(Job *job)
+{
+    job->counter->pending.fetch_add(1, std::memory_order_relaxed);
+    if (!workers[currentWorker]->deque.push(job))
+    {
+        execute(job);
+        return;
+    }
+
+    // Pairs with the check in workerLoop(): either a worker about to sleep
+    // sees the new epoch, or this sees it sleeping and wakes it.
+    workEpoch.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepingWorkers.load(std::memory_order_seq_cst) != 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        workAvailable.notify_one();
+    }
+}
+
+JobSystem::Job *JobSystem::findJob(uint32_t worker)
+{
+    Worker &self = *workers[worker];
+    if (Job *job = self.deque.pop())
+        return job;
+
+    const uint32_t workerCount = (uint32_t)workers.size();
+    if (workerCount <= 1)
+        return nullptr;
+
+    // Xorshift; a random first victim keeps thieves from piling onto the
+    // same worker.
+    self.random ^= self.random << 13;
+    self.random ^= self.random >> 17;
+    self.random ^= self.random << 5;
+    const uint32_t first = self.random % workerCount;
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        const uint32_t victim = (first + i) % workerCount;
+        if (victim == worker)
+            continue;
+        if (Job *job = workers[victim]->deque.steal())
+            return job;
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(Job *job)
+{
+    // The counter may be gone as soon as it reaches zero, and the slot reused
+    // as soon as it's released.
+    JobCounter *counter = job->counter;
+    job->invoke(*job);
+    job->live.store(false, std::memory_order_release);
+    counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::workerLoop(uint32_t index)
+{
+    currentSystem = this;
+    currentWorker = index;
+
+    // Spinning briefly before sleeping keeps workers at hand between the
+    // bursts of jobs a frame spawns.
+    constexpr uint32_t IDLE_SPINS = 64;
+
+    uint32_t idleSpins = 0;
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        const uint64_t epoch = workEpoch.load(std::memory_order_seq_cst);
+        if (Job *job = findJob(index))
+        {
+            execute(job);
+            idleSpins = 0;
+            continue;
+        }
+
+        if (++idleSpins < IDLE_SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        workAvailable.wait(lock, [&]()
+                           { return stopping.load(std::memory_order_relaxed) || workEpoch.load(std::memory_order_seq_cst) != epoch; });
+        sleepingWorkers.fetch_sub(1, std::memory_order_seq_cst);
+        idleSpins = 0;
+    }
+}
+
+bool JobSystem::JobDeque::push(Job *job)
+{
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= DEQUE_CAPACITY)
+        return false;
+
+    buffer[b & (DEQUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+// Every store to bottom is at least a release, so whichever value a thief
+// reads, it sees the jobs below it. The paper's seq_cst fences are folded
+// into seq_cst accesses, which thread sanitizer understands.
+JobSystem::Job *JobSystem::JobDeque::pop()
+{
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+
+    if (t > b)
+    {
+        bottom.store(b + 1, std::memory_order_release);
+        return nullptr;
+    }
+
+    Job *job = buffer[b & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // The last job: race thieves for it.
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_release);
+    }
+    return job;
+}
+
+JobSystem::Job *JobSystem::JobDeque::steal()
+{
+    int64_t t = top.load(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b)
+        return nullptr;
+
+    Job *job = buffer[t & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+bool JobSystem::JobDeque::empty() const
+{
+    return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vkParallel
+{
+    // Spawns, steals and splits jobCount jobs on a JobSystem and a single
+    // mutex-protected queue, and compares them.
+    void runBenchmark(size_t jobCount);
+}
+
+// Jobs still to finish; JobSystem::wait() returns once it reaches zero. Must
+// outlive the jobs counted on it.
+struct JobCounter
+{
+    std::atomic<uint32_t> pending{0};
+};
+
+// Long-lived workers for work that repeats every frame and can't afford to
+// spawn threads each time. Each worker, the thread that called init()
+// included, owns a lock-free Chase-Lev deque: it pushes and pops jobs at the
+// bottom while idle workers steal from the top, so forking is contention-free
+// and work spreads without a shared queue. Jobs come from fixed per-worker
+// pools and store their callable inline, so spawning never allocates.
+//
+// Only the workers spawn jobs; other threads run them inline.
+class JobSystem
+{
+    public:
+        ~JobSystem();
+
+        // threadCount includes the calling thread; 0 uses every hardware thread.
+        void init(unsigned int threadCount = 0);
+        void cleanup();
+
+        unsigned int getThreadCount() const { return (unsigned int)workers.size(); }
+
+        // Queues function on the calling worker and counts it on counter. The
+        // callable is stored in the job and must fit JOB_DATA_SIZE; it runs
+        // inline when the worker's pool or deque is full.
+        template <typename Function>
+        void run(JobCounter &counter, Function &&function)
+        {
+            using Callable = std::decay_t<Function>;
+            static_assert(sizeof(Callable) <= JOB_DATA_SIZE, "Job callable too large; capture by reference");
+            static_assert(alignof(Callable) <= alignof(std::max_align_t), "Job callable over-aligned");
+
+            Job *job = allocateJob();
+            if (job == nullptr)
+            {
+                function();
+                return;
+            }
+
+            new (job->data) Callable(std::forward<Function>(function));
+            job->invoke = [](Job &job)
+            {
+                Callable &callable = *std::launder(reinterpret_cast<Callable *>(job.data));
+                callable();
+                callable.~Callable();
+            };
+            job->counter = &counter;
+            submit(job);
+        }
+
+        // Runs queued and stolen jobs until counter reaches zero.
+        void wait(JobCounter &counter);
+
+        // Calls body(begin, end) over disjoint ranges covering [0, count) and
+        // returns once all of them have run. Ranges are split in half only
+        // while the calling worker's deque is empty, i.e. while other workers
+        // have stolen everything it offered, so an idle machine gets many
+        // small ranges and a busy one few large ones. minRange bounds how
+        // small they get.
+        template <typename Function>
+        void parallelFor(size_t count, size_t minRange, const Function &body)
+        {
+            if (count == 0)
+                return;
+
+            if (workers.size() <= 1 || currentSystem != this)
+            {
+                body(size_t(0), count);
+                return;
+            }
+
+            JobCounter counter;
+            RangeContext<Function> context{this, &counter, &body, std::max<size_t>(minRange, 1)};
+            runRange(context, 0, count);
+            wait(counter);
+        }
+
+    private:
+        // tests/test_parallel.cpp drives the deque and pool directly.
+        friend struct JobSystemTest;
+
+        static constexpr size_t JOB_DATA_SIZE = 96;
+        // Per worker; both powers of two.
+        static constexpr uint32_t JOB_POOL_SIZE = 4096;
+        static constexpr int64_t DEQUE_CAPACITY = 4096;
+
+        // One cache line pair, so workers running neighbouring jobs don't
+        // share lines.
+        struct alignas(64) Job
+        {
+            void (*invoke)(Job &job){nullptr};
+            JobCounter *counter{nullptr};
+            // Set while queued or running; the owner reuses the slot once clear.
+            std::atomic<bool> live{false};
+            alignas(std::max_align_t) unsigned char data[JOB_DATA_SIZE];
+        };
+
+        // Fixed-capacity Chase-Lev deque, after Lê et al., "Correct and
+        // Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+        // push() and pop() are for the owning worker only.
+        class JobDeque
+        {
+            public:
+                bool push(Job *job);
+                Job *pop();
+                Job *steal();
+                bool empty() const;
+
+            private:
+                alignas(64) std::atomic<int64_t> top{0};
+                alignas(64) std::atomic<int64_t> bottom{0};
+                std::atomic<Job *> buffer[DEQUE_CAPACITY]{};
+        };
+
+        struct Worker
+        {
+            JobDeque deque;
+            std::unique_ptr<Job[]> pool;
+            uint32_t nextJob{0};
+            // Picks steal victims.
+            uint32_t random{1};
+        };
+
+        template <typename Function>
+        struct RangeContext
+        {
+            JobSystem *system;
+            JobCounter *counter;
+            const Function *body;
+            size_t minRange;
+        };
+
+        template <typename Function>
+        static void runRange(const RangeContext<Function> &context, size_t begin, size_t end)
+        {
+            JobDeque &deque = context.system->workers[currentWorker]->deque;
+            while (begin < end)
+            {
+                if (end - begin > context.minRange && deque.empty())
+                {
+                    const size_t middle = begin + (end - begin) / 2;
+                    context.system->run(*context.counter, [&context, middle, end]()
+                                        { runRange(context, middle, end); });
+                    end = middle;
+                    continue;
+                }
+
+                const size_t chunkEnd = std::min(end, begin + context.minRange);
+                (*context.body)(begin, chunkEnd);
+                begin = chunkEnd;
+            }
+        }
+
+        // Null when the caller isn't a worker of this system or the next pool
+        // slot is still live.
+        Job *allocateJob();
+        void submit(Job *job);
+        Job *findJob(uint32_t worker);
+        void execute(Job *job);
+        void workerLoop(uint32_t index);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+
+        // Bumped whenever a job is queued; idle workers sleep until it moves.
+        std::atomic<uint64_t> workEpoch{0};
+        std::atomic<uint32_t> sleepingWorkers{0};
+        std::atomic<bool> stopping{false};
+        std::mutex sleepMutex;
+        std::condition_variable workAvailable;
+
+        // The system and worker index of the calling thread, if any.
+        static thread_local JobSystem *currentSystem;
+        static thread_local uint32_t currentWorker;
+        // What the thread that called init() had before it, restored by cleanup().
+        JobSystem *previousSystem{nullptr};
+        uint32_t previousWorker{0};
+};
@@ -0,0 +1,117 @@
+#include <vk_pipeline_cache.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace
+{
+    // Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE, read field by field since
+    // the blob carries no alignment guarantee.
+    constexpr size_t PIPELINE_CACHE_HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+    uint32_t readU32(const std::vector<char> &data, size_t offset)
+    {
+        uint32_t value;
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        return value;
+    }
+
+    bool isCompatible(const std::vector<char> &data, const VkPhysicalDeviceProperties &properties)
+    {
+        if (data.size() < PIPELINE_CACHE_HEADER_SIZE)
+            return false;
+
+        const uint32_t headerSize = readU32(data, 0);
+        const uint32_t headerVersion = readU32(data, 4);
+        const uint32_t vendorID = readU32(data, 8);
+        const uint32_t deviceID = readU32(data, 12);
+
+        return headerSize >= PIPELINE_CACHE_HEADER_SIZE &&
+               headerSize <= data.size() &&
+               headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               vendorID == properties.vendorID &&
+               deviceID == properties.deviceID &&
+               std::memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+}
+
+namespace vkPipelineCache
+{
+    VkPipelineCache load(VkDevice device, VkPhysicalDevice physicalDevice, const std::string &path, bool *warm)
+    {
+        std::vector<char> data;
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (file.is_open())
+                data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        if (!data.empty() && !isCompatible(data, properties))
+        {
+            std::cout << "Discarding pipeline cache from a different driver: " << path << std::endl;
+            data.clear();
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .initialDataSize = data.size(),
+            .pInitialData = data.empty() ? nullptr : data.data()};
+
+        VkPipelineCache cache;
+        VK_CHECK(vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache));
+
+        if (warm)
+            *warm = !data.empty();
+        return cache;
+    }
+
+    bool write(VkDevice device, VkPipelineCache cache, const std::string &path)
+    {
+        // Pipelines built on other threads can grow the cache between the size
+        // query and the copy, which then returns VK_INCOMPLETE; ask again.
+        std::vector<char> data;
+        VkResult result = VK_INCOMPLETE;
+        for (int attempt = 0; attempt < 4 && result == VK_INCOMPLETE; ++attempt)
+        {
+            size_t size = 0;
+            VK_CHECK(vkGetPipelineCacheData(device, cache, &size, nullptr));
+
+            data.resize(size);
+            result = vkGetPipelineCacheData(device, cache, &size, data.data());
+            data.resize(size);
+        }
+
+        if (result != VK_SUCCESS)
+        {
+            std::cout << "Can't read the pipeline cache (Vk result " << result << "), not saving " << path << std::endl;
+            return false;
+        }
+
+        const std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+            {
+                std::cout << "Can't open file: " << tempPath << std::endl;
+                return false;
+            }
+
+            file.write(data.data(), data.size());
+            if (!file.good())
+                return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tempPath, path, ec);
+        return !ec;
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+#include "vk_types.h"
+
+namespace vkPipelineCache
+{
+    // Creates a pipeline cache seeded from path when the file was written by the
+    // same driver (vendor, device and pipelineCacheUUID); starts empty otherwise.
+    VkPipelineCache load(VkDevice device, VkPhysicalDevice physicalDevice, const std::string &path, bool *warm = nullptr);
+    bool write(VkDevice device, VkPipelineCache cache, const std::string &path);
+}
@@ -0,0 +1,221 @@
+#include <vk_profiler.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "imgui.h"
+
+namespace
+{
+    constexpr uint32_t MAX_ZONES = 32;
+    constexpr size_t HISTORY_SIZE = 240;
+    constexpr uint32_t INVALID_ZONE = UINT32_MAX;
+}
+
+void GpuProfiler::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t frameCount, const std::string &csvPath)
+{
+    this->device = device;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    const uint32_t validBits = queueFamily < queueFamilyCount ? queueFamilies[queueFamily].timestampValidBits : 0;
+    if (validBits == 0)
+    {
+        std::cout << "GPU profiler disabled: the graphics queue does not support timestamps" << std::endl;
+        return;
+    }
+
+    enabled = true;
+    nanosecondsPerTick = properties.limits.timestampPeriod;
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo queryPoolInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = MAX_ZONES * 2,
+        .pipelineStatistics = 0};
+
+    frames.resize(frameCount);
+    for (FrameQueries &frame : frames)
+        VK_CHECK(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &frame.queryPool));
+
+    if (!csvPath.empty())
+    {
+        csv.open(csvPath);
+        if (csv)
+            csv << "frame,cpu_ms,draws,triangles,zone,gpu_ms\n";
+        else
+            std::cout << "Failed to open " << csvPath << " for the profiler CSV" << std::endl;
+    }
+}
+
+void GpuProfiler::cleanup()
+{
+    // The last frameCount frames were never come back around to; resolve
+    // them oldest first so the CSV keeps its tail.
+    std::vector<FrameQueries *> pendingFrames;
+    for (FrameQueries &frame : frames)
+    {
+        if (frame.pending)
+            pendingFrames.push_back(&frame);
+    }
+    std::sort(pendingFrames.begin(), pendingFrames.end(), [](const FrameQueries *a, const FrameQueries *b)
+              { return a->profile.frameNumber < b->profile.frameNumber; });
+    for (FrameQueries *frame : pendingFrames)
+        resolve(*frame);
+
+    for (FrameQueries &frame : frames)
+        vkDestroyQueryPool(device, frame.queryPool, nullptr);
+    frames.clear();
+
+    if (csv.is_open())
+        csv.close();
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer cmd, uint32_t frameIndex, int frameNumber)
+{
+    if (!enabled)
+        return;
+
+    currentFrame = &frames[frameIndex];
+    if (currentFrame->pending)
+        resolve(*currentFrame);
+
+    vkCmdResetQueryPool(cmd, currentFrame->queryPool, 0, MAX_ZONES * 2);
+    currentFrame->zoneNames.clear();
+    currentFrame->profile = {.frameNumber = frameNumber};
+    currentFrame->pending = true;
+}
+
+void GpuProfiler::endFrame(uint32_t frameIndex, double cpuMilliseconds, uint32_t draws, uint64_t triangles)
+{
+    if (!enabled)
+        return;
+
+    FrameProfile &profile = frames[frameIndex].profile;
+    profile.cpuMilliseconds = cpuMilliseconds;
+    profile.draws = draws;
+    profile.triangles = triangles;
+    currentFrame = nullptr;
+}
+
+uint32_t GpuProfiler::beginZone(VkCommandBuffer cmd, const char *name)
+{
+    if (!currentFrame || currentFrame->zoneNames.size() == MAX_ZONES)
+        return INVALID_ZONE;
+
+    const uint32_t zone = (uint32_t)currentFrame->zoneNames.size();
+    currentFrame->zoneNames.push_back(name);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, currentFrame->queryPool, zone * 2);
+    return zone;
+}
+
+void GpuProfiler::endZone(VkCommandBuffer cmd, uint32_t zone)
+{
+    if (!currentFrame || zone == INVALID_ZONE)
+        return;
+
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, currentFrame->queryPool, zone * 2 + 1);
+}
+
+void GpuProfiler::resolve(FrameQueries &frame)
+{
+    frame.pending = false;
+
+    const uint32_t queryCount = (uint32_t)frame.zoneNames.size() * 2;
+    if (queryCount == 0)
+        return;
+
+    // No WAIT_BIT: the slot's fence has signalled, so anything else means a
+    // zone was never closed and the frame is dropped.
+    uint64_t timestamps[MAX_ZONES * 2];
+    if (vkGetQueryPoolResults(device, frame.queryPool, 0, queryCount, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return;
+
+    FrameProfile &profile = frame.profile;
+    for (size_t zone = 0; zone < frame.zoneNames.size(); ++zone)
+    {
+        const uint64_t ticks = (timestamps[zone * 2 + 1] - timestamps[zone * 2]) & timestampMask;
+        profile.gpuZones.push_back({frame.zoneNames[zone], ticks * nanosecondsPerTick / 1e6});
+    }
+
+    if (csv.is_open())
+    {
+        for (const GpuZoneResult &zone : profile.gpuZones)
+        {
+            csv << profile.frameNumber << ',' << profile.cpuMilliseconds << ',' << profile.draws << ','
+                << profile.triangles << ',' << zone.name << ',' << zone.milliseconds << '\n';
+        }
+    }
+
+    history.push_back(std::move(profile));
+    if (history.size() > HISTORY_SIZE)
+        history.pop_front();
+}
+
+void GpuProfiler::drawOverlay() const
+{
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.7f);
+    if (!ImGui::Begin("Profiler", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        ImGui::End();
+        return;
+    }
+
+    if (history.empty())
+    {
+        ImGui::TextUnformatted(enabled ? "Waiting for GPU results..." : "Timestamps unsupported on this queue");
+        ImGui::End();
+        return;
+    }
+
+    const FrameProfile &latest = history.back();
+    const ImVec2 graphSize(260.0f, 40.0f);
+    std::vector<float> values(history.size());
+    char overlay[64];
+
+    auto plot = [&](const char *label, const char *format, double value, auto &&sample)
+    {
+        for (size_t i = 0; i < history.size(); ++i)
+            values[i] = (float)sample(history[i]);
+        snprintf(overlay, sizeof(overlay), format, value);
+        ImGui::PlotLines(label, values.data(), (int)values.size(), 0, overlay, 0.0f, FLT_MAX, graphSize);
+    };
+
+    ImGui::Text("Frame %d", latest.frameNumber);
+    plot("CPU ms", "%.3f", latest.cpuMilliseconds, [](const FrameProfile &frame)
+         { return frame.cpuMilliseconds; });
+
+    // Zones are matched by name; frames without a zone plot as zero.
+    for (const GpuZoneResult &zone : latest.gpuZones)
+    {
+        char label[64];
+        snprintf(label, sizeof(label), "GPU %s ms", zone.name);
+        plot(label, "%.3f", zone.milliseconds, [&](const FrameProfile &frame)
+             {
+                 for (const GpuZoneResult &other : frame.gpuZones)
+                     if (std::strcmp(other.name, zone.name) == 0)
+                         return other.milliseconds;
+                 return 0.0; });
+    }
+
+    plot("Draws", "%.0f", latest.draws, [](const FrameProfile &frame)
+         { return (double)frame.draws; });
+    plot("Triangles", "%.0f", (double)latest.triangles, [](const FrameProfile &frame)
+         { return (double)frame.triangles; });
+
+    ImGui::End();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "vk_types.h"
+
+struct GpuZoneResult
+{
+    const char *name;
+    double milliseconds;
+};
+
+struct FrameProfile
+{
+    int frameNumber{-1};
+    // CPU time spent recording and submitting the frame, waits excluded.
+    double cpuMilliseconds{0.0};
+    uint32_t draws{0};
+    uint64_t triangles{0};
+    std::vector<GpuZoneResult> gpuZones;
+};
+
+// Timestamp queries around named GPU zones, one query pool per frame in
+// flight. A frame's timestamps are read back when its slot comes around
+// again, after the slot's fence has been waited on, so reading them never
+// stalls the queue.
+class GpuProfiler
+{
+    public:
+        void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t frameCount, const std::string &csvPath = "");
+        // Call once the device is idle: resolves the frames still in flight
+        // before destroying their queries.
+        void cleanup();
+
+        // Collects the results the slot recorded frameCount frames ago and
+        // resets its queries. Must be recorded before any zone and outside a
+        // render pass.
+        void beginFrame(VkCommandBuffer cmd, uint32_t frameIndex, int frameNumber);
+        void endFrame(uint32_t frameIndex, double cpuMilliseconds, uint32_t draws, uint64_t triangles);
+
+        // Zone names must outlive the frame; string literals are intended.
+        uint32_t beginZone(VkCommandBuffer cmd, const char *name);
+        void endZone(VkCommandBuffer cmd, uint32_t zone);
+
+        // Oldest first; the newest entry is frameCount frames behind.
+        const std::deque<FrameProfile> &getHistory() const { return history; }
+
+        // ImGui window with rolling graphs of every GPU zone, CPU time and
+        // draw/triangle counts. Call between ImGui::NewFrame and ImGui::Render.
+        void drawOverlay() const;
+
+    private:
+        struct FrameQueries
+        {
+            VkQueryPool queryPool;
+            std::vector<const char *> zoneNames;
+            FrameProfile profile;
+            bool pending{false};
+        };
+
+        void resolve(FrameQueries &frame);
+
+        VkDevice device;
+        bool enabled{false};
+        double nanosecondsPerTick{1.0};
+        uint64_t timestampMask{~0ull};
+
+        std::vector<FrameQueries> frames;
+        FrameQueries *currentFrame{nullptr};
+
+        std::deque<FrameProfile> history;
+        std::ofstream csv;
+};
+
+// Scoped GPU zone; a no-op when the profiler has no timestamp support.
+class GpuZone
+{
+    public:
+        GpuZone(GpuProfiler &profiler, VkCommandBuffer cmd, const char *name)
+            : profiler(profiler), cmd(cmd), zone(profiler.beginZone(cmd, name)) {}
+        ~GpuZone() { profiler.endZone(cmd, zone); }
+
+        GpuZone(const GpuZone &) = delete;
+        GpuZone &operator=(const GpuZone &) = delete;
+
+    private:
+        GpuProfiler &profiler;
+        VkCommandBuffer cmd;
+        uint32_t zone;
+};
@@ -0,0 +1,1229 @@
+#include <vk_render_graph.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "vk_deletion_queue.h"
+#include "vk_initializers.h"
+#include "vk_profiler.h"
+
+namespace
+{
+    constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+                                           VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    constexpr VkPipelineStageFlags DEPTH_STAGES = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+    struct UsageInfo
+    {
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout;
+        VkImageUsageFlags imageUsage;
+    };
+
+    bool isDepthFormat(VkFormat format)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    VkImageAspectFlags aspectMask(VkFormat format)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+    }
+
+    bool isAttachment(ResourceUsage usage)
+    {
+        return usage == ResourceUsage::ColorAttachment || usage == ResourceUsage::DepthAttachment || usage == ResourceUsage::InputAttachment;
+    }
+
+    UsageInfo usageInfo(ResourceUsage usage, VkFormat format)
+    {
+        // Depth read in a shader stays in a depth layout.
+        const VkImageLayout readOnly = isDepthFormat(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        switch (usage)
+        {
+        case ResourceUsage::ColorAttachment:
+            return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+        case ResourceUsage::DepthAttachment:
+            return {DEPTH_STAGES, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+        case ResourceUsage::InputAttachment:
+            return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT, readOnly, VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT};
+        case ResourceUsage::SampledFragment:
+            return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, readOnly, VK_IMAGE_USAGE_SAMPLED_BIT};
+        case ResourceUsage::SampledCompute:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, readOnly, VK_IMAGE_USAGE_SAMPLED_BIT};
+        case ResourceUsage::StorageRead:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT};
+        case ResourceUsage::StorageWrite:
+            // Includes reads so atomics and read-modify-write passes are covered.
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                    VK_IMAGE_USAGE_STORAGE_BIT};
+        case ResourceUsage::IndirectRead:
+            return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+        case ResourceUsage::TransferSrc:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+        case ResourceUsage::TransferDst:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+        case ResourceUsage::HostRead:
+            return {VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, 0};
+        case ResourceUsage::Present:
+            return {VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0};
+        }
+        return {};
+    }
+
+    VkAttachmentLoadOp loadOp(AttachmentLoad load)
+    {
+        switch (load)
+        {
+        case AttachmentLoad::Clear:
+            return VK_ATTACHMENT_LOAD_OP_CLEAR;
+        case AttachmentLoad::DontCare:
+            return VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        default:
+            return VK_ATTACHMENT_LOAD_OP_LOAD;
+        }
+    }
+
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Adds a dependency, merging it into an existing one between the same
+    // subpasses.
+    void addDependency(std::vector<VkSubpassDependency> &dependencies, uint32_t src, uint32_t dst, VkPipelineStageFlags srcStages,
+                       VkPipelineStageFlags dstStages, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+    {
+        for (VkSubpassDependency &dependency : dependencies)
+        {
+            if (dependency.srcSubpass == src && dependency.dstSubpass == dst)
+            {
+                dependency.srcStageMask |= srcStages;
+                dependency.dstStageMask |= dstStages;
+                dependency.srcAccessMask |= srcAccess;
+                dependency.dstAccessMask |= dstAccess;
+                return;
+            }
+        }
+
+        dependencies.push_back({
+            .srcSubpass = src,
+            .dstSubpass = dst,
+            .srcStageMask = srcStages,
+            .dstStageMask = dstStages,
+            .srcAccessMask = srcAccess,
+            .dstAccessMask = dstAccess,
+            // Attachment accesses within a render pass only depend on the
+            // same pixel.
+            .dependencyFlags = (src != VK_SUBPASS_EXTERNAL && dst != VK_SUBPASS_EXTERNAL) ? (VkDependencyFlags)VK_DEPENDENCY_BY_REGION_BIT : 0u});
+    }
+}
+
+PassBuilder &PassBuilder::writeColor(RenderResource image, AttachmentLoad load)
+{
+    graph.addAccess(pass, image, ResourceUsage::ColorAttachment, load, true);
+    return *this;
+}
+
+PassBuilder &PassBuilder::writeDepth(RenderResource image, AttachmentLoad load)
+{
+    graph.addAccess(pass, image, ResourceUsage::DepthAttachment, load, true);
+    return *this;
+}
+
+PassBuilder &PassBuilder::read(RenderResource resource, ResourceUsage usage)
+{
+    graph.addAccess(pass, resource, usage, AttachmentLoad::Load, false);
+    return *this;
+}
+
+PassBuilder &PassBuilder::write(RenderResource resource, ResourceUsage usage)
+{
+    // Other than attachments, writes may be partial, so earlier contents are
+    // kept.
+    graph.addAccess(pass, resource, usage, AttachmentLoad::Load, true);
+    return *this;
+}
+
+PassBuilder &PassBuilder::execute(RenderPassCallback &&callback)
+{
+    graph.passes[pass].callback = std::move(callback);
+    return *this;
+}
+
+void RenderGraph::init(VkDevice device, VkPhysicalDevice physicalDevice, VmaAllocator allocator, DeletionQueue *retireQueue, GpuProfiler *profiler)
+{
+    this->device = device;
+    this->physicalDevice = physicalDevice;
+    this->allocator = allocator;
+    this->retireQueue = retireQueue;
+    this->profiler = profiler;
+}
+
+void RenderGraph::cleanup()
+{
+    reset();
+
+    for (const auto &entry : renderPassCache)
+        retireQueue->push(entry.second);
+    renderPassCache.clear();
+}
+
+void RenderGraph::reset()
+{
+    releaseCompiled();
+    resources.clear();
+    passes.clear();
+}
+
+RenderResource RenderGraph::createImage(const char *name, VkFormat format, VkExtent2D extent)
+{
+    Resource resource{.name = name};
+    resource.format = format;
+    resource.extent = extent;
+    resources.push_back(std::move(resource));
+    return (RenderResource)(resources.size() - 1);
+}
+
+RenderResource RenderGraph::importImage(const char *name, VkFormat format, VkExtent2D extent, const std::vector<VkImage> &images,
+                                        const std::vector<VkImageView> &views, VkPipelineStageFlags waitStages)
+{
+    Resource resource{.name = name};
+    resource.imported = true;
+    resource.format = format;
+    resource.extent = extent;
+    resource.images = images;
+    resource.views = views;
+    resource.waitStages = waitStages;
+    resources.push_back(std::move(resource));
+    return (RenderResource)(resources.size() - 1);
+}
+
+RenderResource RenderGraph::importBuffer(const char *name, const std::vector<VkBuffer> &buffers)
+{
+    Resource resource{.name = name};
+    resource.isBuffer = true;
+    resource.imported = true;
+    resource.buffers = buffers;
+    resources.push_back(std::move(resource));
+    return (RenderResource)(resources.size() - 1);
+}
+
+void RenderGraph::markOutput(RenderResource resource, ResourceUsage finalUsage)
+{
+    resources[resource].output = true;
+    resources[resource].finalUsage = finalUsage;
+}
+
+PassBuilder RenderGraph::addPass(const char *name, PassType type)
+{
+    Pass pass{.name = name, .type = type};
+    passes.push_back(std::move(pass));
+    return PassBuilder(*this, (uint32_t)(passes.size() - 1));
+}
+
+void RenderGraph::addAccess(uint32_t pass, RenderResource resource, ResourceUsage usage, AttachmentLoad load, bool write)
+{
+    // A resource read and written by one pass is one access with the write's
+    // usage, so the pass never waits on itself.
+    for (Access &access : passes[pass].accesses)
+    {
+        if (access.resource != resource)
+            continue;
+
+        if (write && !access.write)
+        {
+            access.usage = usage;
+            access.load = load;
+            access.write = true;
+        }
+        return;
+    }
+
+    passes[pass].accesses.push_back({resource, usage, load, write});
+}
+
+void RenderGraph::setClearValue(RenderResource image, VkClearValue value)
+{
+    resources[image].clearValue = value;
+}
+
+void RenderGraph::setSubpassContents(uint32_t pass, VkSubpassContents contents)
+{
+    passes[pass].contents = contents;
+}
+
+VkRenderPass RenderGraph::getRenderPass(uint32_t pass) const
+{
+    const uint32_t step = passes[pass].step;
+    return step < steps.size() ? steps[step].renderPass : VK_NULL_HANDLE;
+}
+
+VkFramebuffer RenderGraph::getFramebuffer(uint32_t pass, uint32_t imageIndex) const
+{
+    const uint32_t step = passes[pass].step;
+    if (step >= steps.size() || steps[step].framebuffers.empty())
+        return VK_NULL_HANDLE;
+    return steps[step].framebuffers[imageIndex % steps[step].framebuffers.size()];
+}
+
+bool RenderGraph::compile()
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    releaseCompiled();
+    stats = {};
+    stats.passes = (uint32_t)passes.size();
+
+    cullPasses();
+    if (!buildSteps())
+        return false;
+    allocateTransients();
+    planBarriers();
+
+    stats.compileMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return true;
+}
+
+void RenderGraph::cullPasses()
+{
+    // Walking back from the outputs, a pass is live if it writes something a
+    // later live pass or the outputs need. An attachment it clears or doesn't
+    // care about is no longer needed from earlier passes.
+    std::vector<bool> needed(resources.size(), false);
+    for (size_t i = 0; i < resources.size(); ++i)
+        needed[i] = resources[i].output;
+
+    for (size_t i = passes.size(); i > 0; --i)
+    {
+        Pass &pass = passes[i - 1];
+        pass.step = UINT32_MAX;
+
+        pass.culled = true;
+        for (const Access &access : pass.accesses)
+        {
+            if (access.write && needed[access.resource])
+                pass.culled = false;
+        }
+
+        if (pass.culled)
+        {
+            ++stats.culledPasses;
+            continue;
+        }
+
+        for (const Access &access : pass.accesses)
+        {
+            if (access.write && access.load != AttachmentLoad::Load)
+                needed[access.resource] = false;
+        }
+        for (const Access &access : pass.accesses)
+        {
+            if (!access.write || access.load == AttachmentLoad::Load)
+                needed[access.resource] = true;
+        }
+    }
+}
+
+bool RenderGraph::buildSteps()
+{
+    // Bits of groupAccess: how the current render pass uses each resource.
+    constexpr uint8_t AS_ATTACHMENT = 1 << 0;
+    constexpr uint8_t AS_OTHER = 1 << 1;
+    constexpr uint8_t WRITTEN = 1 << 2;
+    std::vector<uint8_t> groupAccess(resources.size(), 0);
+
+    for (Resource &resource : resources)
+    {
+        resource.usageFlags = 0;
+        resource.firstStep = UINT32_MAX;
+        resource.lastStep = 0;
+        resource.stages = 0;
+        resource.writeStages = 0;
+        resource.writeAccess = 0;
+        resource.lazy = false;
+        resource.memoryOffset = 0;
+        resource.memorySize = 0;
+        resource.aliases.clear();
+    }
+
+    for (uint32_t i = 0; i < passes.size(); ++i)
+    {
+        Pass &pass = passes[i];
+        if (pass.culled)
+            continue;
+
+        const bool graphics = pass.type == PassType::Graphics;
+
+        VkExtent2D extent{0, 0};
+        for (const Access &access : pass.accesses)
+        {
+            if (isAttachment(access.usage))
+            {
+                extent = resources[access.resource].extent;
+                break;
+            }
+        }
+        if (graphics && extent.width == 0)
+        {
+            std::cout << "Render graph: graphics pass " << pass.name << " has no attachments" << std::endl;
+            return false;
+        }
+
+        // A graphics pass joins the previous one's render pass unless it
+        // needs a barrier the render pass can't express: one on a resource
+        // the render pass touches outside of attachments.
+        bool merge = graphics && !steps.empty() && steps.back().graphics;
+        for (const Access &access : pass.accesses)
+        {
+            if (!merge)
+                break;
+
+            const uint8_t flags = groupAccess[access.resource];
+            if (isAttachment(access.usage))
+            {
+                const VkExtent2D &attachmentExtent = resources[access.resource].extent;
+                const VkExtent2D &groupExtent = steps.back().extent;
+                merge = attachmentExtent.width == groupExtent.width && attachmentExtent.height == groupExtent.height && !(flags & AS_OTHER);
+            }
+            else
+            {
+                merge = !(flags & WRITTEN) && !(access.write && flags != 0);
+            }
+        }
+
+        if (!merge)
+        {
+            steps.emplace_back();
+            steps.back().graphics = graphics;
+            steps.back().extent = extent;
+            std::fill(groupAccess.begin(), groupAccess.end(), 0);
+        }
+
+        Step &step = steps.back();
+        const uint32_t stepIndex = (uint32_t)(steps.size() - 1);
+        pass.step = stepIndex;
+        pass.subpass = (uint32_t)step.passes.size();
+        step.passes.push_back(i);
+
+        for (const Access &access : pass.accesses)
+        {
+            Resource &resource = resources[access.resource];
+            const UsageInfo info = usageInfo(access.usage, resource.format);
+
+            const bool attachment = graphics && isAttachment(access.usage);
+            groupAccess[access.resource] |= (attachment ? AS_ATTACHMENT : AS_OTHER) | (access.write ? WRITTEN : 0);
+            if (attachment && std::find(step.attachments.begin(), step.attachments.end(), access.resource) == step.attachments.end())
+                step.attachments.push_back(access.resource);
+
+            resource.usageFlags |= info.imageUsage;
+            resource.firstStep = std::min(resource.firstStep, stepIndex);
+            resource.lastStep = std::max(resource.lastStep, stepIndex);
+            resource.stages |= info.stages;
+            if (access.write)
+            {
+                resource.writeStages |= info.stages;
+                resource.writeAccess |= info.access & WRITE_ACCESS;
+            }
+        }
+    }
+
+    for (Resource &resource : resources)
+    {
+        if (resource.output && resource.firstStep != UINT32_MAX)
+            resource.lastStep = (uint32_t)steps.size();
+    }
+
+    return true;
+}
+
+void RenderGraph::allocateTransients()
+{
+    VmaAllocationCreateInfo lazyInfo = {.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED};
+    uint32_t lazyMemoryType = 0;
+    const bool lazySupported = vmaFindMemoryTypeIndex(allocator, UINT32_MAX, &lazyInfo, &lazyMemoryType) == VK_SUCCESS;
+
+    std::vector<RenderResource> aliased;
+    std::vector<VkMemoryRequirements> requirements;
+
+    for (RenderResource r = 0; r < resources.size(); ++r)
+    {
+        Resource &resource = resources[r];
+        if (resource.imported || resource.isBuffer || resource.firstStep == UINT32_MAX)
+            continue;
+
+        ++stats.transientImages;
+
+        // Images that never leave one render pass and start out cleared or
+        // discarded can live in tile memory alone on GPUs that have it.
+        bool lazy = lazySupported && !resource.output && resource.firstStep == resource.lastStep;
+        bool firstAccess = true;
+        for (const Pass &pass : passes)
+        {
+            if (pass.culled)
+                continue;
+            for (const Access &access : pass.accesses)
+            {
+                if (access.resource != r)
+                    continue;
+                if (!isAttachment(access.usage) || (firstAccess && (!access.write || access.load == AttachmentLoad::Load)))
+                    lazy = false;
+                firstAccess = false;
+            }
+        }
+
+        VkImageCreateInfo imageInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = resource.format,
+            .extent = {resource.extent.width, resource.extent.height, 1},
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = resource.usageFlags | (lazy ? (VkImageUsageFlags)VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0u),
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+        TransientImage transient{.resource = r};
+        if (lazy && vmaCreateImage(allocator, &imageInfo, &lazyInfo, &transient.image, &transient.allocation, nullptr) == VK_SUCCESS)
+        {
+            VmaAllocationInfo allocationInfo;
+            vmaGetAllocationInfo(allocator, transient.allocation, &allocationInfo);
+
+            resource.lazy = true;
+            ++stats.lazyImages;
+            stats.lazyBytes += allocationInfo.size;
+        }
+        else
+        {
+            imageInfo.usage = resource.usageFlags;
+            VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &transient.image));
+
+            VkMemoryRequirements memoryRequirements;
+            vkGetImageMemoryRequirements(device, transient.image, &memoryRequirements);
+            resource.memorySize = memoryRequirements.size;
+            stats.transientBytes += memoryRequirements.size;
+
+            aliased.push_back(r);
+            requirements.push_back(memoryRequirements);
+        }
+
+        resource.images = {transient.image};
+        transientImages.push_back(transient);
+    }
+
+    if (!aliased.empty())
+        placeAliased(aliased, requirements);
+
+    // Views last, once every image has memory bound.
+    for (TransientImage &transient : transientImages)
+    {
+        Resource *resource = &resources[transient.resource];
+
+        VkImageViewCreateInfo viewInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext = nullptr,
+            .image = transient.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = resource->format,
+            .subresourceRange = {
+                .aspectMask = aspectMask(resource->format) & ~(VkImageAspectFlags)VK_IMAGE_ASPECT_STENCIL_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1}};
+
+        VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &transient.view));
+        resource->views = {transient.view};
+    }
+}
+
+void RenderGraph::placeAliased(const std::vector<RenderResource> &aliased, const std::vector<VkMemoryRequirements> &requirements)
+{
+    // Largest first, each at the lowest offset that doesn't overlap an image
+    // already placed whose lifetime overlaps its own.
+    std::vector<uint32_t> order(aliased.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return requirements[a].size > requirements[b].size; });
+
+    auto livesOverlap = [&](const Resource &a, const Resource &b) {
+        return a.firstStep <= b.lastStep && b.firstStep <= a.lastStep;
+    };
+    auto memoryOverlaps = [&](const Resource &a, const Resource &b) {
+        return a.memoryOffset < b.memoryOffset + b.memorySize && b.memoryOffset < a.memoryOffset + a.memorySize;
+    };
+
+    VkMemoryRequirements pool = {.size = 0, .alignment = 1, .memoryTypeBits = UINT32_MAX};
+    std::vector<uint32_t> placed;
+    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> taken;
+
+    for (uint32_t i : order)
+    {
+        Resource &resource = resources[aliased[i]];
+        const VkMemoryRequirements &memoryRequirements = requirements[i];
+
+        taken.clear();
+        for (uint32_t j : placed)
+        {
+            const Resource &other = resources[aliased[j]];
+            if (livesOverlap(resource, other))
+                taken.push_back({other.memoryOffset, other.memoryOffset + other.memorySize});
+        }
+        std::sort(taken.begin(), taken.end());
+
+        VkDeviceSize offset = 0;
+        for (const auto &range : taken)
+        {
+            if (offset + memoryRequirements.size <= range.first)
+                break;
+            offset = std::max(offset, alignUp(range.second, memoryRequirements.alignment));
+        }
+
+        resource.memoryOffset = offset;
+        pool.size = std::max(pool.size, offset + memoryRequirements.size);
+        pool.alignment = std::max(pool.alignment, memoryRequirements.alignment);
+        pool.memoryTypeBits &= memoryRequirements.memoryTypeBits;
+        placed.push_back(i);
+    }
+
+    VmaAllocationCreateInfo allocInfo = {.usage = VMA_MEMORY_USAGE_GPU_ONLY};
+
+    if (pool.memoryTypeBits == 0)
+    {
+        // No memory type suits every image, so they can't share; each gets
+        // memory of its own.
+        std::cout << "Render graph: transient images need different memory types, not aliasing them" << std::endl;
+        for (RenderResource r : aliased)
+        {
+            Resource &resource = resources[r];
+            VmaAllocation allocation;
+            VK_CHECK(vmaAllocateMemoryForImage(allocator, resource.images[0], &allocInfo, &allocation, nullptr));
+            VK_CHECK(vmaBindImageMemory(allocator, allocation, resource.images[0]));
+            transientAllocations.push_back(allocation);
+
+            resource.memoryOffset = 0;
+            stats.allocatedBytes += resource.memorySize;
+        }
+        return;
+    }
+
+    VmaAllocation allocation;
+    VK_CHECK(vmaAllocateMemory(allocator, &pool, &allocInfo, &allocation, nullptr));
+    transientAllocations.push_back(allocation);
+    stats.allocatedBytes += pool.size;
+
+    for (RenderResource r : aliased)
+        VK_CHECK(vmaBindImageMemory2(allocator, allocation, resources[r].memoryOffset, resources[r].images[0], nullptr));
+
+    // Images sharing memory synchronize with each other like uses of one
+    // resource, including across frames.
+    for (size_t a = 0; a < aliased.size(); ++a)
+    {
+        for (size_t b = a + 1; b < aliased.size(); ++b)
+        {
+            Resource &first = resources[aliased[a]];
+            Resource &second = resources[aliased[b]];
+            if (memoryOverlaps(first, second))
+            {
+                first.aliases.push_back(aliased[b]);
+                second.aliases.push_back(aliased[a]);
+            }
+        }
+    }
+}
+
+RenderGraph::ResourceState &RenderGraph::touch(std::vector<ResourceState> &states, RenderResource r)
+{
+    ResourceState &state = states[r];
+    if (state.touched)
+        return state;
+    state.touched = true;
+
+    const Resource &resource = resources[r];
+    if (resource.imported)
+    {
+        // Imported images arrive undefined once waitStages is reached; buffers
+        // have a variant per frame, which the frame's fence already covers.
+        state.readStages = resource.waitStages;
+        return state;
+    }
+
+    // A transient image's previous contents came from the previous frame or
+    // an image aliasing its memory; either may still be in flight.
+    state.writeStages = resource.writeStages;
+    state.writeAccess = resource.writeAccess;
+    state.readStages = resource.stages;
+    for (RenderResource alias : resource.aliases)
+    {
+        state.writeStages |= resources[alias].writeStages;
+        state.writeAccess |= resources[alias].writeAccess;
+        state.readStages |= resources[alias].stages;
+    }
+    return state;
+}
+
+bool RenderGraph::hazard(const ResourceState &state, VkPipelineStageFlags stages, VkAccessFlags access, bool write, bool layoutChange,
+                         VkPipelineStageFlags &srcStages, VkAccessFlags &srcAccess)
+{
+    // Writes and layout transitions wait for every earlier access; reads
+    // only for the last write, and only until it is visible to them.
+    if (write || layoutChange)
+    {
+        srcStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+        return srcStages != 0 || layoutChange;
+    }
+
+    srcStages = state.writeStages;
+    srcAccess = state.writeAccess;
+    return state.writeStages != 0 && ((stages & ~state.visibleStages) != 0 || (access & ~state.visibleAccess) != 0);
+}
+
+void RenderGraph::advance(ResourceState &state, VkPipelineStageFlags stages, VkAccessFlags access, bool write, bool synchronized)
+{
+    if (write)
+    {
+        state.writeStages = stages;
+        state.writeAccess = access & WRITE_ACCESS;
+        state.readStages = 0;
+        state.visibleStages = 0;
+        state.visibleAccess = 0;
+        return;
+    }
+
+    state.readStages |= stages;
+    if (synchronized)
+    {
+        state.visibleStages |= stages;
+        state.visibleAccess |= access;
+    }
+}
+
+void RenderGraph::require(std::vector<ResourceState> &states, RenderResource r, ResourceUsage usage, bool write, BarrierBatch &batch)
+{
+    const Resource &resource = resources[r];
+    ResourceState &state = touch(states, r);
+    const UsageInfo info = usageInfo(usage, resource.format);
+    const bool layoutChange = !resource.isBuffer && state.layout != info.layout;
+
+    VkPipelineStageFlags srcStages;
+    VkAccessFlags srcAccess;
+    const bool needed = hazard(state, info.stages, info.access, write, layoutChange, srcStages, srcAccess);
+    if (needed)
+    {
+        batch.srcStages |= srcStages != 0 ? srcStages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        batch.dstStages |= info.stages;
+
+        auto existing = std::find_if(batch.barriers.begin(), batch.barriers.end(), [r](const BarrierPlan &plan) { return plan.resource == r; });
+        if (existing != batch.barriers.end())
+        {
+            existing->srcAccess |= srcAccess;
+            existing->dstAccess |= info.access;
+        }
+        else
+        {
+            batch.barriers.push_back({r, srcAccess, info.access, state.layout, resource.isBuffer ? state.layout : info.layout});
+        }
+    }
+
+    advance(state, info.stages, info.access, write, needed);
+    if (!resource.isBuffer)
+        state.layout = info.layout;
+}
+
+void RenderGraph::planBarriers()
+{
+    std::vector<ResourceState> states(resources.size());
+
+    for (uint32_t s = 0; s < steps.size(); ++s)
+    {
+        Step &step = steps[s];
+        if (step.graphics)
+        {
+            createRenderPass(step, states, s);
+            createFramebuffers(step);
+        }
+        else
+        {
+            for (const Access &access : passes[step.passes[0]].accesses)
+                require(states, access.resource, access.usage, access.write, step.barriers);
+        }
+    }
+
+    for (RenderResource r = 0; r < resources.size(); ++r)
+    {
+        if (resources[r].output && states[r].touched)
+            require(states, r, resources[r].finalUsage, false, finalBarriers);
+    }
+
+    auto count = [&](const BarrierBatch &batch) {
+        if (batch.barriers.empty())
+            return;
+        ++stats.barrierBatches;
+        for (const BarrierPlan &plan : batch.barriers)
+        {
+            if (resources[plan.resource].isBuffer)
+                ++stats.bufferBarriers;
+            else
+                ++stats.imageBarriers;
+        }
+    };
+    for (const Step &step : steps)
+        count(step.barriers);
+    count(finalBarriers);
+}
+
+void RenderGraph::createRenderPass(Step &step, std::vector<ResourceState> &states, uint32_t stepIndex)
+{
+    // Anything used outside of attachments is synchronized before the render
+    // pass begins; merging made sure none of it is written inside.
+    for (uint32_t pass : step.passes)
+    {
+        for (const Access &access : passes[pass].accesses)
+        {
+            if (!isAttachment(access.usage))
+                require(states, access.resource, access.usage, access.write, step.barriers);
+        }
+    }
+
+    const uint32_t attachmentCount = (uint32_t)step.attachments.size();
+    const uint32_t subpassCount = (uint32_t)step.passes.size();
+
+    std::vector<VkAttachmentDescription> descriptions(attachmentCount);
+    std::vector<std::vector<VkAttachmentReference>> colorRefs(subpassCount);
+    std::vector<std::vector<VkAttachmentReference>> inputRefs(subpassCount);
+    std::vector<VkAttachmentReference> depthRefs(subpassCount, {VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED});
+    std::vector<std::vector<uint32_t>> preserveRefs(subpassCount);
+    std::vector<VkSubpassDependency> dependencies;
+
+    // Per attachment: the subpass that last wrote it and those that read it
+    // since, VK_SUBPASS_EXTERNAL standing for everything before the render
+    // pass; and the range of subpasses using it.
+    std::vector<uint32_t> writers(attachmentCount, VK_SUBPASS_EXTERNAL);
+    std::vector<std::vector<uint32_t>> readers(attachmentCount);
+    std::vector<uint32_t> firstSubpass(attachmentCount, UINT32_MAX);
+    std::vector<uint32_t> lastSubpass(attachmentCount, 0);
+    std::vector<std::vector<bool>> referenced(subpassCount, std::vector<bool>(attachmentCount, false));
+
+    for (uint32_t subpass = 0; subpass < subpassCount; ++subpass)
+    {
+        for (const Access &access : passes[step.passes[subpass]].accesses)
+        {
+            if (!isAttachment(access.usage))
+                continue;
+
+            const uint32_t a = (uint32_t)(std::find(step.attachments.begin(), step.attachments.end(), access.resource) - step.attachments.begin());
+            const Resource &resource = resources[access.resource];
+            const UsageInfo info = usageInfo(access.usage, resource.format);
+            ResourceState &state = touch(states, access.resource);
+
+            bool layoutChange = state.layout != info.layout;
+            if (firstSubpass[a] == UINT32_MAX)
+            {
+                const bool discard = access.write && access.load != AttachmentLoad::Load;
+                VkAttachmentDescription &description = descriptions[a];
+                description.format = resource.format;
+                description.samples = VK_SAMPLE_COUNT_1_BIT;
+                description.loadOp = access.write ? loadOp(access.load) : VK_ATTACHMENT_LOAD_OP_LOAD;
+                description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                description.initialLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+                layoutChange = layoutChange || discard;
+                firstSubpass[a] = subpass;
+            }
+
+            VkPipelineStageFlags srcStages;
+            VkAccessFlags srcAccess;
+            const bool needed = hazard(state, info.stages, info.access, access.write, layoutChange, srcStages, srcAccess);
+            if (needed && srcStages != 0)
+            {
+                addDependency(dependencies, writers[a], subpass, srcStages, info.stages, srcAccess, info.access);
+                if (access.write || layoutChange)
+                {
+                    for (uint32_t reader : readers[a])
+                        addDependency(dependencies, reader, subpass, srcStages, info.stages, srcAccess, info.access);
+                }
+            }
+            advance(state, info.stages, info.access, access.write, needed);
+            state.layout = info.layout;
+
+            if (access.write)
+            {
+                writers[a] = subpass;
+                readers[a].clear();
+            }
+            else if (std::find(readers[a].begin(), readers[a].end(), subpass) == readers[a].end())
+            {
+                readers[a].push_back(subpass);
+            }
+            lastSubpass[a] = subpass;
+            referenced[subpass][a] = true;
+
+            const VkAttachmentReference reference = {a, info.layout};
+            if (access.usage == ResourceUsage::ColorAttachment)
+                colorRefs[subpass].push_back(reference);
+            else if (access.usage == ResourceUsage::DepthAttachment)
+                depthRefs[subpass] = reference;
+            else
+                inputRefs[subpass].push_back(reference);
+        }
+    }
+
+    for (uint32_t a = 0; a < attachmentCount; ++a)
+    {
+        const RenderResource r = step.attachments[a];
+        const Resource &resource = resources[r];
+        ResourceState &state = states[r];
+
+        // The next use decides whether the contents are stored and which
+        // layout the render pass leaves the image in; one that discards them
+        // doesn't need them.
+        VkPipelineStageFlags nextReadStages;
+        VkAccessFlags nextReadAccess;
+        const Access *nextAccess = findNextAccess(r, stepIndex, nextReadStages, nextReadAccess);
+        bool hasNext = nextAccess && !(nextAccess->write && nextAccess->load != AttachmentLoad::Load);
+        ResourceUsage nextUsage = nextAccess ? nextAccess->usage : resource.finalUsage;
+        bool nextWrite = nextAccess && nextAccess->write;
+        if (!nextAccess && resource.output)
+            hasNext = true;
+
+        VkAttachmentDescription &description = descriptions[a];
+        description.storeOp = hasNext ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        description.finalLayout = state.layout;
+
+        if (hasNext)
+        {
+            // Transition to the next use on the way out, and make the writes
+            // visible to it and the reads after it, so they need no barrier
+            // of their own.
+            UsageInfo next = usageInfo(nextUsage, resource.format);
+            if (nextAccess && !nextWrite)
+            {
+                next.stages = nextReadStages;
+                next.access = nextReadAccess;
+            }
+            description.finalLayout = next.layout;
+
+            VkPipelineStageFlags srcStages;
+            VkAccessFlags srcAccess;
+            if (hazard(state, next.stages, next.access, nextWrite, state.layout != next.layout, srcStages, srcAccess) && srcStages != 0)
+            {
+                addDependency(dependencies, writers[a], VK_SUBPASS_EXTERNAL, srcStages, next.stages, srcAccess, next.access);
+                for (uint32_t reader : readers[a])
+                    addDependency(dependencies, reader, VK_SUBPASS_EXTERNAL, srcStages, next.stages, srcAccess, next.access);
+
+                state.writeStages = next.stages;
+                state.writeAccess = 0;
+                state.readStages = 0;
+                state.visibleStages = next.stages;
+                state.visibleAccess = next.access;
+            }
+            state.layout = next.layout;
+        }
+
+        // Contents must survive the subpasses between uses that don't
+        // reference them; the store happens at the last use.
+        for (uint32_t subpass = firstSubpass[a] + 1; subpass < lastSubpass[a]; ++subpass)
+        {
+            if (!referenced[subpass][a])
+                preserveRefs[subpass].push_back(a);
+        }
+    }
+
+    std::vector<VkSubpassDescription> subpasses(subpassCount);
+    for (uint32_t subpass = 0; subpass < subpassCount; ++subpass)
+    {
+        subpasses[subpass] = {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .inputAttachmentCount = (uint32_t)inputRefs[subpass].size(),
+            .pInputAttachments = inputRefs[subpass].data(),
+            .colorAttachmentCount = (uint32_t)colorRefs[subpass].size(),
+            .pColorAttachments = colorRefs[subpass].data(),
+            .pDepthStencilAttachment = depthRefs[subpass].attachment != VK_ATTACHMENT_UNUSED ? &depthRefs[subpass] : nullptr,
+            .preserveAttachmentCount = (uint32_t)preserveRefs[subpass].size(),
+            .pPreserveAttachments = preserveRefs[subpass].data()};
+    }
+
+    stats.renderPasses++;
+    stats.subpasses += subpassCount;
+    stats.subpassDependencies += (uint32_t)dependencies.size();
+
+    // Everything that makes the render pass, flattened into a cache key.
+    std::vector<uint32_t> key;
+    for (const VkAttachmentDescription &description : descriptions)
+        key.insert(key.end(), {(uint32_t)description.format, (uint32_t)description.loadOp, (uint32_t)description.storeOp,
+                               (uint32_t)description.initialLayout, (uint32_t)description.finalLayout});
+    for (uint32_t subpass = 0; subpass < subpassCount; ++subpass)
+    {
+        key.push_back(UINT32_MAX);
+        for (const VkAttachmentReference &reference : colorRefs[subpass])
+            key.insert(key.end(), {0u, reference.attachment, (uint32_t)reference.layout});
+        for (const VkAttachmentReference &reference : inputRefs[subpass])
+            key.insert(key.end(), {1u, reference.attachment, (uint32_t)reference.layout});
+        key.insert(key.end(), {2u, depthRefs[subpass].attachment, (uint32_t)depthRefs[subpass].layout});
+        for (uint32_t preserved : preserveRefs[subpass])
+            key.insert(key.end(), {3u, preserved});
+    }
+    for (const VkSubpassDependency &dependency : dependencies)
+        key.insert(key.end(), {UINT32_MAX - 1, dependency.srcSubpass, dependency.dstSubpass, dependency.srcStageMask, dependency.dstStageMask,
+                               dependency.srcAccessMask, dependency.dstAccessMask, dependency.dependencyFlags});
+
+    auto cached = renderPassCache.find(key);
+    if (cached != renderPassCache.end())
+    {
+        step.renderPass = cached->second;
+        return;
+    }
+
+    VkRenderPassCreateInfo renderPassInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = attachmentCount,
+        .pAttachments = descriptions.data(),
+        .subpassCount = subpassCount,
+        .pSubpasses = subpasses.data(),
+        .dependencyCount = (uint32_t)dependencies.size(),
+        .pDependencies = dependencies.data()};
+
+    VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, nullptr, &step.renderPass));
+    renderPassCache[key] = step.renderPass;
+}
+
+const RenderGraph::Access *RenderGraph::findNextAccess(RenderResource r, uint32_t stepIndex, VkPipelineStageFlags &readStages,
+                                                       VkAccessFlags &readAccess) const
+{
+    const Resource &resource = resources[r];
+    const Access *next = nullptr;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    readStages = 0;
+    readAccess = 0;
+
+    for (uint32_t s = stepIndex + 1; s < steps.size(); ++s)
+    {
+        for (uint32_t pass : steps[s].passes)
+        {
+            for (const Access &access : passes[pass].accesses)
+            {
+                if (access.resource != r)
+                    continue;
+
+                const UsageInfo info = usageInfo(access.usage, resource.format);
+                if (!next)
+                {
+                    next = &access;
+                    layout = info.layout;
+                }
+                if (access.write || info.layout != layout)
+                    return next;
+
+                readStages |= info.stages;
+                readAccess |= info.access;
+            }
+        }
+    }
+
+    if (next && resource.output)
+    {
+        const UsageInfo info = usageInfo(resource.finalUsage, resource.format);
+        if (info.layout == layout)
+        {
+            readStages |= info.stages;
+            readAccess |= info.access;
+        }
+    }
+    return next;
+}
+
+void RenderGraph::createFramebuffers(Step &step)
+{
+    // One framebuffer per variant of the imported images attached.
+    size_t variants = 1;
+    for (RenderResource r : step.attachments)
+        variants = std::max(variants, resources[r].views.size());
+
+    std::vector<VkImageView> views(step.attachments.size());
+    step.framebuffers.resize(variants);
+
+    for (size_t i = 0; i < variants; ++i)
+    {
+        for (size_t a = 0; a < step.attachments.size(); ++a)
+        {
+            const Resource &resource = resources[step.attachments[a]];
+            views[a] = resource.views[i % resource.views.size()];
+        }
+
+        VkFramebufferCreateInfo framebufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+            .pNext = nullptr,
+            .renderPass = step.renderPass,
+            .attachmentCount = (uint32_t)views.size(),
+            .pAttachments = views.data(),
+            .width = step.extent.width,
+            .height = step.extent.height,
+            .layers = 1};
+
+        VK_CHECK(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &step.framebuffers[i]));
+    }
+}
+
+void RenderGraph::releaseCompiled()
+{
+    // Memory first, so it's freed after the images bound to it.
+    for (VmaAllocation allocation : transientAllocations)
+        retireQueue->push(allocation);
+    for (const TransientImage &transient : transientImages)
+        retireQueue->push(transient.image, transient.allocation);
+    for (const TransientImage &transient : transientImages)
+    {
+        if (transient.view != VK_NULL_HANDLE)
+            retireQueue->push(transient.view);
+    }
+    for (const Step &step : steps)
+    {
+        for (VkFramebuffer framebuffer : step.framebuffers)
+            retireQueue->push(framebuffer);
+    }
+
+    transientAllocations.clear();
+    transientImages.clear();
+    steps.clear();
+    finalBarriers = {};
+
+    for (Resource &resource : resources)
+    {
+        if (!resource.imported)
+        {
+            resource.images.clear();
+            resource.views.clear();
+        }
+    }
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd, uint32_t imageIndex, uint32_t frameIndex)
+{
+    for (const Step &step : steps)
+    {
+        const Pass &first = passes[step.passes[0]];
+        const uint32_t zone = profiler ? profiler->beginZone(cmd, first.name) : 0;
+
+        recordBarriers(cmd, step.barriers, imageIndex, frameIndex);
+
+        RenderPassContext context = {
+            .renderPass = step.renderPass,
+            .subpass = 0,
+            .framebuffer = VK_NULL_HANDLE,
+            .extent = step.extent,
+            .imageIndex = imageIndex,
+            .frameIndex = frameIndex};
+
+        if (step.graphics)
+        {
+            context.framebuffer = step.framebuffers[imageIndex % step.framebuffers.size()];
+
+            clearValueScratch.clear();
+            for (RenderResource r : step.attachments)
+                clearValueScratch.push_back(resources[r].clearValue);
+
+            VkRenderPassBeginInfo beginInfo = {
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                .pNext = nullptr,
+                .renderPass = step.renderPass,
+                .framebuffer = context.framebuffer,
+                .renderArea = {.offset = {0, 0}, .extent = step.extent},
+                .clearValueCount = (uint32_t)clearValueScratch.size(),
+                .pClearValues = clearValueScratch.data()};
+
+            vkCmdBeginRenderPass(cmd, &beginInfo, first.contents);
+            for (uint32_t subpass = 0; subpass < step.passes.size(); ++subpass)
+            {
+                const Pass &pass = passes[step.passes[subpass]];
+                if (subpass > 0)
+                    vkCmdNextSubpass(cmd, pass.contents);
+
+                context.subpass = subpass;
+                if (pass.callback)
+                    pass.callback(cmd, context);
+            }
+            vkCmdEndRenderPass(cmd);
+        }
+        else if (first.callback)
+        {
+            first.callback(cmd, context);
+        }
+
+        if (profiler)
+            profiler->endZone(cmd, zone);
+    }
+
+    recordBarriers(cmd, finalBarriers, imageIndex, frameIndex);
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer cmd, const BarrierBatch &batch, uint32_t imageIndex, uint32_t frameIndex)
+{
+    if (batch.barriers.empty())
+        return;
+
+    imageBarrierScratch.clear();
+    bufferBarrierScratch.clear();
+
+    for (const BarrierPlan &plan : batch.barriers)
+    {
+        const Resource &resource = resources[plan.resource];
+        if (resource.isBuffer)
+        {
+            VkBuffer buffer = resource.buffers[frameIndex % resource.buffers.size()];
+            bufferBarrierScratch.push_back(vkInit::bufferMemoryBarrier(buffer, plan.srcAccess, plan.dstAccess));
+        }
+        else
+        {
+            VkImage image = resource.images[imageIndex % resource.images.size()];
+            VkImageMemoryBarrier barrier = vkInit::imageMemoryBarrier(image, plan.srcAccess, plan.dstAccess, plan.oldLayout, plan.newLayout);
+            barrier.subresourceRange.aspectMask = aspectMask(resource.format);
+            imageBarrierScratch.push_back(barrier);
+        }
+    }
+
+    vkCmdPipelineBarrier(cmd, batch.srcStages, batch.dstStages, 0, 0, nullptr, (uint32_t)bufferBarrierScratch.size(), bufferBarrierScratch.data(),
+                         (uint32_t)imageBarrierScratch.size(), imageBarrierScratch.data());
+}
+
+void RenderGraph::printStats(const char *label) const
+{
+    const double toKiB = 1.0 / 1024.0;
+
+    std::cout << label << ": " << stats.passes << " passes, " << stats.culledPasses << " culled; " << stats.renderPasses << " render passes with "
+              << stats.subpasses << " subpasses and " << stats.subpassDependencies << " subpass dependencies" << std::endl;
+    std::cout << "  Barriers per frame: " << stats.barrierBatches << " batches, " << stats.imageBarriers << " image, " << stats.bufferBarriers
+              << " buffer" << std::endl;
+    std::cout << "  Transient images: " << stats.transientImages << " (" << stats.lazyImages << " lazily allocated, " << stats.lazyBytes * toKiB
+              << " KiB), " << stats.transientBytes * toKiB << " KiB aliased into " << stats.allocatedBytes * toKiB << " KiB, "
+              << (stats.transientBytes - std::min(stats.transientBytes, stats.allocatedBytes)) * toKiB << " KiB saved" << std::endl;
+    std::cout << "  Compiled in " << stats.compileMilliseconds << " ms" << std::endl;
+}
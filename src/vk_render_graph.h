@@ -0,0 +1,306 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "vk_types.h"
+
+class DeletionQueue;
+class GpuProfiler;
+
+// Index of a resource declared in a RenderGraph.
+using RenderResource = uint32_t;
+
+enum class PassType : uint8_t
+{
+    Graphics,
+    Compute,
+    Transfer,
+};
+
+// How a pass touches a resource; each usage implies the pipeline stages,
+// access mask and, for images, layout the graph synchronizes against.
+enum class ResourceUsage : uint8_t
+{
+    ColorAttachment,
+    DepthAttachment,
+    InputAttachment,
+    SampledFragment,
+    SampledCompute,
+    StorageRead,
+    StorageWrite,
+    IndirectRead,
+    TransferSrc,
+    TransferDst,
+    // Only as the final usage of an output.
+    HostRead,
+    Present,
+};
+
+enum class AttachmentLoad : uint8_t
+{
+    Load,
+    Clear,
+    DontCare,
+};
+
+struct RenderPassContext
+{
+    VkRenderPass renderPass{VK_NULL_HANDLE};
+    uint32_t subpass{0};
+    VkFramebuffer framebuffer{VK_NULL_HANDLE};
+    VkExtent2D extent{0, 0};
+    uint32_t imageIndex{0};
+    uint32_t frameIndex{0};
+};
+
+using RenderPassCallback = std::function<void(VkCommandBuffer cmd, const RenderPassContext &context)>;
+
+struct RenderGraphStats
+{
+    uint32_t passes{0};
+    uint32_t culledPasses{0};
+    uint32_t renderPasses{0};
+    uint32_t subpasses{0};
+    uint32_t subpassDependencies{0};
+    // vkCmdPipelineBarrier calls per execution and the barriers they carry.
+    uint32_t barrierBatches{0};
+    uint32_t imageBarriers{0};
+    uint32_t bufferBarriers{0};
+    uint32_t transientImages{0};
+    uint32_t lazyImages{0};
+    // Transient images as if each had memory of its own, and what aliasing
+    // actually allocated. Lazily allocated images count in neither.
+    VkDeviceSize transientBytes{0};
+    VkDeviceSize allocatedBytes{0};
+    VkDeviceSize lazyBytes{0};
+    double compileMilliseconds{0.0};
+};
+
+class RenderGraph;
+
+// Declares what one pass reads and writes; returned by RenderGraph::addPass.
+class PassBuilder
+{
+    public:
+        PassBuilder(RenderGraph &graph, uint32_t pass) : graph(graph), pass(pass) {}
+
+        PassBuilder &writeColor(RenderResource image, AttachmentLoad load);
+        PassBuilder &writeDepth(RenderResource image, AttachmentLoad load);
+        PassBuilder &read(RenderResource resource, ResourceUsage usage);
+        PassBuilder &write(RenderResource resource, ResourceUsage usage);
+        PassBuilder &execute(RenderPassCallback &&callback);
+
+        uint32_t getPass() const { return pass; }
+
+    private:
+        RenderGraph &graph;
+        uint32_t pass;
+};
+
+// Passes declare the resources they use; compile() drops passes nothing
+// depends on, merges consecutive graphics passes into subpasses of one
+// render pass, works out every barrier and layout transition, and places
+// transient images in shared memory where their lifetimes don't overlap.
+// Declaring and compiling is meant to happen when the frame's shape changes;
+// execute() only replays the compiled plan.
+//
+// Imported images have one variant per swapchain image and imported buffers
+// one per frame in flight; execute() picks them by imageIndex and frameIndex.
+// Imported images enter the graph with undefined contents.
+class RenderGraph
+{
+    public:
+        // Compiled resources are handed to retireQueue when the graph is
+        // recompiled, so frames in flight can finish with them. Passes are
+        // wrapped in GPU zones named after them when profiler is set.
+        void init(VkDevice device, VkPhysicalDevice physicalDevice, VmaAllocator allocator, DeletionQueue *retireQueue, GpuProfiler *profiler);
+        void cleanup();
+
+        // Drops the declarations and the compiled plan, retiring what it
+        // created, so the graph can be declared anew.
+        void reset();
+
+        RenderResource createImage(const char *name, VkFormat format, VkExtent2D extent);
+        // waitStages is where the image becomes usable, e.g. the stage the
+        // acquire semaphore is waited on.
+        RenderResource importImage(const char *name, VkFormat format, VkExtent2D extent, const std::vector<VkImage> &images,
+                                   const std::vector<VkImageView> &views, VkPipelineStageFlags waitStages);
+        RenderResource importBuffer(const char *name, const std::vector<VkBuffer> &buffers);
+        // Outputs are what the graph is for; passes that contribute to none
+        // are culled. finalUsage is how the output is used after the graph,
+        // and the graph leaves it ready for that.
+        void markOutput(RenderResource resource, ResourceUsage finalUsage);
+
+        PassBuilder addPass(const char *name, PassType type);
+
+        bool compile();
+        void execute(VkCommandBuffer cmd, uint32_t imageIndex, uint32_t frameIndex);
+
+        // Used by attachments declared with AttachmentLoad::Clear.
+        void setClearValue(RenderResource image, VkClearValue value);
+        void setSubpassContents(uint32_t pass, VkSubpassContents contents);
+
+        // Valid after compile() for graphics passes that weren't culled.
+        VkRenderPass getRenderPass(uint32_t pass) const;
+        VkFramebuffer getFramebuffer(uint32_t pass, uint32_t imageIndex) const;
+
+        const RenderGraphStats &getStats() const { return stats; }
+        void printStats(const char *label) const;
+
+    private:
+        friend class PassBuilder;
+
+        struct Access
+        {
+            RenderResource resource;
+            ResourceUsage usage;
+            AttachmentLoad load;
+            bool write;
+        };
+
+        struct Pass
+        {
+            const char *name;
+            PassType type;
+            std::vector<Access> accesses;
+            RenderPassCallback callback;
+            VkSubpassContents contents{VK_SUBPASS_CONTENTS_INLINE};
+            bool culled{false};
+            // Step and subpass within it, once compiled.
+            uint32_t step{UINT32_MAX};
+            uint32_t subpass{0};
+        };
+
+        struct Resource
+        {
+            const char *name;
+            bool isBuffer{false};
+            bool imported{false};
+            bool output{false};
+            VkFormat format{VK_FORMAT_UNDEFINED};
+            VkExtent2D extent{0, 0};
+            std::vector<VkImage> images;
+            std::vector<VkImageView> views;
+            std::vector<VkBuffer> buffers;
+            VkPipelineStageFlags waitStages{0};
+            ResourceUsage finalUsage{ResourceUsage::HostRead};
+            VkClearValue clearValue{};
+
+            // Filled in by compile(): how live passes use the resource, the
+            // steps it's live for and, for transient images, where its memory
+            // is and which images share it.
+            VkImageUsageFlags usageFlags{0};
+            uint32_t firstStep{UINT32_MAX};
+            uint32_t lastStep{0};
+            VkPipelineStageFlags stages{0};
+            VkPipelineStageFlags writeStages{0};
+            VkAccessFlags writeAccess{0};
+            bool lazy{false};
+            VkDeviceSize memoryOffset{0};
+            VkDeviceSize memorySize{0};
+            std::vector<RenderResource> aliases;
+        };
+
+        // What the barrier logic knows about a resource between steps.
+        struct ResourceState
+        {
+            VkImageLayout layout{VK_IMAGE_LAYOUT_UNDEFINED};
+            VkPipelineStageFlags writeStages{0};
+            VkAccessFlags writeAccess{0};
+            VkPipelineStageFlags readStages{0};
+            // Stages and accesses the last write has been made visible to.
+            VkPipelineStageFlags visibleStages{0};
+            VkAccessFlags visibleAccess{0};
+            bool touched{false};
+        };
+
+        struct BarrierPlan
+        {
+            RenderResource resource;
+            VkAccessFlags srcAccess;
+            VkAccessFlags dstAccess;
+            VkImageLayout oldLayout;
+            VkImageLayout newLayout;
+        };
+
+        struct BarrierBatch
+        {
+            VkPipelineStageFlags srcStages{0};
+            VkPipelineStageFlags dstStages{0};
+            std::vector<BarrierPlan> barriers;
+        };
+
+        struct TransientImage
+        {
+            RenderResource resource;
+            VkImage image{VK_NULL_HANDLE};
+            VkImageView view{VK_NULL_HANDLE};
+            // Set for lazily allocated images; the rest share transientAllocations.
+            VmaAllocation allocation{VK_NULL_HANDLE};
+        };
+
+        // A compute or transfer pass, or a run of graphics passes sharing a
+        // render pass.
+        struct Step
+        {
+            std::vector<uint32_t> passes;
+            BarrierBatch barriers;
+            bool graphics{false};
+            VkRenderPass renderPass{VK_NULL_HANDLE};
+            std::vector<RenderResource> attachments;
+            std::vector<VkFramebuffer> framebuffers;
+            VkExtent2D extent{0, 0};
+        };
+
+        void addAccess(uint32_t pass, RenderResource resource, ResourceUsage usage, AttachmentLoad load, bool write);
+
+        void cullPasses();
+        bool buildSteps();
+        void allocateTransients();
+        void placeAliased(const std::vector<RenderResource> &aliased, const std::vector<VkMemoryRequirements> &requirements);
+        void planBarriers();
+        void createRenderPass(Step &step, std::vector<ResourceState> &states, uint32_t stepIndex);
+        void createFramebuffers(Step &step);
+        // The first access after stepIndex; if it reads, also the stages and
+        // accesses of it and the reads in the same layout that follow it.
+        const Access *findNextAccess(RenderResource resource, uint32_t stepIndex, VkPipelineStageFlags &readStages, VkAccessFlags &readAccess) const;
+
+        // The state a resource is in when the graph starts, on first use.
+        ResourceState &touch(std::vector<ResourceState> &states, RenderResource resource);
+        // Whether an access needs a barrier or dependency, and from what.
+        static bool hazard(const ResourceState &state, VkPipelineStageFlags stages, VkAccessFlags access, bool write, bool layoutChange,
+                           VkPipelineStageFlags &srcStages, VkAccessFlags &srcAccess);
+        static void advance(ResourceState &state, VkPipelineStageFlags stages, VkAccessFlags access, bool write, bool synchronized);
+        // Adds the barrier an access needs, if any, to batch.
+        void require(std::vector<ResourceState> &states, RenderResource resource, ResourceUsage usage, bool write, BarrierBatch &batch);
+        void releaseCompiled();
+        void recordBarriers(VkCommandBuffer cmd, const BarrierBatch &batch, uint32_t imageIndex, uint32_t frameIndex);
+
+        VkDevice device{VK_NULL_HANDLE};
+        VkPhysicalDevice physicalDevice{VK_NULL_HANDLE};
+        VmaAllocator allocator{VK_NULL_HANDLE};
+        DeletionQueue *retireQueue{nullptr};
+        GpuProfiler *profiler{nullptr};
+
+        std::vector<Resource> resources;
+        std::vector<Pass> passes;
+
+        // Compiled state.
+        std::vector<Step> steps;
+        BarrierBatch finalBarriers;
+        std::vector<TransientImage> transientImages;
+        std::vector<VmaAllocation> transientAllocations;
+        RenderGraphStats stats;
+
+        // Render passes outlive recompiles, so an unchanged pass keeps its
+        // handle and pipelines built against it stay valid.
+        std::map<std::vector<uint32_t>, VkRenderPass> renderPassCache;
+
+        // Reused by execute() to avoid allocating per frame.
+        std::vector<VkImageMemoryBarrier> imageBarrierScratch;
+        std::vector<VkBufferMemoryBarrier> bufferBarrierScratch;
+        std::vector<VkClearValue> clearValueScratch;
+};
@@ -0,0 +1,218 @@
+#include <vk_scene.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+#include "glm/gtx/transform.hpp"
+
+namespace
+{
+    constexpr uint32_t RADIX_BITS = 8;
+    constexpr uint32_t RADIX_BUCKETS = 1u << RADIX_BITS;
+    constexpr uint32_t RADIX_PASSES = 64 / RADIX_BITS;
+
+    // LSD radix sort on DrawItem::key. All histograms are built in one read of
+    // the input, and passes whose digit is the same for every item are skipped,
+    // so unused key bits (e.g. high pipeline ids) cost nothing.
+    void radixSort(std::vector<DrawItem> &items, std::vector<DrawItem> &scratch)
+    {
+        const size_t count = items.size();
+        if (count < 2)
+            return;
+
+        uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS] = {};
+        for (const DrawItem &item : items)
+        {
+            for (uint32_t pass = 0; pass < RADIX_PASSES; ++pass)
+                ++histograms[pass][(item.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)];
+        }
+
+        scratch.resize(count);
+        DrawItem *src = items.data();
+        DrawItem *dst = scratch.data();
+
+        for (uint32_t pass = 0; pass < RADIX_PASSES; ++pass)
+        {
+            uint32_t *histogram = histograms[pass];
+            const uint32_t shift = pass * RADIX_BITS;
+
+            if (histogram[(src[0].key >> shift) & (RADIX_BUCKETS - 1)] == count)
+                continue;
+
+            uint32_t offset = 0;
+            for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; ++bucket)
+            {
+                const uint32_t bucketCount = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketCount;
+            }
+
+            for (size_t i = 0; i < count; ++i)
+                dst[histogram[(src[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+
+            std::swap(src, dst);
+        }
+
+        if (src != items.data())
+            items.swap(scratch);
+    }
+}
+
+uint32_t RenderScene::addMesh(Mesh *mesh)
+{
+    assert(meshes.size() < vkDrawKey::MAX_MESHES && "Mesh index doesn't fit the draw key");
+    meshes.push_back(mesh);
+    return (uint32_t)meshes.size() - 1;
+}
+
+uint32_t RenderScene::addMaterial(const Material &material)
+{
+    Material newMaterial = material;
+
+    auto pipeline = std::find(pipelines.begin(), pipelines.end(), material.pipeline);
+    newMaterial.pipelineId = (uint32_t)(pipeline - pipelines.begin());
+    if (pipeline == pipelines.end())
+        pipelines.push_back(material.pipeline);
+
+    assert(pipelines.size() <= vkDrawKey::MAX_PIPELINES && "Pipeline id doesn't fit the draw key");
+    assert(materials.size() < vkDrawKey::MAX_MATERIALS && "Material index doesn't fit the draw key");
+    materials.push_back(newMaterial);
+    return (uint32_t)materials.size() - 1;
+}
+
+uint32_t RenderScene::addObject(uint32_t mesh, uint32_t material, const glm::mat4 &transform)
+{
+    objectMeshes.push_back(mesh);
+    objectMaterials.push_back(material);
+    objectTransforms.push_back(transform);
+    objectBounds.push(vkCull::transformSphere(meshes[mesh]->boundingSphere, transform));
+    objectLods.push_back(0);
+    return (uint32_t)objectTransforms.size() - 1;
+}
+
+void RenderScene::buildDrawList(const std::vector<uint32_t> &objects, const glm::vec3 &cameraPosition, float farPlane, int materialOverride)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const float depthScale = (float)((1u << vkDrawKey::DEPTH_BITS) - 1) / farPlane;
+
+    drawItems.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        const uint32_t object = objects[i];
+        const uint32_t materialIndex = materialOverride >= 0 ? (uint32_t)materialOverride : objectMaterials[object];
+
+        const float distance = glm::length(glm::vec3(objectTransforms[object][3]) - cameraPosition);
+        const uint32_t depth = (uint32_t)std::min(distance * depthScale, (float)((1u << vkDrawKey::DEPTH_BITS) - 1));
+
+        // LODs go by the distance to the nearest point of the bounds.
+        const glm::vec4 sphere = objectBounds.get(object);
+        const float surfaceDistance = glm::length(glm::vec3(sphere) - cameraPosition) - sphere.w;
+        objectLods[object] = vkMeshLod::select(*meshes[objectMeshes[object]], sphere.w, surfaceDistance, objectLods[object], lodSettings);
+
+        drawItems[i] = {
+            .key = vkDrawKey::make(materials[materialIndex].pipelineId, materialIndex, objectMeshes[object], depth),
+            .object = object,
+            .lod = objectLods[object]};
+    }
+
+    radixSort(drawItems, sortScratch);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    lastSortMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+DrawStats RenderScene::countBinds(const std::vector<DrawItem> &items) const
+{
+    DrawStats stats;
+
+    uint32_t lastPipeline = UINT32_MAX;
+    VkDescriptorSet lastDescriptorSet = VK_NULL_HANDLE;
+
+    for (const DrawItem &item : items)
+    {
+        const Material &material = materials[vkDrawKey::material(item.key)];
+
+        if (vkDrawKey::pipeline(item.key) != lastPipeline)
+        {
+            lastPipeline = vkDrawKey::pipeline(item.key);
+            ++stats.pipelineBinds;
+        }
+
+        if (material.descriptorSet != VK_NULL_HANDLE && material.descriptorSet != lastDescriptorSet)
+        {
+            lastDescriptorSet = material.descriptorSet;
+            ++stats.descriptorBinds;
+        }
+
+        ++stats.draws;
+    }
+
+    // Every mesh lives in the shared geometry buffer.
+    stats.vertexBufferBinds = stats.draws > 0 ? 1 : 0;
+    stats.sortMilliseconds = lastSortMilliseconds;
+    return stats;
+}
+
+void RenderScene::runBenchmark(size_t objectCount)
+{
+    constexpr uint32_t PIPELINE_COUNT = 8;
+    constexpr uint32_t MATERIAL_COUNT = 64;
+    constexpr uint32_t MESH_COUNT = 256;
+    constexpr int FRAME_COUNT = 100;
+
+    RenderScene scene;
+    std::vector<Mesh> meshes(MESH_COUNT);
+    for (Mesh &mesh : meshes)
+        scene.addMesh(&mesh);
+
+    // Fake handles: the benchmark never touches the device.
+    for (uint32_t i = 0; i < MATERIAL_COUNT; ++i)
+    {
+        scene.addMaterial({
+            .pipeline = (VkPipeline)(uintptr_t)(1 + i % PIPELINE_COUNT),
+            .descriptorSet = (VkDescriptorSet)(uintptr_t)(1 + i)});
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    for (size_t i = 0; i < objectCount; ++i)
+    {
+        scene.addObject(rng() % MESH_COUNT, rng() % MATERIAL_COUNT,
+                        glm::translate(glm::mat4(1.0f), glm::vec3(position(rng), position(rng), position(rng))));
+    }
+
+    std::vector<uint32_t> allObjects(objectCount);
+    std::iota(allObjects.begin(), allObjects.end(), 0);
+
+    double totalMilliseconds = 0.0;
+    double worstMilliseconds = 0.0;
+    for (int frame = 0; frame < FRAME_COUNT; ++frame)
+    {
+        const float angle = frame * 0.05f;
+        scene.buildDrawList(allObjects, {std::cos(angle) * 800.0f, 0.0f, std::sin(angle) * 800.0f}, 2000.0f);
+
+        totalMilliseconds += scene.lastSortMilliseconds;
+        worstMilliseconds = std::max(worstMilliseconds, scene.lastSortMilliseconds);
+    }
+
+    std::vector<DrawItem> submissionOrder = scene.drawItems;
+    std::sort(submissionOrder.begin(), submissionOrder.end(), [](const DrawItem &a, const DrawItem &b)
+              { return a.object < b.object; });
+
+    const DrawStats sorted = scene.countBinds(scene.drawItems);
+    const DrawStats unsorted = scene.countBinds(submissionOrder);
+
+    std::cout << "Scene benchmark: " << objectCount << " objects, " << PIPELINE_COUNT << " pipelines, "
+              << MATERIAL_COUNT << " materials, " << MESH_COUNT << " meshes" << std::endl;
+    std::cout << "  key build + radix sort: " << totalMilliseconds / FRAME_COUNT << " ms/frame average, "
+              << worstMilliseconds << " ms worst over " << FRAME_COUNT << " frames" << std::endl;
+    std::cout << "  sorted:   " << sorted.draws << " draws, " << sorted.pipelineBinds << " pipeline binds, "
+              << sorted.descriptorBinds << " descriptor binds, " << sorted.vertexBufferBinds << " vertex buffer binds" << std::endl;
+    std::cout << "  unsorted: " << unsorted.draws << " draws, " << unsorted.pipelineBinds << " pipeline binds, "
+              << unsorted.descriptorBinds << " descriptor binds, " << unsorted.vertexBufferBinds << " vertex buffer binds" << std::endl;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "vk_types.h"
+#include "vk_mesh.h"
+#include "vk_mesh_lod.h"
+#include "vk_culling.h"
+
+struct Material
+{
+    VkPipeline pipeline{VK_NULL_HANDLE};
+    VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+    VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+
+    // Dense id of pipeline among the scene's materials, assigned by addMaterial.
+    uint32_t pipelineId{0};
+};
+
+// Draw key, most significant first: pipeline (12 bits), material (12 bits),
+// mesh (16 bits), depth (24 bits). Sorting by it groups draws by state and
+// orders each group front to back.
+namespace vkDrawKey
+{
+    constexpr uint32_t PIPELINE_BITS = 12;
+    constexpr uint32_t MATERIAL_BITS = 12;
+    constexpr uint32_t MESH_BITS = 16;
+    constexpr uint32_t DEPTH_BITS = 24;
+
+    constexpr uint32_t DEPTH_SHIFT = 0;
+    constexpr uint32_t MESH_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+    constexpr uint32_t MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+    constexpr uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+
+    // How many pipelines, materials and meshes a scene can key.
+    constexpr uint32_t MAX_PIPELINES = 1u << PIPELINE_BITS;
+    constexpr uint32_t MAX_MATERIALS = 1u << MATERIAL_BITS;
+    constexpr uint32_t MAX_MESHES = 1u << MESH_BITS;
+
+    // Each field is masked to its width, so an out-of-range value can't
+    // spill into the fields above it.
+    inline uint64_t make(uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth)
+    {
+        return ((uint64_t)(pipeline & (MAX_PIPELINES - 1)) << PIPELINE_SHIFT) |
+               ((uint64_t)(material & (MAX_MATERIALS - 1)) << MATERIAL_SHIFT) |
+               ((uint64_t)(mesh & (MAX_MESHES - 1)) << MESH_SHIFT) |
+               ((uint64_t)(depth & ((1u << DEPTH_BITS) - 1)) << DEPTH_SHIFT);
+    }
+
+    inline uint32_t pipeline(uint64_t key) { return (uint32_t)(key >> PIPELINE_SHIFT) & ((1u << PIPELINE_BITS) - 1); }
+    inline uint32_t material(uint64_t key) { return (uint32_t)(key >> MATERIAL_SHIFT) & ((1u << MATERIAL_BITS) - 1); }
+    inline uint32_t mesh(uint64_t key) { return (uint32_t)(key >> MESH_SHIFT) & ((1u << MESH_BITS) - 1); }
+}
+
+struct DrawItem
+{
+    uint64_t key;
+    uint32_t object;
+    uint32_t lod;
+};
+
+struct DrawStats
+{
+    uint32_t draws{0};
+    uint32_t pipelineBinds{0};
+    uint32_t descriptorBinds{0};
+    uint32_t vertexBufferBinds{0};
+    double sortMilliseconds{0.0};
+};
+
+// Objects are stored as parallel arrays indexed by object id; meshes and
+// materials are referenced by their index in the scene.
+class RenderScene
+{
+    public:
+        // Up to vkDrawKey::MAX_MESHES meshes, MAX_MATERIALS materials and
+        // MAX_PIPELINES distinct pipelines, the widths of their key fields.
+        uint32_t addMesh(Mesh *mesh);
+        uint32_t addMaterial(const Material &material);
+        uint32_t addObject(uint32_t mesh, uint32_t material, const glm::mat4 &transform);
+
+        size_t getObjectCount() const { return objectTransforms.size(); }
+
+        // Fills drawItems with the given objects sorted by draw key and picks
+        // each one's LOD with lodSettings. materialOverride replaces each
+        // object's material when not negative.
+        void buildDrawList(const std::vector<uint32_t> &objects, const glm::vec3 &cameraPosition, float farPlane, int materialOverride = -1);
+
+        // Bind counts for recording items in order with every redundant
+        // pipeline, descriptor set and vertex buffer bind skipped.
+        DrawStats countBinds(const std::vector<DrawItem> &items) const;
+
+        static void runBenchmark(size_t objectCount);
+
+        std::vector<Mesh *> meshes;
+        std::vector<Material> materials;
+
+        std::vector<uint32_t> objectMeshes;
+        std::vector<uint32_t> objectMaterials;
+        std::vector<glm::mat4> objectTransforms;
+        // World-space bounding spheres, kept in step with objectTransforms.
+        SphereBounds objectBounds;
+        // LOD each object was last drawn at, the reference for hysteresis.
+        std::vector<uint32_t> objectLods;
+
+        LodSettings lodSettings;
+
+        std::vector<DrawItem> drawItems;
+        double lastSortMilliseconds{0.0};
+
+    private:
+        std::vector<VkPipeline> pipelines;
+        std::vector<DrawItem> sortScratch;
+};
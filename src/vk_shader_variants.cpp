@@ -0,0 +1,172 @@
+#include <vk_shader_variants.h>
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "vk_engine.h"
+#include "vk_initializers.h"
+
+namespace
+{
+    inline void hashCombine(size_t &hash, uint64_t value)
+    {
+        hash ^= std::hash<uint64_t>()(value) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    }
+}
+
+bool PipelineKey::operator==(const PipelineKey &other) const
+{
+    return vertexShader == other.vertexShader &&
+           fragmentShader == other.fragmentShader &&
+           features == other.features &&
+           layout == other.layout &&
+           renderPass == other.renderPass &&
+           topology == other.topology &&
+           polygonMode == other.polygonMode &&
+           meshVertexInput == other.meshVertexInput &&
+           vertexFormat == other.vertexFormat;
+}
+
+size_t PipelineKeyHash::operator()(const PipelineKey &key) const
+{
+    size_t hash = 0;
+    hashCombine(hash, (uint64_t)key.vertexShader);
+    hashCombine(hash, (uint64_t)key.fragmentShader);
+    hashCombine(hash, key.features);
+    hashCombine(hash, (uint64_t)key.layout);
+    hashCombine(hash, (uint64_t)key.renderPass);
+    hashCombine(hash, ((uint64_t)key.topology << 32) | key.polygonMode);
+    hashCombine(hash, ((uint64_t)key.vertexFormat << 1) | key.meshVertexInput);
+    return hash;
+}
+
+void ShaderCache::init(VkDevice device)
+{
+    this->device = device;
+}
+
+void ShaderCache::cleanup()
+{
+    for (auto &[path, module] : modules)
+        vkDestroyShaderModule(device, module, nullptr);
+    modules.clear();
+}
+
+VkShaderModule ShaderCache::get(const std::string &path)
+{
+    auto it = modules.find(path);
+    if (it != modules.end())
+        return it->second;
+
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cout << "Can't open file: " << path << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    size_t fileSize = (size_t)file.tellg();
+
+    std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
+
+    file.seekg(0);
+    file.read((char *)buffer.data(), fileSize);
+    file.close();
+
+    VkShaderModuleCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pNext = nullptr,
+        .codeSize = buffer.size() * sizeof(uint32_t),
+        .pCode = buffer.data()};
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    {
+        std::cout << "Error building shader module: " << path << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    std::cout << "Shader module loaded: " << path << std::endl;
+    modules[path] = shaderModule;
+    return shaderModule;
+}
+
+void PipelineVariants::init(VkDevice device, VkPipelineCache pipelineCache)
+{
+    this->device = device;
+    this->pipelineCache = pipelineCache;
+}
+
+void PipelineVariants::cleanup()
+{
+    for (auto &[key, pipeline] : pipelines)
+        vkDestroyPipeline(device, pipeline, nullptr);
+    pipelines.clear();
+}
+
+VkPipeline PipelineVariants::get(const PipelineKey &key)
+{
+    auto it = pipelines.find(key);
+    if (it != pipelines.end())
+        return it->second;
+
+    VkPipeline pipeline = build(key);
+    if (pipeline != VK_NULL_HANDLE)
+        pipelines[key] = pipeline;
+    return pipeline;
+}
+
+VkPipeline PipelineVariants::build(const PipelineKey &key)
+{
+    if (key.vertexShader == VK_NULL_HANDLE || key.fragmentShader == VK_NULL_HANDLE)
+        return VK_NULL_HANDLE;
+
+    uint32_t features = key.features;
+    if (key.meshVertexInput && key.vertexFormat != VertexFormat::Float32)
+        features |= SHADER_FEATURE_OCT_NORMAL;
+
+    VkBool32 featureValues[SHADER_FEATURE_COUNT];
+    VkSpecializationMapEntry mapEntries[SHADER_FEATURE_COUNT];
+    for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; ++i)
+    {
+        featureValues[i] = (features >> i) & 1 ? VK_TRUE : VK_FALSE;
+        mapEntries[i] = {
+            .constantID = i,
+            .offset = i * (uint32_t)sizeof(VkBool32),
+            .size = sizeof(VkBool32)};
+    }
+
+    VkSpecializationInfo specializationInfo = {
+        .mapEntryCount = SHADER_FEATURE_COUNT,
+        .pMapEntries = mapEntries,
+        .dataSize = sizeof(featureValues),
+        .pData = featureValues};
+
+    PipelineBuilder pipelineBuilder;
+    pipelineBuilder.pipelineCache = pipelineCache;
+    pipelineBuilder.shaderStages.push_back(vkInit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, key.vertexShader));
+    pipelineBuilder.shaderStages.push_back(vkInit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, key.fragmentShader));
+    for (VkPipelineShaderStageCreateInfo &stage : pipelineBuilder.shaderStages)
+        stage.pSpecializationInfo = &specializationInfo;
+
+    VertexInputDescription vertexDescription = vkVertex::getDescription(key.vertexFormat);
+    pipelineBuilder.vertexInputInfo = vkInit::vertexInputStateCreateInfo();
+    if (key.meshVertexInput)
+    {
+        pipelineBuilder.vertexInputInfo.pVertexAttributeDescriptions = vertexDescription.attributes.data();
+        pipelineBuilder.vertexInputInfo.vertexAttributeDescriptionCount = vertexDescription.attributes.size();
+
+        pipelineBuilder.vertexInputInfo.pVertexBindingDescriptions = vertexDescription.bindings.data();
+        pipelineBuilder.vertexInputInfo.vertexBindingDescriptionCount = vertexDescription.bindings.size();
+    }
+
+    pipelineBuilder.inputAssembly = vkInit::inputAssemblyCreateInfo(key.topology);
+    pipelineBuilder.rasterizer = vkInit::rasterizationStateCreateInfo(key.polygonMode);
+    pipelineBuilder.multisampling = vkInit::multisampleStateCreateInfo();
+    pipelineBuilder.depthStencil = vkInit::depthStencilCreateInfo(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
+    pipelineBuilder.colorBlendAttachment = vkInit::colorBlendAttachmentState();
+    pipelineBuilder.pipelineLayout = key.layout;
+
+    return pipelineBuilder.buildPipeline(device, key.renderPass);
+}
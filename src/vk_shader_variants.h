@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "vk_types.h"
+#include "vk_vertex_format.h"
+
+// Bits of PipelineKey::features. Bit i is specialization constant_id i in
+// every stage; shaders only declare the constants they use.
+enum ShaderFeature : uint32_t
+{
+    SHADER_FEATURE_VERTEX_COLOR = 1 << 0,
+    SHADER_FEATURE_NORMAL_DEBUG = 1 << 1,
+    SHADER_FEATURE_INSTANCING = 1 << 2,
+    SHADER_FEATURE_OBJECT_BUFFER = 1 << 3,
+    // Set by PipelineVariants for quantized vertex formats.
+    SHADER_FEATURE_OCT_NORMAL = 1 << 4,
+};
+
+constexpr uint32_t SHADER_FEATURE_COUNT = 5;
+
+struct PipelineKey
+{
+    VkShaderModule vertexShader{VK_NULL_HANDLE};
+    VkShaderModule fragmentShader{VK_NULL_HANDLE};
+    uint32_t features{0};
+
+    VkPipelineLayout layout{VK_NULL_HANDLE};
+    VkRenderPass renderPass{VK_NULL_HANDLE};
+    VkPrimitiveTopology topology{VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+    VkPolygonMode polygonMode{VK_POLYGON_MODE_FILL};
+    bool meshVertexInput{false};
+    // Only used when meshVertexInput is set.
+    VertexFormat vertexFormat{VertexFormat::Float32};
+
+    bool operator==(const PipelineKey &other) const;
+};
+
+struct PipelineKeyHash
+{
+    size_t operator()(const PipelineKey &key) const;
+};
+
+// Loads each SPIR-V file once and hands out the same module afterwards.
+class ShaderCache
+{
+    public:
+        void init(VkDevice device);
+        void cleanup();
+
+        // Returns VK_NULL_HANDLE if the file can't be loaded.
+        VkShaderModule get(const std::string &path);
+
+    private:
+        VkDevice device;
+        std::unordered_map<std::string, VkShaderModule> modules;
+};
+
+// Builds a pipeline the first time a key is requested and reuses it afterwards.
+class PipelineVariants
+{
+    public:
+        void init(VkDevice device, VkPipelineCache pipelineCache);
+        void cleanup();
+
+        VkPipeline get(const PipelineKey &key);
+        size_t size() const { return pipelines.size(); }
+
+    private:
+        VkPipeline build(const PipelineKey &key);
+
+        VkDevice device;
+        VkPipelineCache pipelineCache;
+        std::unordered_map<PipelineKey, VkPipeline, PipelineKeyHash> pipelines;
+};
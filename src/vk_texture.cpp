@@ -0,0 +1,546 @@
+#include <vk_texture.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "vk_mapped_file.h"
+#include "vk_parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VKP_TEXTURE_SSE2
+#endif
+
+namespace
+{
+    constexpr char TEXTURE_CACHE_MAGIC[4] = {'V', 'K', 'P', 'T'};
+    constexpr uint32_t TEXTURE_CACHE_VERSION = 1;
+
+    // Levels are split into bands of this many block rows when encoding and
+    // downsampling, so one large texture still uses every core.
+    constexpr uint32_t ROWS_PER_BAND = 64;
+
+    struct TextureCacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t pathHash;
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipCount;
+        uint64_t dataSize;
+        uint64_t reserved;
+    };
+
+    // BC blocks are 8 or 16 bytes; keep the data after the header aligned for both.
+    static_assert(sizeof(TextureCacheHeader) % 16 == 0, "Texture data must stay aligned after the header");
+
+    uint64_t hashPath(const std::string &path)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : path)
+            hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+        return hash;
+    }
+
+    bool sourceKey(const std::string &sourcePath, TextureCacheHeader &header)
+    {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(sourcePath, ec);
+        if (ec)
+            return false;
+
+        auto mtime = std::filesystem::last_write_time(sourcePath, ec);
+        if (ec)
+            return false;
+
+        std::memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+        header.version = TEXTURE_CACHE_VERSION;
+        header.pathHash = hashPath(std::filesystem::absolute(sourcePath).lexically_normal().string());
+        header.sourceSize = size;
+        header.sourceMtime = (int64_t)mtime.time_since_epoch().count();
+        return true;
+    }
+
+    double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Bands are jobs when jobs is given and run in order otherwise.
+    void forEachBand(uint32_t rows, JobSystem *jobs, const std::function<void(uint32_t, uint32_t)> &band)
+    {
+        const uint32_t bandCount = (rows + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+        auto runBands = [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const uint32_t first = (uint32_t)i * ROWS_PER_BAND;
+                band(first, std::min(rows, first + ROWS_PER_BAND));
+            }
+        };
+
+        if (jobs)
+            jobs->parallelFor(bandCount, 1, runBands);
+        else
+            runBands(0, bandCount);
+    }
+
+    // Gathers a 4x4 block of RGBA8 texels, clamping at the level's edges.
+    void loadBlock(const uint8_t *src, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t block[16][4])
+    {
+        for (uint32_t y = 0; y < 4; ++y)
+        {
+            const uint32_t sy = std::min(blockY * 4 + y, height - 1);
+            for (uint32_t x = 0; x < 4; ++x)
+            {
+                const uint32_t sx = std::min(blockX * 4 + x, width - 1);
+                std::memcpy(block[y * 4 + x], src + ((size_t)sy * width + sx) * 4, 4);
+            }
+        }
+    }
+
+    uint16_t packRgb565(const uint8_t *color)
+    {
+        return (uint16_t)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+    }
+
+    void unpackRgb565(uint16_t packed, int *color)
+    {
+        const int r = (packed >> 11) & 31;
+        const int g = (packed >> 5) & 63;
+        const int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // Endpoints from the block's bounding box, inset by 1/16 of its extent to
+    // pull them towards the bulk of the colours. Always four-colour mode, as
+    // BC3 requires.
+    void encodeColorBlock(const uint8_t block[16][4], uint8_t *dst)
+    {
+        uint8_t minColor[3] = {255, 255, 255};
+        uint8_t maxColor[3] = {0, 0, 0};
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                minColor[c] = std::min(minColor[c], block[i][c]);
+                maxColor[c] = std::max(maxColor[c], block[i][c]);
+            }
+        }
+
+        for (int c = 0; c < 3; ++c)
+        {
+            const int inset = (maxColor[c] - minColor[c]) >> 4;
+            minColor[c] = (uint8_t)std::min(255, minColor[c] + inset);
+            maxColor[c] = (uint8_t)std::max(0, maxColor[c] - inset);
+        }
+
+        uint16_t color0 = packRgb565(maxColor);
+        uint16_t color1 = packRgb565(minColor);
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        uint32_t indices = 0;
+        if (color0 != color1)
+        {
+            int palette[4][3];
+            unpackRgb565(color0, palette[0]);
+            unpackRgb565(color1, palette[1]);
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; ++i)
+            {
+                uint32_t best = 0;
+                int bestDistance = INT32_MAX;
+                for (uint32_t p = 0; p < 4; ++p)
+                {
+                    int distance = 0;
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        const int d = block[i][c] - palette[p][c];
+                        distance += d * d;
+                    }
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= best << (2 * i);
+            }
+        }
+
+        std::memcpy(dst, &color0, 2);
+        std::memcpy(dst + 2, &color1, 2);
+        std::memcpy(dst + 4, &indices, 4);
+    }
+
+    // Eight-value mode: alpha0 > alpha1 with six interpolated steps.
+    void encodeAlphaBlock(const uint8_t block[16][4], uint8_t *dst)
+    {
+        int minAlpha = 255;
+        int maxAlpha = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            minAlpha = std::min<int>(minAlpha, block[i][3]);
+            maxAlpha = std::max<int>(maxAlpha, block[i][3]);
+        }
+
+        const int inset = (maxAlpha - minAlpha) >> 5;
+        minAlpha += inset;
+        maxAlpha -= inset;
+
+        uint64_t bits = 0;
+        if (maxAlpha > minAlpha)
+        {
+            int palette[8] = {maxAlpha, minAlpha};
+            for (int p = 1; p < 7; ++p)
+                palette[p + 1] = ((7 - p) * maxAlpha + p * minAlpha) / 7;
+
+            for (int i = 0; i < 16; ++i)
+            {
+                uint64_t best = 0;
+                int bestDistance = INT32_MAX;
+                for (int p = 0; p < 8; ++p)
+                {
+                    const int distance = std::abs(block[i][3] - palette[p]);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = (uint64_t)p;
+                    }
+                }
+                bits |= best << (3 * i);
+            }
+        }
+        else
+        {
+            maxAlpha = minAlpha = std::max(maxAlpha, minAlpha);
+        }
+
+        dst[0] = (uint8_t)maxAlpha;
+        dst[1] = (uint8_t)minAlpha;
+        for (int i = 0; i < 6; ++i)
+            dst[2 + i] = (uint8_t)(bits >> (8 * i));
+    }
+
+    template <typename Encode>
+    void compressBlocks(const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst, JobSystem *jobs, uint32_t bytesPerBlock, Encode &&encode)
+    {
+        const uint32_t blocksX = (width + 3) / 4;
+        const uint32_t blocksY = (height + 3) / 4;
+
+        forEachBand(blocksY, jobs, [&](uint32_t firstRow, uint32_t endRow)
+                    {
+                        uint8_t block[16][4];
+                        for (uint32_t by = firstRow; by < endRow; ++by)
+                        {
+                            for (uint32_t bx = 0; bx < blocksX; ++bx)
+                            {
+                                loadBlock(src, width, height, bx, by, block);
+                                encode(block, dst + ((size_t)by * blocksX + bx) * bytesPerBlock);
+                            }
+                        } });
+    }
+
+    bool hasTranslucency(const uint8_t *rgba, size_t pixelCount)
+    {
+        for (size_t i = 0; i < pixelCount; ++i)
+        {
+            if (rgba[i * 4 + 3] != 255)
+                return true;
+        }
+        return false;
+    }
+}
+
+namespace vkTexture
+{
+    VkFormat vkFormat(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat::BC1:
+            return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+        case TextureFormat::BC3:
+            return VK_FORMAT_BC3_SRGB_BLOCK;
+        default:
+            return VK_FORMAT_R8G8B8A8_SRGB;
+        }
+    }
+
+    uint32_t blockSize(TextureFormat format)
+    {
+        return format == TextureFormat::RGBA8 ? 1 : 4;
+    }
+
+    uint32_t blockBytes(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat::BC1:
+            return 8;
+        case TextureFormat::BC3:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    size_t layoutMips(TextureFormat format, uint32_t width, uint32_t height, std::vector<TextureMip> &mips)
+    {
+        const uint32_t block = blockSize(format);
+        const uint32_t bytes = blockBytes(format);
+
+        mips.clear();
+        size_t offset = 0;
+        while (true)
+        {
+            const size_t size = (size_t)((width + block - 1) / block) * ((height + block - 1) / block) * bytes;
+            mips.push_back({width, height, offset, size});
+            offset += size;
+
+            if (width == 1 && height == 1)
+                break;
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+        }
+        return offset;
+    }
+
+    void downsample(const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst, JobSystem *jobs)
+    {
+        const uint32_t dstWidth = std::max(1u, srcWidth / 2);
+        const uint32_t dstHeight = std::max(1u, srcHeight / 2);
+
+        forEachBand(dstHeight, jobs, [&](uint32_t firstRow, uint32_t endRow)
+                    {
+                        for (uint32_t y = firstRow; y < endRow; ++y)
+                        {
+                            const uint8_t *row0 = src + (size_t)std::min(2 * y, srcHeight - 1) * srcWidth * 4;
+                            const uint8_t *row1 = src + (size_t)std::min(2 * y + 1, srcHeight - 1) * srcWidth * 4;
+                            uint8_t *out = dst + (size_t)y * dstWidth * 4;
+
+                            uint32_t x = 0;
+#if defined(VKP_TEXTURE_SSE2)
+                            // Four output texels from eight source texels on each row.
+                            if (srcWidth >= 2)
+                            {
+                                const __m128i zero = _mm_setzero_si128();
+                                const __m128i rounding = _mm_set1_epi16(2);
+                                for (; x + 4 <= dstWidth; x += 4)
+                                {
+                                    __m128i pairs[2];
+                                    for (int half = 0; half < 2; ++half)
+                                    {
+                                        const __m128i top = _mm_loadu_si128((const __m128i *)(row0 + (2 * x + 4 * half) * 4));
+                                        const __m128i bottom = _mm_loadu_si128((const __m128i *)(row1 + (2 * x + 4 * half) * 4));
+                                        // Columns 0-1 and 2-3 summed vertically, in 16 bits.
+                                        const __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+                                        const __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+                                        const __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+                                        pairs[half] = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+                                    }
+                                    _mm_storeu_si128((__m128i *)(out + x * 4), _mm_packus_epi16(pairs[0], pairs[1]));
+                                }
+                            }
+#endif
+                            for (; x < dstWidth; ++x)
+                            {
+                                const uint32_t x0 = std::min(2 * x, srcWidth - 1) * 4;
+                                const uint32_t x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+                                for (int c = 0; c < 4; ++c)
+                                    out[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                            }
+                        } });
+    }
+
+    void compressBC1(const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst, JobSystem *jobs)
+    {
+        compressBlocks(src, width, height, dst, jobs, 8, [](const uint8_t block[16][4], uint8_t *out)
+                       { encodeColorBlock(block, out); });
+    }
+
+    void compressBC3(const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst, JobSystem *jobs)
+    {
+        compressBlocks(src, width, height, dst, jobs, 16, [](const uint8_t block[16][4], uint8_t *out)
+                       {
+                           encodeAlphaBlock(block, out);
+                           encodeColorBlock(block, out + 8); });
+    }
+
+    std::string cachePath(const std::string &sourcePath)
+    {
+        return sourcePath + ".texcache";
+    }
+
+    bool loadCache(const std::string &sourcePath, TextureFormat format, TextureData &texture)
+    {
+        TextureCacheHeader expected = {};
+        if (!sourceKey(sourcePath, expected))
+            return false;
+
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(cachePath(sourcePath)) || file->size() < sizeof(TextureCacheHeader))
+            return false;
+
+        TextureCacheHeader header;
+        std::memcpy(&header, file->data(), sizeof(header));
+
+        if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+            header.version != expected.version ||
+            header.pathHash != expected.pathHash ||
+            header.sourceSize != expected.sourceSize ||
+            header.sourceMtime != expected.sourceMtime)
+            return false;
+
+        // A compressed request accepts either block format; which one was
+        // picked depends on the image's alpha.
+        const TextureFormat cachedFormat = (TextureFormat)header.format;
+        if ((format == TextureFormat::RGBA8) != (cachedFormat == TextureFormat::RGBA8) || header.format > (uint32_t)TextureFormat::BC3)
+            return false;
+
+        std::vector<TextureMip> mips;
+        const size_t dataSize = layoutMips(cachedFormat, header.width, header.height, mips);
+        if (header.dataSize != dataSize || mips.size() != header.mipCount || file->size() != sizeof(TextureCacheHeader) + dataSize)
+            return false;
+
+        texture.format = cachedFormat;
+        texture.width = header.width;
+        texture.height = header.height;
+        texture.mips = std::move(mips);
+        texture.pixels.clear();
+        texture.cachedPixels = file->data() + sizeof(TextureCacheHeader);
+        texture.cachedSize = dataSize;
+        texture.cacheFile = file;
+        return true;
+    }
+
+    bool writeCache(const std::string &sourcePath, const TextureData &texture)
+    {
+        TextureCacheHeader header = {};
+        if (!sourceKey(sourcePath, header))
+            return false;
+
+        header.format = (uint32_t)texture.format;
+        header.width = texture.width;
+        header.height = texture.height;
+        header.mipCount = (uint32_t)texture.mips.size();
+        header.dataSize = texture.getSize();
+
+        const std::string path = cachePath(sourcePath);
+        const std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+            {
+                std::cout << "Can't open file: " << tempPath << std::endl;
+                return false;
+            }
+
+            file.write((const char *)&header, sizeof(header));
+            file.write((const char *)texture.getData(), texture.getSize());
+            if (!file.good())
+                return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tempPath, path, ec);
+        return !ec;
+    }
+
+    bool load(const std::string &sourcePath, bool compress, TextureData &texture, JobSystem *jobs)
+    {
+        texture = {};
+        if (loadCache(sourcePath, compress ? TextureFormat::BC1 : TextureFormat::RGBA8, texture))
+        {
+            texture.stats.fromCache = true;
+            return true;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        int width, height, channels;
+        stbi_uc *decoded = stbi_load(sourcePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!decoded)
+        {
+            std::cout << "Failed to load texture file " << sourcePath << ": " << stbi_failure_reason() << std::endl;
+            return false;
+        }
+
+        std::vector<uint8_t> level(decoded, decoded + (size_t)width * height * 4);
+        stbi_image_free(decoded);
+        texture.stats.decodeMilliseconds = millisecondsSince(start);
+
+        texture.width = (uint32_t)width;
+        texture.height = (uint32_t)height;
+        if (compress)
+            texture.format = hasTranslucency(level.data(), (size_t)width * height) ? TextureFormat::BC3 : TextureFormat::BC1;
+
+        texture.pixels.resize(layoutMips(texture.format, texture.width, texture.height, texture.mips));
+
+        // Only the level being encoded and the next one are kept uncompressed.
+        std::vector<uint8_t> nextLevel;
+        for (size_t i = 0; i < texture.mips.size(); ++i)
+        {
+            const TextureMip &mip = texture.mips[i];
+            uint8_t *out = texture.pixels.data() + mip.offset;
+
+            start = std::chrono::high_resolution_clock::now();
+            if (texture.format == TextureFormat::BC1)
+                compressBC1(level.data(), mip.width, mip.height, out, jobs);
+            else if (texture.format == TextureFormat::BC3)
+                compressBC3(level.data(), mip.width, mip.height, out, jobs);
+            else
+                std::memcpy(out, level.data(), mip.size);
+            texture.stats.compressMilliseconds += millisecondsSince(start);
+
+            if (i + 1 < texture.mips.size())
+            {
+                start = std::chrono::high_resolution_clock::now();
+                nextLevel.resize((size_t)texture.mips[i + 1].width * texture.mips[i + 1].height * 4);
+                downsample(level.data(), mip.width, mip.height, nextLevel.data(), jobs);
+                level.swap(nextLevel);
+                texture.stats.mipMilliseconds += millisecondsSince(start);
+            }
+        }
+
+        if (!writeCache(sourcePath, texture))
+            std::cout << "Failed to write texture cache: " << cachePath(sourcePath) << std::endl;
+
+        return true;
+    }
+
+    std::vector<TextureData> loadAll(const std::vector<std::string> &sourcePaths, bool compress, JobSystem &jobs)
+    {
+        // Each texture is a job and so is each of its bands; bands are only
+        // split off while workers are idle, e.g. once fewer textures than
+        // workers are left.
+        std::vector<TextureData> textures(sourcePaths.size());
+        jobs.parallelFor(sourcePaths.size(), 1, [&](size_t begin, size_t end)
+                         {
+                             for (size_t i = begin; i < end; ++i)
+                             {
+                                 if (!load(sourcePaths[i], compress, textures[i], &jobs))
+                                     textures[i] = {};
+                             } });
+        return textures;
+    }
+}
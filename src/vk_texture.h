@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vk_types.h"
+
+class JobSystem;
+class MappedFile;
+
+enum class TextureFormat : uint32_t
+{
+    RGBA8,
+    // Opaque textures.
+    BC1,
+    // Textures with any alpha below 255.
+    BC3,
+};
+
+struct TextureMip
+{
+    uint32_t width;
+    uint32_t height;
+    // Byte range of the level in the texture's data.
+    size_t offset;
+    size_t size;
+};
+
+struct TextureLoadStats
+{
+    bool fromCache{false};
+    double decodeMilliseconds{0.0};
+    double mipMilliseconds{0.0};
+    double compressMilliseconds{0.0};
+};
+
+// A full mip chain on the CPU, tightly packed from level 0 down to 1x1.
+struct TextureData
+{
+    TextureFormat format{TextureFormat::RGBA8};
+    uint32_t width{0};
+    uint32_t height{0};
+    std::vector<TextureMip> mips;
+
+    std::vector<uint8_t> pixels;
+
+    // Set instead of pixels when the texture was mapped from its cache.
+    std::shared_ptr<MappedFile> cacheFile;
+    const uint8_t *cachedPixels{nullptr};
+    size_t cachedSize{0};
+
+    TextureLoadStats stats;
+
+    const uint8_t *getData() const { return cacheFile ? cachedPixels : pixels.data(); }
+    size_t getSize() const { return cacheFile ? cachedSize : pixels.size(); }
+};
+
+struct Texture
+{
+    AllocatedImage image;
+    VkImageView imageView{VK_NULL_HANDLE};
+    VkFormat format{VK_FORMAT_UNDEFINED};
+    uint32_t mipLevels{0};
+};
+
+namespace vkTexture
+{
+    // Colour textures are sampled as sRGB.
+    VkFormat vkFormat(TextureFormat format);
+    // Edge length of the format's texel blocks and the bytes in one block.
+    uint32_t blockSize(TextureFormat format);
+    uint32_t blockBytes(TextureFormat format);
+
+    // Lays out the mips of a width x height texture in format and returns the
+    // total size in bytes.
+    size_t layoutMips(TextureFormat format, uint32_t width, uint32_t height, std::vector<TextureMip> &mips);
+
+    // Halves an RGBA8 level with a 2x2 box filter. Odd edges repeat their last
+    // row or column. Bands of rows are jobs on jobs when it's given.
+    void downsample(const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst, JobSystem *jobs = nullptr);
+
+    // Encodes an RGBA8 level into 4x4 blocks; edges are padded by clamping.
+    void compressBC1(const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst, JobSystem *jobs = nullptr);
+    void compressBC3(const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst, JobSystem *jobs = nullptr);
+
+    std::string cachePath(const std::string &sourcePath);
+
+    // Maps the cache for sourcePath if it is current and holds format.
+    bool loadCache(const std::string &sourcePath, TextureFormat format, TextureData &texture);
+    bool writeCache(const std::string &sourcePath, const TextureData &texture);
+
+    // Loads from the cache when possible; otherwise decodes the image, builds
+    // its mip chain, compresses it when asked to and writes the cache. The
+    // mips are built and compressed as jobs on jobs when it's given.
+    bool load(const std::string &sourcePath, bool compress, TextureData &texture, JobSystem *jobs = nullptr);
+
+    // Loads every path as a job. Failed loads leave an empty TextureData.
+    std::vector<TextureData> loadAll(const std::vector<std::string> &sourcePaths, bool compress, JobSystem &jobs);
+}
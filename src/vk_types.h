@@ -1,9 +1,29 @@
 ﻿#pragma once
 
+#include <iostream>
+#include <cstdlib>
+
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
 
+#define VK_CHECK(x)                                        \
+    do                                                     \
+    {                                                      \
+        VkResult err = x;                                  \
+        if (err)                                           \
+        {                                                  \
+            std::cout << "Vk error: " << err << std::endl; \
+            exit(EXIT_FAILURE);                            \
+        }                                                  \
+                                                           \
+    } while (0);
+
 struct AllocatedBuffer {
     VkBuffer buffer;
     VmaAllocation allocation;
+};
+
+struct AllocatedImage {
+    VkImage image;
+    VmaAllocation allocation;
 };
\ No newline at end of file
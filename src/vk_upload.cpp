@@ -0,0 +1,295 @@
+#include <vk_upload.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <vk_initializers.h>
+
+namespace
+{
+    constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+}
+
+void UploadContext::init(VkDevice device, VmaAllocator allocator, uint32_t queueFamily, VkQueue queue, VkDeviceSize stagingSize)
+{
+    this->device = device;
+    this->allocator = allocator;
+    this->queue = queue;
+    this->stagingSize = stagingSize;
+
+    VkCommandPoolCreateInfo commandPoolInfo = vkInit::commandPoolCreateInfo(queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &commandPool));
+
+    VkCommandBufferAllocateInfo cmdAllocInfo = vkInit::commandBufferAllocateInfo(commandPool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+    VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &commandBuffer));
+
+    VkFenceCreateInfo fenceCreateInfo = vkInit::fenceCreateInfo();
+    VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &uploadFence));
+
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = nullptr,
+        .size = stagingSize,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
+
+    VmaAllocationCreateInfo vmaAllocInfo = {
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .usage = VMA_MEMORY_USAGE_CPU_ONLY};
+
+    VmaAllocationInfo allocationInfo;
+    VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &stagingBuffer.buffer, &stagingBuffer.allocation, &allocationInfo));
+    stagingData = (uint8_t *)allocationInfo.pMappedData;
+}
+
+void UploadContext::cleanup()
+{
+    flush();
+
+    vmaDestroyBuffer(allocator, stagingBuffer.buffer, stagingBuffer.allocation);
+    vkDestroyFence(device, uploadFence, nullptr);
+    vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+void UploadContext::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size, const std::function<void(void *, VkDeviceSize, VkDeviceSize)> &fill)
+{
+    VkDeviceSize uploaded = 0;
+    while (uploaded < size)
+    {
+        if (stagingHead >= stagingSize)
+            flush();
+
+        const VkDeviceSize pieceSize = std::min(size - uploaded, stagingSize - stagingHead);
+        fill(stagingData + stagingHead, uploaded, pieceSize);
+
+        pendingCopies.push_back({
+            .src = stagingBuffer.buffer,
+            .dst = dst,
+            .region = {
+                .srcOffset = stagingHead,
+                .dstOffset = dstOffset + uploaded,
+                .size = pieceSize}});
+
+        stagingHead = std::min(stagingSize, (stagingHead + pieceSize + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1));
+        pendingBytes += pieceSize;
+        uploaded += pieceSize;
+    }
+}
+
+void UploadContext::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void *data, VkDeviceSize size)
+{
+    uploadBuffer(dst, dstOffset, size, [=](void *staging, VkDeviceSize offset, VkDeviceSize pieceSize)
+                 { std::memcpy(staging, (const uint8_t *)data + offset, pieceSize); });
+}
+
+void UploadContext::copyBuffer(VkBuffer src, VkBuffer dst, const VkBufferCopy &region)
+{
+    pendingCopies.push_back({
+        .src = src,
+        .dst = dst,
+        .region = region});
+}
+
+bool UploadContext::uploadImage(VkImage dst, uint32_t blockSize, uint32_t blockBytes, const std::vector<ImageUploadLevel> &levels)
+{
+    for (const ImageUploadLevel &level : levels)
+    {
+        if ((VkDeviceSize)(level.width + blockSize - 1) / blockSize * blockBytes > stagingSize)
+        {
+            std::cout << "Image row of " << level.width << " texels doesn't fit in the staging buffer" << std::endl;
+            return false;
+        }
+    }
+
+    pendingImages.push_back({
+        .image = dst,
+        .mipLevels = (uint32_t)levels.size(),
+        .inTransferLayout = false,
+        .complete = false});
+
+    for (uint32_t mip = 0; mip < levels.size(); ++mip)
+    {
+        const ImageUploadLevel &level = levels[mip];
+        const VkDeviceSize rowBytes = (level.width + blockSize - 1) / blockSize * blockBytes;
+        const uint32_t rowCount = (level.height + blockSize - 1) / blockSize;
+
+        for (uint32_t row = 0; row < rowCount;)
+        {
+            if (stagingSize - stagingHead < rowBytes)
+                flush();
+
+            const uint32_t pieceRows = (uint32_t)std::min<VkDeviceSize>(rowCount - row, (stagingSize - stagingHead) / rowBytes);
+            std::memcpy(stagingData + stagingHead, (const uint8_t *)level.data + row * rowBytes, pieceRows * rowBytes);
+
+            pendingImageCopies.push_back({
+                .dst = dst,
+                .region = {
+                    .bufferOffset = stagingHead,
+                    .bufferRowLength = 0,
+                    .bufferImageHeight = 0,
+                    .imageSubresource = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel = mip,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1},
+                    .imageOffset = {0, (int32_t)(row * blockSize), 0},
+                    .imageExtent = {level.width, std::min(level.height - row * blockSize, pieceRows * blockSize), 1}}});
+
+            stagingHead = std::min(stagingSize, (stagingHead + pieceRows * rowBytes + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1));
+            pendingBytes += pieceRows * rowBytes;
+            row += pieceRows;
+        }
+    }
+
+    // Flushes above only retire complete images, so this one is still last.
+    pendingImages.back().complete = true;
+    return true;
+}
+
+void UploadContext::recordImageBarriers(bool complete, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (const PendingImage &image : pendingImages)
+    {
+        if (complete ? !image.complete : image.inTransferLayout)
+            continue;
+
+        barriers.push_back(vkInit::imageMemoryBarrier(image.image, complete ? VK_ACCESS_TRANSFER_WRITE_BIT : 0, complete ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                      oldLayout, newLayout, image.mipLevels));
+    }
+
+    if (barriers.empty())
+        return;
+
+    // The transfer queue can't name shader stages; the fence wait in flush()
+    // orders these copies before any later use on the graphics queue.
+    vkCmdPipelineBarrier(commandBuffer, complete ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         complete ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, (uint32_t)barriers.size(), barriers.data());
+}
+
+void UploadContext::flush()
+{
+    if (pendingCopies.empty() && pendingImageCopies.empty() && pendingImages.empty())
+        return;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    VkCommandBufferBeginInfo cmdBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = nullptr,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = nullptr};
+
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+    // Copies run in the order they were queued. Adjacent copies between the
+    // same buffers share one vkCmdCopyBuffer; a copy that touches bytes an
+    // earlier copy in the batch wrote, or writes bytes one read, waits for it
+    // behind a barrier.
+    struct TouchedRange
+    {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        bool written;
+    };
+    std::vector<TouchedRange> touched;
+    auto overlapsTouched = [&touched](VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, bool writtenOnly)
+    {
+        return std::any_of(touched.begin(), touched.end(), [=](const TouchedRange &range)
+                           { return (range.written || !writtenOnly) && range.buffer == buffer &&
+                                    offset < range.offset + range.size && range.offset < offset + size; });
+    };
+
+    std::vector<VkBufferCopy> regions;
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    VkBuffer runSrc = VK_NULL_HANDLE;
+    VkBuffer runDst = VK_NULL_HANDLE;
+    auto recordRun = [&]()
+    {
+        if (!regions.empty())
+            vkCmdCopyBuffer(commandBuffer, runSrc, runDst, (uint32_t)regions.size(), regions.data());
+        regions.clear();
+    };
+
+    for (const PendingCopy &copy : pendingCopies)
+    {
+        const VkBufferCopy &region = copy.region;
+        if (overlapsTouched(copy.src, region.srcOffset, region.size, true) || overlapsTouched(copy.dst, region.dstOffset, region.size, false))
+        {
+            recordRun();
+
+            bufferBarriers.clear();
+            for (const TouchedRange &range : touched)
+            {
+                if (range.written && std::none_of(bufferBarriers.begin(), bufferBarriers.end(), [&](const VkBufferMemoryBarrier &barrier)
+                                                  { return barrier.buffer == range.buffer; }))
+                    bufferBarriers.push_back(vkInit::bufferMemoryBarrier(range.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT));
+            }
+
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                 0, nullptr, (uint32_t)bufferBarriers.size(), bufferBarriers.data(), 0, nullptr);
+            touched.clear();
+        }
+        else if (copy.src != runSrc || copy.dst != runDst)
+        {
+            recordRun();
+        }
+
+        runSrc = copy.src;
+        runDst = copy.dst;
+        regions.push_back(region);
+        touched.push_back({copy.src, region.srcOffset, region.size, false});
+        touched.push_back({copy.dst, region.dstOffset, region.size, true});
+    }
+    recordRun();
+
+    recordImageBarriers(false, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    std::stable_sort(pendingImageCopies.begin(), pendingImageCopies.end(), [](const PendingImageCopy &a, const PendingImageCopy &b)
+                     { return a.dst < b.dst; });
+
+    std::vector<VkBufferImageCopy> imageRegions;
+    for (size_t i = 0; i < pendingImageCopies.size();)
+    {
+        imageRegions.clear();
+        VkImage dst = pendingImageCopies[i].dst;
+        for (; i < pendingImageCopies.size() && pendingImageCopies[i].dst == dst; ++i)
+            imageRegions.push_back(pendingImageCopies[i].region);
+
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)imageRegions.size(), imageRegions.data());
+    }
+
+    recordImageBarriers(true, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    VkSubmitInfo submit = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer};
+
+    VK_CHECK(vkQueueSubmit(queue, 1, &submit, uploadFence));
+    VK_CHECK(vkWaitForFences(device, 1, &uploadFence, true, UINT64_MAX));
+    VK_CHECK(vkResetFences(device, 1, &uploadFence));
+    VK_CHECK(vkResetCommandBuffer(commandBuffer, 0));
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    stats.bytesUploaded += pendingBytes;
+    stats.submissions += 1;
+    stats.seconds += std::chrono::duration<double>(end - start).count();
+
+    pendingCopies.clear();
+    pendingImageCopies.clear();
+    pendingImages.erase(std::remove_if(pendingImages.begin(), pendingImages.end(), [](const PendingImage &image)
+                                       { return image.complete; }),
+                        pendingImages.end());
+    for (PendingImage &image : pendingImages)
+        image.inTransferLayout = true;
+    pendingBytes = 0;
+    stagingHead = 0;
+}
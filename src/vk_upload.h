@@ -0,0 +1,96 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "vk_types.h"
+
+struct UploadStats
+{
+    uint64_t bytesUploaded{0};
+    uint32_t submissions{0};
+    double seconds{0.0};
+};
+
+// One mip level of an image upload, tightly packed in rows of texel blocks.
+struct ImageUploadLevel
+{
+    uint32_t width;
+    uint32_t height;
+    const void *data;
+};
+
+// Batches host-to-device buffer copies through a persistently mapped staging
+// buffer. Copies accumulate in one command buffer and are submitted together
+// by flush(), or earlier when the staging buffer runs out of space.
+class UploadContext
+{
+    public:
+        void init(VkDevice device, VmaAllocator allocator, uint32_t queueFamily, VkQueue queue, VkDeviceSize stagingSize);
+        void cleanup();
+
+        // fill(dst, offset, size) writes `size` bytes starting at byte `offset`
+        // of the upload into dst; large uploads are split across several calls.
+        void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size, const std::function<void(void *, VkDeviceSize, VkDeviceSize)> &fill);
+        void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void *data, VkDeviceSize size);
+        // Device-side copy recorded into the same batch, after every copy queued
+        // before it; one that reads or rewrites their destinations waits on them.
+        void copyBuffer(VkBuffer src, VkBuffer dst, const VkBufferCopy &region);
+        // Fills levels 0 .. levels.size() - 1 of dst. The image goes from UNDEFINED to
+        // TRANSFER_DST_OPTIMAL before its first copy and to SHADER_READ_ONLY_OPTIMAL
+        // after its last, possibly several flushes later; levels that don't fit
+        // in the staging buffer are split by rows of blocks. blockSize is the
+        // edge of the format's texel blocks, 1 for uncompressed formats.
+        bool uploadImage(VkImage dst, uint32_t blockSize, uint32_t blockBytes, const std::vector<ImageUploadLevel> &levels);
+
+        void flush();
+
+        const UploadStats &getStats() const { return stats; }
+
+    private:
+        // Moves the images still waiting for their first copy, or with every
+        // copy recorded when complete is set, between layouts.
+        void recordImageBarriers(bool complete, VkImageLayout oldLayout, VkImageLayout newLayout);
+
+        struct PendingCopy
+        {
+            VkBuffer src;
+            VkBuffer dst;
+            VkBufferCopy region;
+        };
+
+        struct PendingImageCopy
+        {
+            VkImage dst;
+            VkBufferImageCopy region;
+        };
+
+        struct PendingImage
+        {
+            VkImage image;
+            uint32_t mipLevels;
+            // Already in TRANSFER_DST_OPTIMAL from an earlier flush.
+            bool inTransferLayout;
+            bool complete;
+        };
+
+        VkDevice device;
+        VmaAllocator allocator;
+        VkQueue queue;
+
+        VkCommandPool commandPool;
+        VkCommandBuffer commandBuffer;
+        VkFence uploadFence;
+
+        AllocatedBuffer stagingBuffer;
+        uint8_t *stagingData{nullptr};
+        VkDeviceSize stagingSize{0};
+        VkDeviceSize stagingHead{0};
+
+        std::vector<PendingCopy> pendingCopies;
+        std::vector<PendingImageCopy> pendingImageCopies;
+        std::vector<PendingImage> pendingImages;
+        uint64_t pendingBytes{0};
+
+        UploadStats stats;
+};
@@ -0,0 +1,365 @@
+#include <vk_vertex_format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "vk_parallel.h"
+
+namespace
+{
+    struct HalfVertex
+    {
+        uint16_t position[4];
+        int16_t normal[2];
+        uint8_t color[4];
+        uint16_t uv[2];
+    };
+
+    // The normal sits in the position's fourth lane; the position attribute
+    // reads it as w and ignores it.
+    struct Unorm16Vertex
+    {
+        uint16_t position[3];
+        int8_t normal[2];
+        uint8_t color[4];
+        uint16_t uv[2];
+    };
+
+    static_assert(sizeof(HalfVertex) == 20, "HalfVertex must be tightly packed");
+    static_assert(sizeof(Unorm16Vertex) == 16, "Unorm16Vertex must be tightly packed");
+
+    const char *FORMAT_NAMES[VERTEX_FORMAT_COUNT] = {"float32", "half", "unorm16"};
+
+    glm::vec2 octahedralEncode(glm::vec3 normal)
+    {
+        const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (length == 0.0f)
+            return glm::vec2(0.0f);
+
+        normal /= length;
+        glm::vec2 encoded(normal.x, normal.y);
+        if (normal.z < 0.0f)
+        {
+            encoded = glm::vec2((1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+                                (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f));
+        }
+        return encoded;
+    }
+
+    // Same as decodeOctahedral in triangleMesh.vert.
+    glm::vec3 octahedralDecode(glm::vec2 encoded)
+    {
+        glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+        const float t = std::max(-normal.z, 0.0f);
+        normal.x += normal.x >= 0.0f ? -t : t;
+        normal.y += normal.y >= 0.0f ? -t : t;
+        return glm::normalize(normal);
+    }
+
+    template <typename T, int MAX>
+    T toSnorm(float value)
+    {
+        return (T)std::lround(std::clamp(value, -1.0f, 1.0f) * MAX);
+    }
+
+    template <int MAX>
+    float fromSnorm(int value)
+    {
+        return std::max(value / (float)MAX, -1.0f);
+    }
+
+    uint16_t toUnorm16(float value)
+    {
+        return (uint16_t)std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f);
+    }
+
+    void encodeColor(const glm::vec3 &color, uint8_t *out)
+    {
+        for (int c = 0; c < 3; ++c)
+            out[c] = (uint8_t)std::lround(std::clamp(color[c], 0.0f, 1.0f) * 255.0f);
+        out[3] = 255;
+    }
+
+    glm::vec3 decodeColor(const uint8_t *color)
+    {
+        return glm::vec3(color[0], color[1], color[2]) / 255.0f;
+    }
+}
+
+namespace vkVertex
+{
+    const char *name(VertexFormat format)
+    {
+        return FORMAT_NAMES[(uint32_t)format];
+    }
+
+    bool parse(const char *name, VertexFormat &format)
+    {
+        for (uint32_t i = 0; i < VERTEX_FORMAT_COUNT; ++i)
+        {
+            if (std::strcmp(name, FORMAT_NAMES[i]) == 0)
+            {
+                format = (VertexFormat)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t stride(VertexFormat format)
+    {
+        switch (format)
+        {
+        case VertexFormat::Half:
+            return sizeof(HalfVertex);
+        case VertexFormat::Unorm16:
+            return sizeof(Unorm16Vertex);
+        default:
+            return sizeof(Vertex);
+        }
+    }
+
+    VertexInputDescription getDescription(VertexFormat format)
+    {
+        if (format == VertexFormat::Float32)
+            return Vertex::getVertexDescription();
+
+        const bool half = format == VertexFormat::Half;
+
+        VertexInputDescription description;
+        description.bindings.push_back({
+            .binding = 0,
+            .stride = stride(format),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX});
+
+        description.attributes.push_back({
+            .location = 0,
+            .binding = 0,
+            .format = half ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R16G16B16A16_UNORM,
+            .offset = 0});
+        description.attributes.push_back({
+            .location = 1,
+            .binding = 0,
+            .format = half ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R8G8_SNORM,
+            .offset = half ? (uint32_t)offsetof(HalfVertex, normal) : (uint32_t)offsetof(Unorm16Vertex, normal)});
+        description.attributes.push_back({
+            .location = 2,
+            .binding = 0,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .offset = half ? (uint32_t)offsetof(HalfVertex, color) : (uint32_t)offsetof(Unorm16Vertex, color)});
+        description.attributes.push_back({
+            .location = 3,
+            .binding = 0,
+            .format = VK_FORMAT_R16G16_SFLOAT,
+            .offset = half ? (uint32_t)offsetof(HalfVertex, uv) : (uint32_t)offsetof(Unorm16Vertex, uv)});
+
+        return description;
+    }
+
+    void dequantization(VertexFormat format, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, glm::vec3 &scale, glm::vec3 &offset)
+    {
+        scale = glm::vec3(1.0f);
+        offset = glm::vec3(0.0f);
+        if (format == VertexFormat::Float32)
+            return;
+
+        const glm::vec3 extent = boundsMax - boundsMin;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            // Flat axes still need a non-zero scale.
+            const float axisExtent = extent[axis] > 0.0f ? extent[axis] : 1.0f;
+            if (format == VertexFormat::Half)
+            {
+                scale[axis] = axisExtent * 0.5f;
+                offset[axis] = (boundsMin[axis] + boundsMax[axis]) * 0.5f;
+            }
+            else
+            {
+                scale[axis] = axisExtent;
+                offset[axis] = boundsMin[axis];
+            }
+        }
+    }
+
+    void encode(VertexFormat format, const Vertex *vertices, size_t count, const glm::vec3 &scale, const glm::vec3 &offset, void *dst)
+    {
+        if (format == VertexFormat::Float32)
+        {
+            std::memcpy(dst, vertices, count * sizeof(Vertex));
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Vertex &vertex = vertices[i];
+            const glm::vec3 position = (vertex.position - offset) / scale;
+            const glm::vec2 normal = octahedralEncode(vertex.normal);
+
+            if (format == VertexFormat::Half)
+            {
+                HalfVertex &out = ((HalfVertex *)dst)[i];
+                for (int c = 0; c < 3; ++c)
+                    out.position[c] = glm::packHalf1x16(position[c]);
+                out.position[3] = glm::packHalf1x16(1.0f);
+                out.normal[0] = toSnorm<int16_t, 32767>(normal.x);
+                out.normal[1] = toSnorm<int16_t, 32767>(normal.y);
+                encodeColor(vertex.color, out.color);
+                out.uv[0] = glm::packHalf1x16(vertex.uv.x);
+                out.uv[1] = glm::packHalf1x16(vertex.uv.y);
+            }
+            else
+            {
+                Unorm16Vertex &out = ((Unorm16Vertex *)dst)[i];
+                for (int c = 0; c < 3; ++c)
+                    out.position[c] = toUnorm16(position[c]);
+                out.normal[0] = toSnorm<int8_t, 127>(normal.x);
+                out.normal[1] = toSnorm<int8_t, 127>(normal.y);
+                encodeColor(vertex.color, out.color);
+                out.uv[0] = glm::packHalf1x16(vertex.uv.x);
+                out.uv[1] = glm::packHalf1x16(vertex.uv.y);
+            }
+        }
+    }
+
+    void decode(VertexFormat format, const void *src, size_t count, const glm::vec3 &scale, const glm::vec3 &offset, Vertex *vertices)
+    {
+        if (format == VertexFormat::Float32)
+        {
+            std::memcpy(vertices, src, count * sizeof(Vertex));
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Vertex &vertex = vertices[i];
+            glm::vec3 position;
+
+            if (format == VertexFormat::Half)
+            {
+                const HalfVertex &in = ((const HalfVertex *)src)[i];
+                for (int c = 0; c < 3; ++c)
+                    position[c] = glm::unpackHalf1x16(in.position[c]);
+                vertex.normal = octahedralDecode({fromSnorm<32767>(in.normal[0]), fromSnorm<32767>(in.normal[1])});
+                vertex.color = decodeColor(in.color);
+                vertex.uv = {glm::unpackHalf1x16(in.uv[0]), glm::unpackHalf1x16(in.uv[1])};
+            }
+            else
+            {
+                const Unorm16Vertex &in = ((const Unorm16Vertex *)src)[i];
+                for (int c = 0; c < 3; ++c)
+                    position[c] = in.position[c] / 65535.0f;
+                vertex.normal = octahedralDecode({fromSnorm<127>(in.normal[0]), fromSnorm<127>(in.normal[1])});
+                vertex.color = decodeColor(in.color);
+                vertex.uv = {glm::unpackHalf1x16(in.uv[0]), glm::unpackHalf1x16(in.uv[1])};
+            }
+
+            vertex.position = position * scale + offset;
+        }
+    }
+
+    VertexErrorStats measureError(VertexFormat format, const Mesh &mesh)
+    {
+        VertexErrorStats stats;
+
+        const size_t count = mesh.getVertexCount();
+        if (count == 0)
+            return stats;
+
+        glm::vec3 scale, offset;
+        dequantization(format, mesh.boundsMin, mesh.boundsMax, scale, offset);
+
+        std::vector<uint8_t> encoded(count * stride(format));
+        std::vector<Vertex> decoded(count);
+        encode(format, mesh.getVertexData(), count, scale, offset, encoded.data());
+        decode(format, encoded.data(), count, scale, offset, decoded.data());
+
+        const double diagonal = std::max(1e-12f, glm::length(mesh.boundsMax - mesh.boundsMin));
+        size_t normalCount = 0;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Vertex &original = mesh.getVertexData()[i];
+            const Vertex &result = decoded[i];
+
+            const double positionError = glm::length(original.position - result.position) / diagonal;
+            stats.maxPositionError = std::max(stats.maxPositionError, positionError);
+            stats.meanPositionError += positionError;
+
+            if (glm::length(original.normal) > 0.0f)
+            {
+                // atan2 stays accurate for the tiny angles acos loses to rounding.
+                const glm::vec3 a = glm::normalize(original.normal);
+                const glm::vec3 b = glm::normalize(result.normal);
+                const double normalError = glm::degrees(std::atan2((double)glm::length(glm::cross(a, b)), (double)glm::dot(a, b)));
+                stats.maxNormalError = std::max(stats.maxNormalError, normalError);
+                stats.meanNormalError += normalError;
+                ++normalCount;
+            }
+
+            const glm::vec2 uvError = glm::abs(original.uv - result.uv);
+            stats.maxUvError = std::max(stats.maxUvError, (double)std::max(uvError.x, uvError.y));
+
+            // Colours are clamped to [0, 1] by the framebuffer anyway, so
+            // only the quantization step is counted.
+            const glm::vec3 colorError = glm::abs(glm::clamp(original.color, 0.0f, 1.0f) - glm::clamp(result.color, 0.0f, 1.0f));
+            stats.maxColorError = std::max(stats.maxColorError, (double)std::max({colorError.x, colorError.y, colorError.z}));
+        }
+
+        stats.meanPositionError /= count;
+        if (normalCount > 0)
+            stats.meanNormalError /= normalCount;
+        return stats;
+    }
+
+    void runReport(const char *const *paths, size_t pathCount)
+    {
+        constexpr int ITERATIONS = 20;
+
+        JobSystem jobs;
+        jobs.init();
+
+        for (size_t p = 0; p < pathCount; ++p)
+        {
+            Mesh mesh;
+            if (!mesh.loadObj(paths[p], jobs))
+                continue;
+
+            const size_t count = mesh.getVertexCount();
+            std::cout << paths[p] << ": " << count << " vertices, " << mesh.getIndexCount() << " indices" << std::endl;
+
+            for (uint32_t f = 0; f < VERTEX_FORMAT_COUNT; ++f)
+            {
+                const VertexFormat format = (VertexFormat)f;
+
+                glm::vec3 scale, offset;
+                dequantization(format, mesh.boundsMin, mesh.boundsMax, scale, offset);
+
+                std::vector<uint8_t> encoded(count * stride(format));
+                auto start = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < ITERATIONS; ++i)
+                    encode(format, mesh.getVertexData(), count, scale, offset, encoded.data());
+                auto end = std::chrono::high_resolution_clock::now();
+
+                const VertexErrorStats error = measureError(format, mesh);
+                const double kilobytes = encoded.size() / 1024.0;
+                // Every index fetches a vertex when the post-transform cache misses.
+                const double fetchKilobytes = (double)mesh.getIndexCount() * stride(format) / 1024.0;
+
+                std::cout << "  " << name(format) << ": " << stride(format) << " B/vertex, " << kilobytes << " KB ("
+                          << 100.0 * encoded.size() / (count * sizeof(Vertex)) << "% of float32), up to " << fetchKilobytes
+                          << " KB fetched per draw, encode " << std::chrono::duration<double, std::milli>(end - start).count() / ITERATIONS << " ms" << std::endl;
+                std::cout << "    position error max " << error.maxPositionError << " mean " << error.meanPositionError
+                          << " of the diagonal, normal error max " << error.maxNormalError << " mean " << error.meanNormalError
+                          << " deg, uv error max " << error.maxUvError << ", colour error max " << error.maxColorError << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+#include "vk_mesh.h"
+
+// Layouts vertices can be stored in on the GPU. Meshes keep full-precision
+// Vertex data on the CPU and in their cache; the geometry buffer encodes them
+// on upload.
+enum class VertexFormat : uint32_t
+{
+    // Vertex as is, 44 bytes.
+    Float32,
+    // 20 bytes: float16 position, R16G16_SNORM octahedral normal, RGBA8
+    // colour and float16 UV.
+    Half,
+    // 16 bytes: unorm16 position with an 8-bit octahedral normal in the
+    // fourth lane, RGBA8 colour and float16 UV.
+    Unorm16,
+};
+
+constexpr uint32_t VERTEX_FORMAT_COUNT = 3;
+
+struct VertexErrorStats
+{
+    // Relative to the mesh's bounding box diagonal.
+    double maxPositionError{0.0};
+    double meanPositionError{0.0};
+    // Degrees.
+    double maxNormalError{0.0};
+    double meanNormalError{0.0};
+    double maxUvError{0.0};
+    double maxColorError{0.0};
+};
+
+namespace vkVertex
+{
+    const char *name(VertexFormat format);
+    bool parse(const char *name, VertexFormat &format);
+
+    uint32_t stride(VertexFormat format);
+    VertexInputDescription getDescription(VertexFormat format);
+
+    // Quantized positions are stored as (position - offset) / scale, which
+    // fits the mesh's bounds to [0, 1] for Unorm16 and [-1, 1] for Half.
+    void dequantization(VertexFormat format, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, glm::vec3 &scale, glm::vec3 &offset);
+
+    void encode(VertexFormat format, const Vertex *vertices, size_t count, const glm::vec3 &scale, const glm::vec3 &offset, void *dst);
+    void decode(VertexFormat format, const void *src, size_t count, const glm::vec3 &scale, const glm::vec3 &offset, Vertex *vertices);
+
+    VertexErrorStats measureError(VertexFormat format, const Mesh &mesh);
+
+    // Prints the stride, size, encode time and round-trip error of every
+    // format for each OBJ file.
+    void runReport(const char *const *paths, size_t pathCount);
+}
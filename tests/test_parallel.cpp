@@ -0,0 +1,255 @@
+#include <vk_parallel.h>
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char *what)
+    {
+        if (!condition)
+        {
+            std::cout << "FAILED: " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    // Fork/join over a binary tree, each level waiting on its own counter.
+    void spawnTree(JobSystem &jobs, uint32_t depth, std::atomic<uint32_t> &leaves)
+    {
+        if (depth == 0)
+        {
+            leaves.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        JobCounter children;
+        jobs.run(children, [&jobs, depth, &leaves]()
+                 { spawnTree(jobs, depth - 1, leaves); });
+        jobs.run(children, [&jobs, depth, &leaves]()
+                 { spawnTree(jobs, depth - 1, leaves); });
+        jobs.wait(children);
+    }
+}
+
+struct JobSystemTest
+{
+    using Job = JobSystem::Job;
+    using JobDeque = JobSystem::JobDeque;
+
+    static constexpr uint32_t JOB_POOL_SIZE = JobSystem::JOB_POOL_SIZE;
+    static constexpr int64_t DEQUE_CAPACITY = JobSystem::DEQUE_CAPACITY;
+
+    // The owner pushes and pops in random bursts while thieves steal. Every
+    // job must be taken exactly once, and whoever takes it must see the
+    // payload written before it was pushed.
+    static void dequeRaces(unsigned int thiefCount)
+    {
+        constexpr uint32_t JOB_COUNT = 200000;
+
+        std::unique_ptr<Job[]> jobs = std::make_unique<Job[]>(JOB_COUNT);
+        std::unique_ptr<std::atomic<uint32_t>[]> taken = std::make_unique<std::atomic<uint32_t>[]>(JOB_COUNT);
+        for (uint32_t i = 0; i < JOB_COUNT; ++i)
+            taken[i] = 0;
+
+        std::atomic<bool> payloadsMatch{true};
+        auto take = [&](Job *job)
+        {
+            const uint32_t index = (uint32_t)(job - jobs.get());
+            uint32_t payload;
+            std::memcpy(&payload, job->data, sizeof(payload));
+            if (payload != index)
+                payloadsMatch = false;
+            taken[index].fetch_add(1, std::memory_order_relaxed);
+        };
+
+        JobDeque deque;
+        std::atomic<bool> done{false};
+        std::vector<std::thread> thieves;
+        for (unsigned int t = 0; t < thiefCount; ++t)
+        {
+            thieves.emplace_back([&]()
+                                 {
+                                     while (!done.load(std::memory_order_acquire))
+                                     {
+                                         if (Job *job = deque.steal())
+                                             take(job);
+                                     } });
+        }
+
+        std::mt19937 rng(7);
+        uint32_t next = 0;
+        while (next < JOB_COUNT)
+        {
+            const uint32_t pushes = 1 + rng() % 64;
+            for (uint32_t i = 0; i < pushes && next < JOB_COUNT; ++i, ++next)
+            {
+                std::memcpy(jobs[next].data, &next, sizeof(next));
+                if (!deque.push(&jobs[next]))
+                    take(&jobs[next]);
+            }
+
+            const uint32_t pops = rng() % 64;
+            for (uint32_t i = 0; i < pops; ++i)
+            {
+                if (Job *job = deque.pop())
+                    take(job);
+            }
+        }
+
+        while (Job *job = deque.pop())
+            take(job);
+        done.store(true, std::memory_order_release);
+        for (std::thread &thief : thieves)
+            thief.join();
+
+        bool exactlyOnce = true;
+        for (uint32_t i = 0; i < JOB_COUNT; ++i)
+            exactlyOnce = exactlyOnce && taken[i].load() == 1;
+
+        check(exactlyOnce, "every deque job is taken exactly once");
+        check(payloadsMatch.load(), "deque jobs are seen with their payload");
+        check(deque.empty(), "deque is empty once drained");
+    }
+
+    // A full deque refuses pushes instead of overwriting the oldest job.
+    static void dequeCapacity()
+    {
+        std::unique_ptr<Job[]> jobs = std::make_unique<Job[]>(DEQUE_CAPACITY + 1);
+
+        JobDeque deque;
+        bool pushed = true;
+        for (int64_t i = 0; i < DEQUE_CAPACITY; ++i)
+            pushed = pushed && deque.push(&jobs[i]);
+
+        check(pushed, "deque accepts DEQUE_CAPACITY jobs");
+        check(!deque.push(&jobs[DEQUE_CAPACITY]), "full deque refuses a push");
+        check(deque.steal() == &jobs[0], "thieves take the oldest job");
+        check(deque.pop() == &jobs[DEQUE_CAPACITY - 1], "the owner takes the newest job");
+    }
+
+    // With one worker nothing is stolen, so once the pool wraps around to a
+    // live slot every further job must run inside run().
+    static void poolExhaustion()
+    {
+        constexpr uint32_t JOB_COUNT = JOB_POOL_SIZE + 1000;
+
+        JobSystem jobs;
+        jobs.init(1);
+
+        std::atomic<uint32_t> executed{0};
+        JobCounter counter;
+        for (uint32_t i = 0; i < JOB_COUNT; ++i)
+            jobs.run(counter, [&executed]()
+                     { executed.fetch_add(1, std::memory_order_relaxed); });
+
+        check(executed.load() == JOB_COUNT - JOB_POOL_SIZE, "jobs past a full pool run inline");
+        check(counter.pending.load() == JOB_POOL_SIZE, "only queued jobs are counted as pending");
+
+        jobs.wait(counter);
+        check(executed.load() == JOB_COUNT, "every job runs once the queue drains");
+
+        jobs.cleanup();
+    }
+};
+
+namespace
+{
+    void nestedForkJoin(unsigned int threadCount)
+    {
+        constexpr uint32_t DEPTH = 12;
+
+        JobSystem jobs;
+        jobs.init(threadCount);
+
+        std::atomic<uint32_t> leaves{0};
+        for (int i = 0; i < 4; ++i)
+            spawnTree(jobs, DEPTH, leaves);
+        check(leaves.load() == 4u << DEPTH, "nested fork/join reaches every leaf");
+
+        // Jobs that fork parallel loops of their own.
+        std::atomic<uint64_t> sum{0};
+        JobCounter outer;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            jobs.run(outer, [&jobs, &sum]()
+                     { jobs.parallelFor(1000, 8, [&sum](size_t begin, size_t end)
+                                        {
+                                            for (size_t j = begin; j < end; ++j)
+                                                sum.fetch_add(j, std::memory_order_relaxed); }); });
+        }
+        jobs.wait(outer);
+        check(sum.load() == 16ull * (999ull * 1000 / 2), "parallel loops nested in jobs cover their ranges");
+
+        jobs.cleanup();
+    }
+
+    void parallelForCoverage(unsigned int threadCount)
+    {
+        JobSystem jobs;
+        jobs.init(threadCount);
+
+        const size_t counts[] = {0, 1, 7, 64, 1000, 100003};
+        const size_t minRanges[] = {0, 1, 3, 16, 4096};
+        for (size_t count : counts)
+        {
+            for (size_t minRange : minRanges)
+            {
+                std::vector<std::atomic<uint32_t>> visits(count);
+                for (std::atomic<uint32_t> &visit : visits)
+                    visit = 0;
+
+                std::atomic<bool> rangesValid{true};
+                jobs.parallelFor(count, minRange, [&](size_t begin, size_t end)
+                                 {
+                                     if (begin >= end || end > count)
+                                         rangesValid = false;
+                                     for (size_t i = begin; i < end; ++i)
+                                         visits[i].fetch_add(1, std::memory_order_relaxed); });
+
+                bool exactlyOnce = true;
+                for (const std::atomic<uint32_t> &visit : visits)
+                    exactlyOnce = exactlyOnce && visit.load() == 1;
+
+                check(rangesValid.load(), "parallelFor ranges are non-empty and in bounds");
+                check(exactlyOnce, "parallelFor visits every index exactly once");
+            }
+        }
+
+        // From a thread that isn't a worker, the loop runs inline.
+        std::atomic<size_t> visited{0};
+        std::thread([&]()
+                    { jobs.parallelFor(500, 1, [&](size_t begin, size_t end)
+                                       { visited += end - begin; }); })
+            .join();
+        check(visited.load() == 500, "parallelFor from another thread covers its range");
+
+        jobs.cleanup();
+    }
+}
+
+int main()
+{
+    const unsigned int threadCount = std::max(4u, std::thread::hardware_concurrency());
+
+    JobSystemTest::dequeRaces(threadCount - 1);
+    JobSystemTest::dequeCapacity();
+    JobSystemTest::poolExhaustion();
+    nestedForkJoin(threadCount);
+    parallelForCoverage(threadCount);
+    parallelForCoverage(1);
+
+    if (failures != 0)
+    {
+        std::cout << failures << " job system check(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Job system tests passed" << std::endl;
+    return 0;
+}